@@ -0,0 +1,178 @@
+#include "access_log.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t kFlushBytes = 64 * 1024;   // 攒够这么多就写一次，避免每条日志一次系统调用
+constexpr auto kIdleWait = std::chrono::milliseconds(50); // 所有队列都空时隔多久再看一次
+
+// 请求目标里的引号、反斜杠和不可打印字符转成\xHH，日志一行一条、不会被客户端伪造
+void appendEscaped(std::string& out, const char* data, size_t size) {
+    static const char kHex[] = "0123456789abcdef";
+    for (size_t i = 0; i < size; ++i) {
+        auto c = static_cast<unsigned char>(data[i]);
+        if (c < 0x20 || c >= 0x7f || c == '"' || c == '\\') {
+            out += "\\x";
+            out += kHex[c >> 4];
+            out += kHex[c & 15];
+        } else {
+            out += static_cast<char>(c);
+        }
+    }
+}
+
+} // namespace
+
+AccessLogRing::AccessLogRing() : records_(std::make_unique<AccessRecord[]>(kCapacity)) {}
+
+bool AccessLogRing::push(const AccessRecord& record) {
+    uint64_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - cached_head_ == kCapacity) {
+        cached_head_ = head_.load(std::memory_order_acquire);
+        if (tail - cached_head_ == kCapacity) {
+            // 只有本线程写dropped_，不需要原子加
+            dropped_.store(dropped_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return false;
+        }
+    }
+    records_[tail & (kCapacity - 1)] = record;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+AccessLog::AccessLog(const std::string& path) {
+    if (path == "-") {
+        fd_ = STDOUT_FILENO;
+    } else {
+        fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd_ == -1) {
+            perror(("open " + path).c_str());
+            return;
+        }
+        owns_fd_ = true;
+    }
+    buffer_.reserve(kFlushBytes * 2);
+    thread_ = std::thread([this] { run(); });
+}
+
+AccessLog::~AccessLog() {
+    if (thread_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_one();
+        thread_.join();
+    }
+    if (owns_fd_) close(fd_);
+}
+
+AccessLogRing* AccessLog::createRing() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    rings_.push_back(std::make_unique<AccessLogRing>());
+    return rings_.back().get();
+}
+
+uint64_t AccessLog::dropped() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t total = 0;
+    for (const auto& ring : rings_) total += ring->dropped();
+    return total;
+}
+
+void AccessLog::run() {
+    while (true) {
+        size_t drained = drainAll();
+        // 落后时丢掉的条数也写进日志，读日志的人知道这里有缺口
+        uint64_t total = dropped();
+        if (total != reported_dropped_) {
+            buffer_ += "access_log: dropped ";
+            buffer_ += std::to_string(total - reported_dropped_);
+            buffer_ += " records\n";
+            reported_dropped_ = total;
+        }
+        flush();
+        if (drained > 0) continue; // 还有积压时不等待
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (cv_.wait_for(lock, kIdleWait, [this] { return stop_; })) break;
+    }
+    // 退出前把最后一批写完
+    drainAll();
+    flush();
+}
+
+size_t AccessLog::drainAll() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t total = 0;
+    for (const auto& ring : rings_) {
+        total += ring->drain([this](const AccessRecord& record) {
+            format(record);
+            if (buffer_.size() >= kFlushBytes) flush();
+        });
+    }
+    return total;
+}
+
+void AccessLog::format(const AccessRecord& record) {
+    // 2006-01-02T15:04:05.000Z "GET /index.html HTTP/1.1" 200 1234
+    // 同一秒内的记录共用一次gmtime_r的结果
+    int64_t second = record.time_ms / 1000;
+    if (second != cached_second_) {
+        auto time = static_cast<time_t>(second);
+        tm parts{};
+        gmtime_r(&time, &parts);
+        strftime(cached_time_, sizeof(cached_time_), "%Y-%m-%dT%H:%M:%S", &parts);
+        cached_second_ = second;
+    }
+    char text[64];
+    int len = snprintf(text, sizeof(text), "%s.%03dZ \"", cached_time_, static_cast<int>(record.time_ms % 1000));
+    buffer_.append(text, static_cast<size_t>(len));
+    if (record.method_len == 0) {
+        buffer_ += '-'; // 请求格式错误，没有可信的请求行
+    } else {
+        appendEscaped(buffer_, record.method, record.method_len);
+        buffer_ += ' ';
+        appendEscaped(buffer_, record.target, record.target_len);
+        if (record.truncated) buffer_ += "...";
+        len = snprintf(text, sizeof(text), " HTTP/1.%d", record.version_minor);
+        buffer_.append(text, static_cast<size_t>(len));
+    }
+    len = snprintf(text, sizeof(text), "\" %u %llu\n", static_cast<unsigned>(record.status),
+                   static_cast<unsigned long long>(record.bytes));
+    buffer_.append(text, static_cast<size_t>(len));
+}
+
+void AccessLog::flush() {
+    size_t done = 0;
+    while (done < buffer_.size()) {
+        ssize_t n = write(fd_, buffer_.data() + done, buffer_.size() - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break; // 磁盘满或管道关闭：这批日志放弃，不影响服务
+        done += static_cast<size_t>(n);
+    }
+    buffer_.clear();
+}
+
+void fillAccessRecord(AccessRecord& record, std::string_view method, std::string_view target, int version_minor,
+                      int status, uint64_t bytes) {
+    // 粗粒度时钟走vDSO，不进内核，精度（几毫秒）对访问日志足够
+    timespec now{};
+    clock_gettime(CLOCK_REALTIME_COARSE, &now);
+    record.time_ms = static_cast<int64_t>(now.tv_sec) * 1000 + now.tv_nsec / 1000000;
+    record.bytes = bytes;
+    record.status = static_cast<uint16_t>(status);
+    record.version_minor = static_cast<uint8_t>(version_minor);
+    record.method_len = static_cast<uint8_t>(std::min(method.size(), AccessRecord::kMethodMax));
+    if (record.method_len > 0) std::memcpy(record.method, method.data(), record.method_len);
+    record.truncated = target.size() > AccessRecord::kTargetMax;
+    record.target_len = static_cast<uint8_t>(std::min(target.size(), AccessRecord::kTargetMax));
+    if (record.target_len > 0) std::memcpy(record.target, target.data(), record.target_len);
+}
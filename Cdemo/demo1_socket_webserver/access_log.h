@@ -0,0 +1,115 @@
+#ifndef ACCESS_LOG_H
+#define ACCESS_LOG_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// 一条访问日志：定长、不含指针，请求线程只做拷贝，格式化全部交给后台线程
+struct AccessRecord {
+    static constexpr size_t kMethodMax = 10;
+    static constexpr size_t kTargetMax = 96;   // 更长的请求目标截断，日志里以"..."结尾
+
+    int64_t time_ms = 0;       // 响应生成时的墙上时间（毫秒）
+    uint64_t bytes = 0;        // 响应总字节数（头部+正文）
+    uint16_t status = 0;
+    uint8_t version_minor = 1;
+    uint8_t method_len = 0;
+    uint8_t target_len = 0;
+    bool truncated = false;
+    char method[kMethodMax];
+    char target[kTargetMax];
+};
+static_assert(sizeof(AccessRecord) == 128, "访问日志记录应正好两个缓存行");
+
+// 单生产者单消费者的环形队列：生产者是一个Reactor线程，消费者是日志线程
+// 满了直接丢弃并计数，请求路径上永远不等待、不加锁、不分配内存
+class AccessLogRing {
+public:
+    AccessLogRing();
+
+    AccessLogRing(const AccessLogRing&) = delete;
+    AccessLogRing& operator=(const AccessLogRing&) = delete;
+
+    // 生产者调用；队列满时返回false
+    bool push(const AccessRecord& record);
+
+    // 消费者调用：依次把已发布的记录交给fn(const AccessRecord&)，返回取出的条数
+    template <typename Fn>
+    size_t drain(Fn&& fn);
+
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr size_t kCapacity = 4096;  // 2的幂，下标用掩码计算
+
+    // 读写位置各占一个缓存行，两个线程不会互相使对方的缓存行失效
+    alignas(64) std::atomic<uint64_t> head_{0};   // 消费者读到哪里
+    alignas(64) std::atomic<uint64_t> tail_{0};   // 生产者写到哪里
+    uint64_t cached_head_ = 0;                    // 生产者看到的head_，只有看起来满了才重新读
+    std::atomic<uint64_t> dropped_{0};            // 只有生产者写
+    std::unique_ptr<AccessRecord[]> records_;
+};
+
+template <typename Fn>
+size_t AccessLogRing::drain(Fn&& fn) {
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    uint64_t tail = tail_.load(std::memory_order_acquire);
+    for (uint64_t i = head; i != tail; ++i) {
+        fn(records_[i & (kCapacity - 1)]);
+    }
+    head_.store(tail, std::memory_order_release);
+    return static_cast<size_t>(tail - head);
+}
+
+// 异步访问日志，整个进程一份：每个Reactor通过createRing()拿到自己的队列，
+// 后台线程轮流取出所有队列里的记录，格式化后成批write到文件或标准输出
+class AccessLog {
+public:
+    // path为"-"时写标准输出，否则以追加方式打开文件；打开失败时ok()为false
+    explicit AccessLog(const std::string& path);
+    ~AccessLog();
+
+    AccessLog(const AccessLog&) = delete;
+    AccessLog& operator=(const AccessLog&) = delete;
+
+    bool ok() const { return fd_ != -1; }
+
+    // 每个Reactor线程调用一次，队列归AccessLog所有，进程退出前一直有效
+    AccessLogRing* createRing();
+
+    // 所有队列累计丢弃的记录数
+    uint64_t dropped() const;
+
+private:
+    void run();
+    // 把所有队列取空，返回取出的条数
+    size_t drainAll();
+    void format(const AccessRecord& record);
+    void flush();
+
+    int fd_ = -1;
+    bool owns_fd_ = false;
+    mutable std::mutex mutex_;  // 保护rings_和stop_，请求路径上不会碰到
+    std::condition_variable cv_;
+    bool stop_ = false;
+    std::vector<std::unique_ptr<AccessLogRing>> rings_;
+    std::string buffer_;        // 待写出的日志文本，只有日志线程使用
+    int64_t cached_second_ = -1;
+    char cached_time_[32] = {}; // cached_second_格式化后的"2006-01-02T15:04:05"
+    uint64_t reported_dropped_ = 0;
+    std::thread thread_;
+};
+
+// 在请求路径上填好一条记录；method和target超长时截断
+void fillAccessRecord(AccessRecord& record, std::string_view method, std::string_view target, int version_minor,
+                      int status, uint64_t bytes);
+
+#endif // ACCESS_LOG_H
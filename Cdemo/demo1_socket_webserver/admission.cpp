@@ -0,0 +1,38 @@
+#include "admission.h"
+
+AdmissionControl::AdmissionControl(int target_ms, int interval_ms)
+    : target_ms_(target_ms), interval_ms_(interval_ms > 0 ? interval_ms : 100) {}
+
+void AdmissionControl::afterWait(int64_t now_ms) {
+    // 等待时真的阻塞过：这批事件是刚刚就绪的；否则它们在上一批处理期间就已经在等，从上一批开始时算起
+    ready_since_ = now_ms > wait_start_ ? now_ms : batch_start_;
+    batch_start_ = now_ms;
+}
+
+bool AdmissionControl::admit(int64_t now_ms, uint64_t& shed_counter) {
+    if (!enabled()) {
+        ++stats_.admitted;
+        return true;
+    }
+    int64_t delay = now_ms - ready_since_;
+
+    // 1. interval结束时看最小时延：整个interval都没低于target才算过载
+    //    中间空闲了一整个interval以上说明队列早就排空了
+    if (now_ms >= interval_end_) {
+        bool idle = now_ms >= interval_end_ + interval_ms_;
+        last_min_ = interval_min_ == std::numeric_limits<int64_t>::max() ? -1 : interval_min_;
+        overloaded_ = !idle && interval_min_ != std::numeric_limits<int64_t>::max() && interval_min_ > target_ms_;
+        if (overloaded_) ++stats_.overloaded_intervals;
+        interval_min_ = std::numeric_limits<int64_t>::max();
+        interval_end_ = now_ms + interval_ms_;
+    }
+    if (delay < interval_min_) interval_min_ = delay;
+
+    // 2. 过载期间只拒绝等得太久的，刚就绪的照常处理：队列排空后最小时延自然回到target以下
+    if (overloaded_ && delay > target_ms_) {
+        ++shed_counter;
+        return false;
+    }
+    ++stats_.admitted;
+    return true;
+}
@@ -0,0 +1,58 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <cstdint>
+#include <limits>
+
+// 按排队时延做准入控制（CoDel的思路）：过载时不让新请求继续排队，直接回复便宜的503
+//
+// 单线程的Reactor里“排队”就是事件已经就绪、还没轮到处理：一批事件里排在后面的要等前面的处理完，
+// epoll_wait不阻塞就返回时，这批事件在上一批处理期间就已经就绪了。每个新连接和新请求的排队时延
+// 就是从这批事件最早可能就绪的时刻到开始处理它的时刻
+//
+// 偶尔一批事件多、个别请求等得久不算过载：只有一整个interval里排队时延的最小值都超过target，
+// 说明队列一直排不空（常驻队列），才进入过载状态；过载期间等待超过target的请求被拒绝，
+// 直到某个interval里出现低于target的时延。每个Reactor一份，只在本线程访问
+class AdmissionControl {
+public:
+    struct Stats {
+        uint64_t admitted = 0;             // 放行的新请求和新连接
+        uint64_t shed_requests = 0;        // 回复503的请求
+        uint64_t shed_connections = 0;     // 刚accept就回复503关闭的连接
+        uint64_t overloaded_intervals = 0; // 判定为过载的interval数
+    };
+
+    // target_ms为0时不做准入控制，所有请求都放行
+    AdmissionControl(int target_ms, int interval_ms);
+
+    bool enabled() const { return target_ms_ > 0; }
+
+    // 事件循环进入等待前、醒来后各调用一次，now_ms是单调时钟毫秒
+    void beforeWait(int64_t now_ms) { wait_start_ = now_ms; }
+    void afterWait(int64_t now_ms);
+
+    // 一个新连接或新请求开始处理，返回false表示过载、应当回复503
+    bool admitConnection(int64_t now_ms) { return admit(now_ms, stats_.shed_connections); }
+    bool admitRequest(int64_t now_ms) { return admit(now_ms, stats_.shed_requests); }
+
+    bool overloaded() const { return overloaded_; }
+    // 上一个完整interval里的最小排队时延，没有样本时为-1
+    int64_t lastMinDelay() const { return last_min_; }
+    const Stats& stats() const { return stats_; }
+
+private:
+    bool admit(int64_t now_ms, uint64_t& shed_counter);
+
+    int64_t target_ms_;
+    int64_t interval_ms_;
+    int64_t wait_start_ = 0;
+    int64_t batch_start_ = 0;     // 当前这批事件开始处理的时刻
+    int64_t ready_since_ = 0;     // 当前这批事件最早可能就绪的时刻
+    int64_t interval_end_ = 0;
+    int64_t interval_min_ = std::numeric_limits<int64_t>::max();
+    int64_t last_min_ = -1;
+    bool overloaded_ = false;
+    Stats stats_;
+};
+
+#endif // ADMISSION_H
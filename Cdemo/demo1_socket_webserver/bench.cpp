@@ -0,0 +1,842 @@
+// 微基准测试：make bench && ./bench [名称...]，不带参数运行全部
+#include <chrono>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <cstdlib>
+#include <fstream>
+#include <strings.h>
+#include <unistd.h>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+#include "connection.h"
+#include "coroutine.h"
+#include "http_handler.h"
+#include "http_parser.h"
+#include "http_response.h"
+#include "mime_types.h"
+#include "router.h"
+#include "tls.h"
+#include "websocket.h"
+
+namespace {
+
+// 防止编译器把被测代码整个优化掉
+volatile size_t g_sink = 0;
+
+// 反复执行fn直到累计运行约0.5秒，返回每秒处理的次数
+double measure(const std::function<size_t()>& fn, size_t& units_per_call) {
+    using clock = std::chrono::steady_clock;
+    size_t calls = 0;
+    auto start = clock::now();
+    double elapsed = 0;
+    do {
+        units_per_call = fn();
+        ++calls;
+        elapsed = std::chrono::duration<double>(clock::now() - start).count();
+    } while (elapsed < 0.5);
+    return static_cast<double>(calls) / elapsed;
+}
+
+// ---- parser: 请求解析吞吐 ----
+
+// 典型浏览器请求，约500字节、十来个头部
+const char* kBrowserRequest =
+    "GET /static/css/site.min.css?v=20240101 HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0 Safari/537.36\r\n"
+    "Accept: text/css,*/*;q=0.1\r\n"
+    "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Referer: https://www.example.com/index.html\r\n"
+    "Cookie: session=0123456789abcdef0123456789abcdef; theme=dark; lang=zh-CN\r\n"
+    "Connection: keep-alive\r\n"
+    "Sec-Fetch-Dest: style\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "Cache-Control: no-cache\r\n"
+    "\r\n";
+
+// 传统的逐字节状态机：每个字节走一次switch，和SIMD扫描做对比
+// 同样校验token字符、拒绝裸LF，并识别Connection和Content-Length
+size_t byteFrame(const std::string& buf, size_t start, bool& keep_alive) {
+    enum State { Method, Target, Version, VersionLf, NameStart, Name, ValueStart, Value, ValueLf, EndLf };
+    State state = Method;
+    size_t name_begin = 0, name_end = 0, value_begin = 0;
+    size_t content_length = 0;
+    keep_alive = true;
+    for (size_t i = start; i < buf.size(); ++i) {
+        char c = buf[i];
+        switch (state) {
+        case Method:
+            if (c == ' ') state = Target;
+            else if (!std::isalpha(static_cast<unsigned char>(c))) return 0;
+            break;
+        case Target:
+            if (c == ' ') state = Version;
+            else if (c == '\r' || c == '\n') return 0;
+            break;
+        case Version:
+            if (c == '\r') state = VersionLf;
+            else if (c == '\n') return 0;
+            break;
+        case VersionLf:
+            if (c != '\n') return 0;
+            keep_alive = buf.compare(i - 9, 8, "HTTP/1.0") != 0;
+            state = NameStart;
+            break;
+        case NameStart:
+            if (c == '\r') { state = EndLf; break; }
+            name_begin = i;
+            state = Name;
+            // fallthrough
+        case Name:
+            if (c == ':') {
+                name_end = i;
+                state = ValueStart;
+            } else if (!std::isalnum(static_cast<unsigned char>(c)) && c != '-' && c != '_') {
+                return 0;
+            }
+            break;
+        case ValueStart:
+            if (c == ' ' || c == '\t') break;
+            value_begin = i;
+            state = Value;
+            // fallthrough
+        case Value:
+            if (c == '\r') {
+                std::string_view name(buf.data() + name_begin, name_end - name_begin);
+                std::string_view value(buf.data() + value_begin, i - value_begin);
+                if (name.size() == 10 && strncasecmp(name.data(), "connection", 10) == 0) {
+                    keep_alive = value.find("close") == std::string_view::npos;
+                } else if (name.size() == 14 && strncasecmp(name.data(), "content-length", 14) == 0) {
+                    content_length = std::strtoull(std::string(value).c_str(), nullptr, 10);
+                }
+                state = ValueLf;
+            } else if (c == '\n') {
+                return 0;
+            }
+            break;
+        case ValueLf:
+            if (c != '\n') return 0;
+            state = NameStart;
+            break;
+        case EndLf:
+            if (c != '\n') return 0;
+            return i + 1 - start + content_length;
+        }
+    }
+    return 0;
+}
+
+void benchParser() {
+    // 1000个流水线请求拼在一个缓冲区里，模拟高负载时一次读到很多请求
+    std::string buffer;
+    for (int i = 0; i < 1000; ++i) buffer += kBrowserRequest;
+    const double bytes = static_cast<double>(buffer.size());
+
+    size_t count = 0;
+    double per_byte = measure([&] {
+        size_t pos = 0, n = 0;
+        bool keep_alive = false;
+        while (size_t len = byteFrame(buffer, pos, keep_alive)) {
+            pos += len;
+            ++n;
+        }
+        g_sink = g_sink + n;
+        return n;
+    }, count);
+
+    HttpRequest request;
+    double parser = measure([&] {
+        size_t pos = 0, n = 0;
+        HttpParser p;
+        while (pos < buffer.size() && p.parse(&buffer[pos], buffer.size() - pos, request) == ParseStatus::Complete) {
+            pos += p.consumed();
+            p.reset();
+            ++n;
+        }
+        g_sink = g_sink + request.header_count;
+        return n;
+    }, count);
+
+#if defined(__AVX2__)
+    const char* simd = "AVX2";
+#elif defined(__SSE2__)
+    const char* simd = "SSE2";
+#else
+    const char* simd = "标量";
+#endif
+    std::printf("parser: 每轮%zu个请求，共%.0f字节\n", count, bytes);
+    std::printf("  逐字节状态机         %8.2f GB/s  %10.0f 请求/秒\n", per_byte * bytes / 1e9, per_byte * count);
+    std::printf("  HttpParser(%s)     %8.2f GB/s  %10.0f 请求/秒\n", simd, parser * bytes / 1e9, parser * count);
+}
+
+// ---- headers: 响应头生成 ----
+
+// 每个响应都从头格式化：strftime生成Date，snprintf写各个头部
+void formatEveryTime(std::string& out, const char* status, const char* type, uint64_t length, bool keep_alive) {
+    char date[64];
+    time_t now = time(nullptr);
+    tm parts{};
+    gmtime_r(&now, &parts);
+    strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &parts);
+    char line[256];
+    out.append(line, static_cast<size_t>(snprintf(line, sizeof(line), "HTTP/1.1 %s\r\nDate: %s\r\nServer: demo1\r\n",
+                                                  status, date)));
+    out.append(line, static_cast<size_t>(snprintf(line, sizeof(line), "Content-Type: %s\r\nContent-Length: %llu\r\n",
+                                                  type, static_cast<unsigned long long>(length))));
+    out += keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+}
+
+void benchHeaders() {
+    constexpr size_t kResponses = 1000;
+    const char* type = "text/html; charset=utf-8";
+    std::string out;
+    out.reserve(256);
+    size_t count = 0;
+
+    double naive = measure([&] {
+        for (size_t i = 0; i < kResponses; ++i) {
+            out.clear();
+            formatEveryTime(out, "200 OK", type, 1000 + i, true);
+            g_sink = g_sink + out.size();
+        }
+        return kResponses;
+    }, count);
+
+    // 服务器里现拼的响应头（sendfile路径）：appendResponseHead加上缓存的Date
+    DateCache date;
+    std::string head;
+    head.reserve(256);
+    double generated = measure([&] {
+        for (size_t i = 0; i < kResponses; ++i) {
+            date.refresh();
+            head.clear();
+            appendResponseHead(head, "200 OK", type, 1000 + i, true);
+            size_t line = statusLineLength(head);
+            out.assign(head, 0, line);
+            out += date.line();
+            out.append(head, line, std::string::npos);
+            g_sink = g_sink + out.size();
+        }
+        return kResponses;
+    }, count);
+
+    // 统计页、目录列表：模板拷贝加一次整数转十进制
+    HeadTemplate head_template("200 OK", type);
+    double templated = measure([&] {
+        for (size_t i = 0; i < kResponses; ++i) {
+            date.refresh();
+            out.clear();
+            head_template.append(out, date.line(), 1000 + i, true);
+            g_sink = g_sink + out.size();
+        }
+        return kResponses;
+    }, count);
+
+    // 热点文件、内置页面：整个响应预先拼好，只拷贝状态行和Date，其余部分直接引用
+    std::string prebuilt = responseHead("200 OK", type, 1000, true);
+    double cached = measure([&] {
+        for (size_t i = 0; i < kResponses; ++i) {
+            date.refresh();
+            out.clear();
+            size_t line = statusLineLength(prebuilt);
+            out.append(prebuilt, 0, line);
+            out += date.line();
+            g_sink = g_sink + out.size() + prebuilt.size() - line;
+        }
+        return kResponses;
+    }, count);
+
+    std::printf("headers: 200响应头（Date、Server、Content-Type、Content-Length、Connection）\n");
+    std::printf("  每次格式化(strftime+snprintf)  %12.0f 响应/秒\n", naive * count);
+    std::printf("  appendResponseHead+缓存Date    %12.0f 响应/秒\n", generated * count);
+    std::printf("  HeadTemplate                   %12.0f 响应/秒\n", templated * count);
+    std::printf("  预先拼好的完整响应             %12.0f 响应/秒\n", cached * count);
+}
+
+// ---- mime: 扩展名查Content-Type ----
+
+void benchMime() {
+    // 表里每个扩展名各一个路径，加上大写和未知扩展名
+    std::vector<std::string> paths;
+    for (const MimeEntry& entry : kMimeTypes) {
+        paths.push_back("/static/assets/file." + std::string(entry.extension));
+    }
+    paths.push_back("/static/IMG_0001.JPG");
+    paths.push_back("/downloads/setup.exe");
+    paths.push_back("/README");
+
+    // 对照组：常见的写法，扩展名转成小写的std::string后查std::map
+    std::map<std::string, std::string_view> table;
+    for (const MimeEntry& entry : kMimeTypes) table.emplace(entry.extension, entry.type);
+    auto mapLookup = [&](std::string_view path) -> std::string_view {
+        size_t dot = path.rfind('.');
+        size_t slash = path.rfind('/');
+        if (dot == std::string_view::npos || (slash != std::string_view::npos && dot < slash)) return kDefaultMimeType;
+        std::string extension(path.substr(dot + 1));
+        for (char& c : extension) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        auto it = table.find(extension);
+        return it == table.end() ? kDefaultMimeType : it->second;
+    };
+
+    // 两种实现的结果必须一致
+    for (const std::string& path : paths) {
+        if (mapLookup(path) != mimeType(path)) std::printf("mime: %s 结果不一致\n", path.c_str());
+    }
+
+    size_t count = 0;
+    double map = measure([&] {
+        size_t total = 0;
+        for (const std::string& path : paths) total += mapLookup(path).size();
+        g_sink = g_sink + total;
+        return paths.size();
+    }, count);
+    double hash = measure([&] {
+        size_t total = 0;
+        for (const std::string& path : paths) total += mimeType(path).size();
+        g_sink = g_sink + total;
+        return paths.size();
+    }, count);
+
+    std::printf("mime: 每轮%zu个路径（%zu个扩展名，含大写和未知扩展名）\n", count, sizeof(kMimeTypes) / sizeof(kMimeTypes[0]));
+    std::printf("  std::map<std::string>    %12.0f 次/秒\n", map * count);
+    std::printf("  编译期完美哈希           %12.0f 次/秒\n", hash * count);
+}
+
+// ---- router: 路由匹配 ----
+
+// 对照组：逐条路由按路径段比较，代价随路由数线性增长
+struct LinearRoute {
+    std::vector<std::string> segments;   // ":x"为参数，"*x"为通配
+};
+
+bool linearMatch(const LinearRoute& route, std::string_view path, size_t& params) {
+    params = 0;
+    size_t pos = 1;
+    for (const std::string& segment : route.segments) {
+        if (segment[0] == '*') {
+            ++params;
+            return true;
+        }
+        if (pos > path.size()) return false;
+        size_t end = path.find('/', pos);
+        if (end == std::string_view::npos) end = path.size();
+        std::string_view part = path.substr(pos, end - pos);
+        if (segment[0] == ':') {
+            if (part.empty()) return false;
+            ++params;
+        } else if (part != segment) {
+            return false;
+        }
+        pos = end + 1;
+    }
+    return pos > path.size();
+}
+
+void benchRouter() {
+    // 5种形状×100个资源，共500条路由，和实际的路由表规模相当
+    constexpr int kResources = 100;
+    std::vector<std::string> patterns;
+    std::vector<std::string> paths;
+    for (int r = 0; r < kResources; ++r) {
+        std::string base = "/api/v1/resource" + std::to_string(r);
+        patterns.push_back(base);
+        patterns.push_back(base + "/:id");
+        patterns.push_back(base + "/:id/edit");
+        patterns.push_back(base + "/:id/items/:item");
+        patterns.push_back("/static/resource" + std::to_string(r) + "/*path");
+        paths.push_back(base);
+        paths.push_back(base + "/12345");
+        paths.push_back(base + "/12345/edit");
+        paths.push_back(base + "/12345/items/67");
+        paths.push_back("/static/resource" + std::to_string(r) + "/css/site.min.css");
+    }
+
+    Router router;
+    std::vector<LinearRoute> linear;
+    for (const std::string& pattern : patterns) {
+        router.get(pattern, [](const HttpRequest&, const RouteParams&, RouteResponse&) {});
+        LinearRoute route;
+        size_t start = 1;
+        while (start <= pattern.size()) {
+            size_t end = pattern.find('/', start);
+            if (end == std::string::npos) end = pattern.size();
+            route.segments.push_back(pattern.substr(start, end - start));
+            start = end + 1;
+        }
+        linear.push_back(std::move(route));
+    }
+
+    size_t count = 0;
+    double linear_rate = measure([&] {
+        size_t found = 0;
+        for (const std::string& path : paths) {
+            size_t captured = 0;
+            for (const LinearRoute& route : linear) {
+                if (linearMatch(route, path, captured)) {
+                    found += 1 + captured;
+                    break;
+                }
+            }
+        }
+        g_sink = g_sink + found;
+        return paths.size();
+    }, count);
+
+    size_t misses = 0;
+    RouteParams params;
+    double radix = measure([&] {
+        size_t found = 0;
+        for (const std::string& path : paths) {
+            const RouteTarget* target = nullptr;
+            std::string_view allow;
+            if (router.match("GET", path, target, params, allow) == Router::Match::Found) {
+                found += 1 + params.size();
+            } else {
+                ++misses;
+            }
+        }
+        g_sink = g_sink + found;
+        return paths.size();
+    }, count);
+    if (misses > 0) std::printf("router: radix树有%zu次没有匹配\n", misses);
+
+    std::printf("router: %zu条路由，每轮匹配%zu个路径\n", router.size(), count);
+    std::printf("  逐条比较路径段          %12.0f 次/秒\n", linear_rate * count);
+    std::printf("  radix树                 %12.0f 次/秒\n", radix * count);
+}
+
+// ---- tls: 握手和加密吞吐 ----
+
+// 生成自签名的ECDSA P-256证书，写进临时文件交给TlsContext，和服务器加载证书走同一条路径
+bool writeSelfSigned(std::string& cert_path, std::string& key_path) {
+    EVP_PKEY* key = EVP_EC_gen("P-256");
+    X509* cert = X509_new();
+    if (!key || !cert) return false;
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 86400);
+    X509_set_pubkey(cert, key);
+    X509_NAME* name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("localhost"), -1,
+                               -1, 0);
+    X509_set_issuer_name(cert, name);
+    bool ok = X509_sign(cert, key, EVP_sha256()) > 0;
+
+    char cert_name[] = "/tmp/bench-cert-XXXXXX";
+    char key_name[] = "/tmp/bench-key-XXXXXX";
+    int cert_fd = mkstemp(cert_name);
+    int key_fd = mkstemp(key_name);
+    FILE* cert_file = cert_fd >= 0 ? fdopen(cert_fd, "w") : nullptr;
+    FILE* key_file = key_fd >= 0 ? fdopen(key_fd, "w") : nullptr;
+    ok = ok && cert_file && key_file && PEM_write_X509(cert_file, cert) == 1 &&
+         PEM_write_PrivateKey(key_file, key, nullptr, nullptr, 0, nullptr, nullptr) == 1;
+    if (cert_file) fclose(cert_file);
+    if (key_file) fclose(key_file);
+    cert_path = cert_name;
+    key_path = key_name;
+    X509_free(cert);
+    EVP_PKEY_free(key);
+    return ok;
+}
+
+// 一对通过内存BIO相连的客户端和服务端，不经过网络，测的只是TLS本身的开销
+struct TlsPair {
+    SSL* client = nullptr;
+    SSL* server = nullptr;
+
+    TlsPair(SSL_CTX* client_ctx, SSL_CTX* server_ctx, SSL_SESSION* session) {
+        client = SSL_new(client_ctx);
+        server = SSL_new(server_ctx);
+        BIO* client_bio = nullptr;
+        BIO* server_bio = nullptr;
+        BIO_new_bio_pair(&client_bio, 64 * 1024, &server_bio, 64 * 1024);
+        SSL_set_bio(client, client_bio, client_bio);
+        SSL_set_bio(server, server_bio, server_bio);
+        SSL_set_connect_state(client);
+        SSL_set_accept_state(server);
+        if (session) SSL_set_session(client, session);
+    }
+    ~TlsPair() {
+        // 和服务器关闭连接时一样先发close_notify：没有正常关闭的会话会被当成坏会话，不能再恢复
+        SSL_shutdown(client);
+        SSL_shutdown(server);
+        SSL_free(client);
+        SSL_free(server);
+    }
+
+    // 两边轮流推进直到握手完成；客户端再读一次，收下TLS 1.3握手后才发的会话票据
+    bool handshake() {
+        for (int round = 0; round < 16; ++round) {
+            int c = SSL_do_handshake(client);
+            int s = SSL_do_handshake(server);
+            if (c == 1 && s == 1) {
+                char byte;
+                SSL_read(client, &byte, 1);
+                ERR_clear_error();
+                return true;
+            }
+        }
+        ERR_clear_error();
+        return false;
+    }
+};
+
+void benchTls() {
+    std::string cert_path, key_path;
+    bool written = writeSelfSigned(cert_path, key_path);
+    TlsContext server(cert_path, key_path);
+    unlink(cert_path.c_str());
+    unlink(key_path.c_str());
+    if (!written || !server.ok()) {
+        std::printf("tls: 生成测试证书失败\n");
+        return;
+    }
+    SSL_CTX* client_ctx = SSL_CTX_new(TLS_client_method());
+    SSL_CTX_set_verify(client_ctx, SSL_VERIFY_NONE, nullptr);
+
+    // 每种版本先做一次完整握手拿到会话，之后分别测完整握手和恢复握手
+    size_t count = 0;
+    double rates[2][2] = {};
+    const int versions[2] = {TLS1_3_VERSION, TLS1_2_VERSION};
+    for (int v = 0; v < 2; ++v) {
+        SSL_CTX_set_min_proto_version(client_ctx, versions[v]);
+        SSL_CTX_set_max_proto_version(client_ctx, versions[v]);
+        SSL_SESSION* session = nullptr;
+        {
+            TlsPair pair(client_ctx, server.get(), nullptr);
+            if (pair.handshake()) session = SSL_get1_session(pair.client);
+        }
+        size_t failures = 0;
+        rates[v][0] = measure([&] {
+            TlsPair pair(client_ctx, server.get(), nullptr);
+            failures += !pair.handshake();
+            return 1;
+        }, count);
+        rates[v][1] = measure([&] {
+            TlsPair pair(client_ctx, server.get(), session);
+            failures += !pair.handshake() || !SSL_session_reused(pair.server);
+            return 1;
+        }, count);
+        if (failures > 0) std::printf("tls: %zu次握手失败或没有恢复会话\n", failures);
+        SSL_SESSION_free(session);
+    }
+
+    // 吞吐：服务端一次写一条16KB的记录，客户端读出来，加密和解密都在本线程
+    SSL_CTX_set_min_proto_version(client_ctx, TLS1_3_VERSION);
+    SSL_CTX_set_max_proto_version(client_ctx, TLS1_3_VERSION);
+    TlsPair pair(client_ctx, server.get(), nullptr);
+    pair.handshake();
+    constexpr size_t kRecord = 16 * 1024;
+    constexpr size_t kRecords = 64;
+    std::vector<char> plain(kRecord, 'x');
+    std::vector<char> received(kRecord);
+    double throughput = measure([&] {
+        for (size_t i = 0; i < kRecords; ++i) {
+            SSL_write(pair.server, plain.data(), static_cast<int>(kRecord));
+            size_t got = 0;
+            while (got < kRecord) {
+                int n = SSL_read(pair.client, received.data(), static_cast<int>(kRecord));
+                if (n <= 0) break;
+                got += static_cast<size_t>(n);
+            }
+            g_sink = g_sink + got;
+        }
+        return kRecords * kRecord;
+    }, count);
+    SSL_CTX_free(client_ctx);
+
+    std::printf("tls: 自签名ECDSA P-256证书，内存BIO对（客户端和服务端都在本线程，握手次数是两端合计的开销）\n");
+    std::printf("  完整握手 TLS 1.3               %12.0f 次/秒\n", rates[0][0]);
+    std::printf("  恢复握手 TLS 1.3（会话票据）   %12.0f 次/秒\n", rates[0][1]);
+    std::printf("  完整握手 TLS 1.2               %12.0f 次/秒\n", rates[1][0]);
+    std::printf("  恢复握手 TLS 1.2（会话缓存）   %12.0f 次/秒\n", rates[1][1]);
+    std::printf("  加密+解密 16KB记录             %12.0f MB/秒\n", throughput * count / (1024 * 1024));
+}
+
+// ---- websocket: 去掩码和UTF-8检查 ----
+
+void benchWebSocket() {
+    const uint8_t mask[4] = {0x37, 0xfa, 0x21, 0x3d};
+    // 1. 去掩码：SIMD版本和逐字节版本先对一遍结果，长度覆盖各档循环的边界
+    for (size_t len : {0, 1, 7, 8, 15, 16, 31, 32, 33, 100, 1000}) {
+        std::string data(len, '\0');
+        for (size_t i = 0; i < len; ++i) data[i] = static_cast<char>(i * 131 + 7);
+        std::string expect = data;
+        unmaskPayload(data.data(), len, mask);
+        unmaskPayloadScalar(expect.data(), len, mask);
+        if (data != expect) std::printf("websocket: %zu字节去掩码结果不一致\n", len);
+    }
+
+    size_t count = 0;
+    std::printf("websocket: 去掩码（原地异或）\n");
+    for (size_t len : {125, 4096, 65536}) {
+        std::string data(len, 'x');
+        double scalar = measure([&] {
+            unmaskPayloadScalar(data.data(), len, mask);
+            g_sink = g_sink + static_cast<unsigned char>(data[len - 1]);
+            return len;
+        }, count);
+        double simd = measure([&] {
+            unmaskPayload(data.data(), len, mask);
+            g_sink = g_sink + static_cast<unsigned char>(data[len - 1]);
+            return len;
+        }, count);
+        std::printf("  %6zu字节  逐字节 %8.0f MB/秒    按块 %8.0f MB/秒\n", len,
+                    scalar * count / (1024 * 1024), simd * count / (1024 * 1024));
+    }
+
+    // 2. UTF-8检查：纯ASCII（聊天、JSON的常见情况）和中英混排
+    std::string ascii;
+    while (ascii.size() < 4096) ascii += "{\"type\":\"message\",\"user\":42,\"text\":\"hello world\"}";
+    std::string mixed;
+    while (mixed.size() < 4096) mixed += "用户42说：hello，今天的会议改到下午三点。";
+    if (!validUtf8(ascii) || !validUtf8(mixed) || validUtf8("\xed\xa0\x80") || validUtf8("\xc0\xaf")) {
+        std::printf("websocket: UTF-8检查结果不对\n");
+    }
+    std::printf("websocket: UTF-8检查（约4KB文本）\n");
+    for (const std::string* text : {&ascii, &mixed}) {
+        double rate = measure([&] {
+            g_sink = g_sink + validUtf8(*text);
+            return text->size();
+        }, count);
+        std::printf("  %-10s %8.0f MB/秒\n", text == &ascii ? "纯ASCII" : "中英混排", rate * count / (1024 * 1024));
+    }
+}
+
+// ---- coroutine: 协程路由的挂起/恢复和协程帧分配 ----
+
+Task writeLines(CoConnection& conn, int lines) {
+    char line[32];
+    for (int i = 0; i < lines; ++i) {
+        int len = std::snprintf(line, sizeof(line), "line %d\n", i);
+        co_await conn.write(std::string_view(line, static_cast<size_t>(len)));
+    }
+}
+
+Task emptyTask(CoConnection&) {
+    co_return;
+}
+
+void benchCoroutine() {
+    std::string text = kBrowserRequest;
+    HttpRequest request;
+    HttpParser parser;
+    parser.parse(text.data(), text.size(), request);
+    constexpr int kLines = 1000;
+    size_t count = 0;
+
+    // 1. 每段输出一次切换：协程co_await write后由“事件循环”恢复，对比流式响应的生产回调
+    FramePool pool;
+    FramePool::setCurrent(&pool);
+    double coroutine = measure([&] {
+        CoConnection conn(request, false);
+        conn.start(writeLines(conn, kLines));
+        size_t bytes = 0;
+        for (conn.resume(); !conn.done(); conn.resume()) bytes += conn.pendingWrite().size();
+        g_sink = g_sink + bytes;
+        return static_cast<size_t>(kLines);
+    }, count);
+    double callback = measure([&] {
+        StreamProducer producer = [next = 0](std::string& out) mutable {
+            char line[32];
+            int len = std::snprintf(line, sizeof(line), "line %d\n", next++);
+            out.append(line, static_cast<size_t>(len));
+            return next < kLines;
+        };
+        std::string out;
+        size_t bytes = 0;
+        bool more = true;
+        while (more) {
+            out.clear();
+            more = producer(out);
+            bytes += out.size();
+        }
+        g_sink = g_sink + bytes;
+        return static_cast<size_t>(kLines);
+    }, count);
+    std::printf("coroutine: 逐段输出（每段一次挂起/恢复 vs 一次回调）\n");
+    std::printf("  协程 co_await write            %12.0f 段/秒\n", coroutine * count);
+    std::printf("  StreamProducer回调             %12.0f 段/秒\n", callback * count);
+
+    // 2. 每个请求创建一个协程：帧从FramePool的空闲链表取，对比直接走全局operator new
+    double rates[2];
+    for (int pooled = 1; pooled >= 0; --pooled) {
+        FramePool::setCurrent(pooled ? &pool : nullptr);
+        rates[pooled] = measure([&] {
+            for (int i = 0; i < 1000; ++i) {
+                CoConnection conn(request, false);
+                conn.start(emptyTask(conn));
+                conn.resume();
+                g_sink = g_sink + conn.done();
+            }
+            return static_cast<size_t>(1000);
+        }, count);
+    }
+    FramePool::setCurrent(nullptr);
+    std::printf("coroutine: 创建+执行+销毁一个协程（含拷贝请求头）\n");
+    std::printf("  FramePool                      %12.0f 个/秒\n", rates[1] * count);
+    std::printf("  operator new                   %12.0f 个/秒\n", rates[0] * count);
+    std::printf("  帧分配 %llu 次，slab %llu 个，超过4KB %llu 次\n",
+                static_cast<unsigned long long>(pool.stats().allocations),
+                static_cast<unsigned long long>(pool.stats().slabs),
+                static_cast<unsigned long long>(pool.stats().oversized));
+}
+
+// ---- static: 静态文件经HttpHandler整条路径（热点缓存命中） ----
+
+// 一批响应里的内存片段拼在一起；文件片段（走sendfile的）只记一个占位
+std::string collectOutput(const Connection& conn) {
+    std::string out;
+    for (const OutputChunk& chunk : conn.out) {
+        if (chunk.file) {
+            out += "[file]";
+        } else if (chunk.pipe == -1 && !chunk.stream) {
+            out.append(static_cast<const char*>(chunk.iov.iov_base), chunk.iov.iov_len);
+        }
+    }
+    return out;
+}
+
+// 响应里某个头部的值，没有时为空
+std::string_view headerValue(std::string_view response, std::string_view name) {
+    size_t end = response.find("\r\n\r\n");
+    std::string_view head = response.substr(0, end);
+    size_t pos = 0;
+    while ((pos = head.find("\r\n", pos)) != std::string_view::npos) {
+        pos += 2;
+        std::string_view line = head.substr(pos, head.find("\r\n", pos) - pos);
+        if (line.size() > name.size() && line[name.size()] == ':' &&
+            strncasecmp(line.data(), name.data(), name.size()) == 0) {
+            std::string_view value = line.substr(name.size() + 1);
+            while (!value.empty() && value.front() == ' ') value.remove_prefix(1);
+            return value;
+        }
+    }
+    return {};
+}
+
+void benchStatic() {
+    // 1. 临时根目录：一个样式表和比它新的预压缩版本（内容不必真的是gzip，服务器不解码）
+    char root[] = "/tmp/bench-static-XXXXXX";
+    if (!mkdtemp(root)) {
+        std::perror("mkdtemp");
+        return;
+    }
+    std::string css_path = std::string(root) + "/a.css";
+    std::string gz_path = css_path + ".gz";
+    std::ofstream(css_path) << std::string(2000, 'a');
+    std::ofstream(gz_path) << std::string(100, 'z');
+
+    ServerConfig config;
+    config.root = root;
+    config.codel_target_ms = 0;
+    config.max_requests = ~0u;
+    Metrics metrics;
+    BufferPool pool;
+    const char* variant_request = "GET /a.css HTTP/1.1\r\nHost: x\r\nAccept-Encoding: gzip\r\n\r\n";
+    const char* direct_request = "GET /a.css.gz HTTP/1.1\r\nHost: x\r\n\r\n";
+    const char* plain_request = "GET /a.css HTTP/1.1\r\nHost: x\r\n\r\n";
+    auto send = [&](HttpHandler& handler, Connection& conn, const char* request) {
+        conn.in.append(request, std::strlen(request));
+        handler.process(conn);
+        std::string out = collectOutput(conn);
+        conn.clearOutput();
+        return out;
+    };
+
+    // 2. 预压缩版本和直接请求.gz文件在热点缓存里不能共用条目：两种先后顺序各用一个新的Handler
+    //    （热点缓存每个Handler一份），两个响应的头部都要对
+    for (bool variant_first : {true, false}) {
+        HttpHandler handler(config, "", nullptr, nullptr, nullptr, nullptr, metrics.createShard());
+        Connection conn(pool);
+        std::string variant, direct;
+        if (variant_first) {
+            variant = send(handler, conn, variant_request);
+            direct = send(handler, conn, direct_request);
+        } else {
+            direct = send(handler, conn, direct_request);
+            variant = send(handler, conn, variant_request);
+        }
+        const char* order = variant_first ? "先压缩版本后.gz" : "先.gz后压缩版本";
+        if (headerValue(variant, "Content-Type").substr(0, 8) != "text/css" ||
+            headerValue(variant, "Content-Encoding") != "gzip") {
+            std::printf("static: %s，/a.css的gzip版本响应头不对\n", order);
+        }
+        if (headerValue(direct, "Content-Type") != "application/gzip" ||
+            !headerValue(direct, "Content-Encoding").empty()) {
+            std::printf("static: %s，/a.css.gz的响应头不对\n", order);
+        }
+        if (headerValue(variant, "ETag") == headerValue(direct, "ETag")) {
+            std::printf("static: %s，两个响应的ETag相同\n", order);
+        }
+    }
+
+    // 3. 命中热点缓存的请求：解析、找文件、拼出响应片段，不含网络收发
+    HttpHandler handler(config, "", nullptr, nullptr, nullptr, nullptr, metrics.createShard());
+    Connection conn(pool);
+    constexpr size_t kRequests = 1000;
+    size_t count = 0;
+    double rates[2];
+    for (int gzip = 0; gzip < 2; ++gzip) {
+        const char* request = gzip ? variant_request : plain_request;
+        size_t length = std::strlen(request);
+        rates[gzip] = measure([&] {
+            for (size_t i = 0; i < kRequests; ++i) {
+                conn.in.append(request, length);
+                handler.process(conn);
+                g_sink = g_sink + conn.out.size();
+                conn.clearOutput();
+            }
+            return kRequests;
+        }, count);
+    }
+    std::printf("static: 热点缓存命中的2000字节文件（HttpHandler::process，不含网络收发）\n");
+    std::printf("  原文件                         %12.0f 请求/秒\n", rates[0] * count);
+    std::printf("  .gz预压缩版本                  %12.0f 请求/秒\n", rates[1] * count);
+
+    unlink(gz_path.c_str());
+    unlink(css_path.c_str());
+    rmdir(root);
+}
+
+struct Benchmark {
+    const char* name;
+    void (*run)();
+};
+
+const Benchmark kBenchmarks[] = {
+    {"parser", benchParser},
+    {"headers", benchHeaders},
+    {"mime", benchMime},
+    {"router", benchRouter},
+    {"tls", benchTls},
+    {"websocket", benchWebSocket},
+    {"coroutine", benchCoroutine},
+    {"static", benchStatic},
+};
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    for (const Benchmark& bench : kBenchmarks) {
+        bool selected = argc == 1;
+        for (int i = 1; i < argc; ++i) {
+            selected = selected || std::strcmp(argv[i], bench.name) == 0;
+        }
+        if (selected) bench.run();
+    }
+    return 0;
+}
@@ -0,0 +1,232 @@
+#include "compressor.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+#ifdef HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+#include "http_response.h"
+#include "mime_types.h"
+
+namespace {
+
+constexpr size_t kMinSize = 256;                  // 太小的文件压缩省不了几个字节
+constexpr size_t kMaxSize = 8 * 1024 * 1024;      // 太大的文件不放进内存
+constexpr size_t kMaxPendingJobs = 1024;          // 后台队列上限，满了就先不压缩
+constexpr double kMaxRatio = 0.9;                 // 压缩后超过原大小的90%视为不可压缩
+
+bool readFile(const std::string& path, const struct stat& expected, std::string& data) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return false;
+    struct stat st{};
+    bool ok = fstat(fd, &st) == 0 && sameFileVersion(st, expected);
+    if (ok) {
+        data.resize(static_cast<size_t>(st.st_size));
+        size_t done = 0;
+        while (ok && done < data.size()) {
+            ssize_t n = pread(fd, &data[done], data.size() - done, static_cast<off_t>(done));
+            if (n < 0 && errno == EINTR) continue;
+            ok = n > 0;
+            if (ok) done += static_cast<size_t>(n);
+        }
+    }
+    close(fd);
+    return ok;
+}
+
+// 后台压缩不在乎CPU，用最高压缩级别
+bool gzipCompress(const std::string& input, std::string& output) {
+    z_stream stream{};
+    // windowBits加16表示输出gzip格式而不是zlib格式
+    if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) return false;
+    output.resize(deflateBound(&stream, input.size()));
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+    stream.avail_in = static_cast<uInt>(input.size());
+    stream.next_out = reinterpret_cast<Bytef*>(&output[0]);
+    stream.avail_out = static_cast<uInt>(output.size());
+    int ret = deflate(&stream, Z_FINISH);
+    output.resize(stream.total_out);
+    deflateEnd(&stream);
+    return ret == Z_STREAM_END;
+}
+
+bool brotliCompress(const std::string& input, std::string& output) {
+#ifdef HAVE_BROTLI
+    // 最高质量11对大文件太慢，超过1MB降到9
+    int quality = input.size() <= 1024 * 1024 ? BROTLI_MAX_QUALITY : 9;
+    size_t size = BrotliEncoderMaxCompressedSize(input.size());
+    if (size == 0) return false;
+    output.resize(size);
+    if (!BrotliEncoderCompress(quality, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, input.size(),
+                               reinterpret_cast<const uint8_t*>(input.data()), &size,
+                               reinterpret_cast<uint8_t*>(&output[0]))) {
+        return false;
+    }
+    output.resize(size);
+    return true;
+#else
+    (void)input;
+    (void)output;
+    return false;
+#endif
+}
+
+// 和热点文件缓存一样：带keep-alive的响应头和压缩后的正文放在一块连续内存里
+std::shared_ptr<const CachedFile> makeVariant(const std::string& path, const struct stat& st, Encoding encoding,
+                                              std::string_view etag, std::string_view last_modified,
+                                              const std::string& body) {
+    auto variant = std::make_shared<CachedFile>();
+    std::string_view type = mimeType(path);
+    std::string_view name = encodingName(encoding);
+    std::string extra = contentHeaders(type, name, variantEtag(etag, name), last_modified);
+    variant->st = st;
+    variant->data = responseHead("200 OK", type, body.size(), true, extra);
+    variant->close_head = responseHead("200 OK", type, body.size(), false, extra);
+    variant->body_offset = variant->data.size();
+    variant->data += body;
+    return variant;
+}
+
+} // namespace
+
+std::string_view encodingName(Encoding encoding) {
+    return encoding == Encoding::Brotli ? "br" : "gzip";
+}
+
+std::string_view encodingSuffix(Encoding encoding) {
+    return encoding == Encoding::Brotli ? ".br" : ".gz";
+}
+
+bool Compressor::supports(Encoding encoding) {
+#ifdef HAVE_BROTLI
+    (void)encoding;
+    return true;
+#else
+    return encoding == Encoding::Gzip;
+#endif
+}
+
+Compressor::Compressor(size_t budget_bytes) : budget_(budget_bytes), worker_([this] { run(); }) {}
+
+Compressor::~Compressor() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_one();
+    worker_.join();
+}
+
+std::shared_ptr<const CachedFile> Compressor::find(const std::string& path, const OpenFile& file,
+                                                   Encoding encoding) {
+    const struct stat& st = file.st;
+    auto size = static_cast<size_t>(st.st_size);
+    if (size < kMinSize || size > kMaxSize || size > budget_ || !supports(encoding)) return nullptr;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(path);
+    if (it != entries_.end()) {
+        Entry& entry = it->second;
+        if (sameFileVersion(entry.st, st)) {
+            lru_.splice(lru_.begin(), lru_, entry.lru);
+            return entry.variants[static_cast<size_t>(encoding)];
+        }
+        if (entry.state == State::Pending) return nullptr; // 旧版本还在压缩，完成后会发现版本不对而丢弃
+        erase(it);
+    }
+    if (jobs_.size() >= kMaxPendingJobs) return nullptr;
+
+    // 交给后台线程，本次请求先返回原文件
+    lru_.push_front(path);
+    Entry& entry = entries_[path];
+    entry.st = st;
+    entry.lru = lru_.begin();
+    jobs_.push_back(Job{path, st, file.etag, file.last_modified});
+    cv_.notify_one();
+    return nullptr;
+}
+
+Compressor::Stats Compressor::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void Compressor::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        cv_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+        if (stop_) return;
+        Job job = std::move(jobs_.front());
+        jobs_.pop_front();
+        // 读文件和压缩都在锁外进行，Reactor查表不会被压缩卡住
+        lock.unlock();
+        compress(job);
+        lock.lock();
+    }
+}
+
+void Compressor::compress(const Job& job) {
+    std::string input;
+    bool ok = readFile(job.path, job.st, input);
+
+    std::string outputs[kEncodingCount];
+    bool compressible = false;
+    if (ok) {
+        for (size_t i = 0; i < kEncodingCount; ++i) {
+            auto encoding = static_cast<Encoding>(i);
+            if (!supports(encoding)) continue;
+            bool done = encoding == Encoding::Brotli ? brotliCompress(input, outputs[i]) : gzipCompress(input, outputs[i]);
+            if (!done || static_cast<double>(outputs[i].size()) > kMaxRatio * static_cast<double>(input.size())) {
+                outputs[i].clear();
+                continue;
+            }
+            compressible = true;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(job.path);
+    if (it == entries_.end() || it->second.state != State::Pending || !sameFileVersion(it->second.st, job.st)) return;
+    if (!ok) {
+        // 文件在排队期间被修改或删除，丢掉条目，下次请求按新版本重新排队
+        erase(it);
+        return;
+    }
+    Entry& entry = it->second;
+    entry.state = compressible ? State::Ready : State::Incompressible;
+    if (compressible) {
+        ++stats_.files;
+        stats_.input_bytes += input.size();
+    } else {
+        ++stats_.incompressible;
+    }
+    for (size_t i = 0; i < kEncodingCount; ++i) {
+        if (outputs[i].empty()) continue;
+        entry.variants[i] = makeVariant(job.path, job.st, static_cast<Encoding>(i), job.etag, job.last_modified,
+                                        outputs[i]);
+        entry.bytes += entry.variants[i]->data.size();
+        (i == static_cast<size_t>(Encoding::Brotli) ? stats_.brotli_bytes : stats_.gzip_bytes) += outputs[i].size();
+    }
+    bytes_ += entry.bytes;
+
+    // 超出预算时从最久未使用的已完成条目开始淘汰
+    auto victim = lru_.end();
+    while (bytes_ > budget_ && victim != lru_.begin()) {
+        --victim;
+        auto candidate = entries_.find(*victim);
+        if (candidate->second.state == State::Pending) continue;
+        auto next = victim;
+        ++next;
+        erase(candidate);
+        victim = next;
+    }
+}
+
+void Compressor::erase(std::unordered_map<std::string, Entry>::iterator it) {
+    bytes_ -= it->second.bytes;
+    lru_.erase(it->second.lru);
+    entries_.erase(it);
+}
@@ -0,0 +1,91 @@
+#ifndef COMPRESSOR_H
+#define COMPRESSOR_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+#include <sys/stat.h>
+
+#include "file_cache.h"
+#include "hot_cache.h"
+
+// 压缩编码，按优先级排列：客户端都接受时优先br
+enum class Encoding : uint8_t { Brotli, Gzip };
+constexpr size_t kEncodingCount = 2;
+
+// Content-Encoding取值和预压缩文件的后缀
+std::string_view encodingName(Encoding encoding);
+std::string_view encodingSuffix(Encoding encoding);
+
+// 后台压缩静态文件并缓存结果，整个进程一份，所有Reactor共用
+// 请求路径上只做一次查表：还没压缩好就把文件交给后台线程，本次先返回原文件，压缩永远不在请求路径上进行
+// 压缩率不够（压缩后超过原大小的90%）的文件记为不可压缩，之后不再尝试
+class Compressor {
+public:
+    struct Stats {
+        uint64_t files = 0;            // 压缩过的文件数
+        uint64_t incompressible = 0;   // 因压缩率不够而跳过的文件数
+        uint64_t input_bytes = 0;      // 压缩过的原始字节数
+        uint64_t gzip_bytes = 0;       // gzip后的字节数
+        uint64_t brotli_bytes = 0;     // brotli后的字节数（没编译brotli时为0）
+    };
+
+    explicit Compressor(size_t budget_bytes);
+    ~Compressor();
+
+    Compressor(const Compressor&) = delete;
+    Compressor& operator=(const Compressor&) = delete;
+
+    // 是否编译了某种编码的支持（brotli是可选依赖）
+    static bool supports(Encoding encoding);
+
+    // 取path当前版本（file）的压缩结果，data是带keep-alive的响应头+压缩后的正文
+    // 没有缓存时排队后台压缩并返回nullptr；不可压缩或不支持的编码也返回nullptr
+    std::shared_ptr<const CachedFile> find(const std::string& path, const OpenFile& file, Encoding encoding);
+
+    Stats stats() const;
+
+private:
+    enum class State : uint8_t { Pending, Ready, Incompressible };
+
+    struct Entry {
+        struct stat st{};
+        State state = State::Pending;
+        std::shared_ptr<const CachedFile> variants[kEncodingCount];
+        size_t bytes = 0;
+        std::list<std::string>::iterator lru;
+    };
+
+    struct Job {
+        std::string path;
+        struct stat st{};
+        std::string etag;            // 原文件的校验器，写进压缩版本的响应头
+        std::string last_modified;
+    };
+
+    void run();
+    void compress(const Job& job);
+    void erase(std::unordered_map<std::string, Entry>::iterator it);
+
+    size_t budget_;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Job> jobs_;
+    std::list<std::string> lru_;                  // 已完成的条目，最近使用的在前
+    std::unordered_map<std::string, Entry> entries_;
+    size_t bytes_ = 0;
+    Stats stats_;
+    bool stop_ = false;
+    std::thread worker_;
+};
+
+#endif // COMPRESSOR_H
@@ -0,0 +1,251 @@
+#include "config.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <netdb.h>
+#include <thread>
+
+namespace {
+
+void printUsage(const char* prog) {
+    std::cerr << "用法: " << prog << " [选项]\n"
+              << "  -p, --port <端口>        监听端口，默认8080\n"
+              << "  -w, --workers <数量>     Reactor线程数，默认1；0表示使用全部CPU核\n"
+              << "  -b, --backend <名称>     事件循环后端：epoll（默认）或 io_uring\n"
+              << "  -k, --keepalive-timeout <秒>  长连接空闲超时，默认15；0表示不使用长连接\n"
+              << "  -t, --header-timeout <秒>     请求头必须在多少秒内收全，默认10\n"
+              << "      --body-timeout <秒>       读请求体时允许多久收不到数据，默认30\n"
+              << "      --send-timeout <秒>       发送响应时允许多久没有进展，默认30\n"
+              << "  -r, --max-requests <数量>     单个长连接最多处理的请求数，默认1000\n"
+              << "      --backlog <数量>          监听socket等待accept的连接队列长度，默认511（受net.core.somaxconn限制）\n"
+              << "      --codel-target <毫秒>     请求排队时延的目标，一个观察窗口内始终超过它时回复503，默认5；0表示不限制\n"
+              << "      --codel-interval <毫秒>   判断排队是否持续超标的观察窗口，默认100\n"
+              << "      --ws-ping <秒>            WebSocket连接空闲多久发Ping，再过同样久没有回应就断开，默认30；0表示不检查\n"
+              << "  -d, --root <目录>        静态文件根目录；不指定时返回内置页面\n"
+              << "  -c, --cache-size <MB>    每个Reactor缓存热点小文件的内存上限，默认32；0表示不缓存\n"
+              << "      --microcache <MB>      每个Reactor缓存动态路由响应的内存上限，默认16；0表示不缓存\n"
+              << "  -z, --compress-cache <MB>  后台压缩结果（gzip/br）的内存上限，默认64；0表示只用磁盘上的.gz/.br文件\n"
+              << "  -s, --stats <路径>       请求这个路径（如/stats）时返回本Reactor的内存池等统计；默认不提供\n"
+              << "      --metrics <路径>       请求这个路径时返回所有Reactor合并的Prometheus指标，默认/metrics；off表示不提供\n"
+              << "  -l, --access-log <文件>  访问日志写到这个文件（追加），默认\"-\"即标准输出；off表示不记录\n"
+              << "      --cert <文件>          PEM证书链，和--key一起指定时端口改为HTTPS（目前只支持epoll后端）\n"
+              << "      --key <文件>           PEM私钥\n"
+              << "      --proxy <前缀>=<host:port>[,<host:port>...]  把路径以前缀开头的请求转发给这组上游，可以重复指定\n"
+              << "      --proxy-timeout <秒>      等上游连接、发送或响应时允许多久没有进展，默认30\n";
+}
+
+// 解析非负整数参数，格式不对返回false
+bool parseNumber(const char* text, long max, long& value) {
+    char* end = nullptr;
+    value = std::strtol(text, &end, 10);
+    return end != text && *end == '\0' && value >= 0 && value <= max;
+}
+
+// 解析--proxy的值：/api/=127.0.0.1:9000,backend:9001，主机名在启动时解析一次（只用IPv4）
+bool parseProxyRoute(const char* text, ProxyRoute& route) {
+    const char* equal = std::strchr(text, '=');
+    if (text[0] != '/' || !equal || equal[1] == '\0') return false;
+    route.prefix.assign(text, equal);
+    const char* item = equal + 1;
+    while (*item != '\0') {
+        const char* comma = std::strchr(item, ',');
+        std::string name = comma ? std::string(item, comma) : std::string(item);
+        item = comma ? comma + 1 : item + name.size();
+        size_t colon = name.rfind(':');
+        if (colon == std::string::npos || colon == 0 || colon + 1 == name.size()) return false;
+        std::string host = name.substr(0, colon);
+        std::string port = name.substr(colon + 1);
+
+        addrinfo hints{};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* result = nullptr;
+        int rc = getaddrinfo(host.c_str(), port.c_str(), &hints, &result);
+        if (rc != 0) {
+            std::cerr << "无法解析上游" << name << ": " << gai_strerror(rc) << '\n';
+            return false;
+        }
+        route.servers.push_back(*reinterpret_cast<const sockaddr_in*>(result->ai_addr));
+        route.names.push_back(std::move(name));
+        freeaddrinfo(result);
+    }
+    return !route.servers.empty();
+}
+
+} // namespace
+
+bool parseArgs(int argc, char* argv[], ServerConfig& config) {
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        long number = 0;
+        if (std::strcmp(arg, "-p") == 0 || std::strcmp(arg, "--port") == 0) {
+            if (!value || !parseNumber(value, 65535, number)) {
+                printUsage(argv[0]);
+                return false;
+            }
+            config.port = static_cast<uint16_t>(number);
+            ++i;
+        } else if (std::strcmp(arg, "-w") == 0 || std::strcmp(arg, "--workers") == 0) {
+            if (!value || !parseNumber(value, 1024, number)) {
+                printUsage(argv[0]);
+                return false;
+            }
+            config.workers = static_cast<int>(number);
+            ++i;
+        } else if (std::strcmp(arg, "-k") == 0 || std::strcmp(arg, "--keepalive-timeout") == 0) {
+            if (!value || !parseNumber(value, 3600, number)) {
+                printUsage(argv[0]);
+                return false;
+            }
+            config.keepalive_timeout = static_cast<int>(number);
+            ++i;
+        } else if (std::strcmp(arg, "-t") == 0 || std::strcmp(arg, "--header-timeout") == 0 ||
+                   std::strcmp(arg, "--body-timeout") == 0 || std::strcmp(arg, "--send-timeout") == 0) {
+            if (!value || !parseNumber(value, 3600, number) || number == 0) {
+                printUsage(argv[0]);
+                return false;
+            }
+            int& timeout = std::strcmp(arg, "--body-timeout") == 0   ? config.body_timeout
+                           : std::strcmp(arg, "--send-timeout") == 0 ? config.send_timeout
+                                                                     : config.header_timeout;
+            timeout = static_cast<int>(number);
+            ++i;
+        } else if (std::strcmp(arg, "-r") == 0 || std::strcmp(arg, "--max-requests") == 0) {
+            if (!value || !parseNumber(value, 1000000000, number) || number == 0) {
+                printUsage(argv[0]);
+                return false;
+            }
+            config.max_requests = static_cast<unsigned>(number);
+            ++i;
+        } else if (std::strcmp(arg, "--backlog") == 0) {
+            if (!value || !parseNumber(value, 65535, number) || number == 0) {
+                printUsage(argv[0]);
+                return false;
+            }
+            config.backlog = static_cast<int>(number);
+            ++i;
+        } else if (std::strcmp(arg, "--codel-target") == 0 || std::strcmp(arg, "--codel-interval") == 0) {
+            bool interval = std::strcmp(arg, "--codel-interval") == 0;
+            if (!value || !parseNumber(value, 60000, number) || (interval && number == 0)) {
+                printUsage(argv[0]);
+                return false;
+            }
+            (interval ? config.codel_interval_ms : config.codel_target_ms) = static_cast<int>(number);
+            ++i;
+        } else if (std::strcmp(arg, "--ws-ping") == 0) {
+            if (!value || !parseNumber(value, 86400, number)) {
+                printUsage(argv[0]);
+                return false;
+            }
+            config.ws_ping_interval = static_cast<int>(number);
+            ++i;
+        } else if (std::strcmp(arg, "-d") == 0 || std::strcmp(arg, "--root") == 0) {
+            if (!value || *value == '\0') {
+                printUsage(argv[0]);
+                return false;
+            }
+            // 统一去掉末尾的'/'，之后直接和以'/'开头的请求路径拼接
+            config.root = value;
+            while (config.root.size() > 1 && config.root.back() == '/') config.root.pop_back();
+            ++i;
+        } else if (std::strcmp(arg, "-c") == 0 || std::strcmp(arg, "--cache-size") == 0) {
+            if (!value || !parseNumber(value, 65536, number)) {
+                printUsage(argv[0]);
+                return false;
+            }
+            config.cache_mb = static_cast<size_t>(number);
+            ++i;
+        } else if (std::strcmp(arg, "--microcache") == 0) {
+            if (!value || !parseNumber(value, 65536, number)) {
+                printUsage(argv[0]);
+                return false;
+            }
+            config.microcache_mb = static_cast<size_t>(number);
+            ++i;
+        } else if (std::strcmp(arg, "-z") == 0 || std::strcmp(arg, "--compress-cache") == 0) {
+            if (!value || !parseNumber(value, 65536, number)) {
+                printUsage(argv[0]);
+                return false;
+            }
+            config.compress_mb = static_cast<size_t>(number);
+            ++i;
+        } else if (std::strcmp(arg, "-s") == 0 || std::strcmp(arg, "--stats") == 0) {
+            if (!value || *value != '/') {
+                printUsage(argv[0]);
+                return false;
+            }
+            config.stats_path = value;
+            ++i;
+        } else if (std::strcmp(arg, "--metrics") == 0) {
+            if (!value || (*value != '/' && std::strcmp(value, "off") != 0)) {
+                printUsage(argv[0]);
+                return false;
+            }
+            config.metrics_path = std::strcmp(value, "off") == 0 ? "" : value;
+            ++i;
+        } else if (std::strcmp(arg, "-l") == 0 || std::strcmp(arg, "--access-log") == 0) {
+            if (!value || *value == '\0') {
+                printUsage(argv[0]);
+                return false;
+            }
+            config.access_log = std::strcmp(value, "off") == 0 ? "" : value;
+            ++i;
+        } else if (std::strcmp(arg, "--cert") == 0 || std::strcmp(arg, "--key") == 0) {
+            if (!value || *value == '\0') {
+                printUsage(argv[0]);
+                return false;
+            }
+            (std::strcmp(arg, "--cert") == 0 ? config.tls_cert : config.tls_key) = value;
+            ++i;
+        } else if (std::strcmp(arg, "--proxy") == 0) {
+            ProxyRoute route;
+            if (!value || !parseProxyRoute(value, route)) {
+                printUsage(argv[0]);
+                return false;
+            }
+            config.proxies.push_back(std::move(route));
+            ++i;
+        } else if (std::strcmp(arg, "--proxy-timeout") == 0) {
+            if (!value || !parseNumber(value, 3600, number) || number == 0) {
+                printUsage(argv[0]);
+                return false;
+            }
+            config.proxy_timeout = static_cast<int>(number);
+            ++i;
+        } else if (std::strcmp(arg, "-b") == 0 || std::strcmp(arg, "--backend") == 0) {
+            if (value && std::strcmp(value, "epoll") == 0) {
+                config.io_uring = false;
+            } else if (value && std::strcmp(value, "io_uring") == 0) {
+                config.io_uring = true;
+            } else {
+                printUsage(argv[0]);
+                return false;
+            }
+            ++i;
+        } else {
+            printUsage(argv[0]);
+            return false;
+        }
+    }
+    if (config.tls_cert.empty() != config.tls_key.empty()) {
+        std::cerr << "--cert和--key必须同时指定\n";
+        return false;
+    }
+    if (!config.tls_cert.empty() && config.io_uring) {
+        // io_uring后端的收发不经过OpenSSL，先统一回退到epoll
+        std::cerr << "TLS目前只支持epoll后端，改用epoll\n";
+        config.io_uring = false;
+    }
+    if (!config.proxies.empty() && config.io_uring) {
+        // 上游连接由epoll监听，正文用splice转发，io_uring后端还没有对应的实现
+        std::cerr << "反向代理目前只支持epoll后端，改用epoll\n";
+        config.io_uring = false;
+    }
+    if (config.workers == 0) {
+        config.workers = static_cast<int>(std::thread::hardware_concurrency());
+        if (config.workers == 0) config.workers = 1;
+    }
+    return true;
+}
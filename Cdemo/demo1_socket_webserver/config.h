@@ -0,0 +1,47 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <netinet/in.h>
+#include <string>
+#include <vector>
+
+// 反向代理的一条规则：路径以prefix开头的请求转发给servers里的一组上游，按在途请求数均衡
+struct ProxyRoute {
+    std::string prefix;
+    std::vector<std::string> names;      // 命令行里写的host:port，统计和日志用
+    std::vector<sockaddr_in> servers;    // 启动时解析好的地址
+};
+
+// 服务器启动参数，全部来自命令行
+struct ServerConfig {
+    uint16_t port = 8080;   // 监听端口
+    int workers = 1;        // Reactor线程数；>1时每个线程各自一个SO_REUSEPORT监听socket，0表示按CPU核数
+    bool io_uring = false;  // 使用io_uring后端；内核不支持时自动回退到epoll
+    int keepalive_timeout = 15;     // 长连接空闲超时（秒），0表示不使用长连接
+    int header_timeout = 10;        // 请求头必须在这么多秒内收全
+    int body_timeout = 30;          // 读请求体时两次收到数据的最大间隔（秒）
+    int send_timeout = 30;          // 发送响应时两次有进展的最大间隔（秒）
+    unsigned max_requests = 1000;   // 单个长连接最多处理的请求数，之后响应带Connection: close
+    int backlog = 511;              // 监听socket的全连接队列长度，内核还会截断到net.core.somaxconn
+    int codel_target_ms = 5;        // 准入控制：排队时延的目标（毫秒），持续超过时回复503；0表示不做准入控制
+    int codel_interval_ms = 100;    // 准入控制：判断是否持续超过目标的观察窗口（毫秒）
+    int ws_ping_interval = 30;      // WebSocket连接空闲这么多秒后发Ping，再过这么久仍没有任何帧就断开；0表示不检查
+    std::string root;               // 静态文件根目录；为空时所有请求都返回内置页面
+    size_t cache_mb = 32;           // 每个Reactor的热点小文件内存缓存预算（MB），0表示不缓存
+    size_t microcache_mb = 16;      // 每个Reactor的动态路由微缓存预算（MB），0表示不缓存（路由上的缓存策略不生效）
+    size_t compress_mb = 64;        // 后台压缩结果的内存预算（MB，所有Reactor共用），0表示不做后台压缩
+    std::string stats_path;         // 返回运行统计的请求路径，如/stats；为空时不提供
+    std::string metrics_path = "/metrics";  // 返回Prometheus指标的请求路径；为空时不提供（计数照常进行）
+    std::string access_log = "-";   // 访问日志写到哪里："-"为标准输出，为空时不记录
+    std::string tls_cert;           // PEM证书链；和tls_key都设置时监听端口只接受HTTPS
+    std::string tls_key;            // PEM私钥
+    std::vector<ProxyRoute> proxies;  // 反向代理规则，按命令行顺序匹配，先于路由和静态文件
+    int proxy_timeout = 30;         // 反向代理：等上游连接、发送或响应时允许多久没有进展（秒）
+};
+
+// 解析命令行参数，失败时打印用法并返回false
+bool parseArgs(int argc, char* argv[], ServerConfig& config);
+
+#endif // CONFIG_H
@@ -0,0 +1,138 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "coroutine.h"
+#include "file_cache.h"
+#include "http_parser.h"
+#include "memory_pool.h"
+#include "microcache.h"
+#include "router.h"
+#include "timer_wheel.h"
+#include "tls.h"
+#include "websocket_hub.h"
+
+// 连接状态：每个连接都有自己独立的读写进度，互不阻塞
+enum class ConnState {
+    Reading,   // 正在读取请求，请求头尚未收全
+    Writing,   // 响应已生成，正在（可能分多次）写出
+    Closed     // 已关闭，等待回收
+};
+
+// 连接当前在等待的期限，各自对应一个超时设置
+enum class Deadline : uint8_t {
+    Header,  // 读请求头：从请求的第一个字节（新连接从accept）算起，之后到达的数据不会推迟它
+    Body,    // 读请求体：每读到一次数据重新计时
+    Idle,    // 长连接上两个请求之间的空闲
+    Write,   // 响应发不出去：每次发送有进展重新计时
+    Wake,    // 协程路由在sleep：到期时恢复协程，不关闭连接
+    Upstream // 协程在等上游（反向代理）：连接、发送或等响应太久没有进展就断开
+};
+
+// 待发送的一段响应：内存片段用writev发送；文件片段用sendfile从文件直接发往socket，正文不经过用户态；
+// 管道片段用splice从管道发往socket（反向代理转发上游的正文）
+// 流式片段不带数据，只是个记号：前面的片段都发完后，事件循环调用HttpHandler::produce()取下一段
+struct OutputChunk {
+    iovec iov{};                             // 内存片段的数据；文件片段时iov_len为剩余要发送的字节数
+    std::shared_ptr<const OpenFile> file;    // 非空表示文件片段
+    off_t offset = 0;                        // 文件片段下一个要发送的位置
+    std::shared_ptr<const void> owner;       // 内存片段指向共享缓存时持有它，淘汰后发送中的数据仍然有效
+    int pipe = -1;                           // 非负表示管道片段，iov_len为管道里还要发送的字节数；管道归生产者所有
+    bool stream = false;                     // 流式响应的记号，永远是out的最后一个片段
+};
+
+// 流式接收请求体的请求：请求头一收全就从缓冲区丢掉，回复和记日志要用的信息在这里留一份
+struct Upload {
+    std::unique_ptr<BodySink> sink;
+    std::string method;
+    std::string target;
+    int version_minor = 1;
+    bool keep_alive = true;
+};
+
+// 空闲时out最多保留这么多片段的容量：常见的一批响应不用重新分配，空闲连接又不会占太多内存
+constexpr size_t kIdleOutputChunks = 8;
+
+// 单个客户端连接的状态机，epoll和io_uring两个后端共用
+// 由事件循环的对象池创建，缓冲区都从同一个Reactor的缓冲区池借用
+struct Connection {
+    explicit Connection(BufferPool& pool) : in(pool), out_storage(pool) {}
+
+    int fd = -1;
+    ConnState state = ConnState::Reading;
+    TlsSession tls;                  // HTTPS连接的TLS状态；明文连接为空
+    InputBuffer in;                  // 已读取但尚未处理的请求数据（可能跨多次read，也可能包含多个流水线请求）
+    HttpParser parser;               // 当前请求的解析进度，跨多次read保持
+    std::vector<OutputChunk> out;    // 待发送的响应片段，一批流水线请求中相邻的内存片段合并为一次writev
+    size_t out_index = 0;            // out中第一个尚未写完的片段（处理部分写）
+    OutputArena out_storage;         // 本批响应中动态生成的内容（头部、目录列表等），发送完一起归还
+    bool close_after_write = false;  // 响应写完后关闭连接（Connection: close、达到请求数上限或对端已关闭）
+    unsigned requests = 0;           // 本连接已处理的请求数
+    int64_t request_start_us = 0;    // 当前请求开始处理的时刻（单调时钟微秒），请求延迟指标从这里算起
+    TimerNode timer;                 // 挂在事件循环的时间轮上，到期就关闭连接
+    Deadline deadline = Deadline::Header;
+    // 流式响应：生产者和它刚写出的一段（发送时直接引用，容量在整个响应期间复用）
+    StreamProducer producer;
+    std::string stream_data;
+    bool stream_chunked = false;     // 按分块编码发送；HTTP/1.0客户端不分块，正文以关闭连接结束
+    // 流式接收中的请求，非空时conn.in里的数据都是请求体，交给它而不是解析成新请求
+    std::unique_ptr<Upload> upload;
+    // 协程路由正在处理的请求，非空时conn.in里的请求体交给协程，协程结束前不处理后面的请求
+    std::unique_ptr<CoConnection> co;
+    // 协程路由的响应要放进微缓存：协程写出的数据同时记在这里
+    std::unique_ptr<CacheFill> fill;
+    // 要的缓存条目正由别的请求生成时挂在条目上，生成完由事件循环唤醒，重新处理缓冲区里的请求
+    CacheWaiter cache_wait;
+    // 升级成WebSocket之后的状态，非空时conn.in里的数据都是WebSocket帧
+    // 必须是最后一个成员：析构时要回调onClose，那时连接的其他部分还应该完好
+    std::unique_ptr<WebSocketState> ws;
+
+    // 已经发出written字节：跳过写完的片段，写了一半的片段调整起点
+    void advanceOutput(size_t written) {
+        while (written > 0) {
+            OutputChunk& chunk = out[out_index];
+            size_t n = written < chunk.iov.iov_len ? written : chunk.iov.iov_len;
+            if (chunk.file) {
+                chunk.offset += static_cast<off_t>(n);
+            } else if (chunk.pipe == -1) {
+                chunk.iov.iov_base = static_cast<char*>(chunk.iov.iov_base) + n;
+            }
+            chunk.iov.iov_len -= n;
+            written -= n;
+            if (chunk.iov.iov_len == 0) ++out_index;
+        }
+    }
+
+    // 一批响应全部发送完毕后释放；特别大的一批用过的片段数组也还掉
+    // WebSocket连接大部分时间空闲、数量又多，片段数组一个也不留
+    void clearOutput() {
+        out.clear();
+        if (out.capacity() > (ws ? 0 : kIdleOutputChunks)) std::vector<OutputChunk>().swap(out);
+        out_index = 0;
+        out_storage.clear();
+        // 流式响应结束后，最后一段也发完了，缓冲区还掉
+        if (!producer && stream_data.capacity() > 0) std::string().swap(stream_data);
+    }
+};
+
+// 单调时钟的当前毫秒数
+inline int64_t steadyNowMs() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// 单调时钟的当前微秒数，请求延迟指标用
+inline int64_t steadyNowUs() {
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+#endif // CONNECTION_H
@@ -0,0 +1,90 @@
+#include "coroutine.h"
+
+#include <utility>
+
+Task& Task::operator=(Task&& other) noexcept {
+    if (this != &other) {
+        if (handle_) handle_.destroy();
+        handle_ = std::exchange(other.handle_, nullptr);
+    }
+    return *this;
+}
+
+Task::~Task() {
+    // 销毁挂起中的协程会连带销毁它co_await着的子协程（子协程的Task是父协程帧里的临时对象）
+    if (handle_) handle_.destroy();
+}
+
+std::coroutine_handle<> Task::await_suspend(Handle parent) noexcept {
+    // 子协程创建时是挂起的：记下父协程和所属连接，直接切换过去执行
+    handle_.promise().conn = parent.promise().conn;
+    handle_.promise().continuation = parent;
+    return handle_;
+}
+
+void Task::await_resume() const {
+    if (handle_.promise().exception) std::rethrow_exception(handle_.promise().exception);
+}
+
+std::string_view CoConnection::ReadAwaiter::await_resume() noexcept {
+    return std::exchange(conn_.piece_, std::string_view());
+}
+
+void CoConnection::WriteAwaiter::await_suspend(std::coroutine_handle<> handle) noexcept {
+    conn_.write_data_ = data_;
+    conn_.write_pipe_ = pipe_;
+    conn_.suspend(Wait::Write, handle);
+}
+
+void CoConnection::IoAwaiter::await_suspend(std::coroutine_handle<> handle) noexcept {
+    conn_.io_fd_ = fd_;
+    conn_.io_writable_ = writable_;
+    conn_.io_ok_ = true;
+    conn_.suspend(Wait::Io, handle);
+}
+
+bool CoConnection::IoAwaiter::await_resume() const noexcept {
+    return conn_.io_ok_;
+}
+
+void CoConnection::SleepAwaiter::await_suspend(Task::Handle handle) noexcept {
+    CoConnection& conn = *handle.promise().conn;
+    conn.sleep_ms_ = duration_.count();
+    conn.suspend(Wait::Sleep, handle);
+}
+
+CoConnection::CoConnection(const HttpRequest& request, bool has_body) : body_done_(!has_body) {
+    copyRequest(request, head_, request_);
+}
+
+void CoConnection::start(Task task) {
+    task_ = std::move(task);
+    task_.handle_.promise().conn = this;
+    resume_ = task_.handle_;
+}
+
+void CoConnection::setStatus(std::string_view status, std::string_view content_type) {
+    status_.assign(status);
+    content_type_.assign(content_type);
+    response_.status = status_;
+    response_.content_type = content_type_;
+}
+
+void CoConnection::resume() {
+    // 恢复的是最内层挂起的协程；它结束后FinalAwaiter逐层切回父协程，根协程结束时回到这里
+    wait_ = Wait::None;
+    write_data_ = {};
+    write_pipe_ = -1;
+    std::coroutine_handle<> handle = std::exchange(resume_, nullptr);
+    handle.resume();
+}
+
+void CoConnection::deliver(std::string_view piece, bool last) {
+    piece_ = piece;
+    if (last) body_done_ = true;
+}
+
+void CoConnection::suspend(Wait wait, std::coroutine_handle<> handle) {
+    wait_ = wait;
+    resume_ = handle;
+}
@@ -0,0 +1,246 @@
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <string>
+#include <string_view>
+
+#include "http_parser.h"
+#include "memory_pool.h"
+#include "router.h"
+
+// 协程路由（C++20协程）：处理函数写成顺序执行的代码，
+//   co_await conn.read()      等下一段请求体
+//   co_await conn.write(data) 等数据交给内核
+//   co_await sleep(100ms)     等定时器
+//   co_await conn.waitFd(fd)  等别的socket（比如反向代理的上游连接）可读或可写
+// 挂起后由连接所属的事件循环在数据到达、发送完成、时间轮到期时恢复，全程在Reactor线程里执行，没有额外的线程，
+// 挂起也不占用线程：等待期间的状态就是协程帧本身，帧从本Reactor的FramePool分配
+
+class CoConnection;
+
+// 协程处理函数和它co_await的子协程的返回类型
+// 创建后先挂起，由事件循环启动；co_await一个Task时子协程继承所属的连接，结束后接着执行父协程
+class Task {
+public:
+    struct promise_type;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    struct promise_type {
+        CoConnection* conn = nullptr;          // 所属的连接，sleep()通过它登记等待
+        std::coroutine_handle<> continuation;  // co_await这个协程的父协程
+        std::exception_ptr exception;          // 协程里没有捕获的异常，在父协程的co_await处重新抛出
+
+        // 结束时直接切换到父协程（对称转移），没有父协程就回到resume的调用者
+        struct FinalAwaiter {
+            bool await_ready() const noexcept { return false; }
+            std::coroutine_handle<> await_suspend(Handle handle) noexcept {
+                std::coroutine_handle<> next = handle.promise().continuation;
+                return next ? next : std::noop_coroutine();
+            }
+            void await_resume() const noexcept {}
+        };
+
+        Task get_return_object() noexcept { return Task(Handle::from_promise(*this)); }
+        std::suspend_always initial_suspend() const noexcept { return {}; }
+        FinalAwaiter final_suspend() const noexcept { return {}; }
+        void return_void() const noexcept {}
+        void unhandled_exception() noexcept { exception = std::current_exception(); }
+
+        static void* operator new(size_t size) { return FramePool::allocateFrame(size); }
+        static void operator delete(void* frame, size_t size) noexcept { FramePool::releaseFrame(frame, size); }
+    };
+
+    Task() = default;
+    Task(Task&& other) noexcept : handle_(other.handle_) { other.handle_ = nullptr; }
+    Task& operator=(Task&& other) noexcept;
+    ~Task();
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    explicit operator bool() const { return static_cast<bool>(handle_); }
+    bool done() const { return !handle_ || handle_.done(); }
+
+    // 在另一个Task里co_await
+    bool await_ready() const noexcept { return done(); }
+    std::coroutine_handle<> await_suspend(Handle parent) noexcept;
+    void await_resume() const;
+
+private:
+    friend class CoConnection;
+    explicit Task(Handle handle) : handle_(handle) {}
+
+    Handle handle_;
+};
+
+// 交给协程处理函数的连接，在请求头收全时创建，协程结束或连接断开时销毁
+// 连接中途断开时协程直接被销毁（不会再从co_await返回），局部变量照常析构
+class CoConnection {
+public:
+    enum class Wait : uint8_t {
+        None,
+        Read,   // 等请求体
+        Write,  // 等数据发出
+        Sleep,  // 等定时器
+        Io      // 等另一个fd可读或可写
+    };
+
+    class ReadAwaiter {
+    public:
+        explicit ReadAwaiter(CoConnection& conn) : conn_(conn) {}
+        bool await_ready() const noexcept { return conn_.body_done_; }
+        void await_suspend(std::coroutine_handle<> handle) noexcept { conn_.suspend(Wait::Read, handle); }
+        std::string_view await_resume() noexcept;
+
+    private:
+        CoConnection& conn_;
+    };
+
+    class WriteAwaiter {
+    public:
+        WriteAwaiter(CoConnection& conn, std::string_view data, int pipe = -1)
+            : conn_(conn), data_(data), pipe_(pipe) {}
+        bool await_ready() const noexcept { return data_.empty(); }
+        void await_suspend(std::coroutine_handle<> handle) noexcept;
+        void await_resume() const noexcept {}
+
+    private:
+        CoConnection& conn_;
+        std::string_view data_;   // 管道片段时只用长度
+        int pipe_;
+    };
+
+    class IoAwaiter {
+    public:
+        IoAwaiter(CoConnection& conn, int fd, bool writable) : conn_(conn), fd_(fd), writable_(writable) {}
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) noexcept;
+        bool await_resume() const noexcept;
+
+    private:
+        CoConnection& conn_;
+        int fd_;
+        bool writable_;
+    };
+
+    class SleepAwaiter {
+    public:
+        explicit SleepAwaiter(std::chrono::milliseconds duration) : duration_(duration) {}
+        bool await_ready() const noexcept { return duration_.count() <= 0; }
+        void await_suspend(Task::Handle handle) noexcept;
+        void await_resume() const noexcept {}
+
+    private:
+        std::chrono::milliseconds duration_;
+    };
+
+    // 请求行和请求头拷贝一份，整个协程期间有效；has_body为false时read()直接返回空
+    CoConnection(const HttpRequest& request, bool has_body);
+
+    CoConnection(const CoConnection&) = delete;
+    CoConnection& operator=(const CoConnection&) = delete;
+
+    // ---- 协程里使用 ----
+    const HttpRequest& request() const { return request_; }
+    const RouteParams& params() const { return params_; }
+    // 响应的状态行、类型和附加头部，在第一次write之前设置；一次也没有write时，
+    // 协程结束后按普通路由发送（body带Content-Length），否则第一次write时用分块编码发出响应头，body作为第一块
+    RouteResponse& response() { return response_; }
+
+    // 下一段请求体（分块编码已经解码），请求体读完后返回空；数据只在下一次co_await之前有效，
+    // 原样write回去是安全的（发送前会拷贝）
+    ReadAwaiter read() { return ReadAwaiter(*this); }
+    // 发送一段正文，内核收下后才返回：慢客户端让协程停在这里，而不是让数据在服务器里越积越多
+    // data在co_await期间必须有效（局部变量、临时对象都满足），空数据直接返回
+    WriteAwaiter write(std::string_view data) { return WriteAwaiter(*this, data); }
+    // 把管道里的length字节用splice直接发给客户端，正文不经过用户态；canSplice()为false时不能用
+    // 返回时管道里的这些数据都已经交给内核。HEAD请求不发正文，管道里的数据留给调用方处理
+    WriteAwaiter splice(int pipe_fd, size_t length) {
+        return WriteAwaiter(*this, std::string_view(nullptr, length), pipe_fd);
+    }
+    bool canSplice() const { return splice_ok_; }
+    // 等一个非阻塞fd可读（writable为false）或可写，由事件循环监听；返回false表示事件循环不支持，不必再等
+    // 事件可能是多余的（醒来时fd不一定就绪），调用方应当重试操作，遇到EAGAIN再等
+    IoAwaiter waitFd(int fd, bool writable = false) { return IoAwaiter(*this, fd, writable); }
+
+    // 状态行和类型不是字面量时（比如从上游的响应里取出来的），拷进连接自己的存储，协程结束后仍然有效
+    void setStatus(std::string_view status, std::string_view content_type);
+    // 正文长度事先知道：响应头带Content-Length，正文不分块，HTTP/1.0客户端也能保持长连接
+    // 实际写出的字节数和它不一致时回复后关闭连接
+    void setContentLength(uint64_t length) {
+        has_length_ = true;
+        content_length_ = length;
+    }
+    // 放弃这个响应：和抛出异常一样，响应头还没发出时回复500，否则直接关闭连接
+    void abort() { aborted_ = true; }
+    // 响应头已经随第一次write发出，之后再改状态行和头部都来不及了
+    bool responseStarted() const { return head_sent_; }
+
+    // ---- 事件循环一侧（HttpHandler）----
+    // 设置根协程，随后resume()开始执行
+    void start(Task task);
+    // 从上次挂起的地方继续，直到再次挂起或者结束
+    void resume();
+    bool done() const { return task_.done(); }
+    // 协程因为没有捕获的异常而结束，或者调用了abort()
+    bool failed() const { return aborted_ || (task_.handle_ && task_.handle_.promise().exception != nullptr); }
+    Wait waiting() const { return wait_; }
+    // waiting()为Write时要发送的数据；pendingPipe()不是-1时数据在这个管道里，pendingWrite()只有长度有意义
+    std::string_view pendingWrite() const { return write_data_; }
+    int pendingPipe() const { return write_pipe_; }
+    // waiting()为Io时等的fd和方向；ioFailed()让协程从waitFd返回false
+    int ioFd() const { return io_fd_; }
+    bool ioWritable() const { return io_writable_; }
+    void ioFailed() { io_ok_ = false; }
+    // waiting()为Sleep时要等的毫秒数
+    int64_t sleepMs() const { return sleep_ms_; }
+    // waiting()为Read时交给协程的一段请求体，last表示请求体已经读完
+    void deliver(std::string_view piece, bool last);
+    bool bodyDone() const { return body_done_; }
+
+private:
+    friend class HttpHandler;   // 填写路由参数，记录回复的进度
+
+    void suspend(Wait wait, std::coroutine_handle<> handle);
+
+    std::string head_;          // 请求行和请求头的拷贝
+    HttpRequest request_;
+    RouteParams params_;
+    RouteResponse response_;
+    bool body_done_;
+    Wait wait_ = Wait::None;
+    std::coroutine_handle<> resume_;   // 最内层挂起的协程（可能是子协程）
+    std::string_view piece_;
+    std::string_view write_data_;
+    int write_pipe_ = -1;
+    int64_t sleep_ms_ = 0;
+    int io_fd_ = -1;
+    bool io_writable_ = false;
+    bool io_ok_ = true;
+    bool aborted_ = false;
+    bool has_length_ = false;
+    uint64_t content_length_ = 0;
+    std::string status_;        // setStatus拷贝的状态行和类型
+    std::string content_type_;
+    // 以下由HttpHandler使用
+    bool splice_ok_ = false;    // 可以把管道里的数据splice给客户端（epoll后端、明文或kTLS）
+    bool keep_alive_ = true;
+    bool head_sent_ = false;    // 响应头已经随第一次write发出
+    bool head_only_ = false;    // HEAD请求，正文不发
+    uint64_t bytes_ = 0;        // 已经交出的字节数（含响应头），记日志用
+    uint64_t body_bytes_ = 0;   // 其中正文的字节数，和Content-Length核对
+    int64_t wake_at_ = 0;       // sleep到期的时刻（单调时钟毫秒）
+    Task task_;                 // 根协程，最后一个成员：销毁时协程里的局部变量还能访问连接的其他部分
+};
+
+// 挂起当前协程一段时间，精度是事件循环时间轮的刻度（100ms），到期时间向上取整
+// 只能在Task协程里co_await；参数是chrono时长（sleep(100ms)），不会和POSIX的sleep(unsigned)混淆
+inline CoConnection::SleepAwaiter sleep(std::chrono::milliseconds duration) {
+    return CoConnection::SleepAwaiter(duration);
+}
+
+#endif // COROUTINE_H
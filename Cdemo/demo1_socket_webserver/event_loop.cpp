@@ -0,0 +1,407 @@
+#include "event_loop.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr int kMaxEvents = 1024;            // 每次epoll_wait最多取回的事件数
+constexpr int kTickMs = 100;                // 时间轮的刻度，超时最多晚这么久触发
+constexpr size_t kTlsRecordSize = 16 * 1024; // TLS记录的最大明文长度，sendTls每次最多交给OpenSSL这么多
+// 协程在等的上游fd：data.ptr是所属连接的地址加上这一位（连接对象至少8字节对齐，最低位总是0）
+constexpr uintptr_t kUpstreamTag = 1;
+
+} // namespace
+
+bool setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags == -1) return false;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK) != -1;
+}
+
+EventLoop::EventLoop(int listen_fd, HttpHandler& handler, TlsContext* tls)
+    : listen_fd_(listen_fd), epoll_fd_(epoll_create1(EPOLL_CLOEXEC)), handler_(handler),
+      timers_(steadyNowMs(), kTickMs), tls_(tls) {
+    if (tls_) tls_buffer_ = std::make_unique<char[]>(kTlsRecordSize);
+    if (epoll_fd_ == -1) {
+        perror("epoll_create1");
+        return;
+    }
+    // 监听socket也用边缘触发，data.ptr为空用来和普通连接区分
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = nullptr;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &ev) == -1) {
+        perror("epoll_ctl");
+    }
+    // 广播邮箱的eventfd（水平触发），data.ptr就是邮箱所在的组
+    if (WebSocketGroup* group = handler_.websockets(); group && group->wakeFd() != -1) {
+        ev.events = EPOLLIN;
+        ev.data.ptr = group;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, group->wakeFd(), &ev) == -1) perror("epoll_ctl");
+    }
+    handler_.setStatsSource([this](std::string& out) { appendStats(out); });
+    handler_.setIoWatcher([this](Connection& conn, int fd, bool writable) { return watchFd(conn, fd, writable); });
+}
+
+EventLoop::~EventLoop() {
+    handler_.setStatsSource(nullptr);
+    handler_.setIoWatcher(nullptr);
+    for (Connection* conn : connections_) {
+        if (!conn) continue;
+        close(conn->fd);
+        pool_.destroy(conn);
+    }
+    for (Connection* conn : closed_) {
+        pool_.destroy(conn);
+    }
+    if (FramePool::current() == &frames_) FramePool::setCurrent(nullptr);
+    if (epoll_fd_ != -1) close(epoll_fd_);
+}
+
+void EventLoop::run() {
+    FramePool::setCurrent(&frames_);
+    AdmissionControl& admission = handler_.admission();
+    epoll_event events[kMaxEvents];
+    while (true) {
+        // 有连接在计时才需要定期醒来推进时间轮，否则一直等到有事件
+        if (admission.enabled()) {
+            handler_.metrics().admission(admission); // 这批事件里拒绝的请求和连接在等待前交给/metrics
+            admission.beforeWait(steadyNowMs());
+        }
+        int n = epoll_wait(epoll_fd_, events, kMaxEvents, timers_.empty() ? -1 : kTickMs);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            return;
+        }
+        if (admission.enabled()) admission.afterWait(steadyNowMs());
+        handler_.refreshDate();
+        for (int i = 0; i < n; ++i) {
+            void* tag = events[i].data.ptr;
+            if (tag == nullptr) {
+                handleAccept();
+                continue;
+            }
+            if (tag == handler_.websockets()) {
+                deliverBroadcasts();
+                continue;
+            }
+            if (reinterpret_cast<uintptr_t>(tag) & kUpstreamTag) {
+                resumeUpstream(reinterpret_cast<Connection*>(reinterpret_cast<uintptr_t>(tag) & ~kUpstreamTag));
+                continue;
+            }
+            auto* conn = static_cast<Connection*>(tag);
+            uint32_t ev = events[i].events;
+            if (ev & (EPOLLERR | EPOLLHUP)) {
+                closeConnection(conn);
+                continue;
+            }
+            // TLS握手中途可能在等socket可写（发ServerHello等），可写时也交给handleRead继续握手
+            if (((ev & EPOLLIN) || ((ev & EPOLLOUT) && conn->tls.handshaking())) &&
+                conn->state == ConnState::Reading) {
+                handleRead(conn);
+            }
+            if ((ev & EPOLLOUT) && conn->state == ConnState::Writing && flush(conn)) handleRead(conn);
+        }
+        expireTimers();
+        // 本轮事件处理完毕后再把已关闭的连接还给对象池，避免同一轮中访问已释放的对象
+        for (Connection* conn : closed_) {
+            pool_.destroy(conn);
+        }
+        closed_.clear();
+        // 在等微缓存的连接：条目生成完了（关闭的连接放弃生成时也会唤醒它们），重新处理缓冲区里的请求
+        // 放在释放连接之后：挂在条目上的已关闭连接这时已经随连接对象摘下，不会被唤醒
+        handler_.wakeCacheWaiters([this](Connection& conn) {
+            if (conn.state == ConnState::Reading) handleRead(&conn);
+        });
+    }
+}
+
+void EventLoop::handleAccept() {
+    // 边缘触发下必须一直accept到EAGAIN，否则积压的连接不会再次通知
+    while (true) {
+        sockaddr_in client_addr{};
+        socklen_t client_len = sizeof(client_addr);
+        int client_fd = accept4(listen_fd_, (sockaddr*)&client_addr, &client_len,
+                                SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("accept4");
+                handler_.metrics().acceptError();
+            }
+            return;
+        }
+        // 过载：这个连接已经排了太久的队，回复503让它稍后重试，不再占用连接对象和缓冲区
+        AdmissionControl& admission = handler_.admission();
+        if (admission.enabled() && !admission.admitConnection(steadyNowMs())) {
+            handler_.rejectConnection(client_fd, !tls_);
+            continue;
+        }
+
+        Connection* conn = pool_.create(buffers_);
+        conn->fd = client_fd;
+        conn->timer.owner = conn;
+        if (tls_ && !conn->tls.start(tls_->get(), client_fd)) {
+            close(client_fd);
+            pool_.destroy(conn);
+            continue;
+        }
+
+        // 读写事件一次性注册，之后只靠连接自身的状态决定该做什么，不需要反复epoll_ctl
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = conn;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, client_fd, &ev) == -1) {
+            perror("epoll_ctl");
+            close(client_fd);
+            pool_.destroy(conn);
+            continue;
+        }
+        handler_.updateDeadline(*conn, timers_);
+        if (static_cast<size_t>(client_fd) >= connections_.size()) connections_.resize(client_fd + 1024);
+        connections_[client_fd] = conn;
+        ++connection_count_;
+        handler_.metrics().connectionOpened();
+    }
+}
+
+void EventLoop::handleRead(Connection* conn) {
+    // HTTPS连接先完成握手；握手期间的期限就是请求头的期限，从accept算起
+    if (conn->tls.handshaking()) {
+        int result = conn->tls.handshake();
+        if (result < 0) {
+            closeConnection(conn);
+            return;
+        }
+        if (result == 0) return; // 等socket可读或可写再继续
+        ++tls_handshakes_;
+        if (conn->tls.resumed()) ++tls_resumed_;
+        if (conn->tls.kernelSend()) ++tls_kernel_send_;
+    }
+    while (true) {
+        // 1. 读到EAGAIN或缓冲区读满为止，数据直接读进连接的缓冲区，请求可以跨多次read到达
+        //    缓冲区在有数据要读时才从池里借，处理完变空就还回去
+        //    读满时先处理一次：流式接收的请求体处理完就丢掉，大上传不会把缓冲区撑大
+        bool drained = false;
+        while (true) {
+            // 协程暂时不读请求体：socket里的数据先留着，它回头读的时候会再调用handleRead
+            if (handler_.readPaused(*conn)) {
+                drained = true;
+                break;
+            }
+            char* dest = conn->in.prepare(1);
+            ssize_t len = conn->tls ? conn->tls.read(dest, conn->in.available())
+                                    : read(conn->fd, dest, conn->in.available());
+            if (len > 0) {
+                conn->in.commit(static_cast<size_t>(len));
+                handler_.metrics().received(static_cast<size_t>(len));
+                if (conn->in.size() > kMaxBufferedRequest) {
+                    closeConnection(conn);
+                    return;
+                }
+                if (conn->in.available() == 0) break;
+                continue;
+            }
+            if (len == 0) {
+                // 对端关闭了写方向：已经收全的请求照常回复，之后关闭
+                conn->close_after_write = true;
+                drained = true;
+                break;
+            }
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                drained = true;
+                break;
+            }
+            closeConnection(conn);
+            return;
+        }
+
+        // 2. 一次处理缓冲区中所有完整的流水线请求；一个完整请求都没有就继续读，读空了再等下一次可读事件
+        handler_.process(*conn);
+        if (conn->out.empty()) {
+            if (conn->close_after_write) {
+                closeConnection(conn);
+            } else if (!drained) {
+                continue; // 边沿触发：socket里还有数据，不读完不会再有通知
+            } else {
+                handler_.updateDeadline(*conn, timers_);
+            }
+            return;
+        }
+
+        // 3. 切换到写状态，立即尝试写一次；写不完就等EPOLLOUT
+        conn->state = ConnState::Writing;
+        if (!flush(conn)) return;
+        // 响应全部写完又回到读状态：继续处理写的过程中新到达的请求
+    }
+}
+
+bool EventLoop::flush(Connection* conn) {
+    // 一批流水线请求的全部响应依次发送：相邻的内存片段合并成一次writev，文件片段用sendfile，管道片段用splice
+    // 返回true表示全部写完且连接继续保持
+    while (conn->out_index < conn->out.size()) {
+        OutputChunk& head = conn->out[conn->out_index];
+        if (head.stream) {
+            // 流式响应之前的部分都发完了，socket还能写：生产下一段
+            handler_.produce(*conn);
+            continue;
+        }
+        ssize_t len;
+        if (conn->tls && !conn->tls.kernelSend()) {
+            len = sendTls(conn);
+        } else if (head.file) {
+            // 明文连接，或加密已经交给内核（kTLS）：文件照样用sendfile发送
+            off_t offset = head.offset;
+            len = sendfile(conn->fd, head.file->fd, &offset, head.iov.iov_len);
+            if (len == 0) {
+                // 文件在发送过程中被截短，已经发出的Content-Length无法兑现，只能断开
+                closeConnection(conn);
+                return false;
+            }
+        } else if (head.pipe != -1) {
+            // 反向代理的响应正文：从管道直接搬到socket（kTLS连接由内核加密）
+            len = splice(head.pipe, nullptr, conn->fd, nullptr, head.iov.iov_len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        } else {
+            iov_.clear();
+            for (size_t i = conn->out_index; i < conn->out.size() && !conn->out[i].file && !conn->out[i].stream &&
+                                             conn->out[i].pipe == -1 && iov_.size() < IOV_MAX;
+                 ++i) {
+                iov_.push_back(conn->out[i].iov);
+            }
+            len = writev(conn->fd, iov_.data(), static_cast<int>(iov_.size()));
+        }
+        if (len < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // 内核发送缓冲区满，等待EPOLLOUT；每次发送有进展都重新计时
+                handler_.updateDeadline(*conn, timers_);
+                return false;
+            }
+            closeConnection(conn);
+            return false;
+        }
+        conn->advanceOutput(static_cast<size_t>(len));
+        handler_.metrics().sent(static_cast<size_t>(len));
+    }
+    conn->clearOutput();
+    if (conn->close_after_write) {
+        closeConnection(conn);
+        return false;
+    }
+    conn->state = ConnState::Reading;
+    return true;
+}
+
+ssize_t EventLoop::sendTls(Connection* conn) {
+    // 内存片段拷进来，文件片段用pread读进来；写不出去时下次从同样的位置重新拼，
+    // 片段没有前进，拼出来的内容和上次相同（SSL_write重试时要求数据不变）
+    char* buffer = tls_buffer_.get();
+    size_t used = 0;
+    for (size_t i = conn->out_index; i < conn->out.size() && used < kTlsRecordSize; ++i) {
+        const OutputChunk& chunk = conn->out[i];
+        if (chunk.stream) break;
+        size_t n = std::min(chunk.iov.iov_len, kTlsRecordSize - used);
+        if (chunk.file) {
+            ssize_t got = pread(chunk.file->fd, buffer + used, n, chunk.offset);
+            if (got <= 0) {
+                // 文件在发送过程中被截短，已经发出的Content-Length无法兑现
+                errno = EIO;
+                return -1;
+            }
+            used += static_cast<size_t>(got);
+            if (static_cast<size_t>(got) < n) break;
+        } else {
+            std::memcpy(buffer + used, chunk.iov.iov_base, n);
+            used += n;
+        }
+    }
+    return conn->tls.write(buffer, used);
+}
+
+void EventLoop::deliverBroadcasts() {
+    handler_.websockets()->deliver([this](Connection& conn, bool overflow) {
+        if (overflow) {
+            closeConnection(&conn); // 收得太慢，积压的消息不再等它
+            return;
+        }
+        // 正在等EPOLLOUT的连接不用管，新片段排在队尾，可写时一起发出
+        if (conn.state != ConnState::Reading) return;
+        conn.state = ConnState::Writing;
+        if (flush(&conn)) handler_.updateDeadline(conn, timers_);
+    });
+}
+
+void EventLoop::expireTimers() {
+    // 到期的连接直接关闭：请求头/请求体没按时收全、长连接空闲太久或响应长时间发不出去
+    // 空闲的WebSocket连接第一次到期时先发Ping，下次到期前收到任何帧都算还活着；sleep中的协程到期时恢复执行
+    timers_.advance(steadyNowMs(), [this](TimerNode& node) {
+        auto* conn = static_cast<Connection*>(node.owner);
+        if (!handler_.handleDeadline(*conn)) {
+            closeConnection(conn);
+            return;
+        }
+        // 写完后接着处理缓冲区里的请求：协程结束后，排在它后面的流水线请求还没处理
+        conn->state = ConnState::Writing;
+        if (flush(conn)) handleRead(conn);
+    });
+}
+
+bool EventLoop::watchFd(Connection& conn, int fd, bool writable) {
+    // 一次性触发：事件来了监听就停下，协程不在等的时候（比如上游连接在空闲池里）上游的数据或关闭不会惊动事件循环
+    // 同一个fd下次等的可能是别的连接，每次都改写data.ptr；第一次等这个fd时还没有注册
+    epoll_event ev{};
+    ev.events = (writable ? EPOLLOUT : EPOLLIN | EPOLLRDHUP) | EPOLLONESHOT;
+    ev.data.ptr = reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(&conn) | kUpstreamTag);
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &ev) == 0) return true;
+    return errno == ENOENT && epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
+void EventLoop::resumeUpstream(Connection* conn) {
+    // 同一轮里连接可能已经关闭；协程也可能已经不在等这个fd（旧事件），这时什么也不做
+    if (conn->state == ConnState::Closed || !handler_.resumeIo(*conn)) return;
+    // 正在等EPOLLOUT：协程写的数据排在队尾，可写时一起发出
+    if (conn->state == ConnState::Writing) return;
+    // 和读完请求后一样：协程写的数据发出去，再处理缓冲区（协程结束后排在后面的请求、它接着要读的请求体）
+    conn->state = ConnState::Writing;
+    if (flush(conn)) handleRead(conn);
+}
+
+void EventLoop::closeConnection(Connection* conn) {
+    if (conn->state == ConnState::Closed) return; // 同一轮里可能还有这个连接的旧事件
+    conn->state = ConnState::Closed;
+    timers_.cancel(conn->timer);
+    int fd = conn->fd;
+    conn->tls.shutdown();      // HTTPS连接尽力发出close_notify，SSL对象随连接对象一起释放
+    close(fd);                 // close会自动把fd从epoll中移除
+    connections_[fd] = nullptr;
+    --connection_count_;
+    handler_.metrics().connectionClosed();
+    closed_.push_back(conn);
+}
+
+void EventLoop::appendStats(std::string& out) const {
+    out += "backend epoll\n";
+    out += "connections " + std::to_string(connection_count_) + "\n";
+    out += "timers " + std::to_string(timers_.size()) + "\n";
+    ::appendStats(out, "connection_pool", pool_.stats());
+    ::appendStats(out, "buffer_pool", buffers_.stats());
+    ::appendStats(out, "coroutine_frames", frames_.stats());
+    if (tls_) {
+        out += "tls_handshakes " + std::to_string(tls_handshakes_) + "\n";
+        out += "tls_resumed " + std::to_string(tls_resumed_) + "\n";
+        out += "tls_kernel_send " + std::to_string(tls_kernel_send_) + "\n";
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/uio.h>
+
+#include "connection.h"
+#include "http_handler.h"
+#include "memory_pool.h"
+#include "timer_wheel.h"
+#include "tls.h"
+
+// 基于epoll边缘触发(EPOLLET)的单线程Reactor
+// 所有socket都是非阻塞的：读写一直进行到EAGAIN为止，任何一个慢客户端都不会卡住事件循环
+class EventLoop {
+public:
+    // tls非空时新连接先做TLS握手，之后的收发都经过OpenSSL（kTLS可用时发送直接走内核）
+    EventLoop(int listen_fd, HttpHandler& handler, TlsContext* tls = nullptr);
+    ~EventLoop();
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    // 进入事件循环，直到出错才返回
+    void run();
+
+private:
+    void handleAccept();
+    void handleRead(Connection* conn);
+    bool flush(Connection* conn);
+    // 没有kTLS时的发送：从out_index起拼出一条记录大小的明文，交给SSL_write加密
+    ssize_t sendTls(Connection* conn);
+    // 把广播邮箱里的帧挂到本Reactor的WebSocket连接上，空闲的连接立即发送
+    void deliverBroadcasts();
+    void expireTimers();
+    // 协程co_await waitFd()：用EPOLLONESHOT监听那个fd，事件到了由resumeUpstream恢复协程
+    bool watchFd(Connection& conn, int fd, bool writable);
+    void resumeUpstream(Connection* conn);
+    void closeConnection(Connection* conn);
+
+    int listen_fd_;
+    int epoll_fd_;
+    HttpHandler& handler_;
+    TimerWheel timers_;       // 所有连接的超时，到期即关闭
+    void appendStats(std::string& out) const;
+
+    BufferPool buffers_;                  // 连接的输入缓冲区和动态响应内容都从这里借
+    ObjectPool<Connection> pool_;         // 连接对象
+    FramePool frames_;                    // 协程路由的协程帧，run()开始时设为本线程的当前池
+    std::vector<Connection*> connections_; // 按fd下标索引，fd是内核分配的最小可用编号，数组很紧凑
+    size_t connection_count_ = 0;
+    std::vector<Connection*> closed_;     // 本轮已关闭、待释放的连接
+    std::vector<iovec> iov_;  // flush时收集相邻内存片段的临时数组，复用以免每次分配
+
+    TlsContext* tls_;
+    std::unique_ptr<char[]> tls_buffer_;  // sendTls拼明文的缓冲区，一条TLS记录大小，只在启用TLS时分配
+    uint64_t tls_handshakes_ = 0;         // 完成的握手次数，其中恢复会话的次数、发送交给kTLS的次数
+    uint64_t tls_resumed_ = 0;
+    uint64_t tls_kernel_send_ = 0;
+};
+
+// 把fd设置为非阻塞模式
+bool setNonBlocking(int fd);
+
+#endif // EVENT_LOOP_H
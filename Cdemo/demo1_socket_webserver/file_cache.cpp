@@ -0,0 +1,88 @@
+#include "file_cache.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "connection.h"
+#include "http_response.h"
+
+namespace {
+
+constexpr int64_t kRevalidateMs = 1000;   // 缓存条目的有效期，过期后stat一次确认文件没变
+
+} // namespace
+
+bool sameFileVersion(const struct stat& a, const struct stat& b) {
+    return a.st_ino == b.st_ino && a.st_dev == b.st_dev && a.st_size == b.st_size &&
+           a.st_mtim.tv_sec == b.st_mtim.tv_sec && a.st_mtim.tv_nsec == b.st_mtim.tv_nsec;
+}
+
+OpenFile::~OpenFile() {
+    if (fd != -1) close(fd);
+}
+
+FileCache::FileCache(size_t capacity) : capacity_(capacity == 0 ? 1 : capacity) {}
+
+std::shared_ptr<const OpenFile> FileCache::openFile(const std::string& path) {
+    // O_NONBLOCK：路径指向FIFO之类的特殊文件时open不会卡住事件循环
+    int fd = ::open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd == -1) return nullptr;
+    auto file = std::make_shared<OpenFile>();
+    file->fd = fd;
+    if (fstat(fd, &file->st) != 0) return nullptr;
+    if (!S_ISREG(file->st.st_mode) && !S_ISDIR(file->st.st_mode)) {
+        errno = EACCES; // 设备、FIFO、socket等不对外提供
+        return nullptr;
+    }
+    if (S_ISREG(file->st.st_mode)) {
+        // 文件的任何修改或替换都会改变inode、大小或纳秒级mtime之一，ETag随之改变
+        char etag[80];
+        snprintf(etag, sizeof(etag), "\"%llx-%llx-%llx.%lx\"",
+                 static_cast<unsigned long long>(file->st.st_ino),
+                 static_cast<unsigned long long>(file->st.st_size),
+                 static_cast<unsigned long long>(file->st.st_mtim.tv_sec),
+                 static_cast<unsigned long>(file->st.st_mtim.tv_nsec));
+        file->etag = etag;
+        file->last_modified = formatHttpDate(file->st.st_mtim.tv_sec);
+    }
+    return file;
+}
+
+std::shared_ptr<const OpenFile> FileCache::open(const std::string& path) {
+    int64_t now = steadyNowMs();
+    auto it = entries_.find(path);
+    if (it != entries_.end()) {
+        Entry& entry = it->second;
+        if (now - entry.checked_ms >= kRevalidateMs) {
+            // 过期了：文件没变就续期，变了（或被删除、新建）就丢弃旧条目重新打开
+            struct stat st{};
+            if (entry.file && stat(path.c_str(), &st) == 0 && sameFileVersion(st, entry.file->st)) {
+                entry.checked_ms = now;
+            } else {
+                lru_.erase(entry.lru);
+                entries_.erase(it);
+                it = entries_.end();
+            }
+        }
+        if (it != entries_.end()) {
+            lru_.splice(lru_.begin(), lru_, entry.lru);
+            if (!entry.file) errno = entry.error;
+            return entry.file;
+        }
+    }
+
+    // 打开失败也缓存起来：探测.gz/.br等不存在的文件时不必每次都open
+    std::shared_ptr<const OpenFile> file = openFile(path);
+    int error = file ? 0 : errno;
+    if (entries_.size() >= capacity_) {
+        // 淘汰最久未使用的条目；仍在发送中的连接持有引用，fd会在发送完后才关闭
+        entries_.erase(lru_.back());
+        lru_.pop_back();
+    }
+    lru_.push_front(path);
+    entries_[path] = Entry{file, error, now, lru_.begin()};
+    errno = error;
+    return file;
+}
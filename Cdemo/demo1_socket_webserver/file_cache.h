@@ -0,0 +1,58 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include <sys/stat.h>
+
+// 一个已打开的文件及其stat结果
+// 用shared_ptr持有：缓存淘汰或文件被替换时，正在sendfile的连接仍然持有旧fd直到发送完
+struct OpenFile {
+    int fd = -1;
+    struct stat st{};
+    // 缓存校验器：打开时按这个版本的inode/大小/mtime算一次，之后每个请求直接使用
+    std::string etag;            // 强ETag，含引号
+    std::string last_modified;   // HTTP日期格式的mtime
+
+    OpenFile() = default;
+    OpenFile(const OpenFile&) = delete;
+    OpenFile& operator=(const OpenFile&) = delete;
+    ~OpenFile();
+};
+
+// 两次stat是否是同一个文件的同一个版本（inode、大小、mtime都没变）
+bool sameFileVersion(const struct stat& a, const struct stat& b);
+
+// 打开文件描述符的LRU缓存，每个Reactor一个，不加锁
+// 热点文件命中时省掉每次请求的open/fstat/close；每个条目最多每秒用一次stat确认
+// 文件没有被修改或替换（inode、大小、mtime任一变化都会重新打开）；打开失败的结果同样缓存1秒
+class FileCache {
+public:
+    explicit FileCache(size_t capacity);
+
+    // 返回path对应的已打开文件（普通文件或目录），失败返回nullptr并设置errno
+    std::shared_ptr<const OpenFile> open(const std::string& path);
+
+    size_t size() const { return entries_.size(); }
+
+private:
+    struct Entry {
+        std::shared_ptr<const OpenFile> file;     // 为空表示打开失败
+        int error = 0;                            // 打开失败时的errno
+        int64_t checked_ms = 0;                   // 上次确认文件未变化的时间
+        std::list<std::string>::iterator lru;     // 在lru_中的位置
+    };
+
+    std::shared_ptr<const OpenFile> openFile(const std::string& path);
+
+    size_t capacity_;
+    std::list<std::string> lru_;                  // 最近使用的在前
+    std::unordered_map<std::string, Entry> entries_;
+};
+
+#endif // FILE_CACHE_H
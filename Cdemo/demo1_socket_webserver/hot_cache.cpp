@@ -0,0 +1,43 @@
+#include "hot_cache.h"
+
+#include "file_cache.h"
+
+HotCache::HotCache(size_t budget_bytes, size_t max_file_size)
+    : budget_(budget_bytes), max_file_size_(max_file_size) {}
+
+bool HotCache::cacheable(const struct stat& st) const {
+    auto size = static_cast<size_t>(st.st_size);
+    return S_ISREG(st.st_mode) && size <= max_file_size_ && size < budget_;
+}
+
+std::shared_ptr<const CachedFile> HotCache::find(const std::string& key, const struct stat& st) {
+    auto it = entries_.find(key);
+    if (it == entries_.end()) return nullptr;
+    if (!sameFileVersion(it->second.file->st, st)) {
+        erase(it);
+        return nullptr;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second.lru);
+    return it->second.file;
+}
+
+std::shared_ptr<const CachedFile> HotCache::insert(const std::string& key, CachedFile file) {
+    auto entry = std::make_shared<const CachedFile>(std::move(file));
+    auto old = entries_.find(key);
+    if (old != entries_.end()) erase(old);
+    if (entry->data.size() > budget_) return entry; // 比整个预算还大，只用这一次
+
+    while (bytes_ + entry->data.size() > budget_ && !lru_.empty()) {
+        erase(entries_.find(lru_.back()));
+    }
+    lru_.push_front(key);
+    entries_[key] = Entry{entry, lru_.begin()};
+    bytes_ += entry->data.size();
+    return entry;
+}
+
+void HotCache::erase(std::unordered_map<std::string, Entry>::iterator it) {
+    bytes_ -= it->second.file->data.size();
+    lru_.erase(it->second.lru);
+    entries_.erase(it);
+}
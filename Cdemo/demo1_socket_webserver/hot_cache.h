@@ -0,0 +1,57 @@
+#ifndef HOT_CACHE_H
+#define HOT_CACHE_H
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include <sys/stat.h>
+
+// 缓存在内存里的小文件：带keep-alive的响应头和正文连续存放，命中时整个响应就是一个iovec
+struct CachedFile {
+    std::string data;        // 响应头 + 正文
+    size_t body_offset = 0;  // 正文在data中的起点
+    std::string close_head;  // Connection: close的响应头，和data中的正文组成两个iovec
+    struct stat st{};        // 缓存时文件的版本，和FileCache里最新的stat不一致就失效
+
+    std::string_view body() const { return std::string_view(data).substr(body_offset); }
+};
+
+// 按字节预算做LRU淘汰的热点文件缓存，每个Reactor一个，不加锁
+// 只缓存不超过max_file_size的文件：大文件用sendfile更划算，也不该挤掉大量小文件
+class HotCache {
+public:
+    HotCache(size_t budget_bytes, size_t max_file_size);
+
+    // 文件大小是否适合放进缓存
+    bool cacheable(const struct stat& st) const;
+
+    // 按键查找缓存，键一般是文件路径，同一文件的不同编码各有自己的键（由调用方决定）
+    // 文件的inode/大小/mtime和缓存时不同则丢弃旧条目并返回nullptr
+    std::shared_ptr<const CachedFile> find(const std::string& key, const struct stat& st);
+
+    // 放入缓存，必要时从最久未使用的条目开始淘汰，直到总字节数回到预算以内
+    // 被淘汰的条目如果还在发送中，由发送方持有的引用保证内存有效
+    std::shared_ptr<const CachedFile> insert(const std::string& key, CachedFile file);
+
+    size_t bytes() const { return bytes_; }
+
+private:
+    struct Entry {
+        std::shared_ptr<const CachedFile> file;
+        std::list<std::string>::iterator lru;
+    };
+
+    void erase(std::unordered_map<std::string, Entry>::iterator it);
+
+    size_t budget_;
+    size_t max_file_size_;
+    size_t bytes_ = 0;
+    std::list<std::string> lru_;                  // 最近使用的在前
+    std::unordered_map<std::string, Entry> entries_;
+};
+
+#endif // HOT_CACHE_H
@@ -0,0 +1,1487 @@
+#include "http_handler.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <dirent.h>
+#include <functional>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <string_view>
+#include <vector>
+
+#include "http_response.h"
+#include "mime_types.h"
+#include "websocket.h"
+
+namespace {
+
+constexpr size_t kMaxBatch = 256; // 一次最多合并多少个流水线响应，避免iovec超过IOV_MAX
+constexpr size_t kFileCacheSize = 1024; // 每个Reactor缓存的打开文件数
+constexpr size_t kHotFileMaxSize = 64 * 1024; // 不超过这个大小的文件才放进内存缓存
+constexpr size_t kMicroCacheMaxBody = 1024 * 1024; // 正文超过这个大小的动态响应不进微缓存
+constexpr std::string_view kIndexFile = "index.html";
+constexpr size_t kMaxRanges = 16; // 一个请求最多的区间数，再多就当没有Range，返回完整内容
+// 客户端发请求体之前等待的中间响应（Expect: 100-continue）
+constexpr std::string_view kContinueResponse = "HTTP/1.1 100 Continue\r\n\r\n";
+constexpr std::string_view kLastChunk = "0\r\n\r\n";
+constexpr std::string_view kOverloadedStatus = "503 Service Unavailable";
+constexpr std::string_view kRetryAfter = "Retry-After: 1\r\n";
+
+// 拼出完整响应：状态行、头部和正文
+std::string buildResponse(std::string_view status, const std::string& body, bool keep_alive,
+                          std::string_view extra_headers = {}) {
+    return responseHead(status, "text/html; charset=utf-8", body.size(), keep_alive, extra_headers) + body;
+}
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// 客户端要求收到100 Continue后再发请求体（HTTP/1.0没有这个机制）
+bool expectsContinue(const HttpRequest& request) {
+    std::string_view expect = request.header("Expect");
+    return request.version_minor >= 1 && expect.size() == 12 && strncasecmp(expect.data(), "100-continue", 12) == 0;
+}
+
+// 请求路径做百分号解码并规范化；含NUL、"."或".."路径段（可能跳出根目录）时返回false
+bool decodePath(std::string_view path, std::string& out) {
+    if (path.empty() || path.front() != '/') return false;
+    out.clear();
+    for (size_t i = 0; i < path.size(); ++i) {
+        char c = path[i];
+        if (c == '%') {
+            int hi = i + 2 < path.size() ? hexValue(path[i + 1]) : -1;
+            int lo = hi >= 0 ? hexValue(path[i + 2]) : -1;
+            if (lo < 0) return false;
+            c = static_cast<char>(hi * 16 + lo);
+            i += 2;
+        }
+        if (c == '\0') return false;
+        if (c == '/' && !out.empty() && out.back() == '/') continue; // 合并连续的'/'
+        out += c;
+    }
+    size_t start = 0;
+    while (start < out.size()) {
+        size_t end = out.find('/', start + 1);
+        std::string_view segment = std::string_view(out).substr(start + 1, end == std::string::npos ? end : end - start - 1);
+        if (segment == "." || segment == "..") return false;
+        if (end == std::string::npos) break;
+        start = end;
+    }
+    return true;
+}
+
+void appendEscaped(std::string& out, std::string_view text) {
+    for (char c : text) {
+        switch (c) {
+        case '&': out += "&amp;"; break;
+        case '<': out += "&lt;"; break;
+        case '>': out += "&gt;"; break;
+        case '"': out += "&quot;"; break;
+        default: out += c; break;
+        }
+    }
+}
+
+// 链接里的文件名：除了不需要编码的字符外都按%XX编码
+void appendUrlEncoded(std::string& out, std::string_view text) {
+    static const char kHex[] = "0123456789ABCDEF";
+    for (char c : text) {
+        auto u = static_cast<unsigned char>(c);
+        if ((u >= 'a' && u <= 'z') || (u >= 'A' && u <= 'Z') || (u >= '0' && u <= '9') ||
+            c == '-' || c == '_' || c == '.' || c == '~' || c == '/') {
+            out += c;
+        } else {
+            out += '%';
+            out += kHex[u >> 4];
+            out += kHex[u & 15];
+        }
+    }
+}
+
+// Accept-Encoding里是否接受coding，比如"gzip, deflate, br;q=0.8"；q=0表示明确拒绝
+bool acceptsEncoding(std::string_view accept, std::string_view coding) {
+    while (!accept.empty()) {
+        size_t comma = accept.find(',');
+        std::string_view item = accept.substr(0, comma);
+        accept = comma == std::string_view::npos ? std::string_view() : accept.substr(comma + 1);
+
+        size_t semicolon = item.find(';');
+        std::string_view name = item.substr(0, semicolon);
+        while (!name.empty() && (name.front() == ' ' || name.front() == '\t')) name.remove_prefix(1);
+        while (!name.empty() && (name.back() == ' ' || name.back() == '\t')) name.remove_suffix(1);
+        if (name != coding && name != "*") continue;
+        if (semicolon == std::string_view::npos) return true;
+        std::string_view params = item.substr(semicolon + 1);
+        size_t q = params.find("q=");
+        if (q == std::string_view::npos) return true;
+        std::string_view value = params.substr(q + 2);
+        value = value.substr(0, value.find_first_of(" \t;"));
+        // 只关心q是否为0：q=0、q=0.0、q=0.000都表示拒绝
+        return value.empty() || value.find_first_not_of("0.") != std::string_view::npos;
+    }
+    return false;
+}
+
+// a的修改时间是否早于b
+bool olderThan(const struct stat& a, const struct stat& b) {
+    if (a.st_mtim.tv_sec != b.st_mtim.tv_sec) return a.st_mtim.tv_sec < b.st_mtim.tv_sec;
+    return a.st_mtim.tv_nsec < b.st_mtim.tv_nsec;
+}
+
+// If-None-Match里是否有和etag匹配的项（弱比较：忽略W/前缀），"*"匹配任何存在的文件
+bool etagMatches(std::string_view list, std::string_view etag) {
+    while (!list.empty()) {
+        size_t comma = list.find(',');
+        std::string_view item = list.substr(0, comma);
+        list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+        while (!item.empty() && (item.front() == ' ' || item.front() == '\t')) item.remove_prefix(1);
+        while (!item.empty() && (item.back() == ' ' || item.back() == '\t')) item.remove_suffix(1);
+        if (item == "*") return true;
+        if (item.substr(0, 2) == "W/") item.remove_prefix(2);
+        if (item == etag) return true;
+    }
+    return false;
+}
+
+// RFC 9110 13.2.2：有If-None-Match时只看它，忽略If-Modified-Since
+bool notModified(std::string_view if_none_match, std::string_view if_modified_since, std::string_view etag,
+                 const OpenFile& file) {
+    if (!if_none_match.empty()) return etagMatches(if_none_match, etag);
+    // 浏览器通常原样带回上次的Last-Modified，先做一次字符串比较，省掉日期解析
+    if (if_modified_since == file.last_modified) return true;
+    time_t since = 0;
+    return parseHttpDate(if_modified_since, since) && file.st.st_mtim.tv_sec <= since;
+}
+
+// If-Range带的校验器和当前版本一致时才按范围返回，否则客户端手里的片段已过期，应返回完整内容
+// RFC 9110 13.1.5：ETag要做强比较（弱ETag永远不匹配），日期必须和Last-Modified完全相同
+bool ifRangeMatches(std::string_view if_range, std::string_view etag, const OpenFile& file) {
+    if (if_range.empty()) return true;
+    if (if_range.front() == '"') return if_range == etag;
+    if (if_range.substr(0, 2) == "W/") return false;
+    if (if_range == file.last_modified) return true;
+    time_t date = 0;
+    return parseHttpDate(if_range, date) && date == file.st.st_mtim.tv_sec;
+}
+
+enum class RangeResult {
+    Ignore,         // 没有可用的Range（格式不对、单位不是bytes、区间太多），返回完整内容
+    Unsatisfiable,  // 所有区间都在文件之外，返回416
+    Satisfiable     // ranges里至少有一个区间
+};
+
+// 解析"bytes=0-99, 200-, -500"；区间按请求顺序保存，末尾越界的部分截到文件末尾
+RangeResult parseRanges(std::string_view header, uint64_t size, std::vector<ByteRange>& ranges) {
+    ranges.clear();
+    constexpr std::string_view kUnit = "bytes=";
+    // 范围单位不区分大小写
+    if (header.size() < kUnit.size() || strncasecmp(header.data(), kUnit.data(), kUnit.size()) != 0) {
+        return RangeResult::Ignore;
+    }
+    header.remove_prefix(kUnit.size());
+    size_t specs = 0;
+    while (!header.empty()) {
+        size_t comma = header.find(',');
+        std::string_view spec = header.substr(0, comma);
+        header = comma == std::string_view::npos ? std::string_view() : header.substr(comma + 1);
+        while (!spec.empty() && (spec.front() == ' ' || spec.front() == '\t')) spec.remove_prefix(1);
+        while (!spec.empty() && (spec.back() == ' ' || spec.back() == '\t')) spec.remove_suffix(1);
+        if (spec.empty()) continue; // 列表里允许空元素
+        if (++specs > kMaxRanges) return RangeResult::Ignore;
+
+        size_t dash = spec.find('-');
+        if (dash == std::string_view::npos) return RangeResult::Ignore;
+        // 数字过长时饱和到最大值，效果等同于越界
+        auto number = [](std::string_view digits, uint64_t& value) {
+            if (digits.empty()) return false;
+            value = 0;
+            for (char c : digits) {
+                if (c < '0' || c > '9') return false;
+                uint64_t digit = static_cast<uint64_t>(c - '0');
+                value = value > (UINT64_MAX - digit) / 10 ? UINT64_MAX : value * 10 + digit;
+            }
+            return true;
+        };
+        std::string_view first_text = spec.substr(0, dash);
+        std::string_view last_text = spec.substr(dash + 1);
+        uint64_t first = 0, last = 0;
+        if (first_text.empty()) {
+            // 后缀区间：最后N个字节
+            if (!number(last_text, last)) return RangeResult::Ignore;
+            if (last == 0 || size == 0) continue;
+            ranges.push_back({last < size ? size - last : 0, size - 1});
+            continue;
+        }
+        if (!number(first_text, first)) return RangeResult::Ignore;
+        if (last_text.empty()) {
+            last = UINT64_MAX;
+        } else if (!number(last_text, last) || last < first) {
+            return RangeResult::Ignore;
+        }
+        if (first >= size) continue;
+        ranges.push_back({first, std::min(last, size - 1)});
+    }
+    if (specs == 0) return RangeResult::Ignore;
+    return ranges.empty() ? RangeResult::Unsatisfiable : RangeResult::Satisfiable;
+}
+
+} // namespace
+
+HttpHandler::HttpHandler(const ServerConfig& config, const std::string& html_body, Compressor* compressor,
+                         AccessLogRing* access_log, const Router* router, WebSocketGroup* websockets,
+                         MetricsShard* metrics)
+    : config_(config),
+      compressor_(compressor),
+      access_log_(access_log),
+      metrics_(metrics),
+      router_(router),
+      websockets_(websockets),
+      admission_(config.codel_target_ms, config.codel_interval_ms),
+      files_(kFileCacheSize),
+      hot_(config.cache_mb * 1024 * 1024, kHotFileMaxSize),
+      micro_(config.microcache_mb * 1024 * 1024, kMicroCacheMaxBody),
+      stats_head_("200 OK", "text/plain; charset=utf-8", "Cache-Control: no-store\r\n"),
+      listing_head_("200 OK", "text/html; charset=utf-8"),
+      metrics_head_("200 OK", "text/plain; version=0.0.4; charset=utf-8", "Cache-Control: no-store\r\n"),
+      keep_alive_response_(buildResponse("200 OK", html_body, true)),
+      close_response_(buildResponse("200 OK", html_body, false)),
+      bad_request_response_(buildResponse("400 Bad Request", "<h1>400 Bad Request</h1>\n", false)),
+      payload_too_large_response_(buildResponse("413 Payload Too Large", "<h1>413 Payload Too Large</h1>\n", false)),
+      header_too_large_response_(buildResponse("431 Request Header Fields Too Large",
+                                               "<h1>431 Request Header Fields Too Large</h1>\n", false)),
+      not_implemented_response_(buildResponse("501 Not Implemented", "<h1>501 Not Implemented</h1>\n", false)) {
+    for (std::string_view status : {"400 Bad Request", "403 Forbidden", "404 Not Found"}) {
+        std::string body = "<h1>" + std::string(status) + "</h1>\n";
+        status_pages_.push_back({status, buildResponse(status, body, true), buildResponse(status, body, false)});
+    }
+    // 过载时的回复：请求处理路径上和404一样只是引用一块预先拼好的内存
+    std::string_view overloaded = kOverloadedStatus;
+    std::string body = "<h1>" + std::string(overloaded) + "</h1>\n";
+    status_pages_.push_back({overloaded, buildResponse(overloaded, body, true, kRetryAfter),
+                             buildResponse(overloaded, body, false, kRetryAfter)});
+    for (const ProxyRoute& route : config_.proxies) upstreams_.push_back(std::make_unique<UpstreamGroup>(route));
+}
+
+void HttpHandler::rejectConnection(int fd, bool plaintext) {
+    // HTTPS连接还没握手，写不了明文，只能直接关闭
+    if (plaintext) {
+        // 新连接的发送缓冲区是空的，一次send就能写完整页；写不出去也不等
+        const std::string& response = status_pages_.back().close;
+        size_t line = response.find("\r\n") + 2;
+        std::string_view date = date_.line();
+        iovec iov[3] = {{const_cast<char*>(response.data()), line},
+                        {const_cast<char*>(date.data()), date.size()},
+                        {const_cast<char*>(response.data()) + line, response.size() - line}};
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = 3;
+        // 没有解析请求，延迟记0；连接没有算进accepted，被拒绝的次数由准入控制的计数给出
+        metrics_->request(503, response.size() + date.size(), 0);
+        ssize_t n = sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n > 0) {
+            metrics_->sent(static_cast<uint64_t>(n));
+            // 客户端多半已经发来了请求：读掉它再关闭，关闭时接收缓冲区里有数据会发RST，503可能被丢掉
+            char discard[4096];
+            shutdown(fd, SHUT_WR);
+            while (recv(fd, discard, sizeof(discard), MSG_DONTWAIT) > 0) {
+            }
+        }
+    }
+    close(fd);
+}
+
+const std::string& HttpHandler::errorResponse(int status) const {
+    switch (status) {
+    case 413: return payload_too_large_response_;
+    case 431: return header_too_large_response_;
+    case 501: return not_implemented_response_;
+    default:  return bad_request_response_;
+    }
+}
+
+void HttpHandler::appendResponse(Connection& conn, const std::string& response) {
+    appendPrebuilt(conn, nullptr, response);
+}
+
+void HttpHandler::appendPrebuilt(Connection& conn, std::shared_ptr<const void> owner, std::string_view response) {
+    // 预先拼好的部分在线程之间共用、不能就地改写，Date放在单独的一小段里，整个响应两个iovec
+    size_t line = statusLineLength(response);
+    appendShared(conn, nullptr, conn.out_storage.store({response.substr(0, line), date_.line()}));
+    appendShared(conn, std::move(owner), response.substr(line));
+}
+
+void HttpHandler::appendGenerated(Connection& conn, std::string_view response) {
+    size_t line = statusLineLength(response);
+    appendShared(conn, nullptr,
+                 conn.out_storage.store({response.substr(0, line), date_.line(), response.substr(line)}));
+}
+
+void HttpHandler::appendOwned(Connection& conn, std::string_view data) {
+    // 拷进连接的输出区，之前写进去的内容不会移动，片段里的指针保持有效
+    appendShared(conn, nullptr, conn.out_storage.store(data));
+}
+
+void HttpHandler::appendShared(Connection& conn, std::shared_ptr<const void> owner, std::string_view data) {
+    OutputChunk chunk;
+    chunk.iov = iovec{const_cast<char*>(data.data()), data.size()};
+    chunk.owner = std::move(owner);
+    conn.out.push_back(std::move(chunk));
+}
+
+void HttpHandler::appendFile(Connection& conn, std::shared_ptr<const OpenFile> file, off_t offset, size_t length) {
+    if (length == 0) return;
+    OutputChunk chunk;
+    chunk.iov.iov_len = length;
+    chunk.file = std::move(file);
+    chunk.offset = offset;
+    conn.out.push_back(std::move(chunk));
+}
+
+void HttpHandler::appendStatus(Connection& conn, std::string_view status, bool keep_alive,
+                               std::string_view extra_headers) {
+    if (extra_headers.empty()) {
+        for (const StatusPage& page : status_pages_) {
+            if (page.status != status) continue;
+            std::string_view response = keep_alive ? page.keep_alive : page.close;
+            if (request_.method == "HEAD") response = response.substr(0, response.find("\r\n\r\n") + 4);
+            appendPrebuilt(conn, nullptr, response);
+            return;
+        }
+    }
+    std::string body = "<h1>";
+    body += status;
+    body += "</h1>\n";
+    std::string response = responseHead(status, "text/html; charset=utf-8", body.size(), keep_alive, extra_headers);
+    if (request_.method != "HEAD") response += body;
+    appendGenerated(conn, response);
+}
+
+void HttpHandler::process(Connection& conn) {
+    size_t pos = 0;
+    // 流式响应要等它发完才处理后面的请求
+    while (!conn.close_after_write && !conn.producer && conn.out.size() < kMaxBatch && pos < conn.in.size()) {
+        // 协程路由：请求体在协程等着读时才交给它，协程结束前后面的请求留在缓冲区
+        if (conn.co) {
+            if (!feedCoroutine(conn, pos)) break;
+            continue;
+        }
+        // 升级成WebSocket之后缓冲区里都是帧，一次处理一个
+        if (conn.ws) {
+            if (!feedWebSocket(conn, pos)) break;
+            continue;
+        }
+        // 流式接收请求体时缓冲区里都是请求体，解码后交给BodySink，读过的部分随后就从缓冲区丢掉
+        if (conn.upload) {
+            if (!feedUpload(conn, pos)) break;
+            continue;
+        }
+        // 解析器记得上次扫描到哪里，请求跨多次read时不会从头再扫
+        ParseStatus status = conn.parser.parse(&conn.in[pos], conn.in.size() - pos, request_);
+        if (status == ParseStatus::HeadersComplete) {
+            // 请求头收全了、请求体还在路上：上传路由和协程路由改为流式读取，其他请求照旧等完整的请求体
+            if (startStreaming(conn, pos)) continue;
+            bool expect = expectsContinue(request_);
+            status = conn.parser.parse(&conn.in[pos], conn.in.size() - pos, request_);
+            if (status == ParseStatus::Incomplete && expect) {
+                appendShared(conn, nullptr, kContinueResponse);
+                break;
+            }
+        }
+        if (status == ParseStatus::Incomplete) break;
+        conn.request_start_us = steadyNowUs();
+        size_t first = conn.out.size();
+        if (status == ParseStatus::Error) {
+            appendResponse(conn, errorResponse(conn.parser.errorStatus()));
+            logRequest(conn, first, false);
+            conn.close_after_write = true;
+            break;
+        }
+        // 微缓存：要的内容正由别的请求生成、又没有旧内容可给，请求先留在缓冲区里；
+        // 生成结束后事件循环再让这个连接处理一遍，那时多半直接命中。没有条目在生成时不用检查
+        if (micro_.filling() > 0 && waitForCache(conn)) break;
+        pos += conn.parser.consumed();
+        conn.parser.reset();
+        ++conn.requests;
+        conn.deadline = Deadline::Idle; // 这个请求已经收全，下一个请求头的期限重新计算
+
+        // 超时为0表示关闭长连接；达到单连接请求数上限后本次响应带上Connection: close
+        bool keep_alive = request_.keep_alive && config_.keepalive_timeout > 0 &&
+                          conn.requests < config_.max_requests;
+        bool stats = !config_.stats_path.empty() && request_.path == config_.stats_path;
+        bool metrics = !config_.metrics_path.empty() && request_.path == config_.metrics_path;
+        if (!stats && !metrics && admission_.enabled() && !admission_.admitRequest(steadyNowMs())) {
+            // 过载：排队太久的请求不再处理，回复503让客户端过一会儿再来；统计页和指标不受限制，过载时也看得到
+            appendStatus(conn, kOverloadedStatus, keep_alive);
+        } else if (stats) {
+            serveStats(conn, keep_alive);
+        } else if (metrics) {
+            serveMetrics(conn, keep_alive);
+        } else if (UpstreamGroup* upstream = matchProxy(request_.path)) {
+            CoConnection& co = startCoroutine(conn, keep_alive, false);
+            co.start(proxyRequest(co, *upstream));
+        } else if (router_ && serveRoute(conn, keep_alive)) {
+            // 已由路由处理
+        } else if (config_.root.empty()) {
+            appendResponse(conn, keep_alive ? keep_alive_response_ : close_response_);
+        } else {
+            serveStatic(conn, keep_alive);
+        }
+        // 协程路由和反向代理：这里只创建了协程，在这里开始执行；日志和连接的去留等协程结束时再定
+        if (conn.co) {
+            resumeCoroutine(conn);
+            continue;
+        }
+        logRequest(conn, first, true);
+        // 升级成WebSocket的连接不再是HTTP长连接，不受空闲超时和请求数上限的限制
+        if (!keep_alive && !conn.ws) conn.close_after_write = true;
+    }
+    // 已处理的请求从缓冲区移除；连接要关闭时剩下的数据也不再需要
+    if (conn.close_after_write) {
+        conn.in.clear();
+    } else {
+        conn.in.consume(pos);
+    }
+}
+
+void HttpHandler::logRequest(const Connection& conn, size_t first, bool parsed) {
+    if (first >= conn.out.size()) return;
+    // 状态码直接从响应的第一个片段读："HTTP/1.1 200 ..."，各条生成路径不必再单独传出来
+    const OutputChunk& head = conn.out[first];
+    const auto* line = static_cast<const char*>(head.iov.iov_base);
+    int status = 0;
+    if (!head.file && head.iov.iov_len > 12) {
+        status = (line[9] - '0') * 100 + (line[10] - '0') * 10 + (line[11] - '0');
+    }
+    uint64_t bytes = 0;
+    for (size_t i = first; i < conn.out.size(); ++i) bytes += conn.out[i].iov.iov_len;
+    metrics_->request(status, bytes, steadyNowUs() - conn.request_start_us);
+    if (!access_log_) return;
+
+    AccessRecord record;
+    if (parsed) {
+        fillAccessRecord(record, request_.method, request_.target, request_.version_minor, status, bytes);
+    } else {
+        fillAccessRecord(record, {}, {}, 1, status, bytes);
+    }
+    access_log_->push(record); // 日志线程跟不上时丢弃，计数在统计页里
+}
+
+void HttpHandler::updateDeadline(Connection& conn, TimerWheel& timers) const {
+    Deadline deadline;
+    int seconds;
+    if (conn.state == ConnState::Writing) {
+        deadline = Deadline::Write;
+        seconds = config_.send_timeout;
+    } else if (conn.co) {
+        // 协程路由：在sleep就按它要的时刻叫醒，在等上游按代理的超时，否则是在等请求体
+        if (conn.co->waiting() == CoConnection::Wait::Sleep) {
+            conn.deadline = Deadline::Wake;
+            timers.schedule(conn.timer, conn.co->wake_at_);
+            return;
+        }
+        if (conn.co->waiting() == CoConnection::Wait::Io) {
+            deadline = Deadline::Upstream;
+            seconds = config_.proxy_timeout;
+        } else {
+            deadline = Deadline::Body;
+            seconds = config_.body_timeout;
+        }
+    } else if (conn.ws) {
+        // WebSocket连接：空闲到期先发Ping（handleDeadline），再到期还没有收到任何帧才关闭
+        if (config_.ws_ping_interval == 0) {
+            timers.cancel(conn.timer);
+            return;
+        }
+        deadline = Deadline::Idle;
+        seconds = config_.ws_ping_interval;
+    } else if (conn.in.empty() && conn.requests > 0 && !conn.upload) {
+        deadline = Deadline::Idle;
+        seconds = config_.keepalive_timeout;
+    } else if (conn.parser.readingBody()) {
+        deadline = Deadline::Body;
+        seconds = config_.body_timeout;
+    } else {
+        deadline = Deadline::Header;
+        seconds = config_.header_timeout;
+        // 请求头的期限不随新数据顺延，每次只发几个字节的客户端（slowloris）占不住连接
+        if (conn.deadline == Deadline::Header && conn.timer.armed()) return;
+    }
+    conn.deadline = deadline;
+    timers.schedule(conn.timer, steadyNowMs() + static_cast<int64_t>(seconds) * 1000);
+}
+
+void HttpHandler::serveStats(Connection& conn, bool keep_alive) {
+    // 每行一个“名字 数值”，只反映处理这个请求的Reactor
+    std::string body;
+    if (stats_source_) stats_source_(body);
+    if (access_log_) body += "access_log_dropped " + std::to_string(access_log_->dropped()) + "\n";
+    const AdmissionControl::Stats& admission = admission_.stats();
+    body += "admission_admitted " + std::to_string(admission.admitted) + "\n";
+    body += "admission_shed_requests " + std::to_string(admission.shed_requests) + "\n";
+    body += "admission_shed_connections " + std::to_string(admission.shed_connections) + "\n";
+    body += "admission_overloaded_intervals " + std::to_string(admission.overloaded_intervals) + "\n";
+    body += "admission_overloaded " + std::to_string(admission_.overloaded() ? 1 : 0) + "\n";
+    body += "admission_min_delay_ms " + std::to_string(admission_.lastMinDelay()) + "\n";
+    if (websockets_) {
+        const WebSocketGroup::Stats& stats = websockets_->stats();
+        body += "websocket_connections " + std::to_string(websockets_->size()) + "\n";
+        body += "websocket_broadcasts " + std::to_string(stats.broadcasts) + "\n";
+        body += "websocket_deliveries " + std::to_string(stats.deliveries) + "\n";
+        body += "websocket_slow_dropped " + std::to_string(stats.slow_dropped) + "\n";
+    }
+    for (size_t i = 0; i < upstreams_.size(); ++i) upstreams_[i]->appendStats(body, i);
+    if (micro_.enabled()) {
+        const MicroCache::Stats& cache = micro_.stats();
+        body += "microcache_entries " + std::to_string(micro_.size()) + "\n";
+        body += "microcache_bytes " + std::to_string(micro_.bytes()) + "\n";
+        body += "microcache_hits " + std::to_string(cache.hits) + "\n";
+        body += "microcache_stale " + std::to_string(cache.stale) + "\n";
+        body += "microcache_misses " + std::to_string(cache.misses) + "\n";
+        body += "microcache_revalidations " + std::to_string(cache.revalidations) + "\n";
+        body += "microcache_waits " + std::to_string(cache.waits) + "\n";
+        body += "microcache_stored " + std::to_string(cache.stored) + "\n";
+        body += "microcache_uncacheable " + std::to_string(cache.uncacheable) + "\n";
+        body += "microcache_evictions " + std::to_string(cache.evictions) + "\n";
+    }
+    head_.clear();
+    stats_head_.append(head_, date_.line(), body.size(), keep_alive);
+    if (request_.method != "HEAD") head_ += body;
+    appendOwned(conn, head_);
+}
+
+void HttpHandler::serveMetrics(Connection& conn, bool keep_alive) {
+    // 和统计页不同，这里是整个进程的数据：所有Reactor的计数器在这时才合并
+    std::string body;
+    metrics_->owner().render(body);
+    head_.clear();
+    metrics_head_.append(head_, date_.line(), body.size(), keep_alive);
+    if (request_.method != "HEAD") head_ += body;
+    appendOwned(conn, head_);
+}
+
+bool HttpHandler::serveRoute(Connection& conn, bool keep_alive) {
+    const RouteTarget* target = nullptr;
+    std::string_view allow;
+    Router::Match match = router_->match(request_.method, request_.path, target, route_params_, allow);
+    if (match == Router::Match::NotFound) return false;
+    if (match == Router::Match::MethodNotAllowed) {
+        extra_.assign("Allow: ");
+        extra_ += allow;
+        extra_ += "\r\n";
+        appendStatus(conn, "405 Method Not Allowed", keep_alive, extra_);
+        return true;
+    }
+
+    if (target->websocket) {
+        upgradeWebSocket(conn, *target->websocket, keep_alive);
+        return true;
+    }
+    // 打开了微缓存的路由：命中就不再调用处理函数
+    bool fill = false;
+    if (target->cache && cacheKey(*target->cache) && serveCached(conn, *target, keep_alive, fill)) return true;
+    if (target->coroutine) {
+        CoConnection& co = startCoroutine(conn, keep_alive, false);
+        co.start(routeCoroutine(co, *target));
+        if (fill) conn.fill = std::make_unique<CacheFill>(micro_, cache_key_, target->cache);
+        return true;
+    }
+
+    route_response_.reset();
+    if (target->upload) {
+        // 上传路由收到了没有请求体的请求：照样创建BodySink，直接结束
+        std::unique_ptr<BodySink> sink = target->upload(request_, route_params_);
+        if (!sink) {
+            appendStatus(conn, "403 Forbidden", false);
+            conn.close_after_write = true;
+            return true;
+        }
+        sink->finish(route_response_);
+    } else {
+        target->handler(request_, route_params_, route_response_);
+    }
+    if (fill) {
+        // 处理函数是同步的，生成期间本线程不会处理别的请求，这里生成完就放进缓存，正文只拷贝这一次
+        RouteResponse& response = route_response_;
+        if (!response.stream && response.body.size() <= micro_.maxBody() &&
+            MicroCache::cacheable(response.status, response.headers)) {
+            int64_t now = steadyNowMs();
+            auto cached = micro_.store(cache_key_,
+                                       CachedResponse{std::string(response.status), std::string(response.content_type),
+                                                      response.headers, response.body},
+                                       *target->cache, now);
+            sendCached(conn, cached, keep_alive, "MISS", now);
+            return true;
+        }
+        micro_.abandon(cache_key_);
+    }
+    sendRouteResponse(conn, keep_alive);
+    return true;
+}
+
+bool HttpHandler::cacheKey(const CachePolicy& policy) {
+    if (!micro_.enabled() || (request_.method != "GET" && request_.method != "HEAD") ||
+        request_.content_length > 0 || request_.chunked || !request_.header("Authorization").empty()) {
+        return false;
+    }
+    // HEAD和GET共用条目；请求头的值之间用换行分隔，合法的请求头里不会出现换行
+    cache_key_.assign("GET ");
+    cache_key_ += request_.target;
+    for (const std::string& name : policy.vary) {
+        cache_key_ += '\n';
+        cache_key_ += request_.header(name);
+    }
+    return true;
+}
+
+bool HttpHandler::waitForCache(Connection& conn) {
+    // 和process()里的分派顺序一致：统计页、指标和反向代理先于路由
+    if (!router_ || (!config_.stats_path.empty() && request_.path == config_.stats_path) ||
+        (!config_.metrics_path.empty() && request_.path == config_.metrics_path) || matchProxy(request_.path)) {
+        return false;
+    }
+    const RouteTarget* target = nullptr;
+    std::string_view allow;
+    if (router_->match(request_.method, request_.path, target, route_params_, allow) != Router::Match::Found ||
+        !target->cache || !cacheKey(*target->cache) || !micro_.pending(cache_key_, steadyNowMs())) {
+        return false;
+    }
+    // 请求留在缓冲区里，被唤醒时从头重新解析
+    conn.cache_wait.owner = &conn;
+    micro_.wait(cache_key_, conn.cache_wait);
+    conn.parser.reset();
+    return true;
+}
+
+bool HttpHandler::serveCached(Connection& conn, const RouteTarget& target, bool keep_alive, bool& fill) {
+    int64_t now = steadyNowMs();
+    std::shared_ptr<const CachedResponse> cached;
+    switch (micro_.lookup(cache_key_, now, cached)) {
+    case MicroCache::Lookup::Hit:
+        sendCached(conn, cached, keep_alive, "HIT", now);
+        return true;
+    case MicroCache::Lookup::Stale:
+        sendCached(conn, cached, keep_alive, "STALE", now);
+        return true;
+    case MicroCache::Lookup::Wait:
+        return false; // waitForCache已经拦下了这种请求，走到这里就不合并，照常生成
+    case MicroCache::Lookup::Fill:
+        break;
+    }
+    // 这个请求负责重新生成，生成期间同一个键的其他请求拿旧内容或者等它
+    // 协程路由只有GET请求生成缓存：HEAD请求时协程写的正文不发出，没法核对是否完整；有旧内容就给旧的
+    if (!target.coroutine || request_.method == "GET") {
+        fill = true;
+        return false;
+    }
+    micro_.abandon(cache_key_);
+    if (!cached) return false;
+    sendCached(conn, cached, keep_alive, "STALE", now);
+    return true;
+}
+
+void HttpHandler::sendCached(Connection& conn, const std::shared_ptr<const CachedResponse>& cached, bool keep_alive,
+                             std::string_view state, int64_t now_ms) {
+    extra_.assign(cached->headers);
+    extra_ += "Age: ";
+    appendDecimal(extra_, static_cast<uint64_t>(now_ms - cached->stored_ms) / 1000);
+    extra_ += "\r\nX-Cache: ";
+    extra_ += state;
+    extra_ += "\r\n";
+    head_.clear();
+    appendResponseHead(head_, cached->status, cached->content_type, cached->body.size(), keep_alive, extra_);
+    appendGenerated(conn, head_);
+    if (request_.method != "HEAD" && !cached->body.empty()) appendShared(conn, cached, cached->body);
+}
+
+void HttpHandler::sendRouteResponse(Connection& conn, bool keep_alive) {
+    RouteResponse& response = route_response_;
+    bool head_only = request_.method == "HEAD";
+    head_.clear();
+    if (!response.stream) {
+        appendResponseHead(head_, response.status, response.content_type, response.body.size(), keep_alive,
+                           response.headers);
+        if (!head_only) head_ += response.body;
+        appendGenerated(conn, head_);
+        return;
+    }
+
+    // 流式响应：长度事先不知道，HTTP/1.1用分块编码；HTTP/1.0只能不带长度、发完关闭连接
+    bool chunked = request_.version_minor >= 1;
+    if (!chunked) {
+        keep_alive = false;
+        conn.close_after_write = true;
+    }
+    appendStreamHead(head_, response.status, response.content_type, chunked, keep_alive, response.headers);
+    appendGenerated(conn, head_);
+    if (head_only) return;
+    conn.producer = std::move(response.stream);
+    conn.stream_chunked = chunked;
+    if (!response.body.empty()) {
+        conn.stream_data = response.body;
+        appendStreamPiece(conn, conn.stream_data);
+    }
+    // 后面的数据等这些发完、socket还能写时再生产
+    OutputChunk marker;
+    marker.stream = true;
+    conn.out.push_back(std::move(marker));
+}
+
+void HttpHandler::appendStreamPiece(Connection& conn, std::string_view data) {
+    if (!conn.stream_chunked) {
+        appendShared(conn, nullptr, data);
+        return;
+    }
+    head_.clear();
+    appendChunkSize(head_, data.size());
+    appendOwned(conn, head_);
+    appendShared(conn, nullptr, data);
+    appendShared(conn, nullptr, "\r\n");
+}
+
+void HttpHandler::produce(Connection& conn) {
+    // 记号之前的片段都已经发出，连同输出区一起清掉；上一段数据也发完了，stream_data可以重写
+    conn.out.clear();
+    conn.out_index = 0;
+    conn.out_storage.clear();
+    conn.stream_data.clear();
+    // 协程路由：上一次write的数据已经交给内核，协程从co_await返回
+    if (conn.co) {
+        resumeCoroutine(conn);
+        return;
+    }
+    bool more = conn.producer(conn.stream_data) && !conn.stream_data.empty();
+    if (!conn.stream_data.empty()) appendStreamPiece(conn, conn.stream_data);
+    if (more) {
+        OutputChunk marker;
+        marker.stream = true;
+        conn.out.push_back(std::move(marker));
+        return;
+    }
+    conn.producer = nullptr;
+    if (conn.stream_chunked) appendShared(conn, nullptr, kLastChunk);
+}
+
+bool HttpHandler::startStreaming(Connection& conn, size_t& pos) {
+    UpstreamGroup* upstream = matchProxy(request_.path);
+    const RouteTarget* target = nullptr;
+    std::string_view allow;
+    if (!upstream && (!router_ || router_->match(request_.method, request_.path, target, route_params_, allow) !=
+                                      Router::Match::Found || (!target->upload && !target->coroutine))) {
+        return false;
+    }
+    conn.request_start_us = steadyNowUs(); // 流式读取的请求从请求头收全算起，读请求体的时间也算在内
+    if (admission_.enabled() && !admission_.admitRequest(steadyNowMs())) {
+        // 过载：请求体不读了，回复503后关闭连接
+        size_t first = conn.out.size();
+        appendStatus(conn, kOverloadedStatus, false);
+        logRequest(conn, first, true);
+        conn.close_after_write = true;
+        return true;
+    }
+    bool expect = expectsContinue(request_);
+    if (upstream || target->coroutine) {
+        // 协程拿到请求头的拷贝，请求体由它自己read（反向代理边读边转给上游）；100 Continue排在协程写的任何东西前面
+        ++conn.requests;
+        conn.deadline = Deadline::Idle;
+        bool keep_alive = request_.keep_alive && config_.keepalive_timeout > 0 &&
+                          conn.requests < config_.max_requests;
+        CoConnection& co = startCoroutine(conn, keep_alive, true);
+        co.start(upstream ? proxyRequest(co, *upstream) : routeCoroutine(co, *target));
+        pos += conn.parser.headerLength();
+        conn.parser.streamBody();
+        if (expect) appendShared(conn, nullptr, kContinueResponse);
+        resumeCoroutine(conn);
+        return true;
+    }
+    std::unique_ptr<BodySink> sink = target->upload(request_, route_params_);
+    if (!sink) {
+        // 拒绝接收：请求体不读了，回复后关闭连接
+        size_t first = conn.out.size();
+        appendStatus(conn, "403 Forbidden", false);
+        logRequest(conn, first, true);
+        conn.close_after_write = true;
+        return true;
+    }
+    auto upload = std::make_unique<Upload>();
+    upload->sink = std::move(sink);
+    upload->method = request_.method;
+    upload->target = request_.target;
+    upload->version_minor = request_.version_minor;
+    upload->keep_alive = request_.keep_alive;
+    conn.upload = std::move(upload);
+    // 请求头用完就丢，之后缓冲区里只放还没交出去的请求体
+    pos += conn.parser.headerLength();
+    conn.parser.streamBody();
+    if (expect) appendShared(conn, nullptr, kContinueResponse);
+    return true;
+}
+
+bool HttpHandler::feedUpload(Connection& conn, size_t& pos) {
+    Upload& upload = *conn.upload;
+    std::string_view piece;
+    size_t used = 0;
+    ParseStatus status = conn.parser.parseBody(&conn.in[pos], conn.in.size() - pos, piece, used);
+    pos += used;
+    bool accepted = status == ParseStatus::Error || piece.empty() || upload.sink->write(piece);
+    if (status == ParseStatus::Incomplete && accepted) return false;
+
+    // 请求体读完、格式错误或BodySink不再接收：生成响应；后两种情况剩下的请求体没读，回复后关闭连接
+    // 请求头早已丢掉，回复和日志用留下来的请求行
+    request_.method = upload.method;
+    request_.target = upload.target;
+    request_.path = request_.target.substr(0, request_.target.find('?'));
+    request_.version_minor = upload.version_minor;
+    request_.header_count = 0;
+    ++conn.requests;
+    conn.deadline = Deadline::Idle;
+    size_t first = conn.out.size();
+    if (status == ParseStatus::Error) {
+        appendResponse(conn, errorResponse(conn.parser.errorStatus()));
+        conn.close_after_write = true;
+    } else {
+        bool keep_alive = accepted && upload.keep_alive && config_.keepalive_timeout > 0 &&
+                          conn.requests < config_.max_requests;
+        route_response_.reset();
+        upload.sink->finish(route_response_);
+        sendRouteResponse(conn, keep_alive);
+        if (!keep_alive) conn.close_after_write = true;
+    }
+    logRequest(conn, first, true);
+    conn.upload.reset();
+    conn.parser.reset();
+    return true;
+}
+
+UpstreamGroup* HttpHandler::matchProxy(std::string_view path) const {
+    for (const auto& upstream : upstreams_) {
+        if (upstream->matches(path)) return upstream.get();
+    }
+    return nullptr;
+}
+
+CoConnection& HttpHandler::startCoroutine(Connection& conn, bool keep_alive, bool has_body) {
+    conn.co = std::make_unique<CoConnection>(request_, has_body);
+    CoConnection& co = *conn.co;
+    co.keep_alive_ = keep_alive;
+    co.head_only_ = request_.method == "HEAD";
+    // 管道片段由epoll后端的flush用splice发送；TLS连接只有加密交给了内核（kTLS）才能直接splice
+    co.splice_ok_ = io_watcher_ && (!conn.tls || conn.tls.kernelSend());
+    return co;
+}
+
+Task HttpHandler::routeCoroutine(CoConnection& co, const RouteTarget& target) const {
+    // 路由参数指向请求路径，而连接缓冲区里的请求很快就会被丢掉：对拷贝出来的路径重新匹配一次
+    const RouteTarget* matched = nullptr;
+    std::string_view allow;
+    router_->match(co.request_.method, co.request_.path, matched, co.params_, allow);
+    return target.coroutine(co);
+}
+
+bool HttpHandler::feedCoroutine(Connection& conn, size_t& pos) {
+    CoConnection& co = *conn.co;
+    // 在等发送完成或定时器：请求体先留在缓冲区里
+    if (co.waiting() != CoConnection::Wait::Read) return false;
+    std::string_view piece;
+    size_t used = 0;
+    ParseStatus status = conn.parser.parseBody(&conn.in[pos], conn.in.size() - pos, piece, used);
+    pos += used;
+    if (status == ParseStatus::Error) {
+        // 请求体格式错误：协程直接销毁；响应头还没发出就回复错误状态，否则只能断开
+        if (!co.head_sent_) {
+            size_t first = conn.out.size();
+            request_.method = co.request_.method;
+            request_.target = co.request_.target;
+            request_.version_minor = co.request_.version_minor;
+            appendResponse(conn, errorResponse(conn.parser.errorStatus()));
+            logRequest(conn, first, true);
+        }
+        conn.co.reset();
+        conn.close_after_write = true;
+        return true;
+    }
+    if (status == ParseStatus::Incomplete && piece.empty()) return false;
+    co.deliver(piece, status == ParseStatus::Complete);
+    resumeCoroutine(conn);
+    return true;
+}
+
+void HttpHandler::resumeCoroutine(Connection& conn) {
+    CoConnection& co = *conn.co;
+    co.resume();
+    if (co.done()) {
+        finishCoroutine(conn);
+        return;
+    }
+    switch (co.waiting()) {
+    case CoConnection::Wait::Write:
+        writeCoroutine(conn);
+        break;
+    case CoConnection::Wait::Sleep:
+        // 事件循环随后调用updateDeadline，按这个时刻设置定时器
+        co.wake_at_ = steadyNowMs() + co.sleepMs();
+        break;
+    case CoConnection::Wait::Io:
+        // 交给事件循环监听；监听不了（io_uring后端没有实现）就让waitFd返回false，协程自己收场
+        if (io_watcher_ && io_watcher_(conn, co.ioFd(), co.ioWritable())) break;
+        co.ioFailed();
+        resumeCoroutine(conn);
+        break;
+    default:
+        break; // 等请求体：数据到了由feedCoroutine恢复
+    }
+}
+
+void HttpHandler::writeCoroutine(Connection& conn) {
+    CoConnection& co = *conn.co;
+    if (conn.fill) captureCoroutine(conn);
+    // 第一次write时发出响应头：长度不知道，和流式响应一样用分块编码，HTTP/1.0客户端不分块、发完关闭连接
+    // 协程事先给了长度（setContentLength）时带Content-Length、不分块
+    if (!co.head_sent_) {
+        RouteResponse& response = co.response_;
+        bool chunked = !co.has_length_ && co.request_.version_minor >= 1;
+        if (!chunked && !co.has_length_) co.keep_alive_ = false;
+        head_.clear();
+        if (co.has_length_) {
+            appendResponseHead(head_, response.status, response.content_type, co.content_length_, co.keep_alive_,
+                               response.headers);
+        } else {
+            appendStreamHead(head_, response.status, response.content_type, chunked, co.keep_alive_, response.headers);
+        }
+        appendGenerated(conn, head_);
+        co.bytes_ += head_.size();
+        co.head_sent_ = true;
+        conn.stream_chunked = chunked;
+        if (!co.head_only_ && !response.body.empty()) {
+            appendStreamPiece(conn, response.body);
+            co.bytes_ += response.body.size();
+            co.body_bytes_ += response.body.size();
+        }
+    }
+    if (!co.head_only_ && co.pendingPipe() != -1) {
+        // 管道里的数据由flush用splice直接发出，分块编码时前后照样加块头和块尾
+        size_t size = co.pendingWrite().size();
+        if (conn.stream_chunked) {
+            head_.clear();
+            appendChunkSize(head_, size);
+            appendOwned(conn, head_);
+        }
+        OutputChunk chunk;
+        chunk.iov.iov_len = size;
+        chunk.pipe = co.pendingPipe();
+        conn.out.push_back(std::move(chunk));
+        if (conn.stream_chunked) appendShared(conn, nullptr, "\r\n");
+        co.bytes_ += size;
+        co.body_bytes_ += size;
+    } else if (!co.head_only_) {
+        // 数据直接被iovec引用，协程在内核收下之前不会返回，局部变量一直有效；
+        // 只有read()读到的请求体在连接的输入缓冲区里，process()结束时会被移走，先拷进输出区
+        std::string_view data = co.pendingWrite();
+        const char* in = conn.in.data();
+        if (in && !std::less<const char*>()(data.data(), in) && std::less<const char*>()(data.data(), in + conn.in.size())) {
+            data = conn.out_storage.store(data);
+        }
+        appendStreamPiece(conn, data);
+        co.bytes_ += data.size();
+        co.body_bytes_ += data.size();
+    }
+    // 前面的数据都发出后，事件循环调用produce()，协程从write返回
+    OutputChunk marker;
+    marker.stream = true;
+    conn.out.push_back(std::move(marker));
+}
+
+void HttpHandler::finishCoroutine(Connection& conn) {
+    CoConnection& co = *conn.co;
+    // 请求体没有读完（剩下的还在路上，长度可能不知道）、协程抛了异常，或者写出的正文和声明的Content-Length
+    // 对不上（客户端没法判断响应在哪里结束）：回复后关闭连接
+    bool short_body = co.has_length_ && co.head_sent_ && !co.head_only_ && co.body_bytes_ != co.content_length_;
+    bool keep_alive = co.keep_alive_ && co.bodyDone() && !co.failed() && !short_body;
+    if (conn.fill) finishFill(conn, !co.failed() && !short_body);
+    std::string_view status = co.response_.status;
+    request_.method = co.request_.method;
+    if (co.failed() && !co.head_sent_) {
+        status = "500 Internal Server Error";
+        appendStatus(conn, status, false);
+    } else if (!co.head_sent_) {
+        // 一次也没有write：和普通路由一样带Content-Length一次发出；HEAD请求用协程声明的长度
+        RouteResponse& response = co.response_;
+        uint64_t length = co.has_length_ && co.head_only_ ? co.content_length_ : response.body.size();
+        head_.clear();
+        appendResponseHead(head_, response.status, response.content_type, length, keep_alive, response.headers);
+        if (!co.head_only_) head_ += response.body;
+        appendGenerated(conn, head_);
+        co.bytes_ += head_.size();
+    } else if (conn.stream_chunked && !co.head_only_ && !co.failed()) {
+        appendShared(conn, nullptr, kLastChunk);
+    }
+    if (!keep_alive) conn.close_after_write = true;
+    int code = status.size() >= 3 ? (status[0] - '0') * 100 + (status[1] - '0') * 10 + (status[2] - '0') : 0;
+    metrics_->request(code, co.bytes_, steadyNowUs() - conn.request_start_us);
+    if (access_log_) {
+        AccessRecord record;
+        fillAccessRecord(record, co.request_.method, co.request_.target, co.request_.version_minor, code, co.bytes_);
+        access_log_->push(record);
+    }
+    conn.co.reset();
+    conn.parser.reset();
+    conn.deadline = Deadline::Idle;
+}
+
+void HttpHandler::captureCoroutine(Connection& conn) {
+    CoConnection& co = *conn.co;
+    CacheFill& fill = *conn.fill;
+    if (!fill.started) {
+        const RouteResponse& response = co.response_;
+        fill.response.status = response.status;
+        fill.response.content_type = response.content_type;
+        fill.response.headers = response.headers;
+        fill.append(response.body);
+        fill.started = true;
+    }
+    if (co.done()) return;
+    if (co.pendingPipe() != -1) {
+        fill.overflow = true; // 管道里的数据不经过用户态，记不下来
+    } else {
+        fill.append(co.pendingWrite());
+    }
+}
+
+void HttpHandler::finishFill(Connection& conn, bool ok) {
+    CoConnection& co = *conn.co;
+    CacheFill& fill = *conn.fill;
+    captureCoroutine(conn); // 一次也没有write时，响应全在response里
+    const CachedResponse& response = fill.response;
+    if (ok && !fill.overflow && (!co.has_length_ || response.body.size() == co.content_length_) &&
+        MicroCache::cacheable(response.status, response.headers)) {
+        fill.commit(steadyNowMs());
+    }
+    conn.fill.reset(); // 没有放进缓存时放弃，唤醒等着的请求
+}
+
+void HttpHandler::upgradeWebSocket(Connection& conn, WebSocketHandler& handler, bool keep_alive) {
+    // RFC 6455 4.2.1：HTTP/1.1的GET，Upgrade里有websocket，Connection里有upgrade，版本13，Key是16字节的base64
+    if (request_.method != "GET" || request_.version_minor < 1 || !hasToken(request_.header("Upgrade"), "websocket") ||
+        !hasToken(request_.header("Connection"), "upgrade")) {
+        appendStatus(conn, "426 Upgrade Required", keep_alive, "Upgrade: websocket\r\n");
+        return;
+    }
+    if (request_.header("Sec-WebSocket-Version") != "13") {
+        appendStatus(conn, "426 Upgrade Required", keep_alive, "Sec-WebSocket-Version: 13\r\n");
+        return;
+    }
+    if (!webSocketAccept(request_.header("Sec-WebSocket-Key"), accept_)) {
+        appendStatus(conn, "400 Bad Request", keep_alive);
+        return;
+    }
+    if (!handler.accept(request_, route_params_)) {
+        appendStatus(conn, "403 Forbidden", keep_alive);
+        return;
+    }
+
+    // 没有协商子协议和扩展（permessage-deflate）：响应里不带，客户端按不压缩的帧收发
+    head_.assign("HTTP/1.1 101 Switching Protocols\r\n");
+    head_ += kServerHeader;
+    head_ += "Upgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: ";
+    head_ += accept_;
+    head_ += "\r\n\r\n";
+    appendGenerated(conn, head_);
+    conn.ws = std::make_unique<WebSocketState>(conn, handler, websockets_);
+    WebSocket socket(conn);
+    handler.onOpen(socket);
+}
+
+bool HttpHandler::feedWebSocket(Connection& conn, size_t& pos) {
+    WebSocketState& ws = *conn.ws;
+    WebSocket socket(conn);
+    WebSocketFrame frame;
+    char* data = &conn.in[pos];
+    FrameStatus status = parseWebSocketFrame(data, conn.in.size() - pos, frame);
+    if (status == FrameStatus::Incomplete) return false;
+    if (status == FrameStatus::Error) {
+        socket.close(frame.error);
+        return true;
+    }
+    pos += frame.header_size + frame.payload_size;
+    ws.ping_sent = false; // 对方还活着
+
+    // 载荷在缓冲区里原地去掩码，完整的单帧消息直接以string_view交给handler，不拷贝
+    char* payload = data + frame.header_size;
+    size_t size = frame.payload_size;
+    unmaskPayload(payload, size, frame.mask);
+    std::string_view body(payload, size);
+
+    switch (frame.opcode) {
+    case WsOpcode::Ping:
+        if (!ws.close_sent) appendWebSocketFrame(conn, WsOpcode::Pong, body);
+        return true;
+    case WsOpcode::Pong:
+        return true;
+    case WsOpcode::Close: {
+        // 关闭码可以没有；有的话必须合法，后面的原因必须是UTF-8
+        uint16_t code = kCloseNoStatus;
+        if (size >= 2) {
+            code = static_cast<uint16_t>(static_cast<uint8_t>(payload[0]) << 8 | static_cast<uint8_t>(payload[1]));
+        }
+        if (size == 1 || (size >= 2 && !validCloseCode(code))) {
+            socket.close(kCloseProtocolError);
+            return true;
+        }
+        if (size > 2 && !validUtf8(body.substr(2))) {
+            socket.close(kCloseInvalidData);
+            return true;
+        }
+        // 回一个带同样关闭码的Close，发完就关闭连接
+        ws.close_code = code;
+        if (!ws.close_sent) appendWebSocketFrame(conn, WsOpcode::Close, body.substr(0, size >= 2 ? 2 : 0));
+        ws.close_sent = true;
+        conn.close_after_write = true;
+        return true;
+    }
+    case WsOpcode::Text:
+    case WsOpcode::Binary:
+        if (ws.message_opcode != WsOpcode::Continuation) {
+            socket.close(kCloseProtocolError); // 上一条分片消息还没结束
+            return true;
+        }
+        if (frame.fin) {
+            deliverMessage(conn, frame.opcode, body);
+            return true;
+        }
+        ws.message_opcode = frame.opcode;
+        ws.message.assign(body);
+        return true;
+    case WsOpcode::Continuation:
+        if (ws.message_opcode == WsOpcode::Continuation) {
+            socket.close(kCloseProtocolError); // 没有可以接续的消息
+            return true;
+        }
+        if (ws.message.size() + size > kMaxWebSocketMessage) {
+            socket.close(kCloseTooBig);
+            return true;
+        }
+        ws.message.append(body);
+        if (frame.fin) {
+            deliverMessage(conn, ws.message_opcode, ws.message);
+            // 拼接区用完就还掉，空闲连接不留着它
+            std::string().swap(ws.message);
+            ws.message_opcode = WsOpcode::Continuation;
+        }
+        return true;
+    }
+    return true;
+}
+
+void HttpHandler::deliverMessage(Connection& conn, WsOpcode opcode, std::string_view message) {
+    WebSocket socket(conn);
+    bool binary = opcode == WsOpcode::Binary;
+    if (!binary && !validUtf8(message)) {
+        socket.close(kCloseInvalidData);
+        return;
+    }
+    if (conn.ws->close_sent) return;
+    conn.ws->handler->onMessage(socket, message, binary);
+}
+
+bool HttpHandler::resumeIo(Connection& conn) {
+    if (!conn.co || conn.co->waiting() != CoConnection::Wait::Io) return false;
+    resumeCoroutine(conn);
+    return true;
+}
+
+bool HttpHandler::readPaused(const Connection& conn) const {
+    return conn.co && conn.co->waiting() != CoConnection::Wait::Read && conn.in.size() >= kIoBufferSize;
+}
+
+bool HttpHandler::handleDeadline(Connection& conn) {
+    // 发送中到期的是发送超时，直接关闭
+    if (conn.state != ConnState::Reading) return false;
+    if (conn.deadline == Deadline::Wake && conn.co) {
+        resumeCoroutine(conn);
+        return true;
+    }
+    // 空闲的WebSocket连接：上次的Ping还没回音就放弃这个连接
+    if (!conn.ws || conn.ws->ping_sent) return false;
+    WebSocket socket(conn);
+    if (!socket.ping()) return false;
+    conn.ws->ping_sent = true;
+    return true;
+}
+
+void HttpHandler::serveStatic(Connection& conn, bool keep_alive) {
+    if (request_.method != "GET" && request_.method != "HEAD") {
+        appendStatus(conn, "405 Method Not Allowed", keep_alive, "Allow: GET, HEAD\r\n");
+        return;
+    }
+    // 路径放在复用的成员里，容量保留下来，稳定运行时不再分配内存
+    if (!decodePath(request_.path, url_path_)) {
+        appendStatus(conn, "400 Bad Request", keep_alive);
+        return;
+    }
+    path_.assign(config_.root);
+    path_ += url_path_;
+    std::shared_ptr<const OpenFile> file = files_.open(path_);
+    if (!file) {
+        bool missing = errno == ENOENT || errno == ENOTDIR || errno == ENAMETOOLONG;
+        appendStatus(conn, missing ? "404 Not Found" : "403 Forbidden", keep_alive);
+        return;
+    }
+    if (!S_ISDIR(file->st.st_mode)) {
+        serveFile(conn, file, path_, keep_alive);
+        return;
+    }
+
+    // 目录：没有以'/'结尾时重定向，保证页面里的相对链接正确；有index.html就返回它，否则列出目录内容
+    if (url_path_.back() != '/') {
+        std::string location = "Location: ";
+        appendUrlEncoded(location, url_path_);
+        location += "/\r\n";
+        appendStatus(conn, "301 Moved Permanently", keep_alive, location);
+        return;
+    }
+    std::string index_path = path_;
+    index_path += kIndexFile;
+    std::shared_ptr<const OpenFile> index = files_.open(index_path);
+    if (index && S_ISREG(index->st.st_mode)) {
+        serveFile(conn, index, index_path, keep_alive);
+        return;
+    }
+    serveDirectory(conn, path_, url_path_, keep_alive);
+}
+
+void HttpHandler::serveFile(Connection& conn, const std::shared_ptr<const OpenFile>& file, const std::string& path,
+                            bool keep_alive) {
+    std::string_view type = mimeType(path);
+
+    // 1. 选出要返回的表示。可压缩的类型且客户端接受压缩时，优先用磁盘上的.br/.gz预压缩文件，
+    //    其次用后台压缩好的缓存；都没有时返回原文件，请求路径上从不压缩
+    std::shared_ptr<const OpenFile> source = file;   // 正文来自哪个文件
+    const std::string* hot_key = &path;               // 在热点缓存里的键
+    std::string sibling_path;
+    std::string variant_key;
+    std::shared_ptr<const CachedFile> compressed;
+    std::string_view encoding;
+    if (compressibleType(type)) {
+        std::string_view accept = request_.header("Accept-Encoding");
+        for (Encoding candidate : {Encoding::Brotli, Encoding::Gzip}) {
+            std::string_view name = encodingName(candidate);
+            if (!acceptsEncoding(accept, name)) continue;
+            sibling_path = path;
+            sibling_path += encodingSuffix(candidate);
+            std::shared_ptr<const OpenFile> sibling = files_.open(sibling_path);
+            // 比原文件旧的预压缩文件已经过期，不能用
+            if (sibling && S_ISREG(sibling->st.st_mode) && !olderThan(sibling->st, file->st)) {
+                source = std::move(sibling);
+                // 响应头（类型、编码、ETag）来自原文件，不能和直接请求.br/.gz文件的响应共用一个条目：
+                // 按原文件路径加编码存放，文件路径里不会有'\0'
+                variant_key = path;
+                variant_key += '\0';
+                variant_key += name;
+                hot_key = &variant_key;
+                encoding = name;
+                break;
+            }
+            if (compressor_ && (compressed = compressor_->find(path, *file, candidate))) {
+                encoding = name;
+                break;
+            }
+        }
+    }
+
+    // 2. 条件请求：客户端缓存的版本仍然有效时只回304，不带正文
+    //    校验器在文件打开时已经算好，这里只做字符串比较
+    std::string_view if_none_match = request_.header("If-None-Match");
+    std::string_view if_modified_since = request_.header("If-Modified-Since");
+    if (!if_none_match.empty() || !if_modified_since.empty()) {
+        std::string etag = variantEtag(file->etag, encoding);
+        if (notModified(if_none_match, if_modified_since, etag, *file)) {
+            appendGenerated(conn, notModifiedHead(keep_alive, contentHeaders(type, {}, etag, file->last_modified)));
+            return;
+        }
+    }
+
+    // 3. 范围请求：只对GET生效，区间针对选中的这个表示（压缩版本就是压缩后的字节）
+    std::string_view range = request_.header("Range");
+    if (!range.empty() && request_.method == "GET") {
+        std::string etag = variantEtag(file->etag, encoding);
+        uint64_t size = compressed ? compressed->body().size() : static_cast<uint64_t>(source->st.st_size);
+        RangeResult result = ifRangeMatches(request_.header("If-Range"), etag, *file)
+                                 ? parseRanges(range, size, ranges_) : RangeResult::Ignore;
+        if (result == RangeResult::Unsatisfiable) {
+            std::string unsatisfied = "Content-Range: bytes */" + std::to_string(size) + "\r\n";
+            appendStatus(conn, "416 Range Not Satisfiable", keep_alive, unsatisfied);
+            return;
+        }
+        if (result == RangeResult::Satisfiable) {
+            sendRanges(conn, source, compressed, size, type,
+                       contentHeaders(type, encoding, etag, file->last_modified), keep_alive);
+            return;
+        }
+    }
+
+    // 4. 返回完整内容
+    if (compressed) {
+        appendCached(conn, compressed, keep_alive);
+    } else {
+        sendVariant(conn, source, *hot_key, *file, type, encoding, keep_alive);
+    }
+}
+
+void HttpHandler::sendVariant(Connection& conn, const std::shared_ptr<const OpenFile>& file, const std::string& key,
+                              const OpenFile& original, std::string_view type, std::string_view encoding,
+                              bool keep_alive) {
+    // 1. 热点小文件：响应头和正文在一块连续内存里，keep-alive时整个响应只是状态行+Date和其余部分两个iovec
+    if (hot_.cacheable(file->st)) {
+        std::shared_ptr<const CachedFile> cached = hot_.find(key, file->st);
+        if (!cached) cached = loadHotFile(key, *file, original, type, encoding);
+        if (cached) {
+            appendCached(conn, cached, keep_alive);
+            return;
+        }
+    }
+
+    // 2. 其他文件：头部在内存里，正文是文件片段，发送时交给sendfile
+    //    头部在复用的成员字符串里拼好再拷进连接的输出区，不分配内存
+    auto size = static_cast<uint64_t>(file->st.st_size);
+    etag_.clear();
+    appendVariantEtag(etag_, original.etag, encoding);
+    extra_.clear();
+    appendContentHeaders(extra_, type, encoding, etag_, original.last_modified);
+    head_.clear();
+    appendResponseHead(head_, "200 OK", type, size, keep_alive, extra_);
+    appendGenerated(conn, head_);
+    if (request_.method == "GET") appendFile(conn, file, 0, static_cast<size_t>(size));
+}
+
+void HttpHandler::appendCached(Connection& conn, const std::shared_ptr<const CachedFile>& cached, bool keep_alive) {
+    bool get = request_.method == "GET";
+    if (keep_alive) {
+        std::string_view data = cached->data;
+        appendPrebuilt(conn, cached, get ? data : data.substr(0, cached->body_offset));
+        return;
+    }
+    appendPrebuilt(conn, cached, cached->close_head);
+    if (get && !cached->body().empty()) appendShared(conn, cached, cached->body());
+}
+
+void HttpHandler::sendRanges(Connection& conn, const std::shared_ptr<const OpenFile>& file,
+                             const std::shared_ptr<const CachedFile>& compressed, uint64_t size,
+                             std::string_view type, std::string_view extra_headers, bool keep_alive) {
+    auto appendBody = [&](const ByteRange& range) {
+        auto length = static_cast<size_t>(range.last - range.first + 1);
+        if (compressed) {
+            appendShared(conn, compressed, compressed->body().substr(static_cast<size_t>(range.first), length));
+        } else {
+            appendFile(conn, file, static_cast<off_t>(range.first), length);
+        }
+    };
+
+    // 1. 单个区间：206加Content-Range，正文就是sendfile从偏移处开始的一段
+    if (ranges_.size() == 1) {
+        const ByteRange& range = ranges_.front();
+        std::string extra(extra_headers);
+        extra += contentRange(range.first, range.last, size);
+        appendGenerated(conn, responseHead("206 Partial Content", type, range.last - range.first + 1, keep_alive, extra));
+        appendBody(range);
+        return;
+    }
+
+    // 2. 多个区间：multipart/byteranges，每段前面是分隔符和段头部
+    //    段头部都在内存里，和文件片段交替排进输出队列，发送时内存片段由writev合并
+    char boundary[32];
+    snprintf(boundary, sizeof(boundary), "%020llu", static_cast<unsigned long long>(++boundary_));
+    std::vector<std::string> part_heads;
+    part_heads.reserve(ranges_.size());
+    uint64_t length = 0;
+    for (const ByteRange& range : ranges_) {
+        std::string head = "\r\n--";
+        head += boundary;
+        head += "\r\nContent-Type: ";
+        head += type;
+        head += "\r\n";
+        head += contentRange(range.first, range.last, size);
+        head += "\r\n";
+        length += head.size() + (range.last - range.first + 1);
+        part_heads.push_back(std::move(head));
+    }
+    std::string tail = "\r\n--";
+    tail += boundary;
+    tail += "--\r\n";
+    length += tail.size();
+
+    std::string multipart_type = "multipart/byteranges; boundary=";
+    multipart_type += boundary;
+    appendGenerated(conn, responseHead("206 Partial Content", multipart_type, length, keep_alive, extra_headers));
+    for (size_t i = 0; i < ranges_.size(); ++i) {
+        appendOwned(conn, part_heads[i]);
+        appendBody(ranges_[i]);
+    }
+    appendOwned(conn, tail);
+}
+
+std::shared_ptr<const CachedFile> HttpHandler::loadHotFile(const std::string& key, const OpenFile& file,
+                                                           const OpenFile& original, std::string_view type,
+                                                           std::string_view encoding) {
+    // 文件只有几十KB且多半已在页缓存里，第一次请求时直接读进来
+    CachedFile cached;
+    cached.st = file.st;
+    auto size = static_cast<size_t>(file.st.st_size);
+    // 预压缩文件的校验器来自原文件，这样不同来源的同一编码版本ETag一致
+    std::string extra = contentHeaders(type, encoding, variantEtag(original.etag, encoding), original.last_modified);
+    cached.data = responseHead("200 OK", type, size, true, extra);
+    cached.close_head = responseHead("200 OK", type, size, false, extra);
+    cached.body_offset = cached.data.size();
+    cached.data.resize(cached.body_offset + size);
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = pread(file.fd, &cached.data[cached.body_offset + done], size - done, static_cast<off_t>(done));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return nullptr; // 读的过程中文件被截短，这次走sendfile
+        done += static_cast<size_t>(n);
+    }
+    return hot_.insert(key, std::move(cached));
+}
+
+void HttpHandler::serveDirectory(Connection& conn, const std::string& dir, std::string_view url_path,
+                                 bool keep_alive) {
+    DIR* handle = opendir(dir.c_str());
+    if (!handle) {
+        appendStatus(conn, "403 Forbidden", keep_alive);
+        return;
+    }
+    std::vector<std::string> names;
+    while (dirent* entry = readdir(handle)) {
+        std::string_view name = entry->d_name;
+        if (name == "." || name == "..") continue;
+        std::string display(name);
+        if (entry->d_type == DT_DIR) display += '/';
+        names.push_back(std::move(display));
+    }
+    closedir(handle);
+    std::sort(names.begin(), names.end());
+
+    std::string body = "<html>\n<head>\n<meta charset=\"utf-8\">\n<title>";
+    appendEscaped(body, url_path);
+    body += "</title>\n</head>\n<body>\n<h1>目录 ";
+    appendEscaped(body, url_path);
+    body += "</h1>\n<ul>\n";
+    if (url_path != "/") body += "<li><a href=\"../\">../</a></li>\n";
+    for (const std::string& name : names) {
+        body += "<li><a href=\"";
+        appendUrlEncoded(body, name);
+        body += "\">";
+        appendEscaped(body, name);
+        body += "</a></li>\n";
+    }
+    body += "</ul>\n</body>\n</html>\n";
+
+    head_.clear();
+    listing_head_.append(head_, date_.line(), body.size(), keep_alive);
+    if (request_.method == "GET") head_ += body;
+    appendOwned(conn, head_);
+}
@@ -0,0 +1,215 @@
+#ifndef HTTP_HANDLER_H
+#define HTTP_HANDLER_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "access_log.h"
+#include "admission.h"
+#include "compressor.h"
+#include "config.h"
+#include "connection.h"
+#include "file_cache.h"
+#include "hot_cache.h"
+#include "http_parser.h"
+#include "http_response.h"
+#include "metrics.h"
+#include "microcache.h"
+#include "proxy.h"
+#include "router.h"
+#include "websocket_hub.h"
+
+// Range请求里的一个字节区间，两端都包含
+struct ByteRange {
+    uint64_t first;
+    uint64_t last;
+};
+
+// HTTP请求处理：从连接的输入缓冲区切出完整请求并生成响应，epoll和io_uring后端共用
+// 每个Reactor线程持有自己的一份，线程之间不共享
+class HttpHandler {
+public:
+    // compressor为进程共用的后台压缩器，可以为空（不做后台压缩，只使用磁盘上的.br/.gz文件）
+    // access_log是本线程的访问日志队列，为空时不记录
+    // router是进程共用的只读路由表，可以为空；没有路由匹配的请求照旧交给静态文件或内置页面
+    // websockets是本线程的WebSocket连接表和广播邮箱，可以为空（WebSocket照常工作，只是收不到广播）
+    // metrics是本线程的指标计数器，不能为空
+    HttpHandler(const ServerConfig& config, const std::string& html_body, Compressor* compressor,
+                AccessLogRing* access_log, const Router* router, WebSocketGroup* websockets,
+                MetricsShard* metrics);
+
+    // 处理conn.in中所有已经完整到达的请求（HTTP/1.1流水线），响应追加到conn.out
+    // 遇到Connection: close、达到单连接请求数上限或请求格式错误时设置conn.close_after_write
+    void process(Connection& conn);
+
+    // 流式响应：事件循环发到out末尾的流式记号（前面的片段都已发出）时调用，
+    // 清掉已发送的片段，向生产者要下一段追加到conn.out；生产者结束时追加结尾的空块
+    void produce(Connection& conn);
+
+    // 事件循环每次醒来时调用，跨过一秒时重新生成缓存的Date头部
+    void refreshDate() { date_.refresh(); }
+
+    // 本Reactor的准入控制：事件循环在等待前后通知它，accept到新连接时问它要不要放行
+    AdmissionControl& admission() { return admission_; }
+    // 过载时刚accept的连接：回复503（带Retry-After）后关闭，不创建连接对象；plaintext为false（HTTPS）时直接关闭
+    void rejectConnection(int fd, bool plaintext);
+
+    // 按连接当前的读写进度设置它在时间轮上的期限，事件循环每次读写告一段落后调用
+    void updateDeadline(Connection& conn, TimerWheel& timers) const;
+    // 连接的期限到了：sleep中的协程恢复执行，空闲的WebSocket连接第一次到期时发一个Ping，
+    // 返回true表示连接保留（输出队列里可能有数据要发）；其他情况返回false，事件循环关闭连接
+    bool handleDeadline(Connection& conn);
+
+    WebSocketGroup* websockets() const { return websockets_; }
+    // 本线程的指标计数器，事件循环在这里记连接数和收发的字节数
+    MetricsShard& metrics() { return *metrics_; }
+
+    // 协程co_await waitFd()时由事件循环监听那个fd（反向代理的上游连接），事件到了调用resumeIo()
+    // 事件循环设置watcher才支持，否则waitFd直接返回false；watcher返回false表示监听失败
+    void setIoWatcher(std::function<bool(Connection& conn, int fd, bool writable)> watcher) {
+        io_watcher_ = std::move(watcher);
+    }
+    // 协程在等的fd有事件了：恢复协程，返回false表示它已经不在等（旧事件），什么也不用做
+    bool resumeIo(Connection& conn);
+    // 协程暂时不读请求体（在等上游或者发送），缓冲区里又已经攒了一块：事件循环先别往里读，
+    // 否则上传的速度比上游收得快时请求体会堆在内存里。协程回头等read()时事件循环会接着读
+    bool readPaused(const Connection& conn) const;
+
+    // 在等微缓存条目的连接：条目生成完（或者生成失败）后，事件循环在一批事件处理完时把它们逐个交给fn，
+    // fn像收到新数据一样处理连接缓冲区里的请求，这时多半直接命中
+    template <typename Fn>
+    void wakeCacheWaiters(Fn&& fn) {
+        micro_.wake([&fn](void* owner) { fn(*static_cast<Connection*>(owner)); });
+    }
+
+    // 事件循环提供本Reactor的统计（连接对象池、缓冲区池等），按“名字 数值”逐行追加到out
+    // 配置了统计路径（-s）时，请求这个路径返回这些内容
+    void setStatsSource(std::function<void(std::string& out)> source) { stats_source_ = std::move(source); }
+
+    const ServerConfig& config() const { return config_; }
+
+private:
+    void appendResponse(Connection& conn, const std::string& response);
+    // 完整的响应或响应头（以状态行开头）：状态行和Date拷进连接的输出区，其余部分引用owner持有的内存
+    void appendPrebuilt(Connection& conn, std::shared_ptr<const void> owner, std::string_view response);
+    // 本次请求现拼的响应或响应头：插入Date后整段拷进连接的输出区
+    void appendGenerated(Connection& conn, std::string_view response);
+    void appendOwned(Connection& conn, std::string_view data);
+    void appendShared(Connection& conn, std::shared_ptr<const void> owner, std::string_view data);
+    void appendFile(Connection& conn, std::shared_ptr<const OpenFile> file, off_t offset, size_t length);
+    void appendStatus(Connection& conn, std::string_view status, bool keep_alive, std::string_view extra_headers = {});
+    const std::string& errorResponse(int status) const;
+    // 为刚生成的响应（conn.out中从first开始的片段）记一条访问日志，计入请求指标
+    void logRequest(const Connection& conn, size_t first, bool parsed);
+
+    void serveStats(Connection& conn, bool keep_alive);
+    // 所有Reactor合并后的指标，Prometheus文本格式
+    void serveMetrics(Connection& conn, bool keep_alive);
+    // 按注册的路由处理，没有匹配的路由时返回false
+    bool serveRoute(Connection& conn, bool keep_alive);
+    // 请求能不能用微缓存（GET/HEAD、没有请求体、没有Authorization），能用时把缓存键拼在cache_key_里
+    bool cacheKey(const CachePolicy& policy);
+    // 请求收全、还没处理时检查：它要的缓存条目正由别的请求生成、又没有旧内容可给时挂到条目上等，返回true
+    bool waitForCache(Connection& conn);
+    // 打开了微缓存的路由：命中或者给了旧内容时返回true；否则返回false由调用方生成响应，
+    // fill为true表示生成的响应要放进缓存（键在cache_key_里）
+    bool serveCached(Connection& conn, const RouteTarget& target, bool keep_alive, bool& fill);
+    // 发送缓存的响应：头部现拼（带Age和X-Cache），正文引用缓存的内存
+    void sendCached(Connection& conn, const std::shared_ptr<const CachedResponse>& cached, bool keep_alive,
+                    std::string_view state, int64_t now_ms);
+    // 协程的响应头和这次write的数据记进conn.fill
+    void captureCoroutine(Connection& conn);
+    // 协程结束：能缓存就放进缓存，否则放弃；ok为false表示协程失败或者正文不完整
+    void finishFill(Connection& conn, bool ok);
+    // 发送route_response_：普通响应一次拼好；流式响应发出响应头后把生产者交给连接
+    void sendRouteResponse(Connection& conn, bool keep_alive);
+    // 流式响应的一段数据（引用data，不拷贝），分块编码时加上块头和块尾
+    void appendStreamPiece(Connection& conn, std::string_view data);
+    // 请求头刚收全：匹配到上传路由或协程路由时改为流式读取请求体，pos跳过请求头，返回true
+    bool startStreaming(Connection& conn, size_t& pos);
+    // 把缓冲区里的请求体交给BodySink；请求体读完（或出错）并生成响应后返回true，否则等待更多数据
+    bool feedUpload(Connection& conn, size_t& pos);
+    // 路径匹配的反向代理规则，没有返回空
+    UpstreamGroup* matchProxy(std::string_view path) const;
+    // 为协程路由或反向代理创建协程的连接，随后由调用方start()、resumeCoroutine()开始执行
+    CoConnection& startCoroutine(Connection& conn, bool keep_alive, bool has_body);
+    // 协程路由的根协程：路由参数改为指向协程留的请求拷贝
+    Task routeCoroutine(CoConnection& co, const RouteTarget& target) const;
+    // 协程在等请求体时把缓冲区里的下一段交给它；协程在等别的东西或者数据不够时返回false
+    bool feedCoroutine(Connection& conn, size_t& pos);
+    // 恢复协程执行，然后按它停下的原因处理：write的数据排进输出队列，sleep记下到期时刻，
+    // waitFd交给事件循环监听，结束时补上响应的结尾
+    void resumeCoroutine(Connection& conn);
+    void writeCoroutine(Connection& conn);
+    void finishCoroutine(Connection& conn);
+    // GET请求匹配到WebSocket路由：合法的升级请求回复101并切换协议，否则回复400/426
+    void upgradeWebSocket(Connection& conn, WebSocketHandler& handler, bool keep_alive);
+    // 从缓冲区里取一个完整的帧处理：回复Ping和Close，拼接分片，把完整的消息交给handler
+    // 帧还没收全返回false
+    bool feedWebSocket(Connection& conn, size_t& pos);
+    void deliverMessage(Connection& conn, WsOpcode opcode, std::string_view message);
+    // 静态文件模式：把请求路径映射到根目录下的文件、目录索引页或目录列表
+    void serveStatic(Connection& conn, bool keep_alive);
+    void serveFile(Connection& conn, const std::shared_ptr<const OpenFile>& file, const std::string& path,
+                   bool keep_alive);
+    // key是热点缓存里的键：原文件就是它的路径，预压缩文件是原文件路径加编码
+    void sendVariant(Connection& conn, const std::shared_ptr<const OpenFile>& file, const std::string& key,
+                     const OpenFile& original, std::string_view type, std::string_view encoding, bool keep_alive);
+    void appendCached(Connection& conn, const std::shared_ptr<const CachedFile>& cached, bool keep_alive);
+    // 正文来自文件（compressed为空，走sendfile）或后台压缩的缓存（引用其内存）
+    void sendRanges(Connection& conn, const std::shared_ptr<const OpenFile>& file,
+                    const std::shared_ptr<const CachedFile>& compressed, uint64_t size, std::string_view type,
+                    std::string_view extra_headers, bool keep_alive);
+    std::shared_ptr<const CachedFile> loadHotFile(const std::string& key, const OpenFile& file,
+                                                  const OpenFile& original, std::string_view type,
+                                                  std::string_view encoding);
+    void serveDirectory(Connection& conn, const std::string& dir, std::string_view url_path, bool keep_alive);
+
+    ServerConfig config_;
+    Compressor* compressor_;
+    AccessLogRing* access_log_;
+    MetricsShard* metrics_;
+    const Router* router_;
+    WebSocketGroup* websockets_;
+    AdmissionControl admission_;
+    std::function<void(std::string&)> stats_source_;
+    std::function<bool(Connection&, int, bool)> io_watcher_;
+    std::vector<std::unique_ptr<UpstreamGroup>> upstreams_;   // 反向代理规则，协程持有引用，地址不能变
+    HttpRequest request_;   // 解析结果的暂存区，只在process()内部使用
+    FileCache files_;       // 打开的文件描述符和stat结果
+    HotCache hot_;          // 热点小文件的完整响应
+    MicroCache micro_;      // 动态路由的响应
+    std::string cache_key_; // 微缓存的键，重复使用避免每次分配
+    std::string url_path_;           // 解码后的请求路径
+    std::string path_;               // 对应的文件系统路径
+    std::string etag_, extra_, head_; // 拼响应头用的临时缓冲区
+    std::string accept_;             // Sec-WebSocket-Accept
+    std::vector<ByteRange> ranges_;  // Range头部的解析结果，重复使用避免每次分配
+    RouteParams route_params_;       // 路由参数，指向请求路径
+    RouteResponse route_response_;   // 路由处理函数填写的响应，重复使用
+    uint64_t boundary_ = 0;          // multipart/byteranges分隔符的序号
+    DateCache date_;                 // 本线程的Date头部行，每秒最多格式化一次
+    HeadTemplate stats_head_;        // 统计页和目录列表的响应头模板，只有长度每次不同
+    HeadTemplate listing_head_;
+    HeadTemplate metrics_head_;      // /metrics，Prometheus文本格式的Content-Type
+    // 响应预先拼好，同一份内存被所有连接的iovec引用，发送时无需拷贝
+    std::string keep_alive_response_;
+    std::string close_response_;
+    std::string bad_request_response_;       // 400
+    std::string payload_too_large_response_; // 413
+    std::string header_too_large_response_;  // 431
+    std::string not_implemented_response_;   // 501
+    // 常见状态页（400/403/404，以及带Retry-After的503，放在最后），长连接和Connection: close各一份
+    struct StatusPage {
+        std::string_view status;
+        std::string keep_alive;
+        std::string close;
+    };
+    std::vector<StatusPage> status_pages_;
+};
+
+#endif // HTTP_HANDLER_H
@@ -0,0 +1,487 @@
+#include "http_parser.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// ---- SIMD分隔符扫描 ----
+// 逐字节比较换成一次比较16(SSE2)或32(AVX2)字节，用movemask+ctz直接定位第一个匹配
+
+// 找第一个等于c的字节，找不到返回end
+const char* findByte(const char* p, const char* end, char c) {
+#if defined(__AVX2__)
+    const __m256i v = _mm256_set1_epi8(c);
+    for (; end - p >= 32; p += 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, v)));
+        if (mask) return p + __builtin_ctz(mask);
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i v16 = _mm_set1_epi8(c);
+    for (; end - p >= 16; p += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, v16)));
+        if (mask) return p + __builtin_ctz(mask);
+    }
+#endif
+    for (; p < end; ++p) {
+        if (*p == c) return p;
+    }
+    return end;
+}
+
+// 找第一个等于a或b的字节，找不到返回end
+const char* findByte2(const char* p, const char* end, char a, char b) {
+#if defined(__AVX2__)
+    const __m256i va = _mm256_set1_epi8(a);
+    const __m256i vb = _mm256_set1_epi8(b);
+    for (; end - p >= 32; p += 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i hit = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, va), _mm256_cmpeq_epi8(chunk, vb));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(hit));
+        if (mask) return p + __builtin_ctz(mask);
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i va16 = _mm_set1_epi8(a);
+    const __m128i vb16 = _mm_set1_epi8(b);
+    for (; end - p >= 16; p += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i hit = _mm_or_si128(_mm_cmpeq_epi8(chunk, va16), _mm_cmpeq_epi8(chunk, vb16));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(hit));
+        if (mask) return p + __builtin_ctz(mask);
+    }
+#endif
+    for (; p < end; ++p) {
+        if (*p == a || *p == b) return p;
+    }
+    return end;
+}
+
+// 找第一个控制字符（0x00-0x1f中除'\t'以外的字节，以及0x7f），找不到返回end
+// 头部值合法时第一个控制字符就是行尾的'\r'，一遍扫描同时完成定位和校验
+const char* findControl(const char* p, const char* end) {
+#if defined(__AVX2__)
+    const __m256i limit = _mm256_set1_epi8(0x1f);
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i del = _mm256_set1_epi8(0x7f);
+    for (; end - p >= 32; p += 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i ctl = _mm256_cmpeq_epi8(_mm256_min_epu8(chunk, limit), chunk); // 无符号 <= 0x1f
+        __m256i hit = _mm256_or_si256(_mm256_andnot_si256(_mm256_cmpeq_epi8(chunk, tab), ctl),
+                                      _mm256_cmpeq_epi8(chunk, del));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(hit));
+        if (mask) return p + __builtin_ctz(mask);
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i limit16 = _mm_set1_epi8(0x1f);
+    const __m128i tab16 = _mm_set1_epi8('\t');
+    const __m128i del16 = _mm_set1_epi8(0x7f);
+    for (; end - p >= 16; p += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i ctl = _mm_cmpeq_epi8(_mm_min_epu8(chunk, limit16), chunk);
+        __m128i hit = _mm_or_si128(_mm_andnot_si128(_mm_cmpeq_epi8(chunk, tab16), ctl),
+                                   _mm_cmpeq_epi8(chunk, del16));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(hit));
+        if (mask) return p + __builtin_ctz(mask);
+    }
+#endif
+    for (; p < end; ++p) {
+        unsigned char c = static_cast<unsigned char>(*p);
+        if ((c < 0x20 && c != '\t') || c == 0x7f) return p;
+    }
+    return end;
+}
+
+char lower(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+}
+
+// 不区分大小写比较，b必须是小写
+bool equalsLower(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (lower(a[i]) != b[i]) return false;
+    }
+    return true;
+}
+
+// RFC 9110 token字符表，编译期生成，判断一个字符只需一次查表
+struct TokenTable {
+    bool allowed[256];
+    constexpr TokenTable() : allowed() {
+        for (int c = '0'; c <= '9'; ++c) allowed[c] = true;
+        for (int c = 'a'; c <= 'z'; ++c) allowed[c] = true;
+        for (int c = 'A'; c <= 'Z'; ++c) allowed[c] = true;
+        const char* extra = "!#$%&'*+-.^_`|~";
+        for (const char* p = extra; *p; ++p) allowed[static_cast<unsigned char>(*p)] = true;
+    }
+};
+constexpr TokenTable kTokenTable;
+
+bool isTokenChar(char c) {
+    return kTokenTable.allowed[static_cast<unsigned char>(c)];
+}
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    c = lower(c);
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+} // namespace
+
+bool hasToken(std::string_view value, std::string_view token) {
+    while (!value.empty()) {
+        size_t comma = value.find(',');
+        std::string_view item = value.substr(0, comma);
+        while (!item.empty() && (item.front() == ' ' || item.front() == '\t')) item.remove_prefix(1);
+        while (!item.empty() && (item.back() == ' ' || item.back() == '\t')) item.remove_suffix(1);
+        if (equalsLower(item, token)) return true;
+        if (comma == std::string_view::npos) break;
+        value.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+void copyRequest(const HttpRequest& from, std::string& storage, HttpRequest& to) {
+    // 请求行和头部在缓冲区里是连续的一段，从方法开始到最后一个视图结束整段拷贝，再按偏移改写视图
+    const char* begin = from.method.data();
+    const char* end = from.target.data() + from.target.size();
+    for (size_t i = 0; i < from.header_count; ++i) {
+        const HttpHeader& header = from.headers[i];
+        end = std::max(end, header.name.data() + header.name.size());
+        if (!header.value.empty()) end = std::max(end, header.value.data() + header.value.size());
+    }
+    storage.assign(begin, end);
+    auto rebase = [&](std::string_view view) {
+        if (view.empty()) return std::string_view();
+        return std::string_view(storage.data() + (view.data() - begin), view.size());
+    };
+    to.method = rebase(from.method);
+    to.target = rebase(from.target);
+    to.path = rebase(from.path);
+    to.query = rebase(from.query);
+    to.version_minor = from.version_minor;
+    to.header_count = from.header_count;
+    for (size_t i = 0; i < from.header_count; ++i) {
+        to.headers[i].name = rebase(from.headers[i].name);
+        to.headers[i].value = rebase(from.headers[i].value);
+    }
+    to.keep_alive = from.keep_alive;
+    to.chunked = from.chunked;
+    to.content_length = from.content_length;
+    to.body = {};
+}
+
+std::string_view HttpRequest::header(std::string_view name) const {
+    for (size_t i = 0; i < header_count; ++i) {
+        if (headers[i].name.size() != name.size()) continue;
+        bool same = true;
+        for (size_t j = 0; j < name.size() && same; ++j) {
+            same = lower(headers[i].name[j]) == lower(name[j]);
+        }
+        if (same) return headers[i].value;
+    }
+    return {};
+}
+
+ParseStatus HttpParser::fail(int status) {
+    phase_ = Phase::Failed;
+    error_status_ = status;
+    return ParseStatus::Error;
+}
+
+ParseStatus HttpParser::parse(char* data, size_t len, HttpRequest& request) {
+    if (phase_ == Phase::Failed) return ParseStatus::Error;
+
+    bool head_parsed = false;
+    if (phase_ == Phase::Headers) {
+        ParseStatus status;
+        if (scan_ == 0) {
+            // 1. 快速路径：请求头通常一次就到齐，直接边扫描边解析，每个字节只看一遍
+            status = parseHead(data, len, request);
+        } else {
+            // 2. 请求头跨多次读取：只找结尾的空行，从上次扫到的位置继续，已看过的字节不再扫描
+            const char* p = data + (scan_ >= 3 ? scan_ - 3 : 0);
+            const char* end = data + len;
+            status = ParseStatus::Incomplete;
+            while ((p = findByte(p, end, '\n')) != end) {
+                if (p - data >= 3 && p[-1] == '\r' && p[-2] == '\n' && p[-3] == '\r') {
+                    // 头部收全了，完整解析一遍
+                    status = parseHead(data, static_cast<size_t>(p + 1 - data), request);
+                    break;
+                }
+                ++p;
+            }
+        }
+        if (status == ParseStatus::Error) return status;
+        if (status == ParseStatus::Incomplete) {
+            if (len > kMaxHeaderSize) return fail(431);
+            scan_ = static_cast<uint32_t>(len);
+            return status;
+        }
+        if (header_length_ > kMaxHeaderSize) return fail(431);
+        head_parsed = true;
+
+        // 3. 根据请求头确定请求体的长度；有请求体时先让调用方决定是否流式读取
+        if (request.chunked) {
+            phase_ = Phase::Chunked;
+            scan_ = header_length_;
+            body_end_ = header_length_;
+            return ParseStatus::HeadersComplete;
+        }
+        phase_ = Phase::Body;
+        content_length_ = request.content_length;
+        if (content_length_ > 0) return ParseStatus::HeadersComplete;
+    }
+
+    // 4. 请求体：Content-Length直接切片；分块编码边读边在原地解码
+    // 请求体跨了多次读取时，完成后重新解析一遍请求头，生成指向当前缓冲区的视图
+    if (phase_ == Phase::Body) {
+        if (content_length_ > kMaxBodySize) return fail(413);
+        if (len - header_length_ < content_length_) return ParseStatus::Incomplete;
+        if (!head_parsed && parseHead(data, header_length_, request) != ParseStatus::Complete) return fail(400);
+        request.body = std::string_view(data + header_length_, content_length_);
+        consumed_ = header_length_ + content_length_;
+    } else if (phase_ == Phase::Chunked) {
+        ParseStatus status = parseChunked(data, len);
+        if (status != ParseStatus::Complete) return status;
+        if (!head_parsed && parseHead(data, header_length_, request) != ParseStatus::Complete) return fail(400);
+        request.body = std::string_view(data + header_length_, body_end_ - header_length_);
+        consumed_ = scan_;
+    }
+    phase_ = Phase::Done;
+    return ParseStatus::Complete;
+}
+
+void HttpParser::streamBody() {
+    streaming_ = true;
+    header_length_ = 0;
+}
+
+void HttpParser::expectBody(bool chunked, uint64_t length) {
+    reset();
+    phase_ = chunked ? Phase::Chunked : Phase::Body;
+    content_length_ = length;
+    streaming_ = true;
+}
+
+ParseStatus HttpParser::parseBody(char* data, size_t len, std::string_view& piece, size_t& used) {
+    if (phase_ == Phase::Failed) return ParseStatus::Error;
+    if (phase_ == Phase::Body) {
+        size_t n = len < content_length_ ? len : static_cast<size_t>(content_length_);
+        piece = std::string_view(data, n);
+        used = n;
+        content_length_ -= n;
+        if (content_length_ > 0) return ParseStatus::Incomplete;
+    } else {
+        // 每次都从头解码，解码结果写回data的开头；块头和块尾按原始字节计入used
+        scan_ = 0;
+        body_end_ = 0;
+        ParseStatus status = parseChunked(data, len);
+        piece = std::string_view(data, body_end_);
+        used = scan_;
+        if (status != ParseStatus::Complete) return status;
+    }
+    phase_ = Phase::Done;
+    return ParseStatus::Complete;
+}
+
+ParseStatus HttpParser::parseHead(char* data, size_t len, HttpRequest& request) {
+    const char* p = data;
+    const char* end = data + len;
+
+    // 允许请求前面有多余的空行（RFC 9112 2.2）
+    while (end - p >= 2 && p[0] == '\r' && p[1] == '\n') p += 2;
+
+    // 请求行：方法 SP 请求目标 SP HTTP/1.x CRLF
+    const char* line_end = findByte2(p, end, '\r', '\n');
+    if (end - line_end < 2) return ParseStatus::Incomplete;
+    if (*line_end != '\r' || line_end[1] != '\n') return fail(400);
+    const char* sp1 = findByte(p, line_end, ' ');
+    if (sp1 == line_end || sp1 == p) return fail(400);
+    const char* sp2 = findByte(sp1 + 1, line_end, ' ');
+    if (sp2 == line_end || sp2 == sp1 + 1) return fail(400);
+    request.method = std::string_view(p, sp1 - p);
+    for (char c : request.method) {
+        if (!isTokenChar(c)) return fail(400);
+    }
+    request.target = std::string_view(sp1 + 1, sp2 - sp1 - 1);
+    size_t question = request.target.find('?');
+    request.path = request.target.substr(0, question);
+    request.query = question == std::string_view::npos ? std::string_view() : request.target.substr(question + 1);
+    std::string_view version(sp2 + 1, line_end - sp2 - 1);
+    if (version.size() != 8 || version.substr(0, 7) != "HTTP/1." || version[7] < '0' || version[7] > '9') {
+        return fail(400);
+    }
+    request.version_minor = version[7] - '0';
+    request.keep_alive = request.version_minor >= 1;
+    request.chunked = false;
+    request.content_length = 0;
+    request.body = {};
+    request.header_count = 0;
+
+    bool has_length = false;
+    p = line_end + 2;
+    while (true) {
+        if (end - p < 2) return ParseStatus::Incomplete;
+        if (*p == '\r') {
+            if (p[1] != '\n') return fail(400);
+            break; // 空行，请求头结束
+        }
+        // 头部名一般只有十几个字节，查表逐字节校验的同时找到':'（也拒绝了旧式的折行头部）
+        const char* colon = p;
+        while (colon < end && isTokenChar(*colon)) ++colon;
+        if (colon == end) return ParseStatus::Incomplete;
+        if (*colon != ':' || colon == p) return fail(400);
+        std::string_view name(p, colon - p);
+        // 值里第一个控制字符必须是行尾的CRLF；单独的'\n'若放过，转发给上游时可能被当成新的头部
+        const char* value_end = findControl(colon + 1, end);
+        if (end - value_end < 2) return ParseStatus::Incomplete;
+        if (*value_end != '\r' || value_end[1] != '\n') return fail(400);
+        const char* value_begin = colon + 1;
+        while (value_begin < value_end && (*value_begin == ' ' || *value_begin == '\t')) ++value_begin;
+        const char* value_last = value_end;
+        while (value_last > value_begin && (value_last[-1] == ' ' || value_last[-1] == '\t')) --value_last;
+        std::string_view value(value_begin, value_last - value_begin);
+        p = value_end + 2;
+
+        if (request.header_count == kMaxHeaders) return fail(431);
+        request.headers[request.header_count++] = HttpHeader{name, value};
+
+        // 决定连接语义和请求体长度的几个头部在这里直接处理，先按长度过滤
+        switch (name.size()) {
+        case 10:
+            if (equalsLower(name, "connection")) {
+                if (hasToken(value, "close")) request.keep_alive = false;
+                else if (hasToken(value, "keep-alive")) request.keep_alive = true;
+            }
+            break;
+        case 14:
+            if (equalsLower(name, "content-length")) {
+                uint64_t length = 0;
+                if (value.empty()) return fail(400);
+                for (char c : value) {
+                    if (c < '0' || c > '9' || length > (1ULL << 40)) return fail(400);
+                    length = length * 10 + static_cast<uint64_t>(c - '0');
+                }
+                // 多个不一致的Content-Length可能是请求走私，直接拒绝
+                if (has_length && length != request.content_length) return fail(400);
+                has_length = true;
+                request.content_length = length;
+            }
+            break;
+        case 17:
+            if (equalsLower(name, "transfer-encoding")) {
+                // 只支持chunked，且必须是最后一个编码
+                size_t comma = value.rfind(',');
+                std::string_view last = comma == std::string_view::npos ? value : value.substr(comma + 1);
+                while (!last.empty() && last.front() == ' ') last.remove_prefix(1);
+                if (!equalsLower(last, "chunked")) return fail(501);
+                request.chunked = true;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    // 同时带Transfer-Encoding和Content-Length也是请求走私的常见手法
+    if (request.chunked && has_length) return fail(400);
+    header_length_ = static_cast<uint32_t>(p + 2 - data);
+    return ParseStatus::Complete;
+}
+
+ParseStatus HttpParser::parseChunked(char* data, size_t len) {
+    // 原始数据从scan_读出，解码后的数据紧接着写到body_end_，写指针永远不会超过读指针
+    while (scan_ < len) {
+        char c = data[scan_];
+        switch (chunk_state_) {
+        case ChunkState::Size: {
+            int digit = hexValue(c);
+            if (digit >= 0) {
+                if (chunk_left_ > (streaming_ ? UINT64_MAX >> 8 : kMaxBodySize << 4)) return fail(413);
+                chunk_left_ = chunk_left_ * 16 + static_cast<uint64_t>(digit);
+                chunk_digits_ = true;
+                ++scan_;
+            } else if (!chunk_digits_) {
+                return fail(400);
+            } else if (c == '\r') {
+                chunk_state_ = ChunkState::SizeLf;
+                ++scan_;
+            } else if (c == ';' || c == ' ' || c == '\t') {
+                chunk_state_ = ChunkState::Extension;
+                ++scan_;
+            } else {
+                return fail(400);
+            }
+            break;
+        }
+        case ChunkState::Extension: {
+            // 块扩展直接跳过
+            const char* cr = findByte(data + scan_, data + len, '\r');
+            scan_ = static_cast<uint32_t>(cr - data);
+            if (cr != data + len) {
+                chunk_state_ = ChunkState::SizeLf;
+                ++scan_;
+            }
+            break;
+        }
+        case ChunkState::SizeLf:
+            if (c != '\n') return fail(400);
+            ++scan_;
+            if (!streaming_ && body_end_ - header_length_ + chunk_left_ > kMaxBodySize) return fail(413);
+            chunk_state_ = chunk_left_ == 0 ? ChunkState::TrailerStart : ChunkState::Data;
+            break;
+        case ChunkState::Data: {
+            size_t n = len - scan_;
+            if (n > chunk_left_) n = static_cast<size_t>(chunk_left_);
+            std::memmove(data + body_end_, data + scan_, n);
+            body_end_ += static_cast<uint32_t>(n);
+            scan_ += static_cast<uint32_t>(n);
+            chunk_left_ -= n;
+            if (chunk_left_ == 0) chunk_state_ = ChunkState::DataCr;
+            break;
+        }
+        case ChunkState::DataCr:
+            if (c != '\r') return fail(400);
+            ++scan_;
+            chunk_state_ = ChunkState::DataLf;
+            break;
+        case ChunkState::DataLf:
+            if (c != '\n') return fail(400);
+            ++scan_;
+            chunk_state_ = ChunkState::Size;
+            chunk_digits_ = false;
+            break;
+        case ChunkState::TrailerStart:
+            // 尾部头部逐行跳过，遇到空行结束
+            ++scan_;
+            chunk_state_ = c == '\r' ? ChunkState::FinalLf : ChunkState::Trailer;
+            break;
+        case ChunkState::Trailer: {
+            if (scan_ - header_length_ > kMaxBufferedRequest) return fail(431);
+            const char* lf = findByte(data + scan_, data + len, '\n');
+            scan_ = static_cast<uint32_t>(lf - data);
+            if (lf != data + len) {
+                ++scan_;
+                chunk_state_ = ChunkState::TrailerStart;
+            }
+            break;
+        }
+        case ChunkState::FinalLf:
+            if (c != '\n') return fail(400);
+            ++scan_;
+            return ParseStatus::Complete;
+        }
+    }
+    return ParseStatus::Incomplete;
+}
@@ -0,0 +1,106 @@
+#ifndef HTTP_PARSER_H
+#define HTTP_PARSER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+constexpr size_t kMaxHeaderSize = 64 * 1024;     // 请求行+请求头上限，超过返回431
+constexpr size_t kMaxBodySize = 1024 * 1024;     // 请求体上限，超过返回413
+constexpr size_t kMaxHeaders = 64;               // 单个请求最多的头部数量
+// 连接缓冲区里允许积压的原始请求数据上限（分块编码的块头会让原始数据比请求体更大）
+constexpr size_t kMaxBufferedRequest = 2 * (kMaxHeaderSize + kMaxBodySize);
+
+struct HttpHeader {
+    std::string_view name;
+    std::string_view value;
+};
+
+// 解析结果：所有字段都是指向连接缓冲区的string_view，不做任何拷贝
+// 只在本次process()期间有效，缓冲区移动或清理后即失效
+struct HttpRequest {
+    std::string_view method;
+    std::string_view target;       // 原始请求目标，如 /index.html?x=1
+    std::string_view path;         // target去掉查询串
+    std::string_view query;        // ?之后的部分，没有则为空
+    int version_minor = 1;         // HTTP/1.x 中的 x
+    HttpHeader headers[kMaxHeaders];
+    size_t header_count = 0;
+    bool keep_alive = true;
+    bool chunked = false;
+    uint64_t content_length = 0;
+    std::string_view body;         // 完整请求体；分块编码已在缓冲区内原地解码为连续内存
+
+    // 按名字查找头部（不区分大小写），不存在返回空
+    std::string_view header(std::string_view name) const;
+};
+
+// 逗号分隔的头部取值里是否有token（不区分大小写，token必须是小写），比如"Connection: keep-alive, Upgrade"
+bool hasToken(std::string_view value, std::string_view token);
+
+// 把请求行和请求头拷进storage，to的各个视图改为指向storage，之后连接缓冲区移动或清理都不受影响
+// 请求体不拷贝（to.body为空）；需要跨越多次process()使用请求的地方（协程路由）用它留一份
+void copyRequest(const HttpRequest& from, std::string& storage, HttpRequest& to);
+
+enum class ParseStatus {
+    Incomplete,  // 数据还不够，保留状态等下一次调用
+    Complete,    // 一个完整请求（含请求体）已解析完
+    HeadersComplete, // 请求头已收全、还有请求体要读；每个请求最多返回一次，
+                     // 调用方可以streamBody()改为流式读取，或者继续调用parse等完整的请求体
+    Error        // 请求非法，errorStatus()给出应返回的状态码
+};
+
+// 可恢复的HTTP/1.x请求解析器，每个连接一个，状态只有几十字节
+// 每次调用都从上次停下的位置继续扫描，不会重复扫描已经看过的字节；
+// 空格、行尾和头部值里的控制字符用SSE2/AVX2一次比较16/32字节
+class HttpParser {
+public:
+    // data指向当前请求在连接缓冲区中的起点，len为目前已收到的字节数
+    // 两次调用之间缓冲区可以整体搬移（扩容、丢弃前面的请求），内部只记偏移
+    // 分块编码的请求体会在data内原地解码，所以需要可写的缓冲区
+    ParseStatus parse(char* data, size_t len, HttpRequest& request);
+
+    // 收到HeadersComplete后改为流式读取请求体：调用方丢掉请求头，之后把请求体的原始数据交给parseBody，
+    // 不再受kMaxBodySize限制
+    void streamBody();
+    // data指向尚未读取的请求体原始数据（每次都从缓冲区开头算起）；本次解码出的请求体放在piece里
+    // （分块编码在data内原地解码），used为消耗掉的原始字节数，调用方随后即可丢弃
+    // 请求体读完返回Complete
+    ParseStatus parseBody(char* data, size_t len, std::string_view& piece, size_t& used);
+    // 解析响应的正文（反向代理读上游的响应）：响应头由调用方自己解析，之后同样交给parseBody分段解码
+    void expectBody(bool chunked, uint64_t length);
+
+    // 完成后：本请求在缓冲区中占用的原始字节数、请求行+请求头的长度
+    size_t consumed() const { return consumed_; }
+    size_t headerLength() const { return header_length_; }
+    // 出错后：应返回给客户端的状态码（400/413/431/501）
+    int errorStatus() const { return error_status_; }
+    // 请求头已经收全，正在等请求体
+    bool readingBody() const { return phase_ == Phase::Body || phase_ == Phase::Chunked; }
+
+    // 开始解析下一个请求
+    void reset() { *this = HttpParser(); }
+
+private:
+    enum class Phase : uint8_t { Headers, Body, Chunked, Done, Failed };
+    enum class ChunkState : uint8_t { Size, Extension, SizeLf, Data, DataCr, DataLf, TrailerStart, Trailer, FinalLf };
+
+    ParseStatus fail(int status);
+    ParseStatus parseHead(char* data, size_t len, HttpRequest& request);
+    ParseStatus parseChunked(char* data, size_t len);
+
+    Phase phase_ = Phase::Headers;
+    ChunkState chunk_state_ = ChunkState::Size;
+    bool chunk_digits_ = false;     // 块大小至少要有一位十六进制数字
+    bool streaming_ = false;        // 请求体流式交给调用方，不在缓冲区里攒
+    uint32_t scan_ = 0;             // 头部阶段：已经扫描过的位置；分块阶段：下一个要读的原始字节
+    uint32_t header_length_ = 0;
+    uint32_t body_end_ = 0;         // 分块阶段：解码后的请求体写到了哪里
+    uint64_t chunk_left_ = 0;       // 当前块还剩多少字节
+    uint64_t content_length_ = 0;
+    size_t consumed_ = 0;
+    int error_status_ = 0;
+};
+
+#endif // HTTP_PARSER_H
@@ -0,0 +1,191 @@
+#include "http_response.h"
+
+#include <ctime>
+
+#include "mime_types.h"
+
+void appendResponseHead(std::string& out, std::string_view status, std::string_view content_type, uint64_t length,
+                        bool keep_alive, std::string_view extra_headers) {
+    out += "HTTP/1.1 ";
+    out += status;
+    out += "\r\n";
+    out += kServerHeader;
+    out += "Content-Type: ";
+    out += content_type;
+    out += "\r\nContent-Length: ";
+    appendDecimal(out, length);
+    out += keep_alive ? "\r\nConnection: keep-alive\r\n" : "\r\nConnection: close\r\n";
+    out += extra_headers;
+    out += "\r\n";
+}
+
+void appendStreamHead(std::string& out, std::string_view status, std::string_view content_type, bool chunked,
+                      bool keep_alive, std::string_view extra_headers) {
+    out += "HTTP/1.1 ";
+    out += status;
+    out += "\r\n";
+    out += kServerHeader;
+    out += "Content-Type: ";
+    out += content_type;
+    if (chunked) out += "\r\nTransfer-Encoding: chunked";
+    out += keep_alive ? "\r\nConnection: keep-alive\r\n" : "\r\nConnection: close\r\n";
+    out += extra_headers;
+    out += "\r\n";
+}
+
+std::string responseHead(std::string_view status, std::string_view content_type, uint64_t length,
+                         bool keep_alive, std::string_view extra_headers) {
+    std::string head;
+    appendResponseHead(head, status, content_type, length, keep_alive, extra_headers);
+    return head;
+}
+
+HeadTemplate::HeadTemplate(std::string_view status, std::string_view content_type, std::string_view extra_headers) {
+    status_line_ = "HTTP/1.1 ";
+    status_line_ += status;
+    status_line_ += "\r\n";
+    fields_ = kServerHeader;
+    fields_ += "Content-Type: ";
+    fields_ += content_type;
+    fields_ += "\r\nContent-Length: ";
+    for (bool keep_alive : {true, false}) {
+        std::string& tail = keep_alive ? keep_alive_tail_ : close_tail_;
+        tail = keep_alive ? "\r\nConnection: keep-alive\r\n" : "\r\nConnection: close\r\n";
+        tail += extra_headers;
+        tail += "\r\n";
+    }
+}
+
+void HeadTemplate::append(std::string& out, std::string_view date_line, uint64_t length, bool keep_alive) const {
+    out += status_line_;
+    out += date_line;
+    out += fields_;
+    appendDecimal(out, length);
+    out += keep_alive ? keep_alive_tail_ : close_tail_;
+}
+
+std::string notModifiedHead(bool keep_alive, std::string_view extra_headers) {
+    std::string head = "HTTP/1.1 304 Not Modified\r\n";
+    head += kServerHeader;
+    head += keep_alive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+    head += extra_headers;
+    head += "\r\n";
+    return head;
+}
+
+std::string contentHeaders(std::string_view content_type, std::string_view encoding, std::string_view etag,
+                           std::string_view last_modified) {
+    std::string headers;
+    appendContentHeaders(headers, content_type, encoding, etag, last_modified);
+    return headers;
+}
+
+void appendContentHeaders(std::string& headers, std::string_view content_type, std::string_view encoding,
+                          std::string_view etag, std::string_view last_modified) {
+    if (!encoding.empty()) {
+        headers += "Content-Encoding: ";
+        headers += encoding;
+        headers += "\r\n";
+    }
+    if (compressibleType(content_type)) headers += "Vary: Accept-Encoding\r\n";
+    headers += "Accept-Ranges: bytes\r\n";
+    if (!etag.empty()) {
+        headers += "ETag: ";
+        headers += etag;
+        headers += "\r\n";
+    }
+    if (!last_modified.empty()) {
+        headers += "Last-Modified: ";
+        headers += last_modified;
+        headers += "\r\n";
+    }
+}
+
+std::string contentRange(uint64_t first, uint64_t last, uint64_t size) {
+    std::string header = "Content-Range: bytes ";
+    appendDecimal(header, first);
+    header += '-';
+    appendDecimal(header, last);
+    header += '/';
+    appendDecimal(header, size);
+    header += "\r\n";
+    return header;
+}
+
+std::string variantEtag(std::string_view etag, std::string_view encoding) {
+    std::string result;
+    appendVariantEtag(result, etag, encoding);
+    return result;
+}
+
+void appendVariantEtag(std::string& out, std::string_view etag, std::string_view encoding) {
+    if (encoding.empty() || etag.size() < 2) {
+        out += etag;
+        return;
+    }
+    out += etag.substr(0, etag.size() - 1);
+    out += '-';
+    out += encoding;
+    out += '"';
+}
+
+void appendDecimal(std::string& out, uint64_t value) {
+    char digits[20];
+    char* end = digits + sizeof(digits);
+    char* p = end;
+    do {
+        *--p = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    out.append(p, static_cast<size_t>(end - p));
+}
+
+void appendChunkSize(std::string& out, uint64_t size) {
+    static const char kHex[] = "0123456789abcdef";
+    char digits[16];
+    char* end = digits + sizeof(digits);
+    char* p = end;
+    do {
+        *--p = kHex[size & 15];
+        size >>= 4;
+    } while (size != 0);
+    out.append(p, static_cast<size_t>(end - p));
+    out += "\r\n";
+}
+
+size_t statusLineLength(std::string_view response) {
+    size_t end = response.find("\r\n");
+    return end == std::string_view::npos ? 0 : end + 2;
+}
+
+void DateCache::refresh() {
+    // 粗粒度时钟走vDSO，比time()/gettimeofday更便宜，误差只有几毫秒
+    timespec now{};
+    clock_gettime(CLOCK_REALTIME_COARSE, &now);
+    if (now.tv_sec == second_) return;
+    second_ = now.tv_sec;
+    tm parts{};
+    gmtime_r(&second_, &parts);
+    length_ = strftime(line_, sizeof(line_), "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &parts);
+}
+
+std::string formatHttpDate(time_t time) {
+    tm parts{};
+    gmtime_r(&time, &parts);
+    char buffer[64];
+    size_t len = strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &parts);
+    return std::string(buffer, len);
+}
+
+bool parseHttpDate(std::string_view text, time_t& time) {
+    // strptime需要以'\0'结尾的字符串
+    char buffer[64];
+    if (text.size() >= sizeof(buffer)) return false;
+    text.copy(buffer, text.size());
+    buffer[text.size()] = '\0';
+    tm parts{};
+    const char* end = strptime(buffer, "%a, %d %b %Y %H:%M:%S GMT", &parts);
+    if (!end || *end != '\0') return false;
+    time = timegm(&parts);
+    return true;
+}
@@ -0,0 +1,88 @@
+#ifndef HTTP_RESPONSE_H
+#define HTTP_RESPONSE_H
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <string_view>
+
+// 所有响应都带的Server头部，和其他固定头部一起预先拼进模板
+constexpr std::string_view kServerHeader = "Server: demo1\r\n";
+
+// 拼出状态行和头部（含结尾的空行），正文另外追加
+// extra_headers是若干完整的头部行，每行以\r\n结尾
+// 结果里没有Date：拼好的头部会被缓存、在线程之间共用，Date在发送时由HttpHandler插到状态行之后
+std::string responseHead(std::string_view status, std::string_view content_type, uint64_t length,
+                         bool keep_alive, std::string_view extra_headers = {});
+// 同上，追加到out末尾：out是调用方复用的缓冲区时不分配内存
+void appendResponseHead(std::string& out, std::string_view status, std::string_view content_type, uint64_t length,
+                        bool keep_alive, std::string_view extra_headers = {});
+
+// 长度事先未知的流式响应头：chunked为true时带Transfer-Encoding: chunked，
+// 否则（HTTP/1.0客户端）不带长度，正文以关闭连接结束，调用方必须传keep_alive=false
+void appendStreamHead(std::string& out, std::string_view status, std::string_view content_type, bool chunked,
+                      bool keep_alive, std::string_view extra_headers = {});
+
+// 预先拼好的响应头模板：状态行、Server、Content-Type和附加头部都是固定的，
+// 生成一个响应头只是几次拷贝、插入Date，再把Content-Length转成十进制，用于正文长度每次不同的路由
+class HeadTemplate {
+public:
+    HeadTemplate(std::string_view status, std::string_view content_type, std::string_view extra_headers = {});
+
+    // 完整的响应头（含Date和结尾的空行）追加到out末尾
+    void append(std::string& out, std::string_view date_line, uint64_t length, bool keep_alive) const;
+
+private:
+    std::string status_line_;       // "HTTP/1.1 200 OK\r\n"
+    std::string fields_;            // Server、Content-Type，以"Content-Length: "结尾
+    std::string keep_alive_tail_;   // 长度之后的部分：Connection、附加头部和空行
+    std::string close_tail_;
+};
+
+// 304响应：没有正文，只带校验器和其他附加头部
+std::string notModifiedHead(bool keep_alive, std::string_view extra_headers);
+
+// 静态文件响应的附加头部：压缩版本带Content-Encoding；可压缩的类型都带Vary，让中间缓存按Accept-Encoding区分；
+// 再加上这个版本的ETag和Last-Modified，并声明支持按字节范围请求
+std::string contentHeaders(std::string_view content_type, std::string_view encoding, std::string_view etag,
+                           std::string_view last_modified);
+void appendContentHeaders(std::string& out, std::string_view content_type, std::string_view encoding,
+                          std::string_view etag, std::string_view last_modified);
+
+// 范围响应的Content-Range头部行：bytes first-last/size
+std::string contentRange(uint64_t first, uint64_t last, uint64_t size);
+
+// 同一文件不同编码的表示各有自己的强ETag：在原文件ETag的引号内加上编码名
+std::string variantEtag(std::string_view etag, std::string_view encoding);
+void appendVariantEtag(std::string& out, std::string_view etag, std::string_view encoding);
+
+// 分块编码的块头："十六进制长度\r\n"
+void appendChunkSize(std::string& out, uint64_t size);
+
+// 十进制追加非负整数，代替snprintf，Content-Length等每个响应都要格式化一次
+void appendDecimal(std::string& out, uint64_t value);
+
+// 响应中状态行（含\r\n）的长度，Date头部插在它后面
+size_t statusLineLength(std::string_view response);
+
+// 本线程缓存的"Date: ...\r\n"头部行：事件循环每次醒来调用refresh()，秒数变了才重新格式化，
+// 生成响应时只是一次拷贝。每个Reactor一份，不需要同步
+class DateCache {
+public:
+    DateCache() { refresh(); }
+
+    void refresh();
+    std::string_view line() const { return std::string_view(line_, length_); }
+
+private:
+    time_t second_ = -1;
+    size_t length_ = 0;
+    char line_[48] = {};
+};
+
+// HTTP日期（IMF-fixdate），如 Sun, 06 Nov 1994 08:49:37 GMT
+std::string formatHttpDate(time_t time);
+// 解析IMF-fixdate，格式不对返回false
+bool parseHttpDate(std::string_view text, time_t& time);
+
+#endif // HTTP_RESPONSE_H
@@ -0,0 +1,690 @@
+// HTTP/1.1负载生成器：make loadgen && ./loadgen -c 16 -r 2000 -d 10 http://127.0.0.1:8080/
+// 开环压测：请求按固定速率预先排好计划发送时刻，服务器变慢时不会跟着少发。延迟从计划时刻算起，
+// 连接被慢响应占住、请求只能晚发的那段时间也算进去（校正协调遗漏，coordinated omission），记在HDR直方图里
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <functional>
+#include <iostream>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace {
+
+constexpr int kMaxEvents = 1024;
+constexpr size_t kReadSize = 64 * 1024;     // 每次recv的大小，正文不保存，读完就丢
+constexpr size_t kMaxLine = 64 * 1024;      // 响应头（或者一行分块长度）最长多少
+constexpr int64_t kMaxLatencyUs = 3600LL * 1000 * 1000; // 直方图记录的最大延迟，更大的按它记
+constexpr uint32_t kTimerTag = UINT32_MAX;  // 定时器fd在epoll里的data.u32
+
+int64_t nowNs() {
+    timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// HDR直方图（HdrHistogram的布局）：按2的幂分桶，每个桶再等分成1024个子桶，
+// 任何值的相对误差不超过1/1024（3位有效数字），记录和查询都是O(1)，内存只和最大值的位数有关
+class Histogram {
+public:
+    explicit Histogram(int64_t max_value) : highest_(max_value), counts_(index(max_value) + 1) {}
+
+    void record(int64_t value) {
+        value = std::clamp<int64_t>(value, 0, highest_);
+        ++counts_[index(value)];
+        ++total_;
+        sum_ += static_cast<double>(value);
+        max_ = std::max(max_, value);
+    }
+
+    // 第percent百分位的值：至少有percent%的记录不超过它（取所在子桶的上界，和HdrHistogram一致）
+    int64_t percentile(double percent) const {
+        if (total_ == 0) return 0;
+        if (percent >= 100) return max_;
+        uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(percent / 100 * total_)));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            seen += counts_[i];
+            if (seen >= target) return std::min(highestEquivalent(i), max_);
+        }
+        return max_;
+    }
+
+    uint64_t count() const { return total_; }
+    int64_t max() const { return max_; }
+    double mean() const { return total_ ? sum_ / total_ : 0; }
+
+private:
+    static constexpr int kSubBucketHalfMagnitude = 10;
+    static constexpr int64_t kSubBucketHalf = int64_t(1) << kSubBucketHalfMagnitude;
+    static constexpr int64_t kSubBucketMask = 2 * kSubBucketHalf - 1;
+
+    // 小于2048的值一个数一个子桶；更大的值落在第bucket个桶，只保留最高的11位
+    static size_t index(int64_t value) {
+        int pow2_ceiling = 64 - __builtin_clzll(static_cast<uint64_t>(value) | kSubBucketMask);
+        int bucket = pow2_ceiling - (kSubBucketHalfMagnitude + 1);
+        int64_t sub_bucket = value >> bucket;
+        return static_cast<size_t>(((bucket + 1) << kSubBucketHalfMagnitude) + sub_bucket - kSubBucketHalf);
+    }
+
+    // 落在这个下标的最大值
+    static int64_t highestEquivalent(size_t index) {
+        int bucket = static_cast<int>(index >> kSubBucketHalfMagnitude) - 1;
+        int64_t sub_bucket = static_cast<int64_t>(index & (kSubBucketHalf - 1)) + kSubBucketHalf;
+        if (bucket < 0) {
+            sub_bucket -= kSubBucketHalf;
+            bucket = 0;
+        }
+        return (sub_bucket << bucket) + (int64_t(1) << bucket) - 1;
+    }
+
+    int64_t highest_;
+    std::vector<uint64_t> counts_;
+    uint64_t total_ = 0;
+    double sum_ = 0;
+    int64_t max_ = 0;
+};
+
+// 增量解析一个响应，正文只数长度不保存；支持Content-Length、分块编码和读到连接关闭为止
+class ResponseParser {
+public:
+    enum class Result { More, Done, Error };
+
+    void reset() {
+        state_ = State::Head;
+        line_.clear();
+        status = 0;
+        close = false;
+    }
+
+    // 喂入收到的数据，used返回用掉的字节数；Done之后剩下的数据不属于这个响应
+    Result feed(const char* data, size_t len, size_t& used) {
+        used = 0;
+        while (used < len) {
+            switch (state_) {
+            case State::Head:
+            case State::ChunkSize:
+            case State::Trailer: {
+                std::string_view delimiter = state_ == State::Head ? "\r\n\r\n" : "\r\n";
+                size_t old_size = line_.size();
+                line_.append(data + used, len - used);
+                size_t from = old_size >= delimiter.size() ? old_size - (delimiter.size() - 1) : 0;
+                size_t found = line_.find(delimiter, from);
+                if (found == std::string::npos) {
+                    if (line_.size() > kMaxLine) return Result::Error;
+                    used = len;
+                    return Result::More;
+                }
+                size_t end = found + delimiter.size();
+                used += end - old_size;
+                line_.resize(found);
+                if (!finishLine()) return Result::Error;
+                line_.clear();
+                break;
+            }
+            case State::Body:
+            case State::ChunkData: {
+                size_t take = static_cast<size_t>(std::min<uint64_t>(remaining_, len - used));
+                used += take;
+                remaining_ -= take;
+                if (remaining_ == 0) state_ = state_ == State::Body ? State::Done : State::ChunkSize;
+                break;
+            }
+            case State::UntilClose:
+                used = len;
+                return Result::More;
+            case State::Done:
+                return Result::Done;
+            }
+            if (state_ == State::Done) return Result::Done;
+        }
+        return state_ == State::Done ? Result::Done : Result::More;
+    }
+
+    // 服务器关闭了连接：没有长度的响应到这里才算完整
+    bool completeOnClose() const { return state_ == State::UntilClose; }
+
+    int status = 0;
+    bool close = false;   // 响应之后连接不能再用
+
+private:
+    enum class State { Head, Body, ChunkSize, ChunkData, Trailer, UntilClose, Done };
+
+    static bool hasToken(std::string_view value, std::string_view token) {
+        for (size_t i = 0; i + token.size() <= value.size(); ++i) {
+            if (strncasecmp(value.data() + i, token.data(), token.size()) == 0) return true;
+        }
+        return false;
+    }
+
+    bool finishLine() {
+        if (state_ == State::ChunkSize) {
+            char* end = nullptr;
+            remaining_ = std::strtoull(line_.c_str(), &end, 16);
+            if (end == line_.c_str()) return false;
+            // 长度0是最后一块，后面是尾部头部，以空行结束；其他块的数据后面跟着\r\n
+            if (remaining_ == 0) {
+                state_ = State::Trailer;
+            } else {
+                remaining_ += 2;
+                state_ = State::ChunkData;
+            }
+            return true;
+        }
+        if (state_ == State::Trailer) {
+            if (line_.empty()) state_ = State::Done;
+            return true;
+        }
+        return parseHead();
+    }
+
+    bool parseHead() {
+        std::string_view head = line_;
+        if (head.size() < 12 || head.substr(0, 7) != "HTTP/1.") return false;
+        status = std::atoi(std::string(head.substr(9, 3)).c_str());
+        if (status < 100) return false;
+        if (status < 200) return true; // 100 Continue之类的中间响应：接着等真正的响应
+        close = head[7] == '0';
+        bool chunked = false;
+        bool has_length = false;
+        size_t pos = head.find("\r\n");
+        while (pos != std::string_view::npos) {
+            size_t end = head.find("\r\n", pos + 2);
+            std::string_view line = head.substr(pos + 2, end == std::string_view::npos ? end : end - pos - 2);
+            pos = end;
+            size_t colon = line.find(':');
+            if (colon == std::string_view::npos) continue;
+            std::string_view name = line.substr(0, colon);
+            std::string_view value = line.substr(colon + 1);
+            if (name.size() == 14 && strncasecmp(name.data(), "Content-Length", 14) == 0) {
+                remaining_ = std::strtoull(std::string(value).c_str(), nullptr, 10);
+                has_length = true;
+            } else if (name.size() == 17 && strncasecmp(name.data(), "Transfer-Encoding", 17) == 0) {
+                chunked = hasToken(value, "chunked");
+            } else if (name.size() == 10 && strncasecmp(name.data(), "Connection", 10) == 0) {
+                if (hasToken(value, "close")) close = true;
+                if (hasToken(value, "keep-alive")) close = false;
+            }
+        }
+        if (status == 204 || status == 304) {
+            state_ = State::Done;
+        } else if (chunked) {
+            state_ = State::ChunkSize;
+        } else if (has_length) {
+            state_ = remaining_ == 0 ? State::Done : State::Body;
+        } else {
+            state_ = State::UntilClose;
+            close = true;
+        }
+        return true;
+    }
+
+    State state_ = State::Head;
+    std::string line_;
+    uint64_t remaining_ = 0;
+};
+
+struct Options {
+    int connections = 16;
+    double rate = 1000;
+    int duration = 10;
+    std::string host = "127.0.0.1";
+    std::string port = "8080";
+    std::string path = "/";
+    std::vector<std::string> headers;
+};
+
+void printUsage(const char* prog) {
+    std::cerr << "用法: " << prog << " [选项] [http://主机[:端口][/路径]]\n"
+              << "  -c, --connections <数量>  长连接数，默认16；每个连接同一时刻只有一个请求在途\n"
+              << "  -r, --rate <请求/秒>      所有连接合计的固定请求速率，默认1000\n"
+              << "  -d, --duration <秒>       压测持续时间，默认10\n"
+              << "  -H, --header <头部>       额外的请求头，如 -H \"Accept-Encoding: gzip\"，可以重复指定\n"
+              << "目标默认是 http://127.0.0.1:8080/（实验一）；实验三是 http://127.0.0.1:8081/hello\n";
+}
+
+// 解析非负整数参数，格式不对返回false
+bool parseNumber(const char* text, long max, long& value) {
+    char* end = nullptr;
+    value = std::strtol(text, &end, 10);
+    return end != text && *end == '\0' && value >= 0 && value <= max;
+}
+
+// 只支持明文HTTP：http://host[:port][/path]，省略http://也可以
+bool parseUrl(std::string_view url, Options& options) {
+    if (url.substr(0, 7) == "http://") url.remove_prefix(7);
+    else if (url.find("://") != std::string_view::npos) return false;
+    size_t slash = url.find('/');
+    std::string_view authority = url.substr(0, slash);
+    options.path = slash == std::string_view::npos ? "/" : std::string(url.substr(slash));
+    size_t colon = authority.rfind(':');
+    if (colon == std::string_view::npos) {
+        options.host = authority;
+        options.port = "80";
+    } else {
+        options.host = authority.substr(0, colon);
+        options.port = authority.substr(colon + 1);
+    }
+    return !options.host.empty() && !options.port.empty();
+}
+
+bool parseArgs(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        long number = 0;
+        if (std::strcmp(arg, "-c") == 0 || std::strcmp(arg, "--connections") == 0) {
+            if (!value || !parseNumber(value, 100000, number) || number == 0) return false;
+            options.connections = static_cast<int>(number);
+            ++i;
+        } else if (std::strcmp(arg, "-r") == 0 || std::strcmp(arg, "--rate") == 0) {
+            if (!value || !parseNumber(value, 10000000, number) || number == 0) return false;
+            options.rate = static_cast<double>(number);
+            ++i;
+        } else if (std::strcmp(arg, "-d") == 0 || std::strcmp(arg, "--duration") == 0) {
+            if (!value || !parseNumber(value, 86400, number) || number == 0) return false;
+            options.duration = static_cast<int>(number);
+            ++i;
+        } else if (std::strcmp(arg, "-H") == 0 || std::strcmp(arg, "--header") == 0) {
+            if (!value || !std::strchr(value, ':')) return false;
+            options.headers.emplace_back(value);
+            ++i;
+        } else if (arg[0] != '-') {
+            if (!parseUrl(arg, options)) return false;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+struct Client {
+    enum class State { Closed, Connecting, Idle, Writing, Reading };
+
+    int fd = -1;
+    State state = State::Closed;
+    uint64_t seq = 0;          // 这个连接已经用掉的计划时刻数
+    int64_t next_ns = 0;       // 下一个请求的计划发送时刻
+    int64_t intended_ns = 0;   // 在途请求的计划发送时刻
+    int64_t sent_ns = 0;       // 在途请求实际开始发送的时刻
+    size_t written = 0;
+    ResponseParser parser;
+};
+
+class LoadGenerator {
+public:
+    LoadGenerator(const Options& options, const sockaddr_in& addr)
+        : options_(options), addr_(addr), clients_(options.connections),
+          interval_ns_(1e9 / options.rate), corrected_(kMaxLatencyUs), service_(kMaxLatencyUs),
+          buffer_(kReadSize) {
+        request_ = "GET " + options.path + " HTTP/1.1\r\nHost: " + options.host;
+        if (options.port != "80") request_ += ":" + options.port;
+        request_ += "\r\n";
+        for (const std::string& header : options.headers) request_ += header + "\r\n";
+        request_ += "\r\n";
+    }
+
+    ~LoadGenerator() {
+        for (Client& client : clients_) {
+            if (client.fd != -1) ::close(client.fd);
+        }
+        if (timer_fd_ != -1) ::close(timer_fd_);
+        if (epoll_fd_ != -1) ::close(epoll_fd_);
+    }
+
+    bool run();
+    void report() const;
+
+private:
+    // 第k个连接的第j个请求排在start + (k + j*N)/rate，N个连接的计划时刻交错铺满整个速率
+    int64_t slot(size_t index, uint64_t seq) const {
+        double offset = (static_cast<double>(index) + static_cast<double>(seq) * clients_.size()) * interval_ns_;
+        return start_ns_ + static_cast<int64_t>(offset);
+    }
+
+    int openSocket(bool blocking);
+    void fire(size_t index, int64_t now);
+    void startRequest(size_t index, int64_t now);
+    void writeRequest(size_t index);
+    void readResponse(size_t index);
+    void finishResponse(size_t index);
+    void fail(size_t index, uint64_t& counter);
+    void closeClient(Client& client);
+    void schedule(size_t index) { ready_.emplace(clients_[index].next_ns, index); }
+    void armTimer(int64_t deadline_ns);
+
+    const Options& options_;
+    sockaddr_in addr_;
+    std::vector<Client> clients_;
+    double interval_ns_;
+    std::string request_;
+    int epoll_fd_ = -1;
+    int timer_fd_ = -1;
+    int64_t armed_ns_ = -1;
+    int64_t start_ns_ = 0;
+    int64_t end_ns_ = 0;
+    // 空闲连接按下一个计划时刻排队，最早的在堆顶；在途的连接不在里面
+    std::priority_queue<std::pair<int64_t, size_t>, std::vector<std::pair<int64_t, size_t>>, std::greater<>> ready_;
+
+    Histogram corrected_;   // 从计划发送时刻到收完响应（微秒）
+    Histogram service_;     // 从实际发送到收完响应，未校正，用来对比
+    std::vector<char> buffer_;
+    uint64_t status_classes_[6] = {};
+    uint64_t connect_errors_ = 0;
+    uint64_t io_errors_ = 0;
+    uint64_t reconnects_ = 0;
+    uint64_t bytes_in_ = 0;
+    uint64_t bytes_out_ = 0;
+};
+
+int LoadGenerator::openSocket(bool blocking) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | (blocking ? 0 : SOCK_NONBLOCK), 0);
+    if (fd == -1) return -1;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+bool LoadGenerator::run() {
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (epoll_fd_ == -1 || timer_fd_ == -1) {
+        perror("epoll_create1/timerfd_create");
+        return false;
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.u32 = kTimerTag;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, timer_fd_, &ev);
+
+    // 1. 先把所有连接建好（阻塞connect），建连不算进压测时间；连不上直接退出
+    for (size_t i = 0; i < clients_.size(); ++i) {
+        Client& client = clients_[i];
+        client.fd = openSocket(true);
+        if (client.fd == -1 || connect(client.fd, reinterpret_cast<const sockaddr*>(&addr_), sizeof(addr_)) == -1) {
+            std::cerr << "无法连接" << options_.host << ":" << options_.port << ": " << std::strerror(errno) << '\n';
+            return false;
+        }
+        fcntl(client.fd, F_SETFL, fcntl(client.fd, F_GETFL, 0) | O_NONBLOCK);
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.u32 = static_cast<uint32_t>(i);
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, client.fd, &ev);
+        client.state = Client::State::Idle;
+    }
+
+    // 2. 排好每个连接的第一个计划时刻
+    start_ns_ = nowNs();
+    end_ns_ = start_ns_ + static_cast<int64_t>(options_.duration) * 1000000000;
+    for (size_t i = 0; i < clients_.size(); ++i) {
+        clients_[i].next_ns = slot(i, 0);
+        schedule(i);
+    }
+
+    // 3. 到点的空闲连接发出请求；定时器对准下一个计划时刻，其余时间等响应
+    std::vector<epoll_event> events(kMaxEvents);
+    while (true) {
+        int64_t now = nowNs();
+        if (now >= end_ns_) break;
+        while (!ready_.empty() && ready_.top().first <= now) {
+            size_t index = ready_.top().second;
+            ready_.pop();
+            fire(index, now);
+        }
+        armTimer(ready_.empty() ? end_ns_ : std::min(end_ns_, ready_.top().first));
+        int n = epoll_wait(epoll_fd_, events.data(), kMaxEvents, -1);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            return false;
+        }
+        for (int i = 0; i < n; ++i) {
+            uint32_t tag = events[i].data.u32;
+            if (tag == kTimerTag) {
+                uint64_t expirations = 0;
+                ssize_t ignored = read(timer_fd_, &expirations, sizeof(expirations));
+                (void)ignored;
+                armed_ns_ = -1;
+                continue;
+            }
+            Client& client = clients_[tag];
+            if (client.fd == -1) continue;
+            if ((events[i].events & (EPOLLOUT | EPOLLERR)) &&
+                (client.state == Client::State::Connecting || client.state == Client::State::Writing)) {
+                writeRequest(tag);
+            }
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) readResponse(tag);
+        }
+    }
+    return true;
+}
+
+void LoadGenerator::armTimer(int64_t deadline_ns) {
+    if (deadline_ns == armed_ns_) return;
+    itimerspec spec{};
+    spec.it_value.tv_sec = deadline_ns / 1000000000;
+    spec.it_value.tv_nsec = deadline_ns % 1000000000;
+    // 绝对时刻已经过去时立即到期
+    timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, nullptr);
+    armed_ns_ = deadline_ns;
+}
+
+void LoadGenerator::fire(size_t index, int64_t now) {
+    Client& client = clients_[index];
+    client.intended_ns = client.next_ns;
+    client.next_ns = slot(index, ++client.seq);
+    if (client.state == Client::State::Idle) {
+        startRequest(index, now);
+        return;
+    }
+    // 连接之前被关掉了：这个请求先重新连接，建连的时间也算在它的延迟里
+    client.fd = openSocket(false);
+    if (client.fd == -1) {
+        fail(index, connect_errors_);
+        return;
+    }
+    ++reconnects_;
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.u32 = static_cast<uint32_t>(index);
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, client.fd, &ev);
+    client.sent_ns = now;
+    if (connect(client.fd, reinterpret_cast<const sockaddr*>(&addr_), sizeof(addr_)) == 0) {
+        startRequest(index, now);
+    } else if (errno == EINPROGRESS) {
+        client.state = Client::State::Connecting;
+    } else {
+        fail(index, connect_errors_);
+    }
+}
+
+void LoadGenerator::startRequest(size_t index, int64_t now) {
+    Client& client = clients_[index];
+    client.state = Client::State::Writing;
+    client.sent_ns = now;
+    client.written = 0;
+    client.parser.reset();
+    writeRequest(index);
+}
+
+void LoadGenerator::writeRequest(size_t index) {
+    Client& client = clients_[index];
+    if (client.state == Client::State::Connecting) {
+        int error = 0;
+        socklen_t len = sizeof(error);
+        getsockopt(client.fd, SOL_SOCKET, SO_ERROR, &error, &len);
+        if (error != 0) {
+            fail(index, connect_errors_);
+            return;
+        }
+        startRequest(index, client.sent_ns);
+        return;
+    }
+    while (client.written < request_.size()) {
+        ssize_t n = send(client.fd, request_.data() + client.written, request_.size() - client.written, MSG_NOSIGNAL);
+        if (n > 0) {
+            client.written += static_cast<size_t>(n);
+            bytes_out_ += static_cast<uint64_t>(n);
+        } else if (n == -1 && errno == EAGAIN) {
+            return; // 边缘触发，可写时再来
+        } else if (n == -1 && errno == EINTR) {
+            continue;
+        } else {
+            fail(index, io_errors_);
+            return;
+        }
+    }
+    client.state = Client::State::Reading;
+}
+
+void LoadGenerator::readResponse(size_t index) {
+    Client& client = clients_[index];
+    while (client.fd != -1) {
+        ssize_t n = recv(client.fd, buffer_.data(), buffer_.size(), 0);
+        if (n > 0) {
+            bytes_in_ += static_cast<uint64_t>(n);
+            if (client.state != Client::State::Writing && client.state != Client::State::Reading) {
+                continue; // 不是在等响应时收到的数据，丢掉
+            }
+            size_t used = 0;
+            ResponseParser::Result result = client.parser.feed(buffer_.data(), static_cast<size_t>(n), used);
+            if (result == ResponseParser::Result::Error) {
+                fail(index, io_errors_);
+                return;
+            }
+            if (result == ResponseParser::Result::Done) finishResponse(index);
+        } else if (n == 0) {
+            if ((client.state == Client::State::Reading || client.state == Client::State::Writing) &&
+                client.parser.completeOnClose()) {
+                finishResponse(index);
+            } else if (client.state == Client::State::Reading || client.state == Client::State::Writing ||
+                       client.state == Client::State::Connecting) {
+                fail(index, io_errors_);
+            } else {
+                // 空闲的长连接被服务器关掉（空闲超时之类），下一个计划时刻重新连接
+                closeClient(client);
+            }
+            return;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN) {
+            return;
+        } else {
+            if (client.state == Client::State::Idle) {
+                closeClient(client);
+            } else {
+                fail(index, io_errors_);
+            }
+            return;
+        }
+    }
+}
+
+void LoadGenerator::finishResponse(size_t index) {
+    Client& client = clients_[index];
+    int64_t now = nowNs();
+    corrected_.record((now - client.intended_ns) / 1000);
+    service_.record((now - client.sent_ns) / 1000);
+    ++status_classes_[std::min(client.parser.status / 100, 5)];
+    if (client.parser.close) {
+        closeClient(client);
+    } else {
+        client.state = Client::State::Idle;
+    }
+    schedule(index);
+}
+
+void LoadGenerator::fail(size_t index, uint64_t& counter) {
+    ++counter;
+    closeClient(clients_[index]);
+    schedule(index);
+}
+
+void LoadGenerator::closeClient(Client& client) {
+    if (client.fd != -1) ::close(client.fd); // close会把fd从epoll里摘掉
+    client.fd = -1;
+    client.state = Client::State::Closed;
+}
+
+void LoadGenerator::report() const {
+    double seconds = static_cast<double>(end_ns_ - start_ns_) / 1e9;
+    // 到结束时还在途的请求，以及计划时刻已到、因为连接被占着还没发出的请求
+    uint64_t in_flight = 0;
+    uint64_t backlog = 0;
+    for (size_t i = 0; i < clients_.size(); ++i) {
+        const Client& client = clients_[i];
+        if (client.state == Client::State::Connecting || client.state == Client::State::Writing ||
+            client.state == Client::State::Reading) {
+            ++in_flight;
+        }
+        for (uint64_t seq = client.seq; slot(i, seq) < end_ns_; ++seq) ++backlog;
+    }
+
+    auto ms = [](int64_t us) { return static_cast<double>(us) / 1000; };
+    std::printf("目标 http://%s:%s%s，%zu个连接，计划 %.0f 请求/秒，持续 %.1f 秒\n", options_.host.c_str(),
+                options_.port.c_str(), options_.path.c_str(), clients_.size(), options_.rate, seconds);
+    std::printf("延迟（从计划发送时刻算起，已校正协调遗漏）:\n");
+    static constexpr double kPercentiles[] = {50, 75, 90, 99, 99.9, 99.99};
+    for (double p : kPercentiles) std::printf("  p%-6g %10.3f ms\n", p, ms(corrected_.percentile(p)));
+    std::printf("  max     %10.3f ms\n  mean    %10.3f ms\n", ms(corrected_.max()), corrected_.mean() / 1000);
+    std::printf("服务时间（从实际发送算起，未校正）: p50 %.3f ms，p99 %.3f ms，p99.9 %.3f ms，max %.3f ms\n",
+                ms(service_.percentile(50)), ms(service_.percentile(99)), ms(service_.percentile(99.9)),
+                ms(service_.max()));
+    std::printf("完成 %llu 个请求，%.1f 请求/秒；读入 %.2f MB/s，写出 %.2f MB/s\n",
+                static_cast<unsigned long long>(corrected_.count()), corrected_.count() / seconds,
+                bytes_in_ / seconds / 1e6, bytes_out_ / seconds / 1e6);
+    std::printf("状态码: 1xx %llu，2xx %llu，3xx %llu，4xx %llu，5xx %llu\n",
+                static_cast<unsigned long long>(status_classes_[1]), static_cast<unsigned long long>(status_classes_[2]),
+                static_cast<unsigned long long>(status_classes_[3]), static_cast<unsigned long long>(status_classes_[4]),
+                static_cast<unsigned long long>(status_classes_[5]));
+    std::printf("错误: 连接 %llu，读写 %llu；重新连接 %llu 次\n", static_cast<unsigned long long>(connect_errors_),
+                static_cast<unsigned long long>(io_errors_), static_cast<unsigned long long>(reconnects_));
+    if (in_flight + backlog > 0) {
+        std::printf("结束时 %llu 个请求在途、%llu 个请求到了计划时刻还没发出：", static_cast<unsigned long long>(in_flight),
+                    static_cast<unsigned long long>(backlog));
+        std::printf(backlog > clients_.size() ? "没有跟上计划速率，真实延迟比上面更差\n" : "正常的收尾\n");
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseArgs(argc, argv, options)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* result = nullptr;
+    int rc = getaddrinfo(options.host.c_str(), options.port.c_str(), &hints, &result);
+    if (rc != 0) {
+        std::cerr << "无法解析" << options.host << ":" << options.port << ": " << gai_strerror(rc) << '\n';
+        return 1;
+    }
+    sockaddr_in addr = *reinterpret_cast<const sockaddr_in*>(result->ai_addr);
+    freeaddrinfo(result);
+
+    LoadGenerator generator(options, addr);
+    if (!generator.run()) return 1;
+    generator.report();
+    return 0;
+}
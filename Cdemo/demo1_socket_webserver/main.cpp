@@ -1,65 +1,391 @@
 #include <iostream>      // 标准输入输出流头文件
 #include <string>        // 字符串处理
 #include <cstring>       // C风格字符串处理
+#include <cstdio>        // snprintf
+#include <ctime>         // localtime_r，微缓存示例里的生成时刻
 #include <sys/socket.h>  // socket相关API
 #include <netinet/in.h>  // sockaddr_in结构体
+#include <sys/stat.h>    // stat，检查静态文件根目录
 #include <unistd.h>      // close、read、write等系统调用
+#include <csignal>       // signal，忽略SIGPIPE
+#include <pthread.h>     // pthread_setaffinity_np，把worker绑定到CPU
+#include <thread>        // 多Reactor模式的worker线程
+#include <functional>    // std::cref
+#include <vector>
+#include "config.h"      // 命令行参数
+#include "event_loop.h"  // epoll事件循环
+#include "uring_loop.h"  // io_uring事件循环
+#include "http_handler.h" // 请求处理
+#include "compressor.h"  // 静态文件的后台压缩
+#include "access_log.h"  // 异步访问日志
+#include "metrics.h"     // Prometheus指标
+#include "router.h"      // 路由表
+#include "tls.h"         // HTTPS
+#include "websocket_hub.h" // WebSocket连接和广播
+#include "coroutine.h"   // 协程路由
+#include <memory>
 
-// 定义返回给浏览器的HTML内容，包含HTTP响应头和HTML正文
-const char* html_response =
-    "HTTP/1.1 200 OK\r\nContent-Type: text/html; charset=utf-8\r\n\r\n"
+// 定义返回给浏览器的HTML正文，响应头由HttpHandler根据长连接状态生成
+const char* html_body =
     "<html>\n"
     "<head>\n<meta charset=\"utf-8\">\n<title>软件体系架构实验</title>\n</head>\n"
     "<body>\n<h1>软件体系架构实验(1)</h1>\n<p>软件体系架构实验(1), WEB服务器实现</p>\n</body>\n"
     "</html>\n";
 
-int main() {
+// 上传示例：只统计字节数和FNV-1a校验和，请求体读到一段算一段，多大的上传都只占一个缓冲区
+class ChecksumSink : public BodySink {
+public:
+    bool write(std::string_view data) override {
+        for (char c : data) {
+            hash_ = (hash_ ^ static_cast<unsigned char>(c)) * 0x100000001b3ull;
+        }
+        bytes_ += data.size();
+        return true;
+    }
+
+    void finish(RouteResponse& response) override {
+        char text[96];
+        int len = snprintf(text, sizeof(text), "收到 %llu 字节，FNV-1a %016llx\n",
+                           static_cast<unsigned long long>(bytes_), static_cast<unsigned long long>(hash_));
+        response.body.append(text, static_cast<size_t>(len));
+    }
+
+private:
+    uint64_t bytes_ = 0;
+    uint64_t hash_ = 0xcbf29ce484222325ull;
+};
+
+// WebSocket回显：收到什么原样发回去
+class EchoSocket : public WebSocketHandler {
+public:
+    void onMessage(WebSocket& socket, std::string_view message, bool binary) override {
+        socket.send(message, binary);
+    }
+};
+
+// 聊天室：每条消息广播给连到这条路由的所有客户端，包括其他Reactor线程上的；帧只序列化一次
+class ChatRoom : public WebSocketHandler {
+public:
+    explicit ChatRoom(WebSocketHub& hub) : hub_(hub) {}
+
+    void onOpen(WebSocket& socket) override {
+        announce(socket, "加入了聊天室");
+    }
+
+    void onMessage(WebSocket&, std::string_view message, bool binary) override {
+        hub_.broadcast(*this, message, binary);
+    }
+
+    void onClose(WebSocket& socket, uint16_t) override {
+        announce(socket, "离开了聊天室");
+    }
+
+private:
+    void announce(const WebSocket& socket, const char* what) {
+        char text[64];
+        int len = snprintf(text, sizeof(text), "用户%llu%s", static_cast<unsigned long long>(socket.id()), what);
+        hub_.broadcast(*this, std::string_view(text, static_cast<size_t>(len)));
+    }
+
+    WebSocketHub& hub_;
+};
+
+// 协程路由示例：处理函数是顺序执行的代码，co_await时挂起，Reactor线程去处理别的连接
+// 写成普通函数而不是带捕获的lambda：协程帧里只保存参数，lambda对象本身在协程第一次挂起时就已经销毁了
+Task helloCoroutine(CoConnection& conn) {
+    std::string text = "你好，";
+    text += conn.params().get("name");
+    text += "\n";
+    co_await conn.write(text);
+}
+
+// 每隔100ms输出一行，一共n行：sleep期间不占线程，连接只剩一个定时器节点和协程帧
+Task countCoroutine(CoConnection& conn) {
+    using namespace std::chrono_literals;
+    unsigned count = 0;
+    for (char c : conn.params().get("n")) {
+        if (c < '0' || c > '9' || count > 1000) {
+            conn.response().status = "400 Bad Request";
+            conn.response().body = "n必须是不超过1000的非负整数\n";
+            co_return;
+        }
+        count = count * 10 + static_cast<unsigned>(c - '0');
+    }
+    char line[32];
+    for (unsigned i = 1; i <= count; ++i) {
+        if (i > 1) co_await sleep(100ms);
+        int len = snprintf(line, sizeof(line), "第%u行\n", i);
+        co_await conn.write(std::string_view(line, static_cast<size_t>(len)));
+    }
+}
+
+// 请求体读到一段回写一段：客户端收得慢时read也跟着停下，内存里只有一段
+Task echoCoroutine(CoConnection& conn) {
+    conn.response().content_type = "application/octet-stream";
+    while (true) {
+        std::string_view piece = co_await conn.read();
+        if (piece.empty()) break;
+        co_await conn.write(piece);
+    }
+}
+
+// 当前时刻，精确到毫秒，比如"14:03:27.512"；微缓存示例用它看出响应是哪一刻生成的
+std::string timeOfDay() {
+    using namespace std::chrono;
+    auto now = system_clock::now();
+    std::time_t seconds = system_clock::to_time_t(now);
+    auto millis = duration_cast<milliseconds>(now.time_since_epoch()).count() % 1000;
+    std::tm local{};
+    localtime_r(&seconds, &local);
+    char text[32];
+    int len = snprintf(text, sizeof(text), "%02d:%02d:%02d.%03lld", local.tm_hour, local.tm_min, local.tm_sec,
+                       static_cast<long long>(millis));
+    return std::string(text, static_cast<size_t>(len));
+}
+
+// 微缓存示例：假装要花300ms查询后端才能生成的报表。路由打开了微缓存，1秒内的请求直接用缓存，
+// 过期后10秒内先给旧报表、同时在后台生成新的；不管同时来多少请求，每个Reactor每秒最多生成一次
+Task reportCoroutine(CoConnection& conn) {
+    using namespace std::chrono_literals;
+    std::string text = "报表 ";
+    text += conn.params().get("name");
+    co_await sleep(300ms);
+    text += "，生成于 ";
+    text += timeOfDay();
+    text += "\n";
+    co_await conn.write(text);
+}
+
+// 示例路由：路径参数和通配的值直接指向请求路径，处理函数只往复用的响应里写正文
+// 没有匹配的路径照旧返回静态文件（-d）或上面的内置页面
+void registerRoutes(Router& router, WebSocketHub& websockets) {
+    router.get("/api/hello/:name", [](const HttpRequest&, const RouteParams& params, RouteResponse& response) {
+        response.body += "你好，";
+        response.body += params.get("name");
+        response.body += "\n";
+    });
+    router.get("/api/users/:id/posts/:post", [](const HttpRequest&, const RouteParams& params,
+                                                RouteResponse& response) {
+        response.body += "用户 ";
+        response.body += params.get("id");
+        response.body += " 的文章 ";
+        response.body += params.get("post");
+        response.body += "\n";
+    });
+    router.get("/api/files/*path", [](const HttpRequest&, const RouteParams& params, RouteResponse& response) {
+        response.body += "文件路径: ";
+        response.body += params.get("path");
+        response.body += "\n";
+    });
+    router.post("/api/echo", [](const HttpRequest& request, const RouteParams&, RouteResponse& response) {
+        response.content_type = "application/octet-stream";
+        response.body += request.body;
+    });
+    // 流式响应：生成count行文本，每次socket可写时才生成下一段，内存里从不超过一段
+    router.get("/api/stream/:count", [](const HttpRequest&, const RouteParams& params, RouteResponse& response) {
+        uint64_t count = 0;
+        for (char c : params.get("count")) {
+            if (c < '0' || c > '9' || count > UINT64_MAX / 100) {
+                response.status = "400 Bad Request";
+                response.body = "count必须是不太大的非负整数\n";
+                return;
+            }
+            count = count * 10 + static_cast<uint64_t>(c - '0');
+        }
+        response.stream = [next = uint64_t{0}, count](std::string& out) mutable {
+            char line[48];
+            while (next < count && out.size() + sizeof(line) <= kStreamPieceSize) {
+                int len = snprintf(line, sizeof(line), "第%llu行\n", static_cast<unsigned long long>(++next));
+                out.append(line, static_cast<size_t>(len));
+            }
+            return next < count;
+        };
+    });
+    router.get("/api/time", [](const HttpRequest&, const RouteParams&, RouteResponse& response) {
+        response.body += "服务器时间 ";
+        response.body += timeOfDay();
+        response.body += "\n";
+    });
+    router.upload("/api/upload", [](const HttpRequest&, const RouteParams&) {
+        return std::make_unique<ChecksumSink>();
+    });
+    router.handleCoroutine("GET", "/co/hello/:name", helloCoroutine);
+    router.handleCoroutine("GET", "/co/count/:n", countCoroutine);
+    router.handleCoroutine("POST", "/co/echo", echoCoroutine);
+    router.handleCoroutine("GET", "/co/report/:name", reportCoroutine);
+    // 微缓存：/api/time的内容1秒内不变；报表按Accept-Language分别缓存，过期后10秒内可以先给旧的
+    router.cache("/api/time", CachePolicy{1000, 0, {}});
+    router.cache("/co/report/:name", CachePolicy{1000, 10000, {"Accept-Language"}});
+    router.websocket("/ws/echo", std::make_shared<EchoSocket>());
+    router.websocket("/ws/chat", std::make_shared<ChatRoom>(websockets));
+}
+
+// 创建、绑定并监听一个非阻塞的TCP socket，失败返回-1
+// reuse_port为true时开启SO_REUSEPORT，多个socket可以绑定同一端口，由内核按四元组哈希分发新连接
+// backlog是已完成握手、等待accept的连接队列长度；队列满后内核丢弃新的握手，客户端要等重传超时
+int createListenSocket(uint16_t port, bool reuse_port, int backlog) {
     // 1. 创建socket，AF_INET表示IPv4，SOCK_STREAM表示TCP
     int server_fd = socket(AF_INET, SOCK_STREAM, 0);
     if (server_fd == -1) {
         perror("socket"); // 创建失败时输出错误信息
-        return 1;
+        return -1;
+    }
+
+    // 监听socket设为非阻塞，配合边缘触发一次accept完所有排队连接
+    int reuse = 1;
+    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (reuse_port && setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) < 0) {
+        perror("setsockopt(SO_REUSEPORT)");
+        close(server_fd);
+        return -1;
     }
+    setNonBlocking(server_fd);
 
     // 2. 配置服务器地址结构体
     sockaddr_in addr{};                // 初始化为0
     addr.sin_family = AF_INET;         // 使用IPv4
     addr.sin_addr.s_addr = INADDR_ANY; // 监听所有本地IP
-    addr.sin_port = htons(8080);       // 端口号8080，htons保证字节序正确
+    addr.sin_port = htons(port);       // htons保证字节序正确
 
     // 3. 绑定socket到指定IP和端口
     if (bind(server_fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
         perror("bind"); // 绑定失败
+        close(server_fd);
+        return -1;
+    }
+
+    // 4. 开始监听端口；过载时的排队由准入控制在用户态处理，这里只需容纳一批突发的连接
+    if (listen(server_fd, backlog) < 0) {
+        perror("listen");
+        close(server_fd);
+        return -1;
+    }
+    return server_fd;
+}
+
+// 把当前线程绑定到指定CPU，Reactor的数据始终留在同一个核的缓存里
+void pinToCpu(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err != 0) {
+        std::cerr << "绑定CPU " << cpu << " 失败: " << strerror(err) << std::endl;
+    }
+}
+
+// 在监听socket上运行事件循环；io_uring初始化失败时回退到epoll
+// 每个事件循环有自己的HttpHandler、访问日志队列、指标计数器和WebSocket连接表，线程之间只共享后台压缩器、日志线程、
+// 只读的路由表、TLS上下文（会话缓存和票据密钥在里面，恢复请求落到哪个线程都能命中）和广播用的WebSocketHub
+void runLoop(int server_fd, const ServerConfig& config, Compressor* compressor, AccessLog* access_log,
+             Metrics* metrics, const Router* router, TlsContext* tls, WebSocketHub* websockets) {
+    HttpHandler handler(config, html_body, compressor, access_log ? access_log->createRing() : nullptr, router,
+                        websockets->createGroup(), metrics->createShard());
+    if (config.io_uring) {
+        UringLoop loop(server_fd, handler);
+        if (loop.ok()) {
+            loop.run();
+            return;
+        }
+        std::cerr << "io_uring初始化失败，回退到epoll" << std::endl;
+    }
+    EventLoop loop(server_fd, handler, tls);
+    loop.run();
+}
+
+// 多Reactor模式下每个worker线程的入口
+// 监听socket、epoll实例、连接表全部在线程内创建，worker之间不共享任何可变状态
+void runWorker(int index, const ServerConfig& config, Compressor* compressor, AccessLog* access_log,
+               Metrics* metrics, const Router* router, TlsContext* tls, WebSocketHub* websockets) {
+    int cpus = static_cast<int>(std::thread::hardware_concurrency());
+    if (cpus > 0) pinToCpu(index % cpus);
+
+    int server_fd = createListenSocket(config.port, true, config.backlog);
+    if (server_fd == -1) {
+        std::cerr << "worker " << index << " 创建监听socket失败" << std::endl;
+        return;
+    }
+    runLoop(server_fd, config, compressor, access_log, metrics, router, tls, websockets);
+    close(server_fd);
+}
+
+int main(int argc, char* argv[]) {
+    ServerConfig config;
+    if (!parseArgs(argc, argv, config)) {
+        return 1;
+    }
+
+    // 静态文件模式：根目录必须存在
+    struct stat root_stat{};
+    if (!config.root.empty() && (stat(config.root.c_str(), &root_stat) != 0 || !S_ISDIR(root_stat.st_mode))) {
+        std::cerr << "静态文件根目录不存在: " << config.root << std::endl;
         return 1;
     }
 
-    // 4. 开始监听端口，最多允许5个等待连接
-    listen(server_fd, 5);
-    std::cout << "服务器已启动，监听8080端口..." << std::endl;
+    // 对端提前断开时write不应让整个进程退出
+    signal(SIGPIPE, SIG_IGN);
 
-    // 5. 进入主循环，持续接受客户端连接
-    while (true) {
-        sockaddr_in client_addr{};           // 客户端地址结构体
-        socklen_t client_len = sizeof(client_addr);
-        // 等待客户端连接，返回新的socket文件描述符
-        int client_fd = accept(server_fd, (sockaddr*)&client_addr, &client_len);
-        if (client_fd < 0) {
-            perror("accept"); // 接受连接失败
-            continue;
+    // 内核缺少io_uring所需特性时自动回退到epoll
+    if (config.io_uring && !UringLoop::supported()) {
+        std::cerr << "当前内核不支持io_uring后端所需特性，回退到epoll" << std::endl;
+        config.io_uring = false;
+    }
+
+    // 静态文件模式下启动后台压缩线程，压缩结果所有Reactor共用
+    std::unique_ptr<Compressor> compressor;
+    if (!config.root.empty() && config.compress_mb > 0) {
+        compressor = std::make_unique<Compressor>(config.compress_mb * 1024 * 1024);
+    }
+
+    // 访问日志由后台线程格式化和写出，请求线程只往自己的队列里放一条定长记录
+    std::unique_ptr<AccessLog> access_log;
+    if (!config.access_log.empty()) {
+        access_log = std::make_unique<AccessLog>(config.access_log);
+        if (!access_log->ok()) return 1;
+    }
+
+    // 指标始终在计数（每个Reactor只写自己的分片），--metrics off只是不提供抓取的路径
+    Metrics metrics;
+
+    // 配置了证书时整个端口改为HTTPS
+    std::unique_ptr<TlsContext> tls;
+    if (!config.tls_cert.empty()) {
+        tls = std::make_unique<TlsContext>(config.tls_cert, config.tls_key);
+        if (!tls->ok()) return 1;
+    }
+    const char* scheme = tls ? "（HTTPS）" : "";
+
+    // 路由表在启动worker之前建好，之后只读，所有线程共用；WebSocket的广播经过hub投递到各个线程
+    WebSocketHub websockets;
+    Router router;
+    registerRoutes(router, websockets);
+
+    if (config.workers > 1) {
+        // 5. 多Reactor模式：每个线程一个SO_REUSEPORT监听socket和一个事件循环，吞吐随核数线性扩展
+        std::vector<std::thread> workers;
+        for (int i = 0; i < config.workers; ++i) {
+            workers.emplace_back(runWorker, i, std::cref(config), compressor.get(), access_log.get(), &metrics,
+                                 &router, tls.get(), &websockets);
         }
-        // 6. 读取客户端请求数据
-        char buffer[4096] = {0};             // 存放请求内容的缓冲区
-        int len = read(client_fd, buffer, sizeof(buffer)-1); // 读取数据
-        if (len > 0) {
-            buffer[len] = '\0';             // 确保字符串结尾
-            std::cout << "收到请求:\n" << buffer << std::endl; // 打印请求内容
-            // 7. 回复HTML内容给客户端
-            write(client_fd, html_response, strlen(html_response));
+        std::cout << "服务器已启动，监听" << config.port << "端口" << scheme << "，" << config.workers
+                  << "个Reactor线程" << (config.io_uring ? "（io_uring）" : "") << "..." << std::endl;
+        for (auto& worker : workers) {
+            worker.join();
         }
-        // 8. 关闭本次客户端连接
-        close(client_fd);
+        return 0;
     }
-    // 9. 关闭服务器socket（理论上不会执行到这里）
+
+    int server_fd = createListenSocket(config.port, false, config.backlog);
+    if (server_fd == -1) {
+        return 1;
+    }
+    std::cout << "服务器已启动，监听" << config.port << "端口" << scheme << (config.io_uring ? "（io_uring）" : "")
+              << "..." << std::endl;
+
+    // 5. 进入事件循环：一个线程同时服务所有连接，慢客户端不会阻塞其他客户端
+    runLoop(server_fd, config, compressor.get(), access_log.get(), &metrics, &router, tls.get(), &websockets);
+
+    // 6. 关闭服务器socket（理论上不会执行到这里）
     close(server_fd);
     return 0;
 }
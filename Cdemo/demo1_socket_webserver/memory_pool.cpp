@@ -0,0 +1,231 @@
+#include "memory_pool.h"
+
+#include <cstring>
+
+namespace {
+
+thread_local FramePool* t_frame_pool = nullptr;
+
+// 包含size字节的最小一档的下标
+size_t frameClass(size_t size, size_t min_shift) {
+    size_t index = 0;
+    while ((size_t{1} << (min_shift + index)) < size) ++index;
+    return index;
+}
+
+void appendLine(std::string& out, const char* prefix, const char* name, uint64_t value) {
+    out += prefix;
+    out += name;
+    out += ' ';
+    out += std::to_string(value);
+    out += '\n';
+}
+
+} // namespace
+
+char* BufferPool::acquire() {
+    if (!free_) {
+        // 空闲块用完时一次申请一整个slab，切成块后全部挂进空闲链表
+        slabs_.push_back(std::make_unique<char[]>(kBlocksPerSlab * kIoBufferSize));
+        char* slab = slabs_.back().get();
+        for (size_t i = kBlocksPerSlab; i-- > 0;) {
+            auto* block = reinterpret_cast<FreeBlock*>(slab + i * kIoBufferSize);
+            block->next = free_;
+            free_ = block;
+        }
+        ++stats_.slabs;
+        stats_.blocks += kBlocksPerSlab;
+        stats_.free_blocks += kBlocksPerSlab;
+    }
+    FreeBlock* block = free_;
+    free_ = block->next;
+    --stats_.free_blocks;
+    ++stats_.acquires;
+    return reinterpret_cast<char*>(block);
+}
+
+void BufferPool::release(char* block) {
+    auto* free_block = reinterpret_cast<FreeBlock*>(block);
+    free_block->next = free_;
+    free_ = free_block;
+    ++stats_.free_blocks;
+}
+
+char* InputBuffer::prepare(size_t n) {
+    if (capacity_ - size_ >= n) return data_ + size_;
+    if (capacity_ == 0 && n <= kIoBufferSize) {
+        data_ = pool_->acquire();
+        capacity_ = kIoBufferSize;
+        return data_;
+    }
+    // 超过一块：按两倍增长搬到堆上，请求处理完变空时释放
+    size_t capacity = capacity_ * 2 > size_ + n ? capacity_ * 2 : size_ + n;
+    char* data = new char[capacity];
+    if (size_ > 0) std::memcpy(data, data_, size_);
+    release();
+    data_ = data;
+    capacity_ = capacity;
+    pool_->countOversized();
+    return data_ + size_;
+}
+
+void InputBuffer::append(const char* data, size_t n) {
+    std::memcpy(prepare(n), data, n);
+    size_ += n;
+}
+
+void InputBuffer::consume(size_t n) {
+    if (n >= size_) {
+        clear();
+        return;
+    }
+    // 剩下的是下一个请求的开头，通常只有几十字节
+    std::memmove(data_, data_ + n, size_ - n);
+    size_ -= n;
+}
+
+void InputBuffer::release() {
+    if (capacity_ == kIoBufferSize) {
+        pool_->release(data_);
+    } else if (capacity_ > 0) {
+        delete[] data_;
+    }
+    data_ = nullptr;
+    capacity_ = 0;
+}
+
+std::string_view OutputArena::store(std::string_view data) {
+    char* dest = allocate(data.size());
+    if (!data.empty()) std::memcpy(dest, data.data(), data.size());
+    return std::string_view(dest, data.size());
+}
+
+std::string_view OutputArena::store(std::initializer_list<std::string_view> parts) {
+    size_t size = 0;
+    for (std::string_view part : parts) size += part.size();
+    char* dest = allocate(size);
+    char* p = dest;
+    for (std::string_view part : parts) {
+        if (!part.empty()) std::memcpy(p, part.data(), part.size());
+        p += part.size();
+    }
+    return std::string_view(dest, size);
+}
+
+char* OutputArena::allocate(size_t size) {
+    if (!head_ || head_->capacity - used_ < size) {
+        Block* block;
+        if (size <= kBlockCapacity) {
+            block = reinterpret_cast<Block*>(pool_->acquire());
+            block->capacity = kBlockCapacity;
+        } else {
+            block = reinterpret_cast<Block*>(new char[sizeof(Block) + size]);
+            block->capacity = size;
+            pool_->countOversized();
+        }
+        block->next = head_;
+        head_ = block;
+        used_ = 0;
+    }
+    char* dest = reinterpret_cast<char*>(head_ + 1) + used_;
+    used_ += size;
+    return dest;
+}
+
+void OutputArena::clear() {
+    while (head_) {
+        Block* next = head_->next;
+        if (head_->capacity == kBlockCapacity) {
+            pool_->release(reinterpret_cast<char*>(head_));
+        } else {
+            delete[] reinterpret_cast<char*>(head_);
+        }
+        head_ = next;
+    }
+    used_ = 0;
+}
+
+void* FramePool::allocateFrame(size_t size) {
+    FramePool* pool = t_frame_pool;
+    char* block = pool ? pool->acquire(kHeaderSize + size) : static_cast<char*>(::operator new(kHeaderSize + size));
+    *reinterpret_cast<FramePool**>(block) = pool;
+    return block + kHeaderSize;
+}
+
+void FramePool::releaseFrame(void* frame, size_t size) noexcept {
+    char* block = static_cast<char*>(frame) - kHeaderSize;
+    FramePool* pool = *reinterpret_cast<FramePool**>(block);
+    if (pool) {
+        pool->release(block, kHeaderSize + size);
+    } else {
+        ::operator delete(block);
+    }
+}
+
+FramePool* FramePool::current() {
+    return t_frame_pool;
+}
+
+void FramePool::setCurrent(FramePool* pool) {
+    t_frame_pool = pool;
+}
+
+char* FramePool::acquire(size_t size) {
+    ++stats_.allocations;
+    ++stats_.in_use;
+    size_t index = frameClass(size, kMinShift);
+    if (index >= kClasses) {
+        ++stats_.oversized;
+        return static_cast<char*>(::operator new(size));
+    }
+    if (!free_[index]) {
+        // 和BufferPool一样一次申请一整个slab，切成这一档的块挂进空闲链表
+        size_t block_size = size_t{1} << (kMinShift + index);
+        slabs_.push_back(std::make_unique<char[]>(kBlocksPerSlab * block_size));
+        char* slab = slabs_.back().get();
+        for (size_t i = kBlocksPerSlab; i-- > 0;) {
+            auto* block = reinterpret_cast<FreeBlock*>(slab + i * block_size);
+            block->next = free_[index];
+            free_[index] = block;
+        }
+        ++stats_.slabs;
+    }
+    FreeBlock* block = free_[index];
+    free_[index] = block->next;
+    return reinterpret_cast<char*>(block);
+}
+
+void FramePool::release(char* block, size_t size) {
+    --stats_.in_use;
+    size_t index = frameClass(size, kMinShift);
+    if (index >= kClasses) {
+        ::operator delete(block);
+        return;
+    }
+    auto* free_block = reinterpret_cast<FreeBlock*>(block);
+    free_block->next = free_[index];
+    free_[index] = free_block;
+}
+
+void appendStats(std::string& out, const char* prefix, const ObjectPoolStats& stats) {
+    appendLine(out, prefix, "_slabs", stats.slabs);
+    appendLine(out, prefix, "_capacity", stats.capacity);
+    appendLine(out, prefix, "_in_use", stats.in_use);
+    appendLine(out, prefix, "_object_bytes", stats.object_size);
+}
+
+void appendStats(std::string& out, const char* prefix, const BufferPool::Stats& stats) {
+    appendLine(out, prefix, "_slabs", stats.slabs);
+    appendLine(out, prefix, "_blocks", stats.blocks);
+    appendLine(out, prefix, "_free_blocks", stats.free_blocks);
+    appendLine(out, prefix, "_block_bytes", kIoBufferSize);
+    appendLine(out, prefix, "_acquires", stats.acquires);
+    appendLine(out, prefix, "_oversized", stats.oversized);
+}
+
+void appendStats(std::string& out, const char* prefix, const FramePool::Stats& stats) {
+    appendLine(out, prefix, "_slabs", stats.slabs);
+    appendLine(out, prefix, "_allocations", stats.allocations);
+    appendLine(out, prefix, "_in_use", stats.in_use);
+    appendLine(out, prefix, "_oversized", stats.oversized);
+}
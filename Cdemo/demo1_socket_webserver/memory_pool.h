@@ -0,0 +1,227 @@
+#ifndef MEMORY_POOL_H
+#define MEMORY_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// 每个Reactor自己的内存池，只在本线程使用，没有锁
+// 连接对象和I/O缓冲区都按slab成批向系统申请，之后在池内循环使用；
+// 稳定运行时建立连接、收发请求都不再调用malloc/free
+
+constexpr size_t kIoBufferSize = 4096;  // 池中每个I/O缓冲区块的大小
+
+// 定长I/O缓冲区池：每个slab切成64块，空闲块串成单链表，借还都是O(1)
+class BufferPool {
+public:
+    struct Stats {
+        uint64_t slabs = 0;       // 向系统申请过的slab数
+        uint64_t blocks = 0;      // 块总数
+        uint64_t free_blocks = 0; // 空闲块数
+        uint64_t acquires = 0;    // 累计借出次数
+        uint64_t oversized = 0;   // 超过一块、只能单独在堆上分配的次数（大请求、目录列表等）
+    };
+
+    BufferPool() = default;
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    char* acquire();
+    void release(char* block);
+    void countOversized() { ++stats_.oversized; }
+    const Stats& stats() const { return stats_; }
+
+private:
+    static constexpr size_t kBlocksPerSlab = 64;
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    std::vector<std::unique_ptr<char[]>> slabs_;
+    FreeBlock* free_ = nullptr;
+    Stats stats_;
+};
+
+struct ObjectPoolStats {
+    uint64_t slabs = 0;
+    uint64_t capacity = 0;     // 已经申请的对象槽位
+    uint64_t in_use = 0;
+    uint64_t object_size = 0;  // 每个对象的字节数
+};
+
+// 定长对象池：连接对象按slab（每次64个）申请，释放的对象放回空闲链表，下次直接复用
+template <typename T>
+class ObjectPool {
+public:
+    using Stats = ObjectPoolStats;
+
+    ObjectPool() = default;
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool& operator=(const ObjectPool&) = delete;
+
+    // 调用方负责在池销毁前destroy所有对象
+    template <typename... Args>
+    T* create(Args&&... args) {
+        if (!free_) grow();
+        Slot* slot = free_;
+        free_ = slot->next;
+        ++stats_.in_use;
+        return new (slot->storage) T(std::forward<Args>(args)...);
+    }
+
+    void destroy(T* object) {
+        object->~T();
+        auto* slot = reinterpret_cast<Slot*>(object);
+        slot->next = free_;
+        free_ = slot;
+        --stats_.in_use;
+    }
+
+    const Stats& stats() const { return stats_; }
+
+private:
+    static constexpr size_t kObjectsPerSlab = 64;
+    union Slot {
+        Slot* next;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    void grow() {
+        slabs_.push_back(std::make_unique<Slot[]>(kObjectsPerSlab));
+        Slot* slab = slabs_.back().get();
+        for (size_t i = kObjectsPerSlab; i-- > 0;) {
+            slab[i].next = free_;
+            free_ = &slab[i];
+        }
+        ++stats_.slabs;
+        stats_.capacity += kObjectsPerSlab;
+    }
+
+    std::vector<std::unique_ptr<Slot[]>> slabs_;
+    Slot* free_ = nullptr;
+    Stats stats_{0, 0, 0, sizeof(Slot)};
+};
+
+// 连接的输入缓冲区：平时借用池里的一块，请求超过一块时换成堆上按需增长的内存；
+// 数据处理完变空时立即归还，空闲的长连接不占任何缓冲区
+class InputBuffer {
+public:
+    explicit InputBuffer(BufferPool& pool) : pool_(&pool) {}
+    ~InputBuffer() { release(); }
+
+    InputBuffer(const InputBuffer&) = delete;
+    InputBuffer& operator=(const InputBuffer&) = delete;
+
+    char* data() { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    char& operator[](size_t index) { return data_[index]; }
+    std::string_view view() const { return std::string_view(data_, size_); }
+
+    // 保证至少还能写入n字节，返回写入位置；写完后用commit确认实际写入的字节数
+    char* prepare(size_t n);
+    void commit(size_t n) { size_ += n; }
+    // 剩余可以直接写入的空间
+    size_t available() const { return capacity_ - size_; }
+    void append(const char* data, size_t n);
+
+    // 丢掉前n字节（已处理的请求），变空时归还内存
+    void consume(size_t n);
+    void clear() {
+        size_ = 0;
+        release();
+    }
+
+private:
+    void release();
+
+    BufferPool* pool_;
+    char* data_ = nullptr;
+    size_t size_ = 0;
+    size_t capacity_ = 0;   // 等于kIoBufferSize时内存来自池，更大时在堆上
+};
+
+// 一批响应里动态生成的内容（响应头、目录列表等）：按顺序写进从池里借来的块，整批发送完一起归还
+// 块不会移动，写入的数据在clear()之前地址不变，可以直接被iovec引用
+class OutputArena {
+public:
+    explicit OutputArena(BufferPool& pool) : pool_(&pool) {}
+    ~OutputArena() { clear(); }
+
+    OutputArena(const OutputArena&) = delete;
+    OutputArena& operator=(const OutputArena&) = delete;
+
+    std::string_view store(std::string_view data);
+    // 几段内容依次拷进一段连续内存，比如状态行+Date+其余头部，发送时只占一个iovec
+    std::string_view store(std::initializer_list<std::string_view> parts);
+    void clear();
+
+private:
+    char* allocate(size_t size);
+
+    struct Block {
+        Block* next;
+        size_t capacity;    // 块头之后可用的字节数
+    };
+    static constexpr size_t kBlockCapacity = kIoBufferSize - sizeof(Block);
+
+    BufferPool* pool_;
+    Block* head_ = nullptr;  // 最新的块在链表头，只有它还可能有剩余空间
+    size_t used_ = 0;        // 最新的块已经写了多少字节
+};
+
+// 协程帧池：帧按大小分成6档（128字节到4KB，每档翻倍），每档和BufferPool一样按slab成批申请、空闲块串成单链表
+// 帧的大小由编译器决定，operator new里拿不到所属的连接，所以用线程级的“当前池”：
+// 每个事件循环开始运行时把自己的池设为本线程的当前池，协程的创建和销毁都在这个线程里
+// 每个帧前面留16字节记下它来自哪个池（没有当前池时来自堆），释放时还回原处
+class FramePool {
+public:
+    struct Stats {
+        uint64_t slabs = 0;        // 向系统申请过的slab数（所有档合计）
+        uint64_t allocations = 0;  // 累计分配的帧数
+        uint64_t in_use = 0;       // 还没释放的帧数
+        uint64_t oversized = 0;    // 超过4KB、只能单独在堆上分配的次数
+    };
+
+    FramePool() = default;
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+
+    // 协程promise的operator new/delete调用：从本线程的当前池分配，释放时还给分配它的池
+    static void* allocateFrame(size_t size);
+    static void releaseFrame(void* frame, size_t size) noexcept;
+
+    static FramePool* current();
+    static void setCurrent(FramePool* pool);
+
+    const Stats& stats() const { return stats_; }
+
+private:
+    static constexpr size_t kMinShift = 7;        // 最小一档128字节
+    static constexpr size_t kClasses = 6;         // 最大一档4KB
+    static constexpr size_t kBlocksPerSlab = 64;
+    static constexpr size_t kHeaderSize = 16;     // 记录来源池的帧头，保持帧本身16字节对齐
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    char* acquire(size_t size);
+    void release(char* block, size_t size);
+
+    std::vector<std::unique_ptr<char[]>> slabs_;
+    FreeBlock* free_[kClasses] = {};
+    Stats stats_;
+};
+
+// 统计页面用：按“名字 数值”逐行追加，名字带上prefix
+void appendStats(std::string& out, const char* prefix, const ObjectPoolStats& stats);
+void appendStats(std::string& out, const char* prefix, const BufferPool::Stats& stats);
+void appendStats(std::string& out, const char* prefix, const FramePool::Stats& stats);
+
+#endif // MEMORY_POOL_H
@@ -0,0 +1,116 @@
+#include "metrics.h"
+
+#include <cstdio>
+
+namespace {
+
+void appendHeader(std::string& out, const char* name, const char* type, const char* help) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+void appendSample(std::string& out, const char* name, uint64_t value) {
+    out += name;
+    out += ' ';
+    out += std::to_string(value);
+    out += '\n';
+}
+
+// 微秒换成Prometheus约定的秒
+std::string seconds(int64_t us) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%g", static_cast<double>(us) / 1e6);
+    return text;
+}
+
+} // namespace
+
+MetricsShard* Metrics::createShard() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shards_.push_back(std::make_unique<MetricsShard>(*this));
+    return shards_.back().get();
+}
+
+void Metrics::render(std::string& out) const {
+    // 1. 所有分片逐项相加；各项分别读取，和正在写的线程之间不同步，同一次抓取里的数值可能差几个请求
+    uint64_t bytes_in = 0, bytes_out = 0, response_bytes = 0, opened = 0, closed = 0, accept_errors = 0;
+    uint64_t shed_requests = 0, shed_connections = 0, overloaded_intervals = 0, overloaded = 0;
+    uint64_t latency_sum_us = 0;
+    uint64_t latency[MetricsShard::kLatencyBuckets] = {};
+    std::vector<uint64_t> status(MetricsShard::kMaxStatus + 1);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& shard : shards_) {
+            bytes_in += MetricsShard::read(shard->bytes_in_);
+            bytes_out += MetricsShard::read(shard->bytes_out_);
+            response_bytes += MetricsShard::read(shard->response_bytes_);
+            closed += MetricsShard::read(shard->closed_);
+            opened += MetricsShard::read(shard->opened_); // 后读opened，活动连接数不会算成负的
+            accept_errors += MetricsShard::read(shard->accept_errors_);
+            shed_requests += MetricsShard::read(shard->shed_requests_);
+            shed_connections += MetricsShard::read(shard->shed_connections_);
+            overloaded_intervals += MetricsShard::read(shard->overloaded_intervals_);
+            overloaded += MetricsShard::read(shard->overloaded_);
+            latency_sum_us += MetricsShard::read(shard->latency_sum_us_);
+            for (size_t i = 0; i < MetricsShard::kLatencyBuckets; ++i) latency[i] += MetricsShard::read(shard->latency_[i]);
+            for (size_t i = 0; i < status.size(); ++i) status[i] += MetricsShard::read(shard->status_[i]);
+        }
+    }
+
+    // 2. 请求数按状态码分开，总数就是各项之和
+    appendHeader(out, "webserver_requests_total", "counter", "处理完的HTTP请求数，按响应状态码分开");
+    for (size_t code = 0; code < status.size(); ++code) {
+        if (status[code] == 0) continue;
+        out += "webserver_requests_total{code=\"";
+        out += code == 0 ? "unknown" : std::to_string(code);
+        out += "\"} ";
+        out += std::to_string(status[code]);
+        out += '\n';
+    }
+
+    // 3. 延迟直方图：le桶是累积的，_count取最后一个桶，和各个桶保持一致
+    appendHeader(out, "webserver_request_duration_seconds", "histogram",
+                 "从开始处理请求（普通请求收全、流式请求的请求头收全）到响应生成完毕的时间");
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < MetricsShard::kLatencyBuckets; ++i) {
+        cumulative += latency[i];
+        out += "webserver_request_duration_seconds_bucket{le=\"";
+        out += i + 1 < MetricsShard::kLatencyBuckets ? seconds(MetricsShard::kLatencyBoundsUs[i]) : "+Inf";
+        out += "\"} ";
+        out += std::to_string(cumulative);
+        out += '\n';
+    }
+    out += "webserver_request_duration_seconds_sum " + seconds(static_cast<int64_t>(latency_sum_us)) + "\n";
+    appendSample(out, "webserver_request_duration_seconds_count", cumulative);
+
+    // 4. 字节数和连接
+    appendHeader(out, "webserver_received_bytes_total", "counter", "从客户端读到的字节数");
+    appendSample(out, "webserver_received_bytes_total", bytes_in);
+    appendHeader(out, "webserver_sent_bytes_total", "counter", "写给客户端的字节数");
+    appendSample(out, "webserver_sent_bytes_total", bytes_out);
+    appendHeader(out, "webserver_response_bytes_total", "counter", "生成的响应字节数（头部+正文）");
+    appendSample(out, "webserver_response_bytes_total", response_bytes);
+    appendHeader(out, "webserver_connections_accepted_total", "counter", "接受的客户端连接数（不含过载时直接拒绝的）");
+    appendSample(out, "webserver_connections_accepted_total", opened);
+    appendHeader(out, "webserver_connections_active", "gauge", "当前打开的客户端连接数");
+    appendSample(out, "webserver_connections_active", opened >= closed ? opened - closed : 0);
+    appendHeader(out, "webserver_accept_errors_total", "counter", "accept失败的次数（不含EAGAIN）");
+    appendSample(out, "webserver_accept_errors_total", accept_errors);
+
+    // 5. 准入控制：被拒绝的请求同时算在requests_total{code="503"}里，刚accept就拒绝的连接只有明文的回了503
+    appendHeader(out, "webserver_shed_requests_total", "counter", "过载时回复503的请求数");
+    appendSample(out, "webserver_shed_requests_total", shed_requests);
+    appendHeader(out, "webserver_shed_connections_total", "counter", "过载时刚accept就拒绝的连接数");
+    appendSample(out, "webserver_shed_connections_total", shed_connections);
+    appendHeader(out, "webserver_overloaded_intervals_total", "counter", "判定为过载的interval数，所有Reactor相加");
+    appendSample(out, "webserver_overloaded_intervals_total", overloaded_intervals);
+    appendHeader(out, "webserver_overloaded_reactors", "gauge", "当前处于过载状态的Reactor数");
+    appendSample(out, "webserver_overloaded_reactors", overloaded);
+}
@@ -0,0 +1,102 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "admission.h"
+
+class Metrics;
+
+// 一个Reactor的计数器：只有所属线程写，抓取/metrics时其他线程读出来合并
+// 只有一个写者，加一不用原子加（不锁总线），relaxed的读再写就够了，编译出来和普通变量一样；
+// 整组按缓存行对齐，不和别的线程的数据共享缓存行
+class alignas(64) MetricsShard {
+public:
+    // 请求延迟直方图各个桶的上界（微秒），和Prometheus的默认桶相近，往下多细分了亚毫秒
+    static constexpr int64_t kLatencyBoundsUs[] = {100,    250,    500,    1000,    2500,    5000,
+                                                   10000,  25000,  50000,  100000,  250000,  500000,
+                                                   1000000, 2500000, 5000000, 10000000};
+    static constexpr size_t kLatencyBuckets = sizeof(kLatencyBoundsUs) / sizeof(kLatencyBoundsUs[0]) + 1;
+    static constexpr int kMaxStatus = 599;
+
+    explicit MetricsShard(const Metrics& owner) : owner_(owner) {}
+
+    MetricsShard(const MetricsShard&) = delete;
+    MetricsShard& operator=(const MetricsShard&) = delete;
+
+    // 一个请求的响应生成完毕：状态码、响应字节数、从开始处理到生成完的微秒数
+    void request(int status, uint64_t bytes, int64_t latency_us) {
+        add(status_[status >= 100 && status <= kMaxStatus ? status : 0]);
+        add(response_bytes_, bytes);
+        add(latency_sum_us_, static_cast<uint64_t>(latency_us > 0 ? latency_us : 0));
+        size_t bucket = 0;
+        while (bucket < kLatencyBuckets - 1 && latency_us > kLatencyBoundsUs[bucket]) ++bucket;
+        add(latency_[bucket]);
+    }
+    void received(uint64_t bytes) { add(bytes_in_, bytes); }
+    void sent(uint64_t bytes) { add(bytes_out_, bytes); }
+    void connectionOpened() { add(opened_); }
+    void connectionClosed() { add(closed_); }
+    void acceptError() { add(accept_errors_); }
+    // 准入控制的计数在AdmissionControl里累加，事件循环每批事件处理完后整组抄一份过来
+    void admission(const AdmissionControl& control) {
+        const AdmissionControl::Stats& stats = control.stats();
+        shed_requests_.store(stats.shed_requests, std::memory_order_relaxed);
+        shed_connections_.store(stats.shed_connections, std::memory_order_relaxed);
+        overloaded_intervals_.store(stats.overloaded_intervals, std::memory_order_relaxed);
+        overloaded_.store(control.overloaded() ? 1 : 0, std::memory_order_relaxed);
+    }
+
+    // 合并用的所有分片都在这里
+    const Metrics& owner() const { return owner_; }
+
+private:
+    friend class Metrics;
+    using Counter = std::atomic<uint64_t>;
+
+    static void add(Counter& counter, uint64_t n = 1) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+    static uint64_t read(const Counter& counter) { return counter.load(std::memory_order_relaxed); }
+
+    const Metrics& owner_;
+    Counter bytes_in_{0};          // 从客户端读到的字节（HTTPS连接是解密后的）
+    Counter bytes_out_{0};         // 写给客户端的字节
+    Counter response_bytes_{0};    // 生成的响应字节（头部+正文），响应没发完连接就断了也算
+    Counter opened_{0};
+    Counter closed_{0};
+    Counter accept_errors_{0};
+    Counter shed_requests_{0};
+    Counter shed_connections_{0};
+    Counter overloaded_intervals_{0};
+    Counter overloaded_{0};        // 0或1，不是计数
+    Counter latency_sum_us_{0};
+    Counter latency_[kLatencyBuckets] = {};     // 不累积，抓取时再累加成Prometheus的le桶
+    Counter status_[kMaxStatus + 1] = {};       // 下标就是状态码，0放不认识的状态码
+};
+
+// 整个进程一份：每个Reactor通过createShard()拿到自己的计数器，抓取时合并所有分片输出Prometheus文本格式
+class Metrics {
+public:
+    Metrics() = default;
+    Metrics(const Metrics&) = delete;
+    Metrics& operator=(const Metrics&) = delete;
+
+    // 每个Reactor线程调用一次，分片归Metrics所有，进程退出前一直有效
+    MetricsShard* createShard();
+
+    // 按Prometheus文本格式（0.0.4）追加所有指标
+    void render(std::string& out) const;
+
+private:
+    mutable std::mutex mutex_;   // 保护shards_，只在创建分片和抓取时加锁，请求路径上不会碰到
+    std::vector<std::unique_ptr<MetricsShard>> shards_;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,208 @@
+#include "microcache.h"
+
+#include <strings.h>
+
+#include <iterator>
+
+namespace {
+
+// 一行头部的名字是否为name（不区分大小写）
+bool headerNamed(std::string_view line, std::string_view name) {
+    return line.size() > name.size() && line[name.size()] == ':' &&
+           strncasecmp(line.data(), name.data(), name.size()) == 0;
+}
+
+} // namespace
+
+void CacheWaiter::unlink() {
+    if (!pprev) return;
+    *pprev = next;
+    if (next) next->pprev = pprev;
+    next = nullptr;
+    pprev = nullptr;
+}
+
+void CacheWaiter::pushTo(CacheWaiter*& head) {
+    unlink();
+    next = head;
+    if (head) head->pprev = &next;
+    head = this;
+    pprev = &head;
+}
+
+MicroCache::MicroCache(size_t budget_bytes, size_t max_body) : budget_(budget_bytes), max_body_(max_body) {}
+
+MicroCache::~MicroCache() {
+    // 连接通常先于缓存销毁；还挂着的节点摘下来，免得它们析构时写回已经释放的链表头
+    for (auto& [key, entry] : entries_) release(entry);
+    while (ready_) ready_->unlink();
+}
+
+MicroCache::Lookup MicroCache::lookup(const std::string& key, int64_t now_ms,
+                                      std::shared_ptr<const CachedResponse>& response) {
+    response = nullptr;
+    auto it = entries_.find(key);
+    if (it == entries_.end()) {
+        // 第一次请求这个键：先占住一个空条目，后到的请求看到它在生成中就等着
+        lru_.push_front(key);
+        Entry& entry = entries_[key];
+        entry.lru = lru_.begin();
+        entry.filling = true;
+        ++filling_;
+        ++stats_.misses;
+        return Lookup::Fill;
+    }
+    Entry& entry = it->second;
+    lru_.splice(lru_.begin(), lru_, entry.lru);
+    if (entry.response && now_ms < entry.fresh_until) {
+        ++stats_.hits;
+        response = entry.response;
+        return Lookup::Hit;
+    }
+    bool usable = entry.response && now_ms < entry.stale_until;
+    if (entry.filling) {
+        if (!usable) return Lookup::Wait;
+        ++stats_.stale;
+        response = entry.response;
+        return Lookup::Stale;
+    }
+    entry.filling = true;
+    ++filling_;
+    if (usable) {
+        ++stats_.revalidations;
+        response = entry.response;
+    } else {
+        ++stats_.misses;
+    }
+    return Lookup::Fill;
+}
+
+bool MicroCache::pending(const std::string& key, int64_t now_ms) const {
+    auto it = entries_.find(key);
+    if (it == entries_.end() || !it->second.filling) return false;
+    const Entry& entry = it->second;
+    return !entry.response || now_ms >= entry.stale_until;
+}
+
+void MicroCache::wait(const std::string& key, CacheWaiter& waiter) {
+    auto it = entries_.find(key);
+    if (it == entries_.end() || !it->second.filling) {
+        waiter.pushTo(ready_); // 条目已经不在生成中：马上重新处理
+        return;
+    }
+    ++stats_.waits;
+    waiter.pushTo(it->second.waiters);
+}
+
+std::shared_ptr<const CachedResponse> MicroCache::store(const std::string& key, CachedResponse response,
+                                                        const CachePolicy& policy, int64_t now_ms) {
+    response.stored_ms = now_ms;
+    size_t size = key.size() * 2 + response.status.size() + response.content_type.size() + response.headers.size() +
+                  response.body.size();
+    auto shared = std::make_shared<const CachedResponse>(std::move(response));
+    ++stats_.stored;
+
+    auto it = entries_.find(key);
+    if (it == entries_.end()) {
+        // 条目已经不在了：重新放进去
+        lru_.push_front(key);
+        it = entries_.emplace(key, Entry()).first;
+        it->second.lru = lru_.begin();
+    }
+    Entry& entry = it->second;
+    if (entry.filling) {
+        entry.filling = false;
+        --filling_;
+    }
+    release(entry);
+    bytes_ -= entry.bytes;
+    entry.response = shared;
+    entry.bytes = size;
+    entry.fresh_until = now_ms + policy.ttl_ms;
+    entry.stale_until = entry.fresh_until + policy.stale_ms;
+    bytes_ += size;
+    lru_.splice(lru_.begin(), lru_, entry.lru);
+    if (size > budget_) {
+        erase(it); // 比整个预算还大，只用这一次
+        return shared;
+    }
+    // 从最久没用的开始淘汰，刚放进去的在最前面，预算以内不会淘汰到它
+    // 生成中的条目跳过：淘汰它会唤醒等着的请求，它们找不到条目就各自再生成一次，合并就失效了
+    auto victim = lru_.end();
+    while (bytes_ > budget_ && victim != lru_.begin()) {
+        auto candidate = std::prev(victim);
+        auto found = entries_.find(*candidate);
+        if (found->second.filling) {
+            victim = candidate;
+            continue;
+        }
+        erase(found);
+        ++stats_.evictions;
+    }
+    return shared;
+}
+
+void MicroCache::abandon(const std::string& key) {
+    ++stats_.uncacheable;
+    auto it = entries_.find(key);
+    if (it == entries_.end()) return;
+    Entry& entry = it->second;
+    if (entry.filling) {
+        entry.filling = false;
+        --filling_;
+    }
+    release(entry);
+    if (!entry.response) erase(it);
+}
+
+bool MicroCache::cacheable(std::string_view status, std::string_view headers) {
+    static constexpr std::string_view kCacheable[] = {"200", "203", "204", "300", "301", "308",
+                                                      "404", "405", "410", "414", "501"};
+    bool status_ok = false;
+    for (std::string_view code : kCacheable) status_ok = status_ok || status.substr(0, 3) == code;
+    if (!status_ok) return false;
+    while (!headers.empty()) {
+        size_t end = headers.find("\r\n");
+        std::string_view line = headers.substr(0, end);
+        headers = end == std::string_view::npos ? std::string_view() : headers.substr(end + 2);
+        if (headerNamed(line, "Set-Cookie")) return false;
+        if (headerNamed(line, "Cache-Control")) {
+            std::string_view value = line.substr(line.find(':') + 1);
+            if (hasToken(value, "no-store") || hasToken(value, "private") || hasToken(value, "no-cache")) return false;
+        }
+    }
+    return true;
+}
+
+void MicroCache::release(Entry& entry) {
+    while (entry.waiters) entry.waiters->pushTo(ready_);
+}
+
+void MicroCache::erase(Iterator it) {
+    Entry& entry = it->second;
+    if (entry.filling) --filling_;
+    release(entry);
+    bytes_ -= entry.bytes;
+    lru_.erase(entry.lru);
+    entries_.erase(it);
+}
+
+CacheFill::~CacheFill() {
+    if (cache) cache->abandon(key);
+}
+
+void CacheFill::append(std::string_view data) {
+    if (overflow) return;
+    if (response.body.size() + data.size() > cache->maxBody()) {
+        overflow = true;
+        std::string().swap(response.body);
+        return;
+    }
+    response.body.append(data);
+}
+
+std::shared_ptr<const CachedResponse> CacheFill::commit(int64_t now_ms) {
+    MicroCache* target = cache;
+    cache = nullptr;
+    return target->store(key, std::move(response), *policy, now_ms);
+}
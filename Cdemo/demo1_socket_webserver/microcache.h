@@ -0,0 +1,155 @@
+#ifndef MICROCACHE_H
+#define MICROCACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "router.h"
+
+// 动态路由的微缓存：打开了CachePolicy的路由，同一个键（方法+请求目标+选定的请求头）的响应在很短的时间内
+// （比如1秒）直接重复使用。每个Reactor一份，只在本线程访问，不加锁；同一个键在不同线程上各自生成一次
+// 条目过期后同一时刻只有一个请求去重新生成：其余请求在stale窗口内拿旧内容，没有旧内容时等它生成完，
+// 热门页面过期的那一刻涌进来的一大批请求（惊群）只让处理函数执行一次
+
+// 缓存的一个完整响应，命中时正文直接被iovec引用
+struct CachedResponse {
+    std::string status;
+    std::string content_type;
+    std::string headers;     // 处理函数加的附加头部，每行以\r\n结尾
+    std::string body;
+    int64_t stored_ms = 0;   // 生成完成的时刻（单调时钟毫秒），Age头部用
+};
+
+// 等条目生成完的连接挂在条目上的节点（侵入式单向链表，带指向前一个next的指针，O(1)摘下）
+// 连接销毁时自动摘下，等待中的连接随时可以关闭
+struct CacheWaiter {
+    CacheWaiter* next = nullptr;
+    CacheWaiter** pprev = nullptr;   // 前一个节点的next，或者链表头
+    void* owner = nullptr;           // 唤醒时用它找回所属连接
+
+    CacheWaiter() = default;
+    CacheWaiter(const CacheWaiter&) = delete;
+    CacheWaiter& operator=(const CacheWaiter&) = delete;
+    ~CacheWaiter() { unlink(); }
+
+    bool linked() const { return pprev != nullptr; }
+    void unlink();
+    void pushTo(CacheWaiter*& head);
+};
+
+// 按字节预算做LRU淘汰，结构和HotCache相同；生成中的条目不淘汰
+class MicroCache {
+public:
+    enum class Lookup {
+        Hit,    // 新鲜，直接用
+        Stale,  // 过期但在stale窗口内，已经有请求在重新生成：直接给旧内容
+        Fill,   // 由这个请求生成，完成后store()，不能缓存或失败时abandon()；response非空时是过期的旧内容
+        Wait    // 别的请求正在生成，又没有旧内容可给：等它
+    };
+
+    struct Stats {
+        uint64_t hits = 0;            // 新鲜命中
+        uint64_t stale = 0;           // 给了旧内容
+        uint64_t misses = 0;          // 没有可用内容，由这个请求生成
+        uint64_t revalidations = 0;   // 条目过期后由这个请求重新生成（其他请求拿旧内容）
+        uint64_t waits = 0;           // 合并掉的未命中：等别的请求生成
+        uint64_t stored = 0;          // 生成完放进缓存的响应
+        uint64_t uncacheable = 0;     // 生成了但不能缓存（状态码、Set-Cookie、no-store、太大）或生成失败
+        uint64_t evictions = 0;       // 因为预算淘汰的条目
+    };
+
+    MicroCache(size_t budget_bytes, size_t max_body);
+    ~MicroCache();
+
+    MicroCache(const MicroCache&) = delete;
+    MicroCache& operator=(const MicroCache&) = delete;
+
+    bool enabled() const { return budget_ > 0; }
+    size_t maxBody() const { return max_body_; }
+    // 正在生成的条目数；为0时不可能有请求需要等，请求处理路径上据此跳过等待检查
+    size_t filling() const { return filling_; }
+
+    // 查找key，返回Fill时条目标记为生成中，调用方必须随后store()或abandon()
+    Lookup lookup(const std::string& key, int64_t now_ms, std::shared_ptr<const CachedResponse>& response);
+    // 现在查找key会不会得到Wait（只看，不改变任何状态）
+    bool pending(const std::string& key, int64_t now_ms) const;
+    // 在生成中的key上等待；条目生成完或生成失败时移到就绪链表，由wake()交还
+    void wait(const std::string& key, CacheWaiter& waiter);
+    // 生成完成：放进缓存，ttl_ms内新鲜，之后stale_ms内还能当旧内容用；唤醒等待的连接，返回缓存的响应
+    std::shared_ptr<const CachedResponse> store(const std::string& key, CachedResponse response,
+                                                const CachePolicy& policy, int64_t now_ms);
+    // 放弃生成：清掉生成中的标记，唤醒等待的连接让它们重新处理（第一个会接着生成）
+    void abandon(const std::string& key);
+    // 把就绪的等待者逐个摘下交给fn(owner)；fn里可以再查找、等待、生成，新就绪的也会在这次交出去
+    template <typename Fn>
+    void wake(Fn&& fn) {
+        while (ready_) {
+            CacheWaiter* waiter = ready_;
+            waiter->unlink();
+            fn(waiter->owner);
+        }
+    }
+
+    // 处理函数的响应能不能缓存：状态码是默认可缓存的（RFC 9111 4.2.2），没有Set-Cookie，
+    // Cache-Control里没有no-store、private和no-cache
+    static bool cacheable(std::string_view status, std::string_view headers);
+
+    size_t size() const { return entries_.size(); }
+    size_t bytes() const { return bytes_; }
+    Stats& stats() { return stats_; }
+
+private:
+    struct Entry {
+        std::shared_ptr<const CachedResponse> response;   // 第一次生成完之前为空
+        int64_t fresh_until = 0;
+        int64_t stale_until = 0;
+        size_t bytes = 0;
+        bool filling = false;
+        CacheWaiter* waiters = nullptr;
+        std::list<std::string>::iterator lru;
+    };
+    using Iterator = std::unordered_map<std::string, Entry>::iterator;
+
+    // 条目的等待者全部移到就绪链表
+    void release(Entry& entry);
+    void erase(Iterator it);
+
+    size_t budget_;
+    size_t max_body_;
+    size_t bytes_ = 0;
+    size_t filling_ = 0;
+    CacheWaiter* ready_ = nullptr;   // 可以重新处理的等待者
+    std::list<std::string> lru_;     // 最近使用的在前
+    std::unordered_map<std::string, Entry> entries_;
+    Stats stats_;
+};
+
+// 协程路由生成缓存的过程：协程写出的数据同时记一份，协程正常结束时放进缓存
+// 中途放弃（连接断开、协程失败、响应不能缓存）时随连接析构，清掉生成中的标记
+struct CacheFill {
+    CacheFill(MicroCache& cache, const std::string& key, std::shared_ptr<const CachePolicy> policy)
+        : cache(&cache), key(key), policy(std::move(policy)) {}
+    ~CacheFill();
+
+    CacheFill(const CacheFill&) = delete;
+    CacheFill& operator=(const CacheFill&) = delete;
+
+    // 记下一段正文，超过缓存允许的大小就不再记，结束时不缓存
+    void append(std::string_view data);
+    // 放进缓存，返回缓存的响应；之后析构不再放弃
+    std::shared_ptr<const CachedResponse> commit(int64_t now_ms);
+
+    MicroCache* cache;             // commit后为空
+    std::string key;
+    std::shared_ptr<const CachePolicy> policy;
+    CachedResponse response;
+    bool started = false;          // 状态行和头部已经记下（第一次write时）
+    bool overflow = false;         // 正文太大，或者写的是管道（数据不经过用户态）
+};
+
+#endif // MICROCACHE_H
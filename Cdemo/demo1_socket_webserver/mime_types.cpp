@@ -0,0 +1,127 @@
+#include "mime_types.h"
+
+#include <cstdint>
+
+namespace {
+
+constexpr size_t kEntryCount = sizeof(kMimeTypes) / sizeof(kMimeTypes[0]);
+constexpr unsigned kSlotBits = 7;                 // 128个槽，装32个条目，很快就能找到无冲突的乘数
+constexpr size_t kSlotCount = size_t{1} << kSlotBits;
+static_assert(kEntryCount < kSlotCount, "MIME表条目太多，需要加大kSlotBits");
+
+// 扩展名按字节装进一个64位整数，大写字母转成小写；超过8个字符或为空时返回0（表里不存在）
+// 只转换A-Z，其他字节原样保留，不会把别的字符误折叠成字母或数字
+constexpr uint64_t packExtension(std::string_view extension) {
+    if (extension.empty() || extension.size() > 8) return 0;
+    uint64_t key = 0;
+    for (size_t i = 0; i < extension.size(); ++i) {
+        auto c = static_cast<unsigned char>(extension[i]);
+        if (c >= 'A' && c <= 'Z') c = static_cast<unsigned char>(c | 0x20);
+        key |= static_cast<uint64_t>(c) << (8 * i);
+    }
+    return key;
+}
+
+constexpr size_t slotOf(uint64_t key, uint64_t multiplier) {
+    return static_cast<size_t>((key * multiplier) >> (64 - kSlotBits));
+}
+
+// 候选乘数：splitmix64序列，保证是奇数
+constexpr uint64_t candidate(uint64_t n) {
+    uint64_t z = n * 0x9e3779b97f4a7c15ull;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return (z ^ (z >> 31)) | 1;
+}
+
+constexpr bool collisionFree(uint64_t multiplier) {
+    bool used[kSlotCount] = {};
+    for (const MimeEntry& entry : kMimeTypes) {
+        size_t slot = slotOf(packExtension(entry.extension), multiplier);
+        if (used[slot]) return false;
+        used[slot] = true;
+    }
+    return true;
+}
+
+// 编译期逐个尝试乘数，直到所有扩展名落在不同的槽里
+constexpr uint64_t findMultiplier() {
+    for (uint64_t n = 1;; ++n) {
+        if (collisionFree(candidate(n))) return candidate(n);
+    }
+}
+
+struct Slot {
+    uint64_t key = 0;          // 0表示空槽
+    uint8_t entry = 0;         // 在kMimeTypes中的下标
+};
+
+struct PerfectHash {
+    uint64_t multiplier = 0;
+    Slot slots[kSlotCount] = {};
+};
+
+constexpr PerfectHash buildTable() {
+    PerfectHash table;
+    table.multiplier = findMultiplier();
+    for (size_t i = 0; i < kEntryCount; ++i) {
+        uint64_t key = packExtension(kMimeTypes[i].extension);
+        Slot& slot = table.slots[slotOf(key, table.multiplier)];
+        slot.key = key;
+        slot.entry = static_cast<uint8_t>(i);
+    }
+    return table;
+}
+
+constexpr PerfectHash kTable = buildTable();
+
+constexpr std::string_view lookup(std::string_view extension) {
+    uint64_t key = packExtension(extension);
+    const Slot& slot = kTable.slots[slotOf(key, kTable.multiplier)];
+    if (key == 0 || slot.key != key) return {};
+    return kMimeTypes[slot.entry].type;
+}
+
+// ---- 编译期自检：表里每个扩展名（原样和全大写）都能查到自己的类型 ----
+
+constexpr bool everyEntryFound() {
+    for (const MimeEntry& entry : kMimeTypes) {
+        if (packExtension(entry.extension) == 0) return false;   // 空的或超过8个字符
+        if (lookup(entry.extension) != entry.type) return false;  // 也排除了重复的扩展名
+        char upper[8] = {};
+        for (size_t i = 0; i < entry.extension.size(); ++i) {
+            char c = entry.extension[i];
+            upper[i] = c >= 'a' && c <= 'z' ? static_cast<char>(c - 0x20) : c;
+        }
+        if (lookup(std::string_view(upper, entry.extension.size())) != entry.type) return false;
+    }
+    return true;
+}
+static_assert(everyEntryFound(), "MIME表中有查不到的扩展名");
+static_assert(lookup("HtMl") == "text/html; charset=utf-8", "扩展名应不区分大小写");
+static_assert(lookup("").empty() && lookup("exe").empty() && lookup("woff2x").empty() && lookup("html5").empty(),
+              "未知扩展名应查不到");
+static_assert(lookup("averyverylongext").empty(), "超过8个字符的扩展名应查不到");
+static_assert(lookup("wof\x46" "2") == "font/woff2" && lookup("woff\x12").empty(), "只折叠A-Z");
+
+} // namespace
+
+std::string_view mimeTypeForExtension(std::string_view extension) {
+    return lookup(extension);
+}
+
+std::string_view mimeType(std::string_view path) {
+    size_t dot = path.rfind('.');
+    size_t slash = path.rfind('/');
+    if (dot == std::string_view::npos || (slash != std::string_view::npos && dot < slash)) return kDefaultMimeType;
+    std::string_view type = lookup(path.substr(dot + 1));
+    return type.empty() ? kDefaultMimeType : type;
+}
+
+bool compressibleType(std::string_view type) {
+    if (type.substr(0, 5) == "text/") return true;
+    for (std::string_view prefix : {"application/json", "application/xml", "application/wasm", "image/svg+xml"}) {
+        if (type.substr(0, prefix.size()) == prefix) return true;
+    }
+    return false;
+}
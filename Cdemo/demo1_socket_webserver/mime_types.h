@@ -0,0 +1,61 @@
+#ifndef MIME_TYPES_H
+#define MIME_TYPES_H
+
+#include <cstddef>
+#include <string_view>
+
+struct MimeEntry {
+    std::string_view extension;   // 小写，不带点，最多8个字符
+    std::string_view type;
+};
+
+// 常见静态资源类型，文本类型统一带上utf-8字符集
+// 查找表（完美哈希）在编译期由这张表生成，增删条目后重新编译即可
+inline constexpr MimeEntry kMimeTypes[] = {
+    {"html", "text/html; charset=utf-8"},
+    {"htm", "text/html; charset=utf-8"},
+    {"css", "text/css; charset=utf-8"},
+    {"js", "text/javascript; charset=utf-8"},
+    {"mjs", "text/javascript; charset=utf-8"},
+    {"json", "application/json"},
+    {"txt", "text/plain; charset=utf-8"},
+    {"md", "text/markdown; charset=utf-8"},
+    {"xml", "application/xml"},
+    {"csv", "text/csv; charset=utf-8"},
+    {"png", "image/png"},
+    {"jpg", "image/jpeg"},
+    {"jpeg", "image/jpeg"},
+    {"gif", "image/gif"},
+    {"svg", "image/svg+xml"},
+    {"ico", "image/x-icon"},
+    {"webp", "image/webp"},
+    {"avif", "image/avif"},
+    {"woff", "font/woff"},
+    {"woff2", "font/woff2"},
+    {"ttf", "font/ttf"},
+    {"otf", "font/otf"},
+    {"mp3", "audio/mpeg"},
+    {"ogg", "audio/ogg"},
+    {"wav", "audio/wav"},
+    {"mp4", "video/mp4"},
+    {"webm", "video/webm"},
+    {"pdf", "application/pdf"},
+    {"zip", "application/zip"},
+    {"gz", "application/gzip"},
+    {"tar", "application/x-tar"},
+    {"wasm", "application/wasm"},
+};
+
+constexpr std::string_view kDefaultMimeType = "application/octet-stream";
+
+// 根据文件扩展名（不区分大小写）给出Content-Type，未知扩展名返回application/octet-stream
+// 一次乘法和移位算出槽位，再比较一个64位整数，不分配内存
+std::string_view mimeType(std::string_view path);
+
+// 只按扩展名（不带点）查找，未知时返回空
+std::string_view mimeTypeForExtension(std::string_view extension);
+
+// 是否值得压缩：文本类格式压缩率高，图片、音视频、字体和压缩包本身已经压缩过
+bool compressibleType(std::string_view type);
+
+#endif // MIME_TYPES_H
@@ -0,0 +1,551 @@
+#include "proxy.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/tcp.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "connection.h"
+#include "http_parser.h"
+#include "http_response.h"
+
+namespace {
+
+constexpr size_t kMaxIdlePerServer = 32;   // 每个上游在每个Reactor里最多保留的空闲连接
+constexpr int64_t kDownMs = 1000;          // 连不上的上游这么久内排在最后
+constexpr size_t kReadSize = 16 * 1024;    // 从上游读响应的缓冲区，响应头放不下时翻倍（最多到kMaxHeaderSize）
+constexpr size_t kPipeSize = 64 * 1024;    // 每次splice进管道的上限，管道的默认容量
+
+bool sameName(std::string_view a, std::string_view b) {
+    return a.size() == b.size() && strncasecmp(a.data(), b.data(), a.size()) == 0;
+}
+
+// 逐跳头部（RFC 9110 7.6.1）只对一段连接有意义，两边的连接各自生成，不转发
+bool hopByHop(std::string_view name) {
+    for (std::string_view hop : {"Connection", "Keep-Alive", "Proxy-Connection", "TE", "Trailer",
+                                 "Transfer-Encoding", "Upgrade"}) {
+        if (sameName(name, hop)) return true;
+    }
+    return false;
+}
+
+// Connection头部里点名的头部也是逐跳的
+bool listedIn(std::string_view connection, std::string_view name) {
+    if (connection.empty()) return false;
+    std::string lower(name);
+    for (char& c : lower) c = static_cast<char>(c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c);
+    return hasToken(connection, lower);
+}
+
+// 上游的响应头，视图指向读缓冲区
+struct ResponseHead {
+    size_t length = 0;            // 响应头（含结尾空行）的字节数
+    int code = 0;
+    int version_minor = 1;
+    std::string_view status;      // "200 OK"
+    std::string_view content_type;
+    std::string_view connection;
+    bool chunked = false;
+    bool has_length = false;
+    uint64_t content_length = 0;
+    HttpHeader headers[kMaxHeaders];
+    size_t header_count = 0;
+};
+
+// 返回1表示响应头完整，0表示还没收全，-1表示格式错误或太大
+int parseResponseHead(std::string_view data, ResponseHead& head) {
+    size_t end = data.find("\r\n\r\n");
+    if (end == std::string_view::npos) return data.size() >= kMaxHeaderSize ? -1 : 0;
+    if (end + 4 > kMaxHeaderSize) return -1;
+    head.length = end + 4;
+    head.chunked = false;
+    head.has_length = false;
+    head.content_length = 0;
+    head.content_type = {};
+    head.connection = {};
+    head.header_count = 0;
+
+    // 1. 状态行：HTTP/1.x SP 三位数字 [SP 原因短语]
+    std::string_view lines = data.substr(0, end + 2);
+    size_t eol = lines.find("\r\n");
+    std::string_view line = lines.substr(0, eol);
+    if (line.size() < 12 || line.substr(0, 7) != "HTTP/1." || (line[7] != '0' && line[7] != '1') || line[8] != ' ' ||
+        (line.size() > 12 && line[12] != ' ')) {
+        return -1;
+    }
+    head.version_minor = line[7] - '0';
+    head.code = 0;
+    for (size_t i = 9; i < 12; ++i) {
+        if (line[i] < '0' || line[i] > '9') return -1;
+        head.code = head.code * 10 + (line[i] - '0');
+    }
+    head.status = line.substr(9);
+    lines.remove_prefix(eol + 2);
+
+    // 2. 头部：名字里不能有空白（防止请求走私的老把戏），值去掉两端的空白
+    while (!lines.empty()) {
+        eol = lines.find("\r\n");
+        line = lines.substr(0, eol);
+        lines.remove_prefix(eol + 2);
+        size_t colon = line.find(':');
+        if (colon == std::string_view::npos || colon == 0 || head.header_count == kMaxHeaders) return -1;
+        std::string_view name = line.substr(0, colon);
+        if (name.find_first_of(" \t") != std::string_view::npos) return -1;
+        std::string_view value = line.substr(colon + 1);
+        while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) value.remove_prefix(1);
+        while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) value.remove_suffix(1);
+
+        if (sameName(name, "Content-Length")) {
+            uint64_t length = 0;
+            if (value.empty() || value.size() > 18) return -1;
+            for (char c : value) {
+                if (c < '0' || c > '9') return -1;
+                length = length * 10 + static_cast<uint64_t>(c - '0');
+            }
+            if (head.has_length && length != head.content_length) return -1;
+            head.has_length = true;
+            head.content_length = length;
+        } else if (sameName(name, "Transfer-Encoding")) {
+            head.chunked = hasToken(value, "chunked");
+        } else if (sameName(name, "Content-Type")) {
+            head.content_type = value;
+        } else if (sameName(name, "Connection")) {
+            head.connection = value;
+        }
+        head.headers[head.header_count++] = HttpHeader{name, value};
+    }
+    return 1;
+}
+
+// 发给上游的请求头：请求行原样转发，一律用HTTP/1.1和上游说话（客户端是HTTP/1.0也一样，回复时再按客户端的版本组织），
+// 去掉逐跳头部和Expect（100 Continue已经由我们回复），最后要求上游保持连接
+void buildUpstreamHead(const HttpRequest& request, bool has_body, std::string& out) {
+    out.append(request.method);
+    out += ' ';
+    out.append(request.target);
+    out += " HTTP/1.1\r\n";
+    std::string_view connection = request.header("Connection");
+    for (size_t i = 0; i < request.header_count; ++i) {
+        std::string_view name = request.headers[i].name;
+        if (hopByHop(name) || sameName(name, "Expect") || listedIn(connection, name)) continue;
+        // 分块编码的请求体重新分块转发，客户端同时给的Content-Length不算数
+        if (request.chunked && sameName(name, "Content-Length")) continue;
+        out.append(name);
+        out += ": ";
+        out.append(request.headers[i].value);
+        out += "\r\n";
+    }
+    if (request.chunked) out += has_body ? "Transfer-Encoding: chunked\r\n" : "Content-Length: 0\r\n";
+    out += "Connection: keep-alive\r\n\r\n";
+}
+
+// 上游连接上的一次读：n>0读到的字节数，0表示上游关闭，-1表示出错
+Task receive(CoConnection& conn, int fd, char* data, size_t size, ssize_t& n) {
+    while (true) {
+        n = recv(fd, data, size, 0);
+        if (n >= 0) co_return;
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            n = -1;
+            co_return;
+        }
+        // co_await单独成句：g++ 12对写在&&、||操作数里的co_await处理有误，挂起时不会调用await_suspend
+        bool ready = co_await conn.waitFd(fd);
+        if (!ready) {
+            n = -1;
+            co_return;
+        }
+    }
+}
+
+// 把data全部发给上游
+Task sendAll(CoConnection& conn, int fd, std::string_view data, bool& ok) {
+    // 要挂起等上游可写时，先把剩下的数据拷下来：data可能是conn.read()读到的请求体，
+    // 指向客户端连接的输入缓冲区，挂起期间会被移走
+    std::string rest;
+    while (!data.empty()) {
+        ssize_t n = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (n > 0) {
+            data.remove_prefix(static_cast<size_t>(n));
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (data.data() < rest.data() || data.data() >= rest.data() + rest.size()) {
+                rest.assign(data);
+                data = rest;
+            }
+            bool ready = co_await conn.waitFd(fd, true);
+            if (ready) continue;
+        }
+        ok = false;
+        co_return;
+    }
+    ok = true;
+}
+
+// 非阻塞connect的结果：fd可写后看SO_ERROR
+Task finishConnect(CoConnection& conn, int fd, bool& ok) {
+    ok = co_await conn.waitFd(fd, true);
+    int error = 0;
+    socklen_t length = sizeof(error);
+    ok = ok && getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) == 0 && error == 0;
+}
+
+// 客户端的请求体逐段转给上游；客户端用分块编码时重新分块，其他情况原样转发（长度和客户端的Content-Length一致）
+Task forwardBody(CoConnection& conn, int fd, bool chunked, bool& ok) {
+    std::string framed;
+    ok = true;
+    while (ok) {
+        std::string_view piece = co_await conn.read();
+        if (piece.empty()) break;
+        if (!chunked) {
+            co_await sendAll(conn, fd, piece, ok);
+            continue;
+        }
+        framed.clear();
+        appendChunkSize(framed, piece.size());
+        framed.append(piece);
+        framed += "\r\n";
+        co_await sendAll(conn, fd, framed, ok);
+    }
+    if (ok && chunked) co_await sendAll(conn, fd, "0\r\n\r\n", ok);
+}
+
+// 读上游的响应头，1xx的临时响应（100 Continue、103 Early Hints）丢掉接着等；多读到的正文留在buffer里
+Task readHead(CoConnection& conn, int fd, std::string& buffer, size_t& have, ResponseHead& head, bool& ok) {
+    ok = false;
+    while (true) {
+        int parsed = parseResponseHead(std::string_view(buffer.data(), have), head);
+        if (parsed < 0) co_return;
+        if (parsed > 0) {
+            if (head.code >= 200) break;
+            if (head.code == 101) co_return;   // 没有转发Upgrade，上游不该切换协议
+            std::memmove(buffer.data(), buffer.data() + head.length, have - head.length);
+            have -= head.length;
+            continue;
+        }
+        if (have == buffer.size()) buffer.resize(std::min(buffer.size() * 2, kMaxHeaderSize));
+        ssize_t n;
+        co_await receive(conn, fd, buffer.data() + have, buffer.size() - have, n);
+        if (n <= 0) co_return;
+        have += static_cast<size_t>(n);
+    }
+    ok = true;
+}
+
+// 有Content-Length的正文：上游socket -> 管道 -> 客户端socket，数据只在内核里搬
+Task spliceBody(CoConnection& conn, UpstreamConn& upstream, uint64_t left, uint64_t& spliced, bool& ok) {
+    ok = false;
+    while (left > 0) {
+        size_t want = static_cast<size_t>(std::min<uint64_t>(left, kPipeSize));
+        ssize_t n = splice(upstream.fd, nullptr, upstream.pipe[1], nullptr, want, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0) {
+            // 管道在上一段发完之后才会再灌，EAGAIN只可能是上游还没有数据
+            left -= static_cast<uint64_t>(n);
+            spliced += static_cast<uint64_t>(n);
+            co_await conn.splice(upstream.pipe[0], static_cast<size_t>(n));
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) co_return;   // 上游出错或提前关闭
+        bool ready = co_await conn.waitFd(upstream.fd);
+        if (!ready) co_return;
+    }
+    ok = true;
+}
+
+// 借用一条上游连接，协程结束或中途被销毁（客户端断开）时归还；没有标记可复用的一律关闭
+class UpstreamLease {
+public:
+    explicit UpstreamLease(UpstreamGroup& group) : group_(group) {}
+    ~UpstreamLease() { release(false); }
+
+    UpstreamLease(const UpstreamLease&) = delete;
+    UpstreamLease& operator=(const UpstreamLease&) = delete;
+
+    bool acquire(bool fresh, bool& connecting) {
+        release(false);
+        conn_ = group_.acquire(fresh, connecting);
+        return conn_ != nullptr;
+    }
+    void release(bool reusable) {
+        if (conn_) group_.release(std::move(conn_), reusable);
+    }
+    UpstreamConn* operator->() const { return conn_.get(); }
+    UpstreamConn& operator*() const { return *conn_; }
+
+private:
+    UpstreamGroup& group_;
+    std::unique_ptr<UpstreamConn> conn_;
+};
+
+void badGateway(CoConnection& conn) {
+    conn.response().reset();
+    conn.setStatus("502 Bad Gateway", "text/html; charset=utf-8");
+    conn.response().body = "<h1>502 Bad Gateway</h1>\n";
+}
+
+} // namespace
+
+UpstreamConn::~UpstreamConn() {
+    if (fd != -1) close(fd);
+    if (pipe[0] != -1) close(pipe[0]);
+    if (pipe[1] != -1) close(pipe[1]);
+}
+
+bool UpstreamConn::openPipe() {
+    return pipe[0] != -1 || pipe2(pipe, O_NONBLOCK | O_CLOEXEC) == 0;
+}
+
+UpstreamGroup::UpstreamGroup(const ProxyRoute& route) : prefix_(route.prefix) {
+    servers_.resize(route.servers.size());
+    for (size_t i = 0; i < servers_.size(); ++i) {
+        servers_[i].addr = route.servers[i];
+        servers_[i].name = route.names[i];
+    }
+}
+
+std::unique_ptr<UpstreamConn> UpstreamGroup::acquire(bool fresh, bool& connecting) {
+    // 1. 在途请求最少的上游；刚连不上的排在后面。在途数相同时从next_开始轮流，请求不会都落在第一个上
+    int64_t now = steadyNowMs();
+    size_t best = next_ % servers_.size();
+    for (size_t k = 1; k < servers_.size(); ++k) {
+        size_t i = (next_ + k) % servers_.size();
+        bool up = servers_[i].down_until <= now;
+        bool best_up = servers_[best].down_until <= now;
+        if ((up && !best_up) || (up == best_up && servers_[i].outstanding < servers_[best].outstanding)) best = i;
+    }
+    next_ = best + 1;
+    Server& server = servers_[best];
+
+    // 2. 复用最近放回的空闲连接；上游可能已经因为空闲超时关掉了它，先看一眼：
+    //    读到EOF或意外的数据都不能再用，只有“暂时没有数据”才是好的
+    while (!fresh && !server.idle.empty()) {
+        std::unique_ptr<UpstreamConn> conn = std::move(server.idle.back());
+        server.idle.pop_back();
+        char byte;
+        if (recv(conn->fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT) < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            conn->reused = true;
+            connecting = false;
+            ++server.outstanding;
+            ++stats_.reused;
+            return conn;
+        }
+    }
+
+    // 3. 新建连接：非阻塞connect通常返回EINPROGRESS，由协程等它可写
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) return nullptr;
+    auto conn = std::make_unique<UpstreamConn>();
+    conn->fd = fd;
+    conn->server = best;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&server.addr), sizeof(server.addr)) == 0) {
+        connecting = false;
+    } else if (errno == EINPROGRESS) {
+        connecting = true;
+    } else {
+        markDown(best);
+        return nullptr;
+    }
+    ++server.outstanding;
+    ++stats_.connects;
+    return conn;
+}
+
+void UpstreamGroup::release(std::unique_ptr<UpstreamConn> conn, bool reusable) {
+    Server& server = servers_[conn->server];
+    --server.outstanding;
+    // 空闲连接留在epoll里也没关系：一次性触发的监听已经用掉，上游关闭它时不会惊动事件循环
+    if (reusable && server.idle.size() < kMaxIdlePerServer) {
+        conn->reused = false;
+        server.idle.push_back(std::move(conn));
+    }
+}
+
+void UpstreamGroup::markDown(size_t server) {
+    servers_[server].down_until = steadyNowMs() + kDownMs;
+}
+
+void UpstreamGroup::appendStats(std::string& out, size_t index) const {
+    std::string prefix = "proxy" + std::to_string(index) + "_";
+    out += prefix + "requests " + std::to_string(stats_.requests) + "\n";
+    out += prefix + "connects " + std::to_string(stats_.connects) + "\n";
+    out += prefix + "reused " + std::to_string(stats_.reused) + "\n";
+    out += prefix + "retries " + std::to_string(stats_.retries) + "\n";
+    out += prefix + "failures " + std::to_string(stats_.failures) + "\n";
+    out += prefix + "spliced_bytes " + std::to_string(stats_.spliced_bytes) + "\n";
+    for (size_t i = 0; i < servers_.size(); ++i) {
+        std::string server = prefix + "server" + std::to_string(i) + "_";
+        out += server + "outstanding " + std::to_string(servers_[i].outstanding) + "\n";
+        out += server + "idle " + std::to_string(servers_[i].idle.size()) + "\n";
+    }
+}
+
+Task proxyRequest(CoConnection& conn, UpstreamGroup& group) {
+    const HttpRequest& request = conn.request();
+    UpstreamGroup::Stats& stats = group.stats();
+    ++stats.requests;
+    bool has_body = !conn.bodyDone();
+    bool head_request = request.method == "HEAD";
+
+    std::string head;
+    buildUpstreamHead(request, has_body, head);
+
+    // 1. 取连接、发请求、等响应头。复用的空闲连接可能刚好被上游关掉，要发出请求才发现（发送出错，
+    //    或者一个字节都没收到就读到了EOF/RST）：请求体还没有发出去时（没有请求体）换一条新连接重发一次
+    UpstreamLease upstream(group);
+    std::string buffer(kReadSize, '\0');
+    size_t have = 0;
+    ResponseHead response;
+    bool ok = false;
+    for (int attempt = 0; attempt < 2 && !ok; ++attempt) {
+        bool connecting = false;
+        if (!upstream.acquire(attempt > 0, connecting)) break;
+        int fd = upstream->fd;
+        bool reused = upstream->reused;
+        ok = true;
+        if (connecting) {
+            co_await finishConnect(conn, fd, ok);
+            if (!ok) {
+                // 连不上的上游先避开，换一个（或者同一个）再试一次
+                group.markDown(upstream->server);
+                upstream.release(false);
+                continue;
+            }
+        }
+        co_await sendAll(conn, fd, head, ok);
+        if (ok && has_body) co_await forwardBody(conn, fd, request.chunked, ok);
+        if (ok) co_await readHead(conn, fd, buffer, have, response, ok);
+        if (ok) break;
+        upstream.release(false);
+        if (!reused || has_body || have > 0) break;
+        ++stats.retries;
+    }
+    if (!ok) {
+        ++stats.failures;
+        badGateway(conn);
+        co_return;
+    }
+
+    // 2. 响应头：状态行和端到端的头部转给客户端；逐跳头部，以及由我们自己生成的Date、Server、
+    //    Content-Type和长度不转发
+    conn.setStatus(response.status,
+                   response.content_type.empty() ? std::string_view("application/octet-stream") : response.content_type);
+    std::string& headers = conn.response().headers;
+    for (size_t i = 0; i < response.header_count; ++i) {
+        std::string_view name = response.headers[i].name;
+        if (hopByHop(name) || listedIn(response.connection, name) || sameName(name, "Content-Length") ||
+            sameName(name, "Content-Type") || sameName(name, "Date") || sameName(name, "Server")) {
+            continue;
+        }
+        headers.append(name);
+        headers += ": ";
+        headers.append(response.headers[i].value);
+        headers += "\r\n";
+    }
+    // HTTP/1.0的上游默认不保持连接，HTTP/1.1的上游明说close才关闭
+    bool reusable = response.version_minor >= 1 ? !hasToken(response.connection, "close")
+                                                : hasToken(response.connection, "keep-alive");
+    std::string_view body(buffer.data() + response.length, have - response.length);
+
+    // 3. 没有正文的响应：HEAD的回复带上上游给的长度
+    if (head_request || response.code == 204 || response.code == 304) {
+        if (head_request && response.has_length && !response.chunked) conn.setContentLength(response.content_length);
+        upstream.release(reusable && body.empty());
+        co_return;
+    }
+
+    // 4. 有Content-Length的正文：随响应头读到的部分先发，其余的能splice就splice，否则读一段写一段
+    if (response.has_length && !response.chunked) {
+        conn.setContentLength(response.content_length);
+        uint64_t left = response.content_length;
+        size_t first = static_cast<size_t>(std::min<uint64_t>(body.size(), left));
+        if (body.size() > first) reusable = false;   // 多出来的字节：上游不守规矩，这条连接不再用
+        co_await conn.write(body.substr(0, first));
+        left -= first;
+        if (left > 0 && conn.canSplice() && upstream->openPipe()) {
+            co_await spliceBody(conn, *upstream, left, stats.spliced_bytes, ok);
+            left = ok ? 0 : left;
+        }
+        while (ok && left > 0) {
+            ssize_t n;
+            co_await receive(conn, upstream->fd, buffer.data(), std::min<uint64_t>(buffer.size(), left), n);
+            if (n <= 0) {
+                ok = false;
+                break;
+            }
+            left -= static_cast<uint64_t>(n);
+            co_await conn.write(std::string_view(buffer.data(), static_cast<size_t>(n)));
+        }
+        if (!ok) {
+            // 响应头已经发出（或者马上随结尾发出），已经声明的长度兑现不了：只能断开客户端
+            ++stats.failures;
+            conn.abort();
+            co_return;
+        }
+        upstream.release(reusable);
+        co_return;
+    }
+
+    // 5. 分块编码的正文解码后逐段写给客户端（客户端那边由CoConnection重新组织，HTTP/1.0客户端不分块）；
+    //    既没有长度也不分块的正文一直读到上游关闭，这条连接也就不能复用了
+    HttpParser decoder;
+    if (response.chunked) {
+        decoder.expectBody(true, 0);
+    } else {
+        reusable = false;
+    }
+    std::memmove(buffer.data(), body.data(), body.size());
+    have = body.size();
+    while (true) {
+        if (response.chunked) {
+            std::string_view piece;
+            size_t used = 0;
+            ParseStatus status = decoder.parseBody(buffer.data(), have, piece, used);
+            if (status == ParseStatus::Error) {
+                ok = false;
+                break;
+            }
+            co_await conn.write(piece);
+            std::memmove(buffer.data(), buffer.data() + used, have - used);
+            have -= used;
+            if (status == ParseStatus::Complete) {
+                if (have > 0) reusable = false;
+                break;
+            }
+            // 块头或结尾的头部长得一块缓冲区都放不下
+            if (have == buffer.size()) {
+                ok = false;
+                break;
+            }
+        } else if (have > 0) {
+            co_await conn.write(std::string_view(buffer.data(), have));
+            have = 0;
+        }
+        ssize_t n;
+        co_await receive(conn, upstream->fd, buffer.data() + have, buffer.size() - have, n);
+        if (n < 0 || (n == 0 && response.chunked)) {
+            ok = false;
+            break;
+        }
+        if (n == 0) break;   // 正文以上游关闭结束
+        have += static_cast<size_t>(n);
+    }
+    if (!ok) {
+        ++stats.failures;
+        if (conn.responseStarted()) {
+            conn.abort();
+        } else {
+            badGateway(conn);
+        }
+        co_return;
+    }
+    upstream.release(reusable);
+}
@@ -0,0 +1,79 @@
+#ifndef PROXY_H
+#define PROXY_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "config.h"
+#include "coroutine.h"
+
+// 反向代理：路径匹配--proxy前缀的请求由协程转发给一组上游（HTTP/1.1明文）
+// 每个Reactor有自己的一份UpstreamGroup，上游连接只在本线程使用：空闲的keep-alive连接放回池里，
+// 下一个请求直接复用，省掉握手；选上游时挑在途请求最少的一个。
+// 有Content-Length的响应正文用splice从上游socket经过管道搬到客户端socket，不拷贝到用户态
+
+// 一条到上游的连接，带一个splice用的管道（第一次需要时才创建）
+struct UpstreamConn {
+    int fd = -1;
+    int pipe[2] = {-1, -1};
+    size_t server = 0;     // 属于哪个上游
+    bool reused = false;   // 从空闲池取出：上游可能恰好在这时关闭了它
+
+    UpstreamConn() = default;
+    UpstreamConn(const UpstreamConn&) = delete;
+    UpstreamConn& operator=(const UpstreamConn&) = delete;
+    ~UpstreamConn();
+
+    bool openPipe();
+};
+
+class UpstreamGroup {
+public:
+    struct Stats {
+        uint64_t requests = 0;      // 转发的请求
+        uint64_t connects = 0;      // 新建的上游连接
+        uint64_t reused = 0;        // 复用空闲连接的次数
+        uint64_t retries = 0;       // 复用的连接已被上游关闭，换新连接重发
+        uint64_t failures = 0;      // 连不上、上游出错或响应格式不对：回复502或中途断开
+        uint64_t spliced_bytes = 0; // 用splice转发的响应正文字节数
+    };
+
+    explicit UpstreamGroup(const ProxyRoute& route);
+
+    // 请求路径以前缀开头（纯字符串比较，需要按目录匹配时前缀写成/api/）
+    bool matches(std::string_view path) const { return path.substr(0, prefix_.size()) == prefix_; }
+
+    // 选在途请求最少的上游（刚连不上的往后放），优先复用它的空闲连接，没有就发起非阻塞connect：
+    // connecting为true时连接还没建立，等fd可写后检查SO_ERROR。fresh为true时不用空闲连接；失败返回空
+    std::unique_ptr<UpstreamConn> acquire(bool fresh, bool& connecting);
+    // 请求结束：reusable（响应完整读完、双方都没要求关闭）时放回空闲池，否则关闭
+    void release(std::unique_ptr<UpstreamConn> conn, bool reusable);
+    // 连不上：这个上游一小段时间内排在最后，其他上游都不可用时仍然会试
+    void markDown(size_t server);
+
+    Stats& stats() { return stats_; }
+    // 按“名字 数值”逐行追加，名字带上规则的序号
+    void appendStats(std::string& out, size_t index) const;
+
+private:
+    struct Server {
+        sockaddr_in addr;
+        std::string name;
+        unsigned outstanding = 0;   // 在途请求数
+        int64_t down_until = 0;     // 单调时钟毫秒
+        std::vector<std::unique_ptr<UpstreamConn>> idle;   // 后进先出：最近用过的连接最不可能已被上游关闭
+    };
+
+    std::string prefix_;
+    std::vector<Server> servers_;
+    size_t next_ = 0;   // 在途请求数相同时从这里开始轮流
+    Stats stats_;
+};
+
+// 转发一个请求的协程：请求头来自conn（请求体由conn.read()逐段读），上游的响应写回conn
+Task proxyRequest(CoConnection& conn, UpstreamGroup& group);
+
+#endif // PROXY_H
@@ -0,0 +1,224 @@
+#include "router.h"
+
+#include <algorithm>
+
+struct Router::Node {
+    struct Route {
+        std::string method;
+        RouteTarget target;
+    };
+
+    std::string prefix;        // 静态节点：这条边上的文本；参数和通配节点为空
+    std::string indices;       // 每个静态子节点prefix的第一个字节，和children一一对应
+    std::vector<std::unique_ptr<Node>> children;
+    std::unique_ptr<Node> param;      // ':'参数子节点，匹配一个路径段
+    std::unique_ptr<Node> wildcard;   // '*'通配子节点，匹配剩下的全部
+    std::string param_name;    // 参数和通配节点的名字
+    std::vector<Route> routes; // 在这里结束的路由，每个方法一条
+    std::string allow;         // 405响应的Allow头部值
+};
+
+std::string_view RouteParams::get(std::string_view name) const {
+    for (size_t i = 0; i < count_; ++i) {
+        if (names_[i] == name) return values_[i];
+    }
+    return {};
+}
+
+Router::Router() : root_(std::make_unique<Node>()) {}
+
+Router::~Router() = default;
+
+bool Router::handle(std::string_view method, std::string_view pattern, RouteHandler handler) {
+    if (!handler) return false;
+    RouteTarget target;
+    target.handler = std::move(handler);
+    return insert(method, pattern, std::move(target));
+}
+
+bool Router::handleUpload(std::string_view method, std::string_view pattern, UploadHandler handler) {
+    if (!handler) return false;
+    RouteTarget target;
+    target.upload = std::move(handler);
+    return insert(method, pattern, std::move(target));
+}
+
+bool Router::websocket(std::string_view pattern, std::shared_ptr<WebSocketHandler> handler) {
+    if (!handler) return false;
+    RouteTarget target;
+    target.websocket = std::move(handler);
+    return insert("GET", pattern, std::move(target));
+}
+
+bool Router::handleCoroutine(std::string_view method, std::string_view pattern, CoroutineHandler handler) {
+    if (!handler) return false;
+    RouteTarget target;
+    target.coroutine = std::move(handler);
+    return insert(method, pattern, std::move(target));
+}
+
+bool Router::cache(std::string_view pattern, CachePolicy policy) {
+    if (policy.ttl_ms <= 0 || policy.stale_ms < 0) return false;
+    Node* node = walk(pattern);
+    if (!node) return false;
+    for (Node::Route& route : node->routes) {
+        if (route.method != "GET") continue;
+        if (!route.target.handler && !route.target.coroutine) return false;
+        route.target.cache = std::make_shared<const CachePolicy>(std::move(policy));
+        return true;
+    }
+    return false;
+}
+
+bool Router::insert(std::string_view method, std::string_view pattern, RouteTarget target) {
+    if (method.empty()) return false;
+    Node* node = walk(pattern);
+    if (!node) return false;
+
+    // 在终点节点上登记方法，并更新405时返回的Allow
+    for (const Node::Route& route : node->routes) {
+        if (route.method == method) return false;
+    }
+    node->routes.push_back({std::string(method), std::move(target)});
+    node->allow.clear();
+    bool has_get = false, has_head = false;
+    for (const Node::Route& route : node->routes) {
+        if (!node->allow.empty()) node->allow += ", ";
+        node->allow += route.method;
+        has_get = has_get || route.method == "GET";
+        has_head = has_head || route.method == "HEAD";
+    }
+    if (has_get && !has_head) node->allow += ", HEAD";
+    ++routes_;
+    return true;
+}
+
+Router::Node* Router::walk(std::string_view pattern) {
+    if (pattern.empty() || pattern.front() != '/') return nullptr;
+
+    // 把模式拆成静态文本、参数和通配片段，沿树向下插入，缺的节点现场创建
+    Node* node = root_.get();
+    size_t params = 0;
+    size_t pos = 0;
+    while (pos < pattern.size()) {
+        char c = pattern[pos];
+        if (c != ':' && c != '*') {
+            size_t end = pattern.find_first_of(":*", pos);
+            if (end == std::string_view::npos) end = pattern.size();
+            node = insertStatic(node, pattern.substr(pos, end - pos));
+            pos = end;
+            continue;
+        }
+        // 参数和通配都必须占据一整个路径段
+        size_t end = c == ':' ? pattern.find('/', pos) : pattern.size();
+        if (end == std::string_view::npos) end = pattern.size();
+        std::string_view name = pattern.substr(pos + 1, end - pos - 1);
+        if (pattern[pos - 1] != '/' || name.empty() || name.find_first_of(":*/") != std::string_view::npos ||
+            ++params > RouteParams::kMaxParams) {
+            return nullptr;
+        }
+        std::unique_ptr<Node>& child = c == ':' ? node->param : node->wildcard;
+        if (!child) {
+            child = std::make_unique<Node>();
+            child->param_name = name;
+        } else if (child->param_name != name) {
+            return nullptr; // 同一位置的参数在不同路由里名字不同，匹配结果会有歧义
+        }
+        node = child.get();
+        pos = end;
+    }
+    return node;
+}
+
+Router::Node* Router::insertStatic(Node* node, std::string_view text) {
+    while (!text.empty()) {
+        size_t index = node->indices.find(text.front());
+        if (index == std::string::npos) {
+            auto child = std::make_unique<Node>();
+            child->prefix = text;
+            node->indices += text.front();
+            node->children.push_back(std::move(child));
+            return node->children.back().get();
+        }
+        Node* child = node->children[index].get();
+        auto mismatch = std::mismatch(child->prefix.begin(), child->prefix.end(), text.begin(), text.end());
+        auto common = static_cast<size_t>(mismatch.first - child->prefix.begin());
+        if (common < child->prefix.size()) {
+            // 只共享一部分前缀：把原来的边拆成两段，公共部分成为新的中间节点
+            auto middle = std::make_unique<Node>();
+            middle->prefix = child->prefix.substr(0, common);
+            child->prefix.erase(0, common);
+            middle->indices += child->prefix.front();
+            middle->children.push_back(std::move(node->children[index]));
+            node->children[index] = std::move(middle);
+            child = node->children[index].get();
+        }
+        node = child;
+        text.remove_prefix(common);
+    }
+    return node;
+}
+
+const Router::Node* Router::find(const Node* node, std::string_view path, RouteParams& params) const {
+    if (path.empty()) {
+        if (!node->routes.empty()) return node;
+        // "/files/*path"也匹配"/files/"，通配的值为空
+        if (node->wildcard && !node->wildcard->routes.empty()) {
+            params.names_[params.count_] = node->wildcard->param_name;
+            params.values_[params.count_++] = {};
+            return node->wildcard.get();
+        }
+        return nullptr;
+    }
+
+    // 1. 静态子节点：按第一个字节选边，整条边的文本都要相同
+    size_t index = node->indices.find(path.front());
+    if (index != std::string::npos) {
+        const Node* child = node->children[index].get();
+        if (path.substr(0, child->prefix.size()) == child->prefix) {
+            if (const Node* found = find(child, path.substr(child->prefix.size()), params)) return found;
+        }
+    }
+
+    // 2. 参数：取到下一个'/'为止的一段；后面匹配失败时撤销，再试通配
+    if (node->param) {
+        std::string_view segment = path.substr(0, path.find('/'));
+        if (!segment.empty()) {
+            size_t count = params.count_;
+            params.names_[count] = node->param->param_name;
+            params.values_[count] = segment;
+            params.count_ = count + 1;
+            if (const Node* found = find(node->param.get(), path.substr(segment.size()), params)) return found;
+            params.count_ = count;
+        }
+    }
+
+    // 3. 通配：吃掉剩下的全部路径
+    if (node->wildcard && !node->wildcard->routes.empty()) {
+        params.names_[params.count_] = node->wildcard->param_name;
+        params.values_[params.count_++] = path;
+        return node->wildcard.get();
+    }
+    return nullptr;
+}
+
+Router::Match Router::match(std::string_view method, std::string_view path, const RouteTarget*& target,
+                            RouteParams& params, std::string_view& allow) const {
+    params.count_ = 0;
+    const Node* node = find(root_.get(), path, params);
+    if (!node) return Match::NotFound;
+    const Node::Route* fallback = nullptr;
+    for (const Node::Route& route : node->routes) {
+        if (route.method == method) {
+            target = &route.target;
+            return Match::Found;
+        }
+        if (method == "HEAD" && route.method == "GET") fallback = &route;
+    }
+    if (fallback) {
+        target = &fallback->target;
+        return Match::Found;
+    }
+    allow = node->allow;
+    return Match::MethodNotAllowed;
+}
@@ -0,0 +1,180 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "http_parser.h"
+
+// 匹配时提取的路径参数：名字指向路由树里的字符串，值指向请求路径，都不分配内存
+class RouteParams {
+public:
+    static constexpr size_t kMaxParams = 8;   // 一条路由最多的参数个数
+
+    // 按名字取值，不存在返回空
+    std::string_view get(std::string_view name) const;
+    size_t size() const { return count_; }
+    std::string_view name(size_t i) const { return names_[i]; }
+    std::string_view value(size_t i) const { return values_[i]; }
+
+private:
+    friend class Router;
+
+    std::string_view names_[kMaxParams];
+    std::string_view values_[kMaxParams];
+    size_t count_ = 0;
+};
+
+// 流式响应的生产者：每次往out里追加下一段数据（建议不超过kStreamPieceSize），还有后续时返回true
+// 只在socket可写、前一段已经发完时才会被调用，整个响应从不完整地放在内存里；
+// 返回true时必须写出数据。连接中途断开时生产者随连接一起销毁，不会再被调用
+using StreamProducer = std::function<bool(std::string& out)>;
+constexpr size_t kStreamPieceSize = 16 * 1024;
+
+// 路由处理函数填写的响应；HttpHandler每个线程复用一份，body的容量保留下来
+// 设置了stream时用Transfer-Encoding: chunked发送：先发body（可以为空），再逐段发生产者的输出
+struct RouteResponse {
+    std::string_view status = "200 OK";
+    std::string_view content_type = "text/plain; charset=utf-8";
+    std::string headers;   // 附加头部，每行以\r\n结尾
+    std::string body;
+    StreamProducer stream;
+
+    void reset() {
+        status = "200 OK";
+        content_type = "text/plain; charset=utf-8";
+        headers.clear();
+        body.clear();
+        stream = nullptr;
+    }
+};
+
+using RouteHandler = std::function<void(const HttpRequest& request, const RouteParams& params,
+                                        RouteResponse& response)>;
+
+// 流式接收的请求体：请求头收全后创建，之后请求体从socket上读到一段就交给write一段
+// （分块编码已经解码），读完调用finish生成响应；请求体从不在内存里攒成一整块
+class BodySink {
+public:
+    virtual ~BodySink() = default;
+    // 返回false表示放弃剩下的请求体：随即调用finish生成响应，回复后关闭连接
+    virtual bool write(std::string_view data) = 0;
+    virtual void finish(RouteResponse& response) = 0;
+};
+
+// 请求和路径参数只在这次调用期间有效，需要的内容由BodySink自己拷贝
+using UploadHandler = std::function<std::unique_ptr<BodySink>(const HttpRequest& request,
+                                                              const RouteParams& params)>;
+
+class Task;
+class CoConnection;
+
+// 协程路由的处理函数（见coroutine.h），通常写成返回Task的lambda：
+// 请求头一收全就调用，请求体由协程自己co_await conn.read()分段读取
+using CoroutineHandler = std::function<Task(CoConnection& conn)>;
+
+class WebSocket;
+
+// WebSocket路由的回调：一条路由一个对象，所有连接、所有Reactor线程共用，
+// 回调在连接所属的Reactor线程里执行，对象里的共享状态需要自己加锁
+// WebSocket&只在回调期间有效；要发给别的连接（包括其他线程上的）用WebSocketHub::broadcast
+class WebSocketHandler {
+public:
+    virtual ~WebSocketHandler() = default;
+    // 握手请求（已经确认是合法的升级请求）是否接受，比如检查Origin；返回false时回复403
+    virtual bool accept(const HttpRequest& /*request*/, const RouteParams& /*params*/) { return true; }
+    // 101响应已经排进输出队列，这里发的消息紧跟在它后面
+    virtual void onOpen(WebSocket& /*socket*/) {}
+    // 一条完整的消息（分片已经拼好、文本已检查过UTF-8），message只在这次调用期间有效
+    virtual void onMessage(WebSocket& socket, std::string_view message, bool binary) = 0;
+    // 连接释放时调用，此时已经不能再发送；code是交换的Close帧里的关闭码（对方发来的，或者本端出错、
+    // 调用close时发出的），没有交换Close就断开时为1006
+    virtual void onClose(WebSocket& /*socket*/, uint16_t /*code*/) {}
+};
+
+// 微缓存策略（见microcache.h）：GET/HEAD请求按“方法+请求目标+vary里的请求头”缓存整个响应，
+// ttl_ms内直接重复使用；过期后stale_ms内先给旧内容，同时只让一个请求去重新生成
+struct CachePolicy {
+    int64_t ttl_ms = 1000;
+    int64_t stale_ms = 0;
+    std::vector<std::string> vary;   // 参与缓存键的请求头，比如Accept-Language
+};
+
+// 一条路由的处理方式：普通路由收完整个请求体后调用handler，上传路由用upload流式接收，
+// WebSocket路由在GET请求带着升级头时切换协议，协程路由启动coroutine
+// cache非空时普通路由和协程路由的响应进微缓存
+struct RouteTarget {
+    RouteHandler handler;
+    UploadHandler upload;
+    std::shared_ptr<WebSocketHandler> websocket;
+    CoroutineHandler coroutine;
+    std::shared_ptr<const CachePolicy> cache;
+};
+
+// 压缩前缀树（radix tree）路由：启动时注册，之后只读，所有Reactor线程共用一份
+// 路径模式由三种片段组成：
+//   静态文本   /api/users
+//   参数       :id   匹配一个非空的路径段（到下一个'/'为止）
+//   通配       *path 匹配剩下的全部路径（可以为空），只能放在最后
+// 同一位置上静态文本优先于参数，参数优先于通配；匹配时逐字节沿树向下走，
+// 代价只和请求路径的长度有关，和注册了多少条路由无关
+class Router {
+public:
+    Router();
+    ~Router();
+
+    Router(const Router&) = delete;
+    Router& operator=(const Router&) = delete;
+
+    // 注册路由；模式不以'/'开头、参数超过kMaxParams个、通配不在末尾，
+    // 或同一位置的参数名不一致、同一方法重复注册时返回false
+    bool handle(std::string_view method, std::string_view pattern, RouteHandler handler);
+    bool get(std::string_view pattern, RouteHandler handler) { return handle("GET", pattern, std::move(handler)); }
+    bool post(std::string_view pattern, RouteHandler handler) { return handle("POST", pattern, std::move(handler)); }
+    bool put(std::string_view pattern, RouteHandler handler) { return handle("PUT", pattern, std::move(handler)); }
+    bool del(std::string_view pattern, RouteHandler handler) { return handle("DELETE", pattern, std::move(handler)); }
+    // 注册流式接收请求体的路由，规则同handle
+    bool handleUpload(std::string_view method, std::string_view pattern, UploadHandler handler);
+    bool upload(std::string_view pattern, UploadHandler handler) {
+        return handleUpload("POST", pattern, std::move(handler));
+    }
+    // 注册WebSocket路由（GET），规则同handle；不带升级头的请求回复426
+    bool websocket(std::string_view pattern, std::shared_ptr<WebSocketHandler> handler);
+    // 注册协程路由，规则同handle
+    bool handleCoroutine(std::string_view method, std::string_view pattern, CoroutineHandler handler);
+    // 给已经注册的GET路由（普通路由或协程路由）打开微缓存，HEAD请求共用；
+    // 路由不存在、是上传或WebSocket路由、ttl_ms不是正数时返回false
+    bool cache(std::string_view pattern, CachePolicy policy);
+
+    enum class Match {
+        NotFound,          // 没有路由匹配这个路径
+        MethodNotAllowed,  // 路径匹配但没有这个方法，allow里是支持的方法（逗号分隔）
+        Found
+    };
+
+    // 查找method+path对应的处理函数；HEAD在没有单独注册时使用GET的处理函数
+    Match match(std::string_view method, std::string_view path, const RouteTarget*& target, RouteParams& params,
+                std::string_view& allow) const;
+
+    bool empty() const { return routes_ == 0; }
+    size_t size() const { return routes_; }
+
+private:
+    struct Node;
+
+    bool insert(std::string_view method, std::string_view pattern, RouteTarget target);
+    // 沿模式走到终点节点，缺的节点现场创建；模式不合法返回nullptr
+    Node* walk(std::string_view pattern);
+    Node* insertStatic(Node* node, std::string_view text);
+    const Node* find(const Node* node, std::string_view path, RouteParams& params) const;
+
+    std::unique_ptr<Node> root_;
+    size_t routes_ = 0;
+};
+
+#endif // ROUTER_H
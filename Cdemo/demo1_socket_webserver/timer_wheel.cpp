@@ -0,0 +1,92 @@
+#include "timer_wheel.h"
+
+TimerWheel::TimerWheel(int64_t now_ms, int64_t tick_ms)
+    : tick_ms_(tick_ms), current_(static_cast<uint64_t>(now_ms / tick_ms)) {
+    for (auto& level : slots_) {
+        for (TimerNode& head : level) {
+            head.prev = head.next = &head;
+        }
+    }
+}
+
+void TimerWheel::link(TimerNode& head, TimerNode& node) {
+    node.prev = head.prev;
+    node.next = &head;
+    head.prev->next = &node;
+    head.prev = &node;
+}
+
+void TimerWheel::unlink(TimerNode& node) {
+    node.prev->next = node.next;
+    node.next->prev = node.prev;
+    node.prev = node.next = nullptr;
+}
+
+void TimerWheel::schedule(TimerNode& node, int64_t deadline_ms) {
+    if (node.armed()) {
+        unlink(node);
+    } else {
+        ++count_;
+    }
+    uint64_t expires = deadline_ms <= 0 ? 0 : static_cast<uint64_t>((deadline_ms + tick_ms_ - 1) / tick_ms_);
+    // 已经过期的放到下一个刻度，保证在下一次advance里触发
+    node.expires = expires > current_ ? expires : current_ + 1;
+    insert(node);
+}
+
+void TimerWheel::cancel(TimerNode& node) {
+    if (!node.armed()) return;
+    unlink(node);
+    --count_;
+}
+
+void TimerWheel::insert(TimerNode& node) {
+    // 按剩余刻度数选层：差值小于64^(n+1)的放第n层，槽号取到期刻度在这一层的那6位
+    uint64_t delta = node.expires - current_;
+    unsigned level = 0;
+    while (level + 1 < kLevels && delta >= (uint64_t{1} << (kBits * (level + 1)))) ++level;
+    if (level == kLevels - 1 && delta >= (uint64_t{1} << (kBits * kLevels))) {
+        // 超出整个轮子的范围（刻度100ms时约19天，远大于任何超时设置）时截到能表示的最远刻度
+        node.expires = current_ + (uint64_t{1} << (kBits * kLevels)) - 1;
+    }
+    unsigned slot = static_cast<unsigned>(node.expires >> (kBits * level)) & (kSlots - 1);
+    link(slots_[level][slot], node);
+}
+
+void TimerWheel::cascade(unsigned level) {
+    unsigned slot = static_cast<unsigned>(current_ >> (kBits * level)) & (kSlots - 1);
+    TimerNode& head = slots_[level][slot];
+    // 先把整条链表摘下来，重新插入时可能落回同一层的其他槽
+    TimerNode pending;
+    pending.prev = pending.next = &pending;
+    if (head.next != &head) {
+        pending.next = head.next;
+        pending.prev = head.prev;
+        pending.next->prev = &pending;
+        pending.prev->next = &pending;
+        head.prev = head.next = &head;
+    }
+    while (pending.next != &pending) {
+        TimerNode& node = *pending.next;
+        unlink(node);
+        insert(node);
+    }
+}
+
+void TimerWheel::step(TimerNode& expired) {
+    ++current_;
+    // 低层转完一圈时从高到低依次下放：先处理高层，落到低层槽里的定时器接着被低层的下放处理
+    unsigned levels = 0;
+    while (levels + 1 < kLevels && (current_ & ((uint64_t{1} << (kBits * (levels + 1))) - 1)) == 0) ++levels;
+    for (unsigned level = levels; level >= 1; --level) {
+        cascade(level);
+    }
+
+    TimerNode& head = slots_[0][current_ & (kSlots - 1)];
+    if (head.next == &head) return;
+    expired.next = head.next;
+    expired.prev = head.prev;
+    expired.next->prev = &expired;
+    expired.prev->next = &expired;
+    head.prev = head.next = &head;
+}
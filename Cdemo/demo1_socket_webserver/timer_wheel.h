@@ -0,0 +1,78 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <cstddef>
+#include <cstdint>
+
+// 嵌在被管理对象里的定时器节点：挂在时间轮某个槽的双向链表上，设置和取消都不分配内存
+struct TimerNode {
+    TimerNode* prev = nullptr;
+    TimerNode* next = nullptr;
+    uint64_t expires = 0;    // 到期的刻度
+    void* owner = nullptr;   // 到期回调里用它找回所属对象
+
+    bool armed() const { return next != nullptr; }
+};
+
+// 分层时间轮：4层、每层64个槽，刻度为tick_ms
+// 第0层每个槽是一个刻度，第n层每个槽是64^n个刻度；高层的槽转到时把里面的定时器重新分到低层
+// 设置、取消都是O(1)的链表操作，推进一个刻度只碰一个槽（偶尔再加一次下放），
+// 和连接数无关，几十万个连接时也不需要每秒遍历所有连接
+class TimerWheel {
+public:
+    TimerWheel(int64_t now_ms, int64_t tick_ms);
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    // 在deadline_ms（单调时钟毫秒）之后到期，已设置的先取消；到期时间向上取整到刻度
+    void schedule(TimerNode& node, int64_t deadline_ms);
+    void cancel(TimerNode& node);
+
+    // 推进到now_ms，把到期的定时器逐个摘下后交给on_expire(TimerNode&)
+    // 回调里可以取消或重新设置任何定时器（包括同一批里还没轮到的）
+    template <typename Fn>
+    void advance(int64_t now_ms, Fn&& on_expire);
+
+    bool empty() const { return count_ == 0; }
+    size_t size() const { return count_; }
+    int64_t tickMs() const { return tick_ms_; }
+
+private:
+    static constexpr unsigned kBits = 6;
+    static constexpr unsigned kSlots = 1u << kBits;
+    static constexpr unsigned kLevels = 4;
+
+    void insert(TimerNode& node);
+    void cascade(unsigned level);
+    // 前进一个刻度，把这个刻度到期的链表整体移到expired里
+    void step(TimerNode& expired);
+
+    static void link(TimerNode& head, TimerNode& node);
+    static void unlink(TimerNode& node);
+
+    int64_t tick_ms_;
+    uint64_t current_;                    // 已经处理到的刻度
+    size_t count_ = 0;
+    TimerNode slots_[kLevels][kSlots];    // 每个槽是带哨兵的环形双向链表
+};
+
+template <typename Fn>
+void TimerWheel::advance(int64_t now_ms, Fn&& on_expire) {
+    uint64_t target = static_cast<uint64_t>(now_ms / tick_ms_);
+    if (count_ == 0 && current_ < target) current_ = target; // 没有定时器时直接跳过空转的刻度
+    while (current_ < target) {
+        TimerNode expired;
+        expired.prev = expired.next = &expired;
+        step(expired);
+        // 每次只摘链表头：回调取消同一批里的其他节点时，它们直接从expired上摘掉
+        while (expired.next != &expired) {
+            TimerNode& node = *expired.next;
+            unlink(node);
+            --count_;
+            on_expire(node);
+        }
+    }
+}
+
+#endif // TIMER_WHEEL_H
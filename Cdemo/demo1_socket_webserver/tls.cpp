@@ -0,0 +1,144 @@
+#include "tls.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+namespace {
+
+constexpr long kSessionCacheSize = 20 * 1024;   // 服务端会话缓存的条数（TLS 1.2会话ID），所有线程共用
+constexpr long kSessionLifetime = 3600;          // 会话和票据的有效期，秒
+constexpr unsigned char kSessionContext[] = "demo1";
+
+void printErrors(const char* what) {
+    unsigned long error = ERR_get_error();
+    char text[256];
+    ERR_error_string_n(error, text, sizeof(text));
+    std::fprintf(stderr, "%s: %s\n", what, error ? text : "unknown error");
+    ERR_clear_error();
+}
+
+// SSL_ERROR_*换成read/write的约定：需要等待时errno设为EAGAIN，其他错误设为EIO
+ssize_t translateError(ssl_st* ssl, int result) {
+    switch (SSL_get_error(ssl, result)) {
+    case SSL_ERROR_WANT_READ:
+    case SSL_ERROR_WANT_WRITE:
+        errno = EAGAIN;
+        return -1;
+    case SSL_ERROR_ZERO_RETURN:
+        return 0;       // 收到close_notify（或忽略掉的意外EOF），和明文连接读到EOF一样处理
+    case SSL_ERROR_SYSCALL:
+        if (errno == 0) errno = EIO;
+        break;
+    default:
+        errno = EIO;
+        break;
+    }
+    ERR_clear_error();
+    return -1;
+}
+
+} // namespace
+
+TlsContext::TlsContext(const std::string& cert_file, const std::string& key_file) {
+    SSL_CTX* ctx = SSL_CTX_new(TLS_server_method());
+    if (!ctx) {
+        printErrors("SSL_CTX_new");
+        return;
+    }
+    if (SSL_CTX_use_certificate_chain_file(ctx, cert_file.c_str()) != 1) {
+        printErrors(cert_file.c_str());
+        SSL_CTX_free(ctx);
+        return;
+    }
+    if (SSL_CTX_use_PrivateKey_file(ctx, key_file.c_str(), SSL_FILETYPE_PEM) != 1 ||
+        SSL_CTX_check_private_key(ctx) != 1) {
+        printErrors(key_file.c_str());
+        SSL_CTX_free(ctx);
+        return;
+    }
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    // ENABLE_KTLS：握手完成后OpenSSL尝试把密钥交给内核（需要内核的tls模块），失败时照旧在用户态加密
+    // IGNORE_UNEXPECTED_EOF：客户端不发close_notify直接断开很常见，当作正常关闭
+    SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS | SSL_OP_IGNORE_UNEXPECTED_EOF | SSL_OP_NO_RENEGOTIATION |
+                                 SSL_OP_CIPHER_SERVER_PREFERENCE);
+    // 部分写：一条记录发出去就返回，配合非阻塞socket；重试时缓冲区地址可以变，发送缓冲区由事件循环现拼
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER |
+                              SSL_MODE_RELEASE_BUFFERS);
+
+    // 会话恢复：TLS 1.2用会话ID查服务端缓存，TLS 1.3用票据（密钥在SSL_CTX创建时随机生成，进程内共用）
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(ctx, kSessionCacheSize);
+    SSL_CTX_set_timeout(ctx, kSessionLifetime);
+    SSL_CTX_set_session_id_context(ctx, kSessionContext, sizeof(kSessionContext) - 1);
+    SSL_CTX_set_num_tickets(ctx, 1);   // 浏览器一个连接只用一张票据，默认的两张多一次加密和发送
+    ctx_ = ctx;
+}
+
+TlsContext::~TlsContext() {
+    if (ctx_) SSL_CTX_free(ctx_);
+}
+
+bool TlsSession::start(ssl_ctx_st* ctx, int fd) {
+    ssl_ = SSL_new(ctx);
+    if (!ssl_) {
+        ERR_clear_error();
+        return false;
+    }
+    if (SSL_set_fd(ssl_, fd) != 1) {
+        reset();
+        return false;
+    }
+    SSL_set_accept_state(ssl_);
+    return true;
+}
+
+void TlsSession::reset() {
+    if (ssl_) SSL_free(ssl_);
+    ssl_ = nullptr;
+    established_ = false;
+    kernel_send_ = false;
+}
+
+int TlsSession::handshake() {
+    ERR_clear_error();
+    int result = SSL_do_handshake(ssl_);
+    if (result == 1) {
+        established_ = true;
+        kernel_send_ = BIO_get_ktls_send(SSL_get_wbio(ssl_));
+        return 1;
+    }
+    int error = SSL_get_error(ssl_, result);
+    if (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE) return 0;
+    ERR_clear_error();
+    return -1;
+}
+
+ssize_t TlsSession::read(char* buf, size_t len) {
+    // 错误队列是线程级的，每次调用前清掉，SSL_get_error才不会读到别的连接留下的错误
+    ERR_clear_error();
+    size_t done = 0;
+    int result = SSL_read_ex(ssl_, buf, len, &done);
+    if (result == 1) return static_cast<ssize_t>(done);
+    return translateError(ssl_, result);
+}
+
+ssize_t TlsSession::write(const char* buf, size_t len) {
+    ERR_clear_error();
+    size_t done = 0;
+    int result = SSL_write_ex(ssl_, buf, len, &done);
+    if (result == 1) return static_cast<ssize_t>(done);
+    return translateError(ssl_, result);
+}
+
+bool TlsSession::resumed() const {
+    return ssl_ && SSL_session_reused(ssl_) == 1;
+}
+
+void TlsSession::shutdown() {
+    if (!ssl_ || !established_) return;
+    ERR_clear_error();
+    SSL_shutdown(ssl_);
+    ERR_clear_error();
+}
@@ -0,0 +1,71 @@
+#ifndef TLS_H
+#define TLS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+
+// 只前置声明OpenSSL的类型，包含connection.h的文件不必引入OpenSSL的头文件
+struct ssl_st;
+struct ssl_ctx_st;
+
+// HTTPS配置：证书、私钥和所有Reactor线程共用的一个SSL_CTX
+// 会话缓存（TLS 1.2的会话ID）和会话票据的密钥都挂在SSL_CTX上，所以无论恢复请求落到哪个线程都能命中，
+// 恢复的握手省掉证书验证和密钥交换的签名
+// 可用时开启kTLS：握手完成后加密交给内核，静态文件照样用sendfile发送
+class TlsContext {
+public:
+    // cert是PEM格式的证书链（服务器证书在前），key是PEM格式的私钥；失败时打印原因，ok()返回false
+    TlsContext(const std::string& cert_file, const std::string& key_file);
+    ~TlsContext();
+
+    TlsContext(const TlsContext&) = delete;
+    TlsContext& operator=(const TlsContext&) = delete;
+
+    bool ok() const { return ctx_ != nullptr; }
+    ssl_ctx_st* get() const { return ctx_; }
+
+private:
+    ssl_ctx_st* ctx_ = nullptr;
+};
+
+// 一个连接的TLS状态；没有调用start()时是空的，连接按明文处理
+// read/write的返回值和errno约定与read(2)/write(2)相同（需要等待时返回-1、errno为EAGAIN，
+// 对端正常关闭时read返回0），事件循环的读写循环不用区分明文和密文
+class TlsSession {
+public:
+    TlsSession() = default;
+    ~TlsSession() { reset(); }
+
+    TlsSession(const TlsSession&) = delete;
+    TlsSession& operator=(const TlsSession&) = delete;
+
+    // 为刚accept的fd创建服务端会话，失败返回false
+    bool start(ssl_ctx_st* ctx, int fd);
+    void reset();
+
+    explicit operator bool() const { return ssl_ != nullptr; }
+    bool handshaking() const { return ssl_ != nullptr && !established_; }
+
+    // 非阻塞握手：完成返回1，需要等socket可读或可写返回0，失败返回-1
+    int handshake();
+
+    ssize_t read(char* buf, size_t len);
+    ssize_t write(const char* buf, size_t len);
+
+    // 发送方向的加密已交给内核（kTLS）：可以直接对fd调用writev/sendfile
+    bool kernelSend() const { return kernel_send_; }
+    // 这次握手是恢复的会话（会话缓存或票据）
+    bool resumed() const;
+
+    // 关闭前尽力发出close_notify，不等待对方回应
+    void shutdown();
+
+private:
+    ssl_st* ssl_ = nullptr;
+    bool established_ = false;
+    bool kernel_send_ = false;
+};
+
+#endif // TLS_H
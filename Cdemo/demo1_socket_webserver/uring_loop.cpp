@@ -0,0 +1,719 @@
+#include "uring_loop.h"
+
+#ifdef HAVE_IO_URING
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <climits>
+#include <iostream>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr unsigned kRingEntries = 4096;      // SQ深度
+constexpr unsigned kBufferCount = 4096;      // 接收缓冲区个数（必须是2的幂）
+constexpr unsigned kBufferSize = 4096;       // 每个接收缓冲区大小
+constexpr uint16_t kBufferGroup = 0;         // 缓冲区组编号
+constexpr int kTickMs = 100;                // 时间轮的刻度，超时最多晚这么久触发
+constexpr unsigned kSlotBits = 24;           // 连接编号里槽位下标占的位数
+constexpr uint64_t kSlotMask = (uint64_t{1} << kSlotBits) - 1;
+constexpr size_t kIdleIovecs = 8;            // 空闲连接最多保留的iovec数组容量
+
+// glibc没有封装io_uring，直接走系统调用
+int sysSetup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int sysEnter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+int sysRegister(int fd, unsigned opcode, void* arg, unsigned nr_args) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+uint64_t makeUserData(uint64_t id, uint8_t op) {
+    return (id << 8) | op;
+}
+
+} // namespace
+
+bool UringLoop::supported() {
+    // multishot recv需要6.0以上内核，这个能力无法通过probe探测，只能看版本号
+    utsname info{};
+    if (uname(&info) != 0) return false;
+    int major = 0, minor = 0;
+    if (sscanf(info.release, "%d.%d", &major, &minor) != 2) return false;
+    if (major < 6) return false;
+
+    io_uring_params params{};
+    int fd = sysSetup(8, &params);
+    if (fd < 0) return false; // 内核未开启io_uring或被seccomp禁用
+
+    // 确认本后端用到的操作码全部可用
+    size_t probe_size = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+    std::vector<char> storage(probe_size, 0);
+    auto* probe = reinterpret_cast<io_uring_probe*>(storage.data());
+    bool ok = sysRegister(fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+    for (uint8_t op : {IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SENDMSG, IORING_OP_CLOSE,
+                       IORING_OP_ASYNC_CANCEL, IORING_OP_TIMEOUT, IORING_OP_POLL_ADD}) {
+        ok = ok && op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+    }
+    close(fd);
+    return ok;
+}
+
+UringLoop::UringLoop(int listen_fd, HttpHandler& handler)
+    : listen_fd_(listen_fd), handler_(handler), timers_(steadyNowMs(), kTickMs) {
+    // 先登记统计来源，下面几种ring建立方式提前返回时/stats里也有本后端的计数
+    handler_.setStatsSource([this](std::string& out) { appendStats(out); });
+    buffers_.resize(static_cast<size_t>(kBufferCount) * kBufferSize);
+    if (!setupRing()) return;
+    if (setupBufferRing()) return;
+    // 缓冲区环不可用时换一个全新的ring再退回旧的PROVIDE_BUFFERS方式，
+    // 自检失败的环境里SQ/CQ的状态已不可信（有的内核上环形队列的头指针会被改乱），不能接着用
+    teardownRing();
+    if (!setupRing() || !provideBuffers()) teardownRing();
+}
+
+UringLoop::~UringLoop() {
+    handler_.setStatsSource(nullptr);
+    for (UringConnection* conn : slots_) {
+        if (!conn) continue;
+        close(conn->fd);
+        connection_pool_.destroy(conn);
+    }
+    if (FramePool::current() == &frames_) FramePool::setCurrent(nullptr);
+    teardownRing();
+}
+
+UringLoop::UringConnection* UringLoop::find(uint64_t id) const {
+    uint64_t slot = id & kSlotMask;
+    if (slot >= slots_.size()) return nullptr;
+    UringConnection* conn = slots_[slot];
+    return conn && conn->id == id ? conn : nullptr;
+}
+
+void UringLoop::appendStats(std::string& out) const {
+    out += "backend io_uring\n";
+    out += "connections " + std::to_string(connection_count_) + "\n";
+    out += "timers " + std::to_string(timers_.size()) + "\n";
+    ::appendStats(out, "connection_pool", connection_pool_.stats());
+    ::appendStats(out, "buffer_pool", pool_.stats());
+    ::appendStats(out, "coroutine_frames", frames_.stats());
+}
+
+void UringLoop::teardownRing() {
+    if (ring_fd_ != -1) close(ring_fd_);
+    if (buf_ring_) munmap(buf_ring_, buf_ring_size_);
+    if (sqes_) munmap(sqes_, sqes_size_);
+    if (cq_ptr_ && cq_ptr_ != sq_ptr_) munmap(cq_ptr_, cq_size_);
+    if (sq_ptr_) munmap(sq_ptr_, sq_size_);
+    ring_fd_ = -1;
+    buf_ring_ = nullptr;
+    sqes_ = nullptr;
+    cq_ptr_ = nullptr;
+    sq_ptr_ = nullptr;
+    sq_local_tail_ = 0;
+    to_submit_ = 0;
+}
+
+bool UringLoop::setupRing() {
+    // 只有本线程提交请求，任务统一推迟到io_uring_enter时执行，减少中断和上下文切换；旧内核不认识这些标志时退回默认
+    io_uring_params params{};
+    params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    ring_fd_ = sysSetup(kRingEntries, &params);
+    if (ring_fd_ < 0) {
+        params = io_uring_params{};
+        ring_fd_ = sysSetup(kRingEntries, &params);
+    }
+    if (ring_fd_ < 0) {
+        perror("io_uring_setup");
+        return false;
+    }
+
+    // 映射SQ/CQ环和SQE数组
+    sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+
+    sq_ptr_ = mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   ring_fd_, IORING_OFF_SQ_RING);
+    if (sq_ptr_ == MAP_FAILED) {
+        sq_ptr_ = nullptr;
+        perror("mmap(sq)");
+        return false;
+    }
+    if (single_mmap) {
+        cq_ptr_ = sq_ptr_;
+    } else {
+        cq_ptr_ = mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ring_fd_, IORING_OFF_CQ_RING);
+        if (cq_ptr_ == MAP_FAILED) {
+            cq_ptr_ = nullptr;
+            perror("mmap(cq)");
+            return false;
+        }
+    }
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring_fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        perror("mmap(sqes)");
+        return false;
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(sq_ptr_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_entries_ = params.sq_entries;
+    sq_local_tail_ = *sq_tail_;
+
+    char* cq = static_cast<char*>(cq_ptr_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+}
+
+bool UringLoop::setupBufferRing() {
+    // 缓冲区环本身要求页对齐，用mmap分配
+    buf_ring_size_ = kBufferCount * sizeof(io_uring_buf);
+    void* ring = mmap(nullptr, buf_ring_size_, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+        perror("mmap(buf_ring)");
+        return false;
+    }
+    buf_ring_ = static_cast<io_uring_buf_ring*>(ring);
+
+    io_uring_buf_reg reg{};
+    reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+    reg.ring_entries = kBufferCount;
+    reg.bgid = kBufferGroup;
+    if (sysRegister(ring_fd_, IORING_REGISTER_PBUF_RING, &reg, 1) == 0) {
+        for (unsigned i = 0; i < kBufferCount; ++i) {
+            recycleBuffer(static_cast<uint16_t>(i));
+        }
+        if (bufferRingWorks()) return true;
+        // 部分内核（或沙箱环境）能注册缓冲区环却取不出缓冲区
+        sysRegister(ring_fd_, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+    }
+    munmap(ring, buf_ring_size_);
+    buf_ring_ = nullptr;
+    return false;
+}
+
+bool UringLoop::provideBuffers() {
+    // 旧方式：一个PROVIDE_BUFFERS请求一次性交出全部缓冲区，之后每个缓冲区用完再单独归还
+    legacy_buffers_ = true;
+    io_uring_sqe* sqe = getSqe();
+    if (!sqe) return false;
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = static_cast<int>(kBufferCount);
+    sqe->addr = reinterpret_cast<uint64_t>(buffers_.data());
+    sqe->len = kBufferSize;
+    sqe->off = 0;
+    sqe->buf_group = kBufferGroup;
+    sqe->user_data = makeUserData(0, OpProvide);
+    return true;
+}
+
+bool UringLoop::bufferRingWorks() {
+    // 用socketpair做一次真实的带缓冲区选择的recv，确认内核确实能从环里取出缓冲区
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) != 0) return false;
+    bool ok = false;
+    io_uring_sqe* sqe = getSqe();
+    if (sqe && write(pair[1], "x", 1) == 1) {
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = pair[0];
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = kBufferGroup;
+        sqe->user_data = 0;
+        if (submitAndWait(1) >= 0) {
+            unsigned head = *cq_head_;
+            const io_uring_cqe* cqe = &cqes_[head & cq_mask_];
+            ok = cqe->res == 1 && (cqe->flags & IORING_CQE_F_BUFFER);
+            if (ok) recycleBuffer(static_cast<uint16_t>(cqe->flags >> IORING_CQE_BUFFER_SHIFT));
+            __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+        }
+    }
+    close(pair[0]);
+    close(pair[1]);
+    return ok;
+}
+
+void UringLoop::recycleBuffer(uint16_t bid) {
+    char* addr = buffers_.data() + static_cast<size_t>(bid) * kBufferSize;
+    if (legacy_buffers_) {
+        // 归还请求和本轮其他SQE一起提交，不产生额外系统调用
+        io_uring_sqe* sqe = getSqe();
+        if (!sqe) return;
+        sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+        sqe->fd = 1;
+        sqe->addr = reinterpret_cast<uint64_t>(addr);
+        sqe->len = kBufferSize;
+        sqe->off = bid;
+        sqe->buf_group = kBufferGroup;
+        sqe->user_data = makeUserData(0, OpProvide);
+        return;
+    }
+    // 把缓冲区放回环尾，tail用release语义发布，保证内核先看到缓冲区内容再看到新tail
+    io_uring_buf& buf = buf_ring_->bufs[buf_tail_ & (kBufferCount - 1)];
+    buf.addr = reinterpret_cast<uint64_t>(addr);
+    buf.len = kBufferSize;
+    buf.bid = bid;
+    ++buf_tail_;
+    __atomic_store_n(&buf_ring_->tail, buf_tail_, __ATOMIC_RELEASE);
+}
+
+bool UringLoop::reserveSqes(unsigned count) {
+    unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    if (sq_local_tail_ - head + count > sq_entries_) {
+        // SQ满了，先把已有的提交掉腾出空间
+        submitAndWait(0);
+        head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    }
+    return sq_local_tail_ - head + count <= sq_entries_;
+}
+
+io_uring_sqe* UringLoop::getSqe() {
+    if (!reserveSqes(1)) return nullptr;
+    unsigned index = sq_local_tail_ & sq_mask_;
+    io_uring_sqe* sqe = &sqes_[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sq_array_[index] = index;
+    ++sq_local_tail_;
+    ++to_submit_;
+    return sqe;
+}
+
+int UringLoop::submitAndWait(unsigned wait_nr) {
+    __atomic_store_n(sq_tail_, sq_local_tail_, __ATOMIC_RELEASE);
+    unsigned submit = to_submit_;
+    to_submit_ = 0;
+    unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+    int ret;
+    do {
+        ret = sysEnter(ring_fd_, submit, wait_nr, flags);
+    } while (ret < 0 && errno == EINTR);
+    return ret;
+}
+
+void UringLoop::armAccept() {
+    io_uring_sqe* sqe = getSqe();
+    if (!sqe) return;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listen_fd_;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC; // 文件片段要直接调用sendfile，不能阻塞
+    sqe->user_data = makeUserData(0, OpAccept);
+}
+
+void UringLoop::armRecv(uint64_t id, UringConnection* conn) {
+    // 不指定缓冲区，由内核在数据到达时从缓冲区组里挑一个
+    io_uring_sqe* sqe = getSqe();
+    if (!sqe) return;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn->fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = kBufferGroup;
+    sqe->user_data = makeUserData(id, OpRecv);
+    conn->recv_armed = true;
+}
+
+void UringLoop::armTick() {
+    io_uring_sqe* sqe = getSqe();
+    if (!sqe) return;
+    // 纯定时器（不按完成事件计数），只在有连接计时期间提交
+    tick_.tv_sec = 0;
+    tick_.tv_nsec = kTickMs * 1000000LL;
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->addr = reinterpret_cast<uint64_t>(&tick_);
+    sqe->len = 1;
+    sqe->off = 0;
+    sqe->user_data = makeUserData(0, OpTick);
+    tick_armed_ = true;
+}
+
+void UringLoop::armWake() {
+    // 等广播邮箱的eventfd可读；eventfd是非阻塞的，计数由deliver()自己读掉，每次完成后重新提交
+    io_uring_sqe* sqe = getSqe();
+    if (!sqe) return;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = handler_.websockets()->wakeFd();
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = makeUserData(0, OpWake);
+}
+
+void UringLoop::cancelRecv(uint64_t id, UringConnection* conn) {
+    // multishot recv持有socket引用，不先取消的话close之后客户端收不到FIN
+    if (!conn->recv_armed) return;
+    io_uring_sqe* sqe = getSqe();
+    if (!sqe) return;
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = makeUserData(id, OpRecv);
+    sqe->user_data = makeUserData(id, OpCancel);
+    conn->recv_armed = false;
+}
+
+void UringLoop::queueClose(uint64_t id, UringConnection* conn) {
+    cancelRecv(id, conn);
+    conn->state = ConnState::Closed;
+    timers_.cancel(conn->timer);
+    io_uring_sqe* sqe = getSqe();
+    if (!sqe) return;
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = conn->fd;
+    sqe->user_data = makeUserData(id, OpClose);
+}
+
+void UringLoop::processAndSend(uint64_t id, UringConnection* conn) {
+    // 上一批响应还在发送中，新请求留在缓冲区，等发送完成后再处理
+    if (conn->state != ConnState::Reading) return;
+    while (true) {
+        handler_.process(*conn);
+        if (conn->out.empty()) {
+            if (conn->close_after_write) {
+                queueClose(id, conn);
+                return;
+            }
+            break;
+        }
+        conn->state = ConnState::Writing;
+        // 整批都同步发完（只有文件片段时可能）且连接保持，继续处理发送期间到达的请求
+        if (!sendPending(id, conn)) break;
+    }
+    // 等下一个请求，或者等发送完成
+    if (conn->state != ConnState::Closed) handler_.updateDeadline(*conn, timers_);
+}
+
+bool UringLoop::sendPending(uint64_t id, UringConnection* conn) {
+    // 从out_index开始发送剩余片段，遇到需要等待的异步操作就返回false
+    while (conn->out_index < conn->out.size()) {
+        OutputChunk& head = conn->out[conn->out_index];
+        if (head.stream) {
+            // 流式响应之前的部分都已被内核收下：生产下一段
+            handler_.produce(*conn);
+            continue;
+        }
+        if (head.file) {
+            // 文件片段：socket是非阻塞的，sendfile直接把页缓存里的数据发出去，写满了就等可写
+            off_t offset = head.offset;
+            ssize_t len = sendfile(conn->fd, head.file->fd, &offset, head.iov.iov_len);
+            if (len > 0) {
+                conn->advanceOutput(static_cast<size_t>(len));
+                handler_.metrics().sent(static_cast<size_t>(len));
+                continue;
+            }
+            if (len < 0 && errno == EINTR) continue;
+            if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                armPollOut(id, conn);
+                return false;
+            }
+            queueClose(id, conn); // 出错，或文件发送中途被截短
+            return false;
+        }
+
+        // 相邻的内存片段合并成一个sendmsg；MSG_WAITALL让内核自己处理部分写
+        // 这是最后一段且需要关闭时sendmsg与close链接，取消recv和两个SQE必须进同一批提交
+        if (!reserveSqes(3)) return false;
+        conn->iov.clear();
+        conn->sending_bytes = 0;
+        size_t end = conn->out_index;
+        for (; end < conn->out.size() && !conn->out[end].file && !conn->out[end].stream &&
+               conn->iov.size() < IOV_MAX;
+             ++end) {
+            conn->iov.push_back(conn->out[end].iov);
+            conn->sending_bytes += conn->out[end].iov.iov_len;
+        }
+        bool link_close = conn->close_after_write && end == conn->out.size();
+        conn->msg = msghdr{};
+        conn->msg.msg_iov = conn->iov.data();
+        conn->msg.msg_iovlen = conn->iov.size();
+
+        if (link_close) cancelRecv(id, conn);
+        io_uring_sqe* send = getSqe();
+        send->opcode = IORING_OP_SENDMSG;
+        send->fd = conn->fd;
+        send->addr = reinterpret_cast<uint64_t>(&conn->msg);
+        send->len = 1;
+        send->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+        send->user_data = makeUserData(id, OpSend);
+        if (link_close) {
+            send->flags = IOSQE_IO_LINK;
+            conn->linked_close = true;
+            io_uring_sqe* close_sqe = getSqe();
+            close_sqe->opcode = IORING_OP_CLOSE;
+            close_sqe->fd = conn->fd;
+            close_sqe->user_data = makeUserData(id, OpClose);
+        }
+        return false;
+    }
+
+    // 整批发送完毕
+    conn->clearOutput();
+    if (conn->iov.capacity() > (conn->ws ? 0 : kIdleIovecs)) std::vector<iovec>().swap(conn->iov);
+    if (conn->close_after_write) {
+        // 链接的close会随后完成；否则（最后是文件片段，或发送期间才决定关闭）这里补上
+        if (conn->linked_close) {
+            conn->state = ConnState::Closed;
+            timers_.cancel(conn->timer);
+        } else {
+            queueClose(id, conn);
+        }
+        return false;
+    }
+    conn->state = ConnState::Reading;
+    return true;
+}
+
+void UringLoop::armPollOut(uint64_t id, UringConnection* conn) {
+    io_uring_sqe* sqe = getSqe();
+    if (!sqe) return;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = conn->fd;
+    sqe->poll32_events = POLLOUT;
+    sqe->user_data = makeUserData(id, OpPoll);
+}
+
+void UringLoop::run() {
+    FramePool::setCurrent(&frames_);
+    AdmissionControl& admission = handler_.admission();
+    armAccept();
+    if (handler_.websockets() && handler_.websockets()->wakeFd() != -1) armWake();
+    while (true) {
+        // 有连接在计时才需要定期醒来推进时间轮
+        if (!tick_armed_ && !timers_.empty()) armTick();
+        if (admission.enabled()) {
+            handler_.metrics().admission(admission); // 这批事件里拒绝的请求和连接在等待前交给/metrics
+            admission.beforeWait(steadyNowMs());
+        }
+        if (submitAndWait(1) < 0 && errno != EBUSY && errno != EAGAIN) {
+            perror("io_uring_enter");
+            return;
+        }
+        if (admission.enabled()) admission.afterWait(steadyNowMs());
+        handler_.refreshDate();
+        // 收割本轮全部完成事件，处理过程中产生的新SQE留到下一次io_uring_enter一起提交
+        unsigned head = *cq_head_;
+        unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const io_uring_cqe* cqe = &cqes_[head & cq_mask_];
+            uint64_t id = cqe->user_data >> 8;
+            switch (static_cast<Op>(cqe->user_data & 0xff)) {
+            case OpAccept: handleAccept(cqe); break;
+            case OpRecv:   handleRecv(id, cqe); break;
+            case OpSend:   handleSend(id, cqe); break;
+            case OpClose:  handleClose(id, cqe); break;
+            case OpTick:   tick_armed_ = false; break;
+            case OpPoll:   handlePoll(id, cqe); break;
+            case OpWake:   handleWake(cqe); break;
+            case OpCancel:
+            case OpProvide: break;
+            }
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+        expireTimers();
+        // 在等微缓存的连接：条目生成完了，重新处理缓冲区里的请求；正在关闭的连接跳过
+        handler_.wakeCacheWaiters([this](Connection& base) {
+            auto* conn = static_cast<UringConnection*>(&base);
+            if (conn->state == ConnState::Reading) processAndSend(conn->id, conn);
+        });
+    }
+}
+
+void UringLoop::handleAccept(const io_uring_cqe* cqe) {
+    // 没有F_MORE说明multishot accept已经终止（比如出错），需要重新提交
+    if (!(cqe->flags & IORING_CQE_F_MORE)) armAccept();
+    if (cqe->res < 0) {
+        if (cqe->res != -EAGAIN && cqe->res != -EINTR) {
+            std::cerr << "accept: " << strerror(-cqe->res) << std::endl;
+            handler_.metrics().acceptError();
+        }
+        return;
+    }
+    // 过载：这个连接已经排了太久的队，同步回复503后关闭，不分配槽位和连接对象
+    AdmissionControl& admission = handler_.admission();
+    if (admission.enabled() && !admission.admitConnection(steadyNowMs())) {
+        handler_.rejectConnection(cqe->res, true);
+        return;
+    }
+    // 连接对象从对象池取，槽位下标复用，稳定运行时建立连接不分配内存
+    uint32_t slot;
+    if (free_slots_.empty()) {
+        slot = static_cast<uint32_t>(slots_.size());
+        if (slot > kSlotMask) {
+            close(cqe->res);
+            return;
+        }
+        slots_.push_back(nullptr);
+    } else {
+        slot = free_slots_.back();
+        free_slots_.pop_back();
+    }
+    UringConnection* conn = connection_pool_.create(pool_);
+    conn->fd = cqe->res;
+    uint64_t id = (next_serial_++ << kSlotBits | slot) & (~uint64_t{0} >> 8);
+    conn->id = id;
+    conn->timer.owner = conn;
+    slots_[slot] = conn;
+    ++connection_count_;
+    handler_.metrics().connectionOpened();
+    handler_.updateDeadline(*conn, timers_);
+    armRecv(id, conn);
+}
+
+void UringLoop::handleRecv(uint64_t id, const io_uring_cqe* cqe) {
+    UringConnection* conn = find(id);
+    bool alive = conn && conn->state != ConnState::Closed && !conn->close_after_write;
+    if (cqe->res > 0) handler_.metrics().received(static_cast<size_t>(cqe->res));
+
+    // 1. 数据已经在缓冲区里：拷进连接自己的缓冲区后立刻把缓冲区还给内核
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+        auto bid = static_cast<uint16_t>(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        if (alive && cqe->res > 0) {
+            conn->in.append(buffers_.data() + static_cast<size_t>(bid) * kBufferSize, static_cast<size_t>(cqe->res));
+        }
+        recycleBuffer(bid);
+    }
+    if (!alive) return;
+    if (!(cqe->flags & IORING_CQE_F_MORE)) conn->recv_armed = false;
+
+    // 2. 出错或请求过大直接关闭；对端关闭写方向时先回复已收全的请求再关闭
+    if ((cqe->res < 0 && cqe->res != -ENOBUFS) || conn->in.size() > kMaxBufferedRequest) {
+        if (conn->state == ConnState::Reading) {
+            queueClose(id, conn);
+        } else {
+            conn->close_after_write = true; // 等进行中的发送完成后关闭
+        }
+        return;
+    }
+    if (cqe->res == 0) {
+        conn->close_after_write = true;
+    } else if (!conn->recv_armed) {
+        // multishot终止（比如缓冲区暂时用光ENOBUFS），重新提交即可
+        armRecv(id, conn);
+    }
+
+    // 3. 处理所有完整到达的请求并发送
+    processAndSend(id, conn);
+}
+
+void UringLoop::handleSend(uint64_t id, const io_uring_cqe* cqe) {
+    UringConnection* conn = find(id);
+    if (!conn) return;
+    bool complete = cqe->res >= 0 && static_cast<size_t>(cqe->res) == conn->sending_bytes;
+    size_t sent = conn->sending_bytes;
+    conn->sending_bytes = 0;
+    if (conn->state == ConnState::Closed) return;
+    if (!complete) {
+        // 发送失败或不完整时链接中的close会被内核以ECANCELED取消，需要自己补一个close
+        queueClose(id, conn);
+        return;
+    }
+    conn->advanceOutput(sent);
+    handler_.metrics().sent(sent);
+    // 还有剩余片段（文件或下一段内存）就继续发送；全部发完后处理发送期间新到达的流水线请求
+    if (sendPending(id, conn)) {
+        processAndSend(id, conn);
+    } else if (conn->state == ConnState::Writing) {
+        handler_.updateDeadline(*conn, timers_); // 发送有进展，重新计时
+    }
+}
+
+void UringLoop::handlePoll(uint64_t id, const io_uring_cqe* cqe) {
+    UringConnection* conn = find(id);
+    if (!conn) return;
+    if (conn->state != ConnState::Writing) return;
+    if (cqe->res < 0 || (cqe->res & (POLLERR | POLLHUP))) {
+        queueClose(id, conn);
+        return;
+    }
+    if (sendPending(id, conn)) {
+        processAndSend(id, conn);
+    } else if (conn->state == ConnState::Writing) {
+        handler_.updateDeadline(*conn, timers_);
+    }
+}
+
+void UringLoop::handleWake(const io_uring_cqe* cqe) {
+    if (cqe->res < 0) {
+        std::cerr << "poll(eventfd): " << strerror(-cqe->res) << std::endl;
+        return;
+    }
+    armWake();
+    handler_.websockets()->deliver([this](Connection& base, bool overflow) {
+        auto* conn = static_cast<UringConnection*>(&base);
+        if (overflow) {
+            // 收得太慢：和发送超时一样，正在发送的先shutdown让它出错返回，再走正常的关闭流程
+            if (conn->state == ConnState::Reading) {
+                queueClose(conn->id, conn);
+            } else {
+                conn->close_after_write = true;
+                shutdown(conn->fd, SHUT_RDWR);
+            }
+            return;
+        }
+        // 正在发送的连接等这次发送完成后会接着发新片段；空闲的现在就发
+        if (conn->state == ConnState::Reading) processAndSend(conn->id, conn);
+    });
+}
+
+void UringLoop::handleClose(uint64_t id, const io_uring_cqe* cqe) {
+    // 被取消的close由handleSend补发，这里等补发的那次完成
+    if (cqe->res == -ECANCELED) return;
+    // close完成才真正释放连接，此时sendmsg引用的响应缓冲区已不再使用
+    UringConnection* conn = find(id);
+    if (!conn) return;
+    timers_.cancel(conn->timer);
+    slots_[id & kSlotMask] = nullptr;
+    free_slots_.push_back(static_cast<uint32_t>(id & kSlotMask));
+    --connection_count_;
+    handler_.metrics().connectionClosed();
+    connection_pool_.destroy(conn);
+}
+
+void UringLoop::expireTimers() {
+    timers_.advance(steadyNowMs(), [this](TimerNode& node) {
+        auto* conn = static_cast<UringConnection*>(node.owner);
+        if (conn->state == ConnState::Reading) {
+            // 空闲的WebSocket连接第一次到期时发Ping，不关闭；sleep中的协程到期时恢复执行
+            if (handler_.handleDeadline(*conn)) {
+                processAndSend(conn->id, conn);
+            } else {
+                queueClose(conn->id, conn);
+            }
+            return;
+        }
+        // 响应发不出去：进行中的sendmsg或POLL_ADD不会自己结束，先shutdown让它们出错返回，
+        // 再由handleSend/handlePoll走正常的关闭流程，保证释放连接时内核已不再引用它的缓冲区
+        conn->close_after_write = true;
+        shutdown(conn->fd, SHUT_RDWR);
+    });
+}
+
+#else // !HAVE_IO_URING
+
+bool UringLoop::supported() { return false; }
+UringLoop::UringLoop(int listen_fd, HttpHandler& handler)
+    : listen_fd_(listen_fd), handler_(handler), timers_(0, 1) {}
+UringLoop::~UringLoop() = default;
+void UringLoop::run() {}
+
+#endif // HAVE_IO_URING
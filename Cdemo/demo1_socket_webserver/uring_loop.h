@@ -0,0 +1,140 @@
+#ifndef URING_LOOP_H
+#define URING_LOOP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+
+#include "connection.h"
+#include "http_handler.h"
+#include "memory_pool.h"
+#include "timer_wheel.h"
+
+// 编译期检测：内核头文件太旧（没有多次recv/提供缓冲区环）时整个后端编译为空实现
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#if defined(IORING_RECV_MULTISHOT) && defined(IORING_ACCEPT_MULTISHOT)
+#define HAVE_IO_URING 1
+#endif
+#endif
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+
+// 基于io_uring的Reactor，与EventLoop功能相同，用于QPS最高的场景
+//  - multishot accept：一个SQE持续产生新连接，无需每次重新提交
+//  - multishot recv + 注册的缓冲区环：数据直接落进预先注册的缓冲区，无需每次提交读请求
+//  - 一批流水线响应用一个sendmsg发出；需要关闭时用链接的 sendmsg -> close 两个SQE一次提交
+//  - io_uring没有sendfile操作码：文件片段直接调用sendfile，socket写满时用POLL_ADD等待可写
+// 所有提交和收割都合并到每轮一次io_uring_enter中，高负载下平均每个请求几乎没有系统调用
+class UringLoop {
+public:
+    UringLoop(int listen_fd, HttpHandler& handler);
+    ~UringLoop();
+
+    UringLoop(const UringLoop&) = delete;
+    UringLoop& operator=(const UringLoop&) = delete;
+
+    // 运行时探测内核是否支持本后端需要的全部特性（6.0+），不支持时调用方应回退到epoll
+    static bool supported();
+
+    // 初始化是否成功；失败时不应调用run()
+    bool ok() const { return ring_fd_ != -1; }
+
+    // 进入事件循环，直到出错才返回
+    void run();
+
+private:
+    // 每个SQE的user_data = 连接编号 << 8 | 操作类型
+    enum Op : uint8_t { OpAccept = 1, OpRecv, OpSend, OpClose, OpCancel, OpProvide, OpTick, OpPoll, OpWake };
+
+    // io_uring后端的连接：sendmsg进行期间msghdr和iovec数组必须一直有效
+    struct UringConnection : Connection {
+        using Connection::Connection;
+        uint64_t id = 0;            // 连接编号：低位是槽位下标，高位是序号，过期的完成事件对不上序号
+        msghdr msg{};
+        std::vector<iovec> iov;     // 正在发送的一段相邻内存片段
+        size_t sending_bytes = 0;   // 正在发送的字节数，0表示没有进行中的发送
+        bool recv_armed = false;    // multishot recv是否仍在内核中
+        bool linked_close = false;  // 进行中的sendmsg后面是否链接了close
+    };
+
+    bool setupRing();
+    void teardownRing();
+    bool setupBufferRing();
+    bool provideBuffers();
+    bool bufferRingWorks();
+    bool reserveSqes(unsigned count);
+    io_uring_sqe* getSqe();
+    int submitAndWait(unsigned wait_nr);
+
+    void armAccept();
+    void armRecv(uint64_t id, UringConnection* conn);
+    void armTick();
+    void armWake();
+    void cancelRecv(uint64_t id, UringConnection* conn);
+    void queueClose(uint64_t id, UringConnection* conn);
+    void processAndSend(uint64_t id, UringConnection* conn);
+    bool sendPending(uint64_t id, UringConnection* conn);
+    void armPollOut(uint64_t id, UringConnection* conn);
+    void expireTimers();
+    UringConnection* find(uint64_t id) const;
+    void appendStats(std::string& out) const;
+    void recycleBuffer(uint16_t bid);
+
+    void handleAccept(const io_uring_cqe* cqe);
+    void handleRecv(uint64_t id, const io_uring_cqe* cqe);
+    void handleSend(uint64_t id, const io_uring_cqe* cqe);
+    void handleClose(uint64_t id, const io_uring_cqe* cqe);
+    void handlePoll(uint64_t id, const io_uring_cqe* cqe);
+    void handleWake(const io_uring_cqe* cqe);
+
+    int listen_fd_;
+    HttpHandler& handler_;
+
+    int ring_fd_ = -1;
+    // SQ/CQ环形队列由内核mmap共享，下面这些指针都指向共享内存
+    void* sq_ptr_ = nullptr;
+    size_t sq_size_ = 0;
+    void* cq_ptr_ = nullptr;
+    size_t cq_size_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    size_t sqes_size_ = 0;
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned sq_entries_ = 0;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+    unsigned sq_local_tail_ = 0;   // 尚未提交给内核的SQ尾指针
+    unsigned to_submit_ = 0;
+
+    // 提供给内核的接收缓冲区环
+    io_uring_buf_ring* buf_ring_ = nullptr;
+    size_t buf_ring_size_ = 0;
+    std::vector<char> buffers_;
+    uint16_t buf_tail_ = 0;
+    bool legacy_buffers_ = false;  // 缓冲区环不可用时退回IORING_OP_PROVIDE_BUFFERS
+
+    TimerWheel timers_;          // 所有连接的超时
+    __kernel_timespec tick_{};   // 推进时间轮的定时器间隔，超时请求进行期间必须有效
+    bool tick_armed_ = false;
+
+    BufferPool pool_;                          // 连接的输入缓冲区和动态响应内容
+    ObjectPool<UringConnection> connection_pool_;
+    FramePool frames_;                         // 协程路由的协程帧，run()开始时设为本线程的当前池
+    std::vector<UringConnection*> slots_;      // 连接编号的低位是这里的下标
+    std::vector<uint32_t> free_slots_;
+    uint64_t next_serial_ = 1;
+    size_t connection_count_ = 0;
+};
+
+#endif // URING_LOOP_H
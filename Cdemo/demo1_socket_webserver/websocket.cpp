@@ -0,0 +1,185 @@
+#include "websocket.h"
+
+#include <cstring>
+#include <openssl/evp.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+constexpr std::string_view kWebSocketGuid = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+bool base64Char(char c) {
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '+' || c == '/';
+}
+
+FrameStatus fail(WebSocketFrame& frame, uint16_t code) {
+    frame.error = code;
+    return FrameStatus::Error;
+}
+
+} // namespace
+
+FrameStatus parseWebSocketFrame(const char* data, size_t len, WebSocketFrame& frame) {
+    if (len < 2) return FrameStatus::Incomplete;
+    auto b0 = static_cast<uint8_t>(data[0]);
+    auto b1 = static_cast<uint8_t>(data[1]);
+    frame.fin = (b0 & 0x80) != 0;
+    frame.opcode = static_cast<WsOpcode>(b0 & 0x0f);
+
+    // 1. 第一个字节：保留位和操作码
+    if (b0 & 0x70) return fail(frame, kCloseProtocolError);
+    bool control = (b0 & 0x08) != 0;
+    switch (frame.opcode) {
+    case WsOpcode::Continuation:
+    case WsOpcode::Text:
+    case WsOpcode::Binary:
+    case WsOpcode::Close:
+    case WsOpcode::Ping:
+    case WsOpcode::Pong:
+        break;
+    default:
+        return fail(frame, kCloseProtocolError);
+    }
+    if (!(b1 & 0x80)) return fail(frame, kCloseProtocolError); // 客户端必须加掩码
+
+    // 2. 载荷长度：7位，126跟2字节，127跟8字节（都是网络字节序）
+    uint64_t size = b1 & 0x7f;
+    size_t header = 2;
+    if (size == 126) {
+        if (len < 4) return FrameStatus::Incomplete;
+        size = static_cast<uint64_t>(static_cast<uint8_t>(data[2])) << 8 | static_cast<uint8_t>(data[3]);
+        header = 4;
+    } else if (size == 127) {
+        if (len < 10) return FrameStatus::Incomplete;
+        size = 0;
+        for (int i = 2; i < 10; ++i) size = size << 8 | static_cast<uint8_t>(data[i]);
+        if (size >> 63) return fail(frame, kCloseProtocolError);
+        header = 10;
+    }
+    if (control && (!frame.fin || size > kMaxControlPayload)) return fail(frame, kCloseProtocolError);
+    if (size > kMaxWebSocketMessage) return fail(frame, kCloseTooBig);
+
+    // 3. 掩码和载荷：整帧收全才返回Complete
+    if (len < header + 4) return FrameStatus::Incomplete;
+    std::memcpy(frame.mask, data + header, 4);
+    frame.header_size = header + 4;
+    frame.payload_size = size;
+    if (len - frame.header_size < size) return FrameStatus::Incomplete;
+    return FrameStatus::Complete;
+}
+
+void unmaskPayload(char* data, size_t len, const uint8_t mask[4]) {
+    // 每次处理的字节数都是4的倍数，尾部逐字节时i & 3仍然对得上掩码的位置
+    uint32_t key;
+    std::memcpy(&key, mask, 4);
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i key32 = _mm256_set1_epi32(static_cast<int>(key));
+    for (; i + 32 <= len; i += 32) {
+        auto* p = reinterpret_cast<__m256i*>(data + i);
+        _mm256_storeu_si256(p, _mm256_xor_si256(_mm256_loadu_si256(p), key32));
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i key16 = _mm_set1_epi32(static_cast<int>(key));
+    for (; i + 16 <= len; i += 16) {
+        auto* p = reinterpret_cast<__m128i*>(data + i);
+        _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), key16));
+    }
+#endif
+    const uint64_t key8 = static_cast<uint64_t>(key) << 32 | key;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        word ^= key8;
+        std::memcpy(data + i, &word, 8);
+    }
+    for (; i < len; ++i) data[i] = static_cast<char>(data[i] ^ mask[i & 3]);
+}
+
+void unmaskPayloadScalar(char* data, size_t len, const uint8_t mask[4]) {
+    for (size_t i = 0; i < len; ++i) data[i] = static_cast<char>(data[i] ^ mask[i & 3]);
+}
+
+size_t writeFrameHeader(char* out, WsOpcode opcode, uint64_t payload_size) {
+    out[0] = static_cast<char>(0x80 | static_cast<uint8_t>(opcode));
+    if (payload_size < 126) {
+        out[1] = static_cast<char>(payload_size);
+        return 2;
+    }
+    if (payload_size <= 0xffff) {
+        out[1] = 126;
+        out[2] = static_cast<char>(payload_size >> 8);
+        out[3] = static_cast<char>(payload_size);
+        return 4;
+    }
+    out[1] = 127;
+    for (int i = 0; i < 8; ++i) out[2 + i] = static_cast<char>(payload_size >> (56 - 8 * i));
+    return 10;
+}
+
+bool validUtf8(std::string_view text) {
+    auto* p = reinterpret_cast<const unsigned char*>(text.data());
+    const unsigned char* end = p + text.size();
+    while (p < end) {
+#if defined(__SSE2__)
+        // 聊天、JSON之类的文本绝大部分是ASCII：16字节里没有最高位为1的字节就整段跳过
+        while (end - p >= 16 &&
+               _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))) == 0) {
+            p += 16;
+        }
+        if (p == end) break;
+#endif
+        unsigned c = *p;
+        if (c < 0x80) {
+            ++p;
+            continue;
+        }
+        size_t follow;
+        uint32_t code;
+        uint32_t min;
+        if ((c & 0xe0) == 0xc0) {
+            follow = 1, code = c & 0x1f, min = 0x80;
+        } else if ((c & 0xf0) == 0xe0) {
+            follow = 2, code = c & 0x0f, min = 0x800;
+        } else if ((c & 0xf8) == 0xf0) {
+            follow = 3, code = c & 0x07, min = 0x10000;
+        } else {
+            return false;
+        }
+        if (static_cast<size_t>(end - p) <= follow) return false;
+        for (size_t i = 1; i <= follow; ++i) {
+            if ((p[i] & 0xc0) != 0x80) return false;
+            code = code << 6 | (p[i] & 0x3f);
+        }
+        if (code < min || code > 0x10ffff || (code >= 0xd800 && code <= 0xdfff)) return false;
+        p += follow + 1;
+    }
+    return true;
+}
+
+bool validCloseCode(uint16_t code) {
+    if (code >= 3000 && code <= 4999) return true;  // 留给库和应用自己定义
+    return code >= 1000 && code <= 1014 && code != 1004 && code != kCloseNoStatus && code != kCloseAbnormal;
+}
+
+bool webSocketAccept(std::string_view key, std::string& accept) {
+    // 16字节的base64编码固定是22个字符加"=="
+    if (key.size() != 24 || key.substr(22) != "==") return false;
+    for (size_t i = 0; i < 22; ++i) {
+        if (!base64Char(key[i])) return false;
+    }
+    char input[24 + kWebSocketGuid.size()];
+    std::memcpy(input, key.data(), key.size());
+    std::memcpy(input + key.size(), kWebSocketGuid.data(), kWebSocketGuid.size());
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digest_len = 0;
+    if (EVP_Digest(input, sizeof(input), digest, &digest_len, EVP_sha1(), nullptr) != 1) return false;
+    unsigned char encoded[32];
+    int encoded_len = EVP_EncodeBlock(encoded, digest, static_cast<int>(digest_len)); // 20字节编码成28个字符
+    accept.assign(reinterpret_cast<const char*>(encoded), static_cast<size_t>(encoded_len));
+    return true;
+}
@@ -0,0 +1,77 @@
+#ifndef WEBSOCKET_H
+#define WEBSOCKET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "http_parser.h"
+
+// WebSocket协议层（RFC 6455）：帧头的解析和生成、载荷去掩码、UTF-8检查、握手的Accept计算
+// 这里只处理字节，不涉及连接和事件循环，连接上的收发见websocket_hub.h
+
+// 一条消息（分片消息拼起来之后）的上限，超过时以1009关闭；整帧要放得进连接的输入缓冲区
+constexpr size_t kMaxWebSocketMessage = kMaxBodySize;
+constexpr size_t kMaxControlPayload = 125;     // 控制帧（Close/Ping/Pong）的载荷上限
+constexpr size_t kMaxFrameHeader = 10;         // 服务器发出的帧不带掩码，帧头最多10字节
+
+enum class WsOpcode : uint8_t {
+    Continuation = 0x0,
+    Text = 0x1,
+    Binary = 0x2,
+    Close = 0x8,
+    Ping = 0x9,
+    Pong = 0xA
+};
+
+// 关闭码（RFC 6455 7.4.1）
+constexpr uint16_t kCloseNormal = 1000;
+constexpr uint16_t kCloseGoingAway = 1001;
+constexpr uint16_t kCloseProtocolError = 1002;
+constexpr uint16_t kCloseNoStatus = 1005;        // 对方的Close没有带关闭码，只在本地使用，不会发出去
+constexpr uint16_t kCloseAbnormal = 1006;        // 没有收到Close就断开，只在本地使用
+constexpr uint16_t kCloseInvalidData = 1007;     // 文本消息不是合法的UTF-8
+constexpr uint16_t kClosePolicy = 1008;
+constexpr uint16_t kCloseTooBig = 1009;
+
+// 解析出的一个客户端帧
+struct WebSocketFrame {
+    bool fin = false;
+    WsOpcode opcode = WsOpcode::Continuation;
+    uint8_t mask[4] = {};
+    size_t header_size = 0;     // 帧头长度（含掩码），载荷紧跟其后
+    uint64_t payload_size = 0;
+    uint16_t error = 0;         // 解析失败时应该回复的关闭码
+};
+
+enum class FrameStatus {
+    Incomplete,  // 整帧（帧头和全部载荷）还没收全
+    Complete,
+    Error        // 违反协议，frame.error给出关闭码
+};
+
+// 从data开头解析一个客户端帧；载荷长度一读出来就检查上限，不会等一个超大的帧收全
+// 客户端的帧必须带掩码；保留位必须为0（没有协商任何扩展）；控制帧不能分片、载荷不超过125字节
+FrameStatus parseWebSocketFrame(const char* data, size_t len, WebSocketFrame& frame);
+
+// 在原地去掉载荷的掩码：按32/16/8字节一次异或（AVX2/SSE2/64位整数），尾部逐字节
+// 掩码按4字节循环，data必须从载荷的第一个字节开始
+void unmaskPayload(char* data, size_t len, const uint8_t mask[4]);
+// 逐字节的参考实现，只用于微基准对比
+void unmaskPayloadScalar(char* data, size_t len, const uint8_t mask[4]);
+
+// 在out（至少kMaxFrameHeader字节）写出服务器帧的帧头（FIN=1、不带掩码），返回帧头长度
+size_t writeFrameHeader(char* out, WsOpcode opcode, uint64_t payload_size);
+
+// 严格的UTF-8检查：拒绝过长编码、代理区和超过U+10FFFF的码点；ASCII部分用SSE2一次跳过16字节
+bool validUtf8(std::string_view text);
+
+// 关闭码是否允许出现在Close帧里
+bool validCloseCode(uint16_t code);
+
+// Sec-WebSocket-Key（base64编码的16字节）对应的Sec-WebSocket-Accept：
+// base64(SHA-1(key + 固定GUID))；key格式不对时返回false
+bool webSocketAccept(std::string_view key, std::string& accept);
+
+#endif // WEBSOCKET_H
@@ -0,0 +1,179 @@
+#include "websocket_hub.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "connection.h"
+
+namespace {
+
+std::atomic<uint64_t> g_next_id{1};
+
+// 连接还能发送：没有关闭、没有在发完这一批后关闭、没有发过Close
+bool writable(const Connection& conn) {
+    return conn.state != ConnState::Closed && !conn.close_after_write && conn.ws && !conn.ws->close_sent;
+}
+
+size_t backlog(const Connection& conn) {
+    return conn.out.size() - conn.out_index;
+}
+
+} // namespace
+
+WebSocketState::WebSocketState(Connection& conn, WebSocketHandler& handler, WebSocketGroup* group)
+    : conn(conn), handler(&handler), group(group), id(g_next_id.fetch_add(1, std::memory_order_relaxed)) {
+    if (group) group->add(*this);
+}
+
+WebSocketState::~WebSocketState() {
+    // Connection里ws是最后一个成员、最先析构，这时连接的其他部分都还在；open()已经返回false，发不出东西
+    close_sent = true;
+    WebSocket socket(conn);
+    handler->onClose(socket, close_code);
+    if (group) group->remove(*this);
+}
+
+void appendWebSocketFrame(Connection& conn, WsOpcode opcode, std::string_view payload) {
+    char header[kMaxFrameHeader];
+    size_t header_size = writeFrameHeader(header, opcode, payload.size());
+    OutputChunk chunk;
+    std::string_view frame = conn.out_storage.store({std::string_view(header, header_size), payload});
+    chunk.iov = iovec{const_cast<char*>(frame.data()), frame.size()};
+    conn.out.push_back(std::move(chunk));
+}
+
+bool WebSocket::open() const {
+    return writable(conn_);
+}
+
+uint64_t WebSocket::id() const {
+    return conn_.ws ? conn_.ws->id : 0;
+}
+
+bool WebSocket::send(std::string_view message, bool binary) {
+    if (!open() || backlog(conn_) >= kMaxWebSocketBacklog || message.size() > kMaxWebSocketMessage) return false;
+    appendWebSocketFrame(conn_, binary ? WsOpcode::Binary : WsOpcode::Text, message);
+    return true;
+}
+
+bool WebSocket::ping(std::string_view payload) {
+    if (!open() || payload.size() > kMaxControlPayload) return false;
+    appendWebSocketFrame(conn_, WsOpcode::Ping, payload);
+    return true;
+}
+
+void WebSocket::close(uint16_t code, std::string_view reason) {
+    if (!open()) return;
+    char payload[kMaxControlPayload];
+    payload[0] = static_cast<char>(code >> 8);
+    payload[1] = static_cast<char>(code);
+    size_t reason_size = std::min(reason.size(), kMaxControlPayload - 2);
+    reason.copy(payload + 2, reason_size);
+    appendWebSocketFrame(conn_, WsOpcode::Close, std::string_view(payload, 2 + reason_size));
+    conn_.ws->close_code = code;
+    conn_.ws->close_sent = true;
+    conn_.close_after_write = true;
+}
+
+WebSocketGroup::WebSocketGroup() : wake_fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+    if (wake_fd_ == -1) perror("eventfd");
+}
+
+WebSocketGroup::~WebSocketGroup() {
+    if (wake_fd_ != -1) close(wake_fd_);
+}
+
+void WebSocketGroup::add(WebSocketState& state) {
+    state.index = static_cast<uint32_t>(connections_.size());
+    connections_.push_back(&state);
+}
+
+void WebSocketGroup::remove(WebSocketState& state) {
+    // 和最后一个交换后弹出，O(1)
+    WebSocketState* last = connections_.back();
+    connections_[state.index] = last;
+    last->index = state.index;
+    connections_.pop_back();
+}
+
+void WebSocketGroup::post(const WebSocketHandler* route, std::shared_ptr<const std::string> frame) {
+    bool wake;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // 邮箱原来是空的才需要唤醒；非空说明唤醒已经发过、事件循环还没来取
+        wake = mailbox_.empty();
+        mailbox_.push_back({route, std::move(frame)});
+    }
+    if (wake && wake_fd_ != -1) {
+        uint64_t one = 1;
+        ssize_t ignored = write(wake_fd_, &one, sizeof(one));
+        (void)ignored;
+    }
+}
+
+void WebSocketGroup::deliver(const std::function<void(Connection& conn, bool overflow)>& ready) {
+    // 1. 先清掉eventfd的计数再取邮箱：之后投递的广播会发现邮箱已空、重新唤醒，不会漏掉
+    uint64_t count;
+    ssize_t ignored = read(wake_fd_, &count, sizeof(count));
+    (void)ignored;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        delivering_.swap(mailbox_);
+    }
+    if (delivering_.empty()) return;
+    stats_.broadcasts += delivering_.size();
+
+    // 2. 逐个连接挂上这一批里属于它的路由的帧：OutputChunk只引用共享的帧，不拷贝
+    //    ready可能关闭连接，但连接要等这一轮事件处理完才释放，连接表在这期间不会变
+    for (size_t i = 0; i < connections_.size(); ++i) {
+        Connection& conn = connections_[i]->conn;
+        if (!writable(conn)) continue;
+        bool queued = false;
+        bool overflow = false;
+        for (const Broadcast& broadcast : delivering_) {
+            if (broadcast.route != connections_[i]->handler) continue;
+            if (backlog(conn) >= kMaxWebSocketBacklog) {
+                overflow = true;
+                break;
+            }
+            OutputChunk chunk;
+            chunk.iov = iovec{const_cast<char*>(broadcast.frame->data()), broadcast.frame->size()};
+            chunk.owner = broadcast.frame;
+            conn.out.push_back(std::move(chunk));
+            ++stats_.deliveries;
+            queued = true;
+        }
+        if (overflow) {
+            ++stats_.slow_dropped;
+            ready(conn, true);
+        } else if (queued) {
+            ready(conn, false);
+        }
+    }
+    delivering_.clear();
+}
+
+WebSocketGroup* WebSocketHub::createGroup() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    groups_.push_back(std::make_unique<WebSocketGroup>());
+    return groups_.back().get();
+}
+
+void WebSocketHub::broadcast(const WebSocketHandler& route, std::string_view message, bool binary) {
+    if (message.size() > kMaxWebSocketMessage) return;
+    // 帧只序列化一次，所有连接的输出队列都引用这一份，最后一个连接发完时释放
+    auto frame = std::make_shared<std::string>();
+    frame->resize(kMaxFrameHeader);
+    size_t header_size = writeFrameHeader(frame->data(), binary ? WsOpcode::Binary : WsOpcode::Text, message.size());
+    frame->resize(header_size);
+    frame->append(message);
+    std::shared_ptr<const std::string> shared = std::move(frame);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& group : groups_) {
+        group->post(&route, shared);
+    }
+}
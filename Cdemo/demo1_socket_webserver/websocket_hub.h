@@ -0,0 +1,137 @@
+#ifndef WEBSOCKET_HUB_H
+#define WEBSOCKET_HUB_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "router.h"
+#include "websocket.h"
+
+struct Connection;
+class WebSocketGroup;
+
+// 一个输出队列最多积压这么多片段（消息），再多说明客户端收得太慢：发送失败，广播时直接断开
+constexpr size_t kMaxWebSocketBacklog = 1024;
+
+// 已经升级的连接在WebSocket层的状态，升级成功后才分配，挂在Connection上
+// 空闲时只有这几十个字节：分片消息的拼接区用完就释放，输入输出缓冲区也都还给了池
+struct WebSocketState {
+    WebSocketState(Connection& conn, WebSocketHandler& handler, WebSocketGroup* group);
+    // 连接释放时调用handler的onClose，并从所属Reactor的连接表里摘掉
+    ~WebSocketState();
+
+    WebSocketState(const WebSocketState&) = delete;
+    WebSocketState& operator=(const WebSocketState&) = delete;
+
+    Connection& conn;
+    WebSocketHandler* handler;
+    WebSocketGroup* group;
+    uint64_t id;                   // 进程内唯一的连接编号
+    uint32_t index = 0;            // 在group连接表里的下标
+    WsOpcode message_opcode = WsOpcode::Continuation;  // 正在拼接的分片消息的类型，Continuation表示没有
+    bool close_sent = false;       // 已经发出Close，之后不能再发送
+    bool ping_sent = false;        // 空闲超时后发了Ping，还没有收到任何帧
+    uint16_t close_code = kCloseAbnormal;
+    std::string message;           // 分片消息已经收到的部分
+};
+
+// 交给WebSocketHandler回调的连接句柄，只在回调期间有效，只能在连接所属的Reactor线程里使用
+// 发送的帧追加到连接的输出队列，回调返回后由事件循环和HTTP响应一样发出
+class WebSocket {
+public:
+    explicit WebSocket(Connection& conn) : conn_(conn) {}
+
+    // 发送一条文本（binary为false时必须是UTF-8）或二进制消息；连接已关闭、正在关闭或积压太多时返回false
+    bool send(std::string_view message, bool binary = false);
+    bool ping(std::string_view payload = {});
+    // 发出Close帧，发完后关闭连接（不等对方回复Close）；reason截断到控制帧能放下的长度
+    void close(uint16_t code = kCloseNormal, std::string_view reason = {});
+
+    bool open() const;
+    uint64_t id() const;
+
+private:
+    Connection& conn_;
+};
+
+// 直接往连接的输出队列追加一个服务器帧（帧头和载荷拷进连接的输出区，只占一个iovec）
+// 不检查连接状态，HttpHandler回复Ping、Close时使用
+void appendWebSocketFrame(Connection& conn, WsOpcode opcode, std::string_view payload);
+
+// 一个Reactor上的WebSocket连接和它的广播邮箱
+// 连接表只在本Reactor线程里访问；邮箱由任意线程投递，用eventfd唤醒事件循环
+class WebSocketGroup {
+public:
+    struct Stats {
+        uint64_t broadcasts = 0;     // 收到的广播条数
+        uint64_t deliveries = 0;     // 排进输出队列的帧数（每个连接算一次）
+        uint64_t slow_dropped = 0;   // 积压太多被断开的连接数
+    };
+
+    WebSocketGroup();
+    ~WebSocketGroup();
+
+    WebSocketGroup(const WebSocketGroup&) = delete;
+    WebSocketGroup& operator=(const WebSocketGroup&) = delete;
+
+    // 事件循环监听它可读：有新的广播到了，调用deliver
+    int wakeFd() const { return wake_fd_; }
+
+    // ---- 以下只在本Reactor线程调用 ----
+    void add(WebSocketState& state);
+    void remove(WebSocketState& state);
+    size_t size() const { return connections_.size(); }
+    const Stats& stats() const { return stats_; }
+
+    // 取出邮箱里的全部广播，追加到对应路由上每个连接的输出队列（引用同一块内存，不拷贝），
+    // 每个拿到新数据的连接交给ready(conn, false)，由事件循环发出；积压太多的交给ready(conn, true)，应当断开
+    // 正在关闭的连接跳过
+    void deliver(const std::function<void(Connection& conn, bool overflow)>& ready);
+
+    // ---- 任意线程 ----
+    // frame是序列化好的完整帧，所有连接共享
+    void post(const WebSocketHandler* route, std::shared_ptr<const std::string> frame);
+
+private:
+    struct Broadcast {
+        const WebSocketHandler* route;
+        std::shared_ptr<const std::string> frame;
+    };
+
+    int wake_fd_ = -1;
+    std::vector<WebSocketState*> connections_;
+    Stats stats_;
+    std::vector<Broadcast> delivering_;   // 从邮箱换出来正在投递的一批，容量复用
+
+    std::mutex mutex_;                    // 只保护mailbox_
+    std::vector<Broadcast> mailbox_;
+};
+
+// 进程内所有Reactor的WebSocket连接，整个进程一份
+// 每个Reactor通过createGroup()登记自己的连接表；broadcast把帧序列化一次，
+// 投进每个Reactor的邮箱，各线程把同一块内存挂到自己所有连接的输出队列上
+class WebSocketHub {
+public:
+    WebSocketHub() = default;
+
+    WebSocketHub(const WebSocketHub&) = delete;
+    WebSocketHub& operator=(const WebSocketHub&) = delete;
+
+    // 每个Reactor线程调用一次，组归WebSocketHub所有，进程退出前一直有效
+    WebSocketGroup* createGroup();
+
+    // 把一条消息发给route这条路由上的所有连接（所有Reactor），任何线程都可以调用
+    void broadcast(const WebSocketHandler& route, std::string_view message, bool binary = false);
+
+private:
+    std::mutex mutex_;   // 保护groups_，只在启动和广播时短暂持有
+    std::vector<std::unique_ptr<WebSocketGroup>> groups_;
+};
+
+#endif // WEBSOCKET_HUB_H